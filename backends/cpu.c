@@ -0,0 +1,393 @@
+#include <ctype.h>
+#include <dlfcn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "nomp-aux.h"
+#include "nomp-impl.h"
+
+// Compiler and flags used to build the kernels. These can be overridden
+// with NOMP_CPU_CC and NOMP_CPU_CFLAGS environment variables.
+#define CPU_CC     "cc"
+#define CPU_CFLAGS "-O3 -march=native -fopenmp"
+
+// Maximum number of work-items in a work-group. Work-items of a work-group
+// run one after the other on the same thread, so this is the length of the
+// innermost loop of a (tiled) kernel.
+#define CPU_MAX_THREADS_PER_BLOCK 256
+
+// Kernels generated by loopy refer to the work-group index with gid(axis).
+// Each thread running the kernel has its own copy of the index.
+static const char *cpu_prelude = "#include <math.h>\n"
+                                 "#include <stdbool.h>\n"
+                                 "#include <stdint.h>\n"
+                                 "static __thread long nomp_gid[3];\n"
+                                 "#define gid(N) nomp_gid[N]\n";
+
+// Entry point of the shared object: runs the kernel once for each
+// work-group. Work-groups are distributed among OpenMP threads.
+static const char *cpu_launch_src =
+    "void nomp_cpu_launch(void **args, const size_t *ng) {\n"
+    "#pragma omp parallel for collapse(3)\n"
+    "  for (long k = 0; k < (long)ng[2]; k++)\n"
+    "    for (long j = 0; j < (long)ng[1]; j++)\n"
+    "      for (long i = 0; i < (long)ng[0]; i++) {\n"
+    "        nomp_gid[0] = i, nomp_gid[1] = j, nomp_gid[2] = k;\n"
+    "        %s(%s);\n"
+    "      }\n"
+    "}\n";
+
+typedef void (*cpu_launch_t)(void **args, const size_t *ng);
+
+struct cpu_backend_t {
+  char     cc[NOMP_MAX_BUFFER_SIZE + 1];
+  char     cflags[NOMP_MAX_CFLAGS_SIZE + 1];
+  char     tmp_dir[PATH_MAX + 1];
+  unsigned n_tmp;
+};
+
+struct cpu_prog_t {
+  void        *handle;
+  cpu_launch_t launch;
+};
+
+// Device memory of the cpu backend is the host memory itself whenever the
+// host pointer is known when the memory is allocated. Otherwise (e.g., the
+// scratch memory), memory is allocated by the backend.
+struct cpu_mem_t {
+  void *ptr;
+  int   owned;
+};
+
+static int cpu_update(nomp_backend_t *NOMP_UNUSED(bnd), nomp_mem_t *m,
+                      const nomp_map_direction_t op, size_t start, size_t end,
+                      size_t usize) {
+  if (op & NOMP_ALLOC) {
+    struct cpu_mem_t *cm = nomp_calloc(struct cpu_mem_t, 1);
+    if (m->hptr) {
+      cm->ptr = (char *)m->hptr + NOMP_MEM_OFFSET(m->idx0, usize);
+    } else {
+      cm->ptr   = nomp_calloc(char, NOMP_MEM_BYTES(start, end, usize));
+      cm->owned = 1;
+    }
+    m->bptr = (void *)cm, m->bsize = sizeof(void *);
+  }
+
+  struct cpu_mem_t *cm = (struct cpu_mem_t *)m->bptr;
+  if (op & NOMP_FREE) {
+    if (cm->owned) nomp_free(&cm->ptr);
+    nomp_free(&m->bptr);
+    return 0;
+  }
+
+  // Nothing to copy if the memory is shared with the host.
+  if (!cm->owned) return 0;
+
+  char *dptr = (char *)cm->ptr + NOMP_MEM_OFFSET(start - m->idx0, usize);
+  char *hptr = (char *)m->hptr + NOMP_MEM_OFFSET(start, usize);
+  // Copies are synchronous, so NOMP_ASYNC is ignored.
+  if (op & NOMP_TO)
+    memcpy(dptr, hptr, NOMP_MEM_BYTES(start, end, usize));
+  else if (op & NOMP_FROM)
+    memcpy(hptr, dptr, NOMP_MEM_BYTES(start, end, usize));
+
+  return 0;
+}
+
+static const char *cpu_arg_type(const nomp_arg_t *arg) {
+  switch (arg->type) {
+  case NOMP_INT: return arg->size == 8 ? "long" : "int";
+  case NOMP_UINT: return arg->size == 8 ? "unsigned long" : "unsigned int";
+  case NOMP_FLOAT: return arg->size == 8 ? "double" : "float";
+  default: return NULL;
+  }
+}
+
+// Generate the source of the shared object: the prelude, the kernel and
+// the entry point which calls the kernel with the arguments in args[].
+static char *cpu_get_source(const nomp_prog_t *prg, const char *source,
+                            const char *name) {
+  size_t len  = strlen(cpu_prelude) + strlen(source) + strlen(cpu_launch_src) +
+               strlen(name) + 64 * (prg->nargs + 1);
+  char  *args = nomp_calloc(char, len), *src = nomp_calloc(char, len);
+
+  size_t n = 0;
+  for (unsigned i = 0; i < prg->nargs; i++) {
+    const char *type = cpu_arg_type(&prg->args[i]);
+    if (type)
+      n += snprintf(args + n, len - n, "%s*(%s *)args[%u]", i ? ", " : "",
+                    type, i);
+    else
+      n += snprintf(args + n, len - n, "%sargs[%u]", i ? ", " : "", i);
+  }
+
+  n = snprintf(src, len, "%s%s\n", cpu_prelude, source);
+  snprintf(src + n, len - n, cpu_launch_src, name, args);
+  nomp_free(&args);
+
+  return src;
+}
+
+static int cpu_compile(nomp_backend_t *bnd, const char *src, const char *so) {
+  struct cpu_backend_t *cpu = (struct cpu_backend_t *)bnd->bptr;
+
+  char *file = nomp_str_cat(2, PATH_MAX, so, ".c");
+  FILE *fp   = fopen(file, "w");
+  if (!fp || fputs(src, fp) == EOF) {
+    if (fp) fclose(fp);
+    nomp_free(&file);
+    return nomp_log(NOMP_CPU_FAILURE, NOMP_ERROR,
+                    "Unable to write kernel source to file \"%s.c\".", so);
+  }
+  fclose(fp);
+
+  // Compiler is run without a shell, so the paths are passed as they are.
+  // Compiler and flags are split at whitespace into separate arguments.
+  size_t len  = strlen(cpu->cc) + strlen(cpu->cflags) + 2;
+  char  *cmd  = nomp_calloc(char, len);
+  char **argv = nomp_calloc(char *, len / 2 + 6);
+  snprintf(cmd, len, "%s %s", cpu->cc, cpu->cflags);
+  unsigned argc = 0;
+  for (char *c = cmd; *c;) {
+    while (isspace((unsigned char)*c))
+      *c++ = '\0';
+    if (*c) argv[argc++] = c;
+    while (*c && !isspace((unsigned char)*c))
+      c++;
+  }
+  char *args[] = {"-fPIC", "-shared", "-o", (char *)so, file};
+  for (unsigned i = 0; i < sizeof(args) / sizeof(args[0]); i++)
+    argv[argc++] = args[i];
+
+  int   status = -1;
+  pid_t pid    = fork();
+  if (pid == 0) {
+    execvp(argv[0], argv);
+    _exit(127);
+  }
+  if (pid > 0 && waitpid(pid, &status, 0) != pid) status = -1;
+  unlink(file);
+
+  int err = 0;
+  if (pid < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    err = nomp_log(NOMP_CPU_FAILURE, NOMP_ERROR,
+                   "Compiling kernel failed with status %d: \"%s %s "
+                   "-fPIC -shared -o %s %s\".",
+                   status, cpu->cc, cpu->cflags, so, file);
+  }
+  nomp_free(&file), nomp_free(&cmd), nomp_free(&argv);
+
+  return err;
+}
+
+static int cpu_knl_build(nomp_backend_t *bnd, nomp_prog_t *prg,
+                         const char *source, const char *name) {
+  struct cpu_backend_t *cpu = (struct cpu_backend_t *)bnd->bptr;
+
+  char *src = cpu_get_source(prg, source, name);
+
+  // Shared objects are cached based on the source, the compiler and the
+  // compiler flags. If the cache is disabled, the shared object is built in a
+  // temporary directory and removed once it is loaded.
+  uint64_t key = nomp_hash(NOMP_HASH_SEED, src, strlen(src) + 1);
+  key          = nomp_hash(key, cpu->cc, strlen(cpu->cc) + 1);
+  key          = nomp_hash(key, cpu->cflags, strlen(cpu->cflags) + 1);
+
+  char *path;
+  nomp_check(nomp_cache_path(&path, key, "so"));
+  int cached = path != NULL;
+  if (!cached) {
+    char so[NOMP_MAX_BUFFER_SIZE];
+    snprintf(so, NOMP_MAX_BUFFER_SIZE, "/%s-%u.so", name, cpu->n_tmp++);
+    path = nomp_str_cat(2, PATH_MAX, cpu->tmp_dir, so);
+  }
+
+  int err = 0;
+  if (!cached || access(path, R_OK)) {
+    // Build to a temporary file and rename it so that concurrent processes
+    // never load a partially written shared object.
+    char pid[NOMP_MAX_BUFFER_SIZE];
+    snprintf(pid, NOMP_MAX_BUFFER_SIZE, ".%ld", (long)getpid());
+    char *tmp = nomp_str_cat(2, PATH_MAX, path, pid);
+    err       = cpu_compile(bnd, src, tmp);
+    if (!err && rename(tmp, path)) {
+      err = nomp_log(NOMP_CPU_FAILURE, NOMP_ERROR,
+                     "Unable to rename \"%s\" to \"%s\".", tmp, path);
+    }
+    if (err) unlink(tmp);
+    nomp_free(&tmp);
+  }
+  nomp_free(&src);
+
+  struct cpu_prog_t *cpu_prg = NULL;
+  if (!err) {
+    cpu_prg         = nomp_calloc(struct cpu_prog_t, 1);
+    cpu_prg->handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (cpu_prg->handle) {
+      *(void **)(&cpu_prg->launch) = dlsym(cpu_prg->handle, "nomp_cpu_launch");
+    }
+    if (!cpu_prg->handle || !cpu_prg->launch) {
+      err = nomp_log(NOMP_CPU_FAILURE, NOMP_ERROR,
+                     "Loading kernel \"%s\" from \"%s\" failed: %s.", name,
+                     path, dlerror());
+      if (cpu_prg->handle) dlclose(cpu_prg->handle);
+      nomp_free(&cpu_prg);
+    }
+  }
+
+  // The shared object stays mapped after it is removed.
+  if (!cached) unlink(path);
+  nomp_free(&path);
+
+  prg->bptr = (void *)cpu_prg;
+
+  return err;
+}
+
+static int cpu_knl_run(nomp_backend_t *NOMP_UNUSED(bnd), nomp_prog_t *prg) {
+  void *args[NOMP_MAX_KERNEL_ARGS_SIZE];
+  for (unsigned i = 0; i < prg->nargs; i++) {
+    if (prg->args[i].type == NOMP_PTR)
+      args[i] = ((struct cpu_mem_t *)prg->args[i].ptr)->ptr;
+    else
+      args[i] = prg->args[i].ptr;
+  }
+
+  // Kernels run synchronously, so there is nothing to wait for afterwards.
+  struct cpu_prog_t *cpu_prg = (struct cpu_prog_t *)prg->bptr;
+  cpu_prg->launch(args, prg->global);
+
+  return 0;
+}
+
+static int cpu_knl_free(nomp_prog_t *prg) {
+  struct cpu_prog_t *cpu_prg = (struct cpu_prog_t *)prg->bptr;
+
+  int err = 0;
+  if (cpu_prg && dlclose(cpu_prg->handle)) {
+    err = nomp_log(NOMP_CPU_FAILURE, NOMP_ERROR, "dlclose failed: %s.",
+                   dlerror());
+  }
+
+  nomp_free(&prg->bptr);
+  return err;
+}
+
+static int cpu_sync(nomp_backend_t *NOMP_UNUSED(bnd)) { return 0; }
+
+// Kernels and copies are synchronous on the host, so every queue is the
+// same queue.
+static int cpu_sync_queue(nomp_backend_t *NOMP_UNUSED(bnd),
+                          unsigned NOMP_UNUSED(queue)) {
+  return 0;
+}
+
+static int cpu_mem_wait(nomp_backend_t *NOMP_UNUSED(bnd),
+                        nomp_mem_t *NOMP_UNUSED(m)) {
+  return 0;
+}
+
+static int cpu_create_queues(nomp_backend_t *NOMP_UNUSED(bnd),
+                             unsigned NOMP_UNUSED(n)) {
+  return 0;
+}
+
+static int cpu_finalize(nomp_backend_t *bnd) {
+  struct cpu_backend_t *cpu = (struct cpu_backend_t *)bnd->bptr;
+
+  if (cpu) rmdir(cpu->tmp_dir);
+  nomp_free(&bnd->bptr);
+
+  return 0;
+}
+
+static void cpu_device_query(nomp_backend_t *bnd) {
+#define set_string(KEY, VAL)                                                   \
+  {                                                                            \
+    PyObject *obj = PyUnicode_FromString(VAL);                                 \
+    PyDict_SetItemString(bnd->py_context, KEY, obj);                           \
+    Py_XDECREF(obj);                                                           \
+  }
+
+#define set_int(KEY, VAL)                                                      \
+  {                                                                            \
+    PyObject *obj = PyLong_FromSize_t(VAL);                                    \
+    PyDict_SetItemString(bnd->py_context, KEY, obj);                           \
+    Py_XDECREF(obj);                                                           \
+  }
+
+  set_string("device::name", "host");
+  set_string("device::vendor", "");
+  set_string("device::driver", "");
+  set_string("device::type", "cpu");
+  set_int("device::max_threads_per_block", CPU_MAX_THREADS_PER_BLOCK);
+
+#undef set_string
+#undef set_int
+}
+
+/**
+ * @ingroup nomp_backend_init
+ * @brief Initializes the CPU backend.
+ *
+ * Kernels are compiled to shared objects with the system C compiler
+ * (`NOMP_CPU_CC` environment variable, defaults to `cc`) using the flags in
+ * `NOMP_CPU_CFLAGS` environment variable (defaults to `-O3 -march=native
+ * -fopenmp`) and loaded with dlopen(). Shared objects are stored in the
+ * kernel cache if it is enabled. Work-groups of a kernel are run in parallel
+ * using OpenMP. Memory is shared with the host whenever possible, so
+ * nomp_update() doesn't copy any data. Only platform 0 and device 0 are
+ * valid.
+ *
+ * @param[in] bnd Target backend for code generation.
+ * @param[in] platform_id Target platform id.
+ * @param[in] device_id Target device id.
+ * @return int
+ */
+int cpu_init(nomp_backend_t *bnd, const int platform_id, const int device_id) {
+  if (platform_id != 0) {
+    return nomp_log(NOMP_USER_INPUT_IS_INVALID, NOMP_ERROR,
+                    "Platform id %d provided to libnomp is not valid.",
+                    platform_id);
+  }
+  if (device_id != 0) {
+    return nomp_log(NOMP_USER_INPUT_IS_INVALID, NOMP_ERROR,
+                    ERR_STR_USER_DEVICE_IS_INVALID, device_id);
+  }
+
+  struct cpu_backend_t *cpu = nomp_calloc(struct cpu_backend_t, 1);
+  const char           *cc  = getenv("NOMP_CPU_CC");
+  strncpy(cpu->cc, cc ? cc : CPU_CC, NOMP_MAX_BUFFER_SIZE);
+  const char *cflags = getenv("NOMP_CPU_CFLAGS");
+  strncpy(cpu->cflags, cflags ? cflags : CPU_CFLAGS, NOMP_MAX_CFLAGS_SIZE);
+
+  const char *tmp = getenv("TMPDIR");
+  snprintf(cpu->tmp_dir, PATH_MAX, "%s/nomp-cpu-XXXXXX", tmp ? tmp : "/tmp");
+  if (!mkdtemp(cpu->tmp_dir)) {
+    int err = nomp_log(NOMP_CPU_FAILURE, NOMP_ERROR,
+                       "Unable to create temporary directory \"%s\": %s.",
+                       cpu->tmp_dir, strerror(errno));
+    nomp_free(&cpu);
+    return err;
+  }
+
+  cpu_device_query(bnd);
+
+  bnd->bptr          = (void *)cpu;
+  bnd->update        = cpu_update;
+  bnd->knl_build     = cpu_knl_build;
+  bnd->knl_run       = cpu_knl_run;
+  bnd->knl_free      = cpu_knl_free;
+  bnd->sync          = cpu_sync;
+  bnd->create_queues = cpu_create_queues;
+  bnd->sync_queue    = cpu_sync_queue;
+  bnd->mem_wait      = cpu_mem_wait;
+  bnd->aliases_host  = 1;
+  bnd->finalize      = cpu_finalize;
+
+  return 0;
+}
+
+#undef CPU_MAX_THREADS_PER_BLOCK
+#undef CPU_CFLAGS
+#undef CPU_CC
@@ -1,3 +1,4 @@
+#include "nomp-aux.h"
 #include "nomp-impl.h"
 
 #define CL_TARGET_OPENCL_VERSION 220
@@ -57,17 +58,184 @@ static const char *ERR_STR_OPENCL_FAILURE = "%s failed with error: %d (%s).";
     }                                                                          \
   }
 
+// Maximum number of devices a kernel can be split between.
+#define OPENCL_MAX_DEVICES 16
+
+// Event of a kernel or a copy, the profiler entry its device time is
+// recorded in, the queue it was enqueued to and the host time right before it
+// was enqueued. Device timestamps are moved to the host clock relative to the
+// time the command was queued.
+struct opencl_timing {
+  cl_event event;
+  unsigned entry, queue;
+  double   host;
+};
+
 struct opencl_backend_t {
-  cl_device_id     device_id;
-  cl_command_queue queue;
-  cl_context       ctx;
+  cl_device_id      device_id;
+  cl_command_queue *queues;
+  cl_context        ctx;
+  uint64_t          device_hash;
+  int               zero_copy;
+  // Id of the last buffer created by this backend.
+  uint64_t mem_id;
+  // Devices which run the kernels (device_id is the first one). Work-groups
+  // along the first axis are split between the devices if there is more than
+  // one. Each queue has a command queue for every device.
+  cl_device_id devices[OPENCL_MAX_DEVICES];
+  unsigned     ndevices;
+  // Non-zero if the devices are sub-devices which have to be released.
+  int sub_devices;
+  // Static share of the work-groups run by each device. Shares follow the
+  // measured throughput of the devices if these are not set.
+  double weights[OPENCL_MAX_DEVICES];
+  int    balance;
+  // Events of kernels and copies which are not measured yet if the device
+  // time is recorded for the profiler.
+  struct opencl_timing *timings;
+  unsigned              timings_n, timings_max;
+  int                   profile;
 };
 
+// Queue selected with nomp_set_queue() on the first device and on device d.
+#define opencl_queue(ocl, bnd) ((ocl)->queues[(bnd)->queue * (ocl)->ndevices])
+#define opencl_device_queue(ocl, bnd, d)                                       \
+  ((ocl)->queues[(bnd)->queue * (ocl)->ndevices + (d)])
+
 struct opencl_prog_t {
   cl_program prg;
   cl_kernel  knl;
+  // Values bound to the kernel arguments by the last launch: id of the
+  // buffer for pointers and the value itself for scalars. Size is zero if
+  // the argument has to be bound again.
+  uint64_t bound[NOMP_MAX_KERNEL_ARGS_SIZE];
+  size_t   bound_size[NOMP_MAX_KERNEL_ARGS_SIZE];
+  // Events of split launches which are not measured yet, the work-groups
+  // they run and the measured throughput of each device in work-groups per
+  // nanosecond.
+  cl_event events[OPENCL_MAX_DEVICES];
+  size_t   groups[OPENCL_MAX_DEVICES];
+  double   rate[OPENCL_MAX_DEVICES];
+};
+
+// Kernels split between devices are launched with a global offset along the
+// first axis. Work-group ids don't include the offset, so they are shifted
+// here. This keeps the generated kernels and the partial results of
+// reductions (which are indexed by the work-group) unchanged.
+static const char *opencl_split_prelude =
+    "#define get_group_id(N) "
+    "(get_group_id(N) + get_global_offset(N) / get_local_size(N))\n";
+
+// The buffer is the first member, so a pointer to this struct can be passed
+// to clSetKernelArg() as a pointer to the buffer.
+struct opencl_mem_t {
+  cl_mem mem;
+  // Non-zero if the buffer was created with CL_MEM_USE_HOST_PTR.
+  int host;
+  // Unique id of the buffer in its backend. The driver can reuse the handle
+  // of a released buffer, so bound arguments are compared using this id
+  // instead.
+  uint64_t id;
 };
 
+// Replace the event of the last work which used a memory region. The memory
+// region takes over the reference to the new event.
+static int opencl_set_event(nomp_mem_t *m, cl_event event) {
+  if (m->event) check(clReleaseEvent((cl_event)m->event), "clReleaseEvent");
+  m->event = (void *)event;
+  return 0;
+}
+
+// Record the device time of the completed events (or of all the events if
+// \p wait is set) in the profiler. Events which are still pending are kept.
+static int opencl_timings_collect(struct opencl_backend_t *ocl, int wait) {
+  unsigned n = 0;
+  for (unsigned i = 0; i < ocl->timings_n; i++) {
+    struct opencl_timing *t      = &ocl->timings[i];
+    cl_int                status = CL_COMPLETE;
+    if (wait) {
+      check(clWaitForEvents(1, &t->event), "clWaitForEvents");
+    } else {
+      check(clGetEventInfo(t->event, CL_EVENT_COMMAND_EXECUTION_STATUS,
+                           sizeof(status), &status, NULL),
+            "clGetEventInfo");
+    }
+    if (status > CL_COMPLETE) {
+      ocl->timings[n++] = *t;
+      continue;
+    }
+
+    // Failed commands (with a negative status) are not timed.
+    if (status == CL_COMPLETE) {
+      cl_ulong queued, start, end;
+      check(clGetEventProfilingInfo(t->event, CL_PROFILING_COMMAND_QUEUED,
+                                    sizeof(queued), &queued, NULL),
+            "clGetEventProfilingInfo");
+      check(clGetEventProfilingInfo(t->event, CL_PROFILING_COMMAND_START,
+                                    sizeof(start), &start, NULL),
+            "clGetEventProfilingInfo");
+      check(clGetEventProfilingInfo(t->event, CL_PROFILING_COMMAND_END,
+                                    sizeof(end), &end, NULL),
+            "clGetEventProfilingInfo");
+      nomp_profile_device(t->entry, t->queue,
+                          t->host + (start - queued) * 1e-6,
+                          t->host + (end - queued) * 1e-6);
+    }
+    check(clReleaseEvent(t->event), "clReleaseEvent");
+  }
+  ocl->timings_n = n;
+
+  return 0;
+}
+
+// Keep the event of a kernel or a copy to record its device time once it is
+// complete. Completed events are collected before growing the list.
+static int opencl_timings_add(struct opencl_backend_t *ocl, cl_event event,
+                              unsigned entry, unsigned queue, double host) {
+  if (ocl->timings_n == ocl->timings_max)
+    nomp_check(opencl_timings_collect(ocl, 0));
+  if (ocl->timings_n == ocl->timings_max) {
+    ocl->timings_max += ocl->timings_max / 2 + 1;
+    ocl->timings =
+        nomp_realloc(ocl->timings, struct opencl_timing, ocl->timings_max);
+  }
+
+  check(clRetainEvent(event), "clRetainEvent");
+  struct opencl_timing *t = &ocl->timings[ocl->timings_n++];
+  t->event = event, t->entry = entry, t->queue = queue, t->host = host;
+
+  return 0;
+}
+
+// Buffers created with CL_MEM_USE_HOST_PTR are synchronized with the host
+// memory by mapping and unmapping them, which doesn't copy anything on
+// devices sharing the host memory. Mapping for NOMP_TO invalidates the region
+// so the map doesn't overwrite the host data, and the unmap makes the host
+// data visible to the device. Mapping for NOMP_FROM makes the device data
+// visible to the host.
+static int opencl_map(cl_command_queue queue, cl_mem mem,
+                      const nomp_map_direction_t op, size_t offset,
+                      size_t bytes, cl_bool blocking, cl_uint nwait,
+                      const cl_event *wait, cl_event *event) {
+  cl_map_flags flags =
+      (op & NOMP_TO) ? CL_MAP_WRITE_INVALIDATE_REGION : CL_MAP_READ;
+
+  cl_int err;
+  void  *ptr = clEnqueueMapBuffer(queue, mem, blocking, flags, offset, bytes,
+                                  nwait, wait, NULL, &err);
+  check(err, "clEnqueueMapBuffer");
+  check(clEnqueueUnmapMemObject(queue, mem, ptr, 0, NULL, event),
+        "clEnqueueUnmapMemObject");
+
+  if (blocking) {
+    check(clWaitForEvents(1, event), "clWaitForEvents");
+    check(clReleaseEvent(*event), "clReleaseEvent");
+    *event = NULL;
+  }
+
+  return 0;
+}
+
 static int opencl_update(nomp_backend_t *bnd, nomp_mem_t *m,
                          const nomp_map_direction_t op, size_t start,
                          size_t end, size_t usize) {
@@ -75,62 +243,161 @@ static int opencl_update(nomp_backend_t *bnd, nomp_mem_t *m,
 
   cl_int err;
   if (op & NOMP_ALLOC) {
-    cl_mem *clm = nomp_calloc(cl_mem, 1);
-    *clm        = clCreateBuffer(ocl->ctx, CL_MEM_READ_WRITE,
-                                 NOMP_MEM_BYTES(start, end, usize), NULL, &err);
+    struct opencl_mem_t *clm   = nomp_calloc(struct opencl_mem_t, 1);
+    cl_mem_flags         flags = CL_MEM_READ_WRITE;
+    void                *hptr  = NULL;
+    // Scratch memory has no host memory when it is allocated.
+    if (ocl->zero_copy && m->hptr) {
+      hptr  = (char *)m->hptr + NOMP_MEM_OFFSET(start, usize);
+      flags |= CL_MEM_USE_HOST_PTR, clm->host = 1;
+    }
+    clm->mem = clCreateBuffer(ocl->ctx, flags,
+                              NOMP_MEM_BYTES(start, end, usize), hptr, &err);
     check(err, "clCreateBuffer");
+    clm->id = ++ocl->mem_id;
     m->bptr = (void *)clm, m->bsize = sizeof(cl_mem);
   }
 
-  cl_mem *clm = (cl_mem *)m->bptr;
-  if (op & NOMP_TO) {
-    check(clEnqueueWriteBuffer(ocl->queue, *clm, CL_TRUE,
-                               NOMP_MEM_OFFSET(start - m->idx0, usize),
-                               NOMP_MEM_BYTES(start, end, usize),
-                               (char *)m->hptr + NOMP_MEM_OFFSET(start, usize),
-                               0, NULL, NULL),
+  // Copies wait for the last work which used the memory region, which might
+  // be on a different queue. Blocking copies only need an event if they are
+  // timed.
+  cl_command_queue queue    = opencl_queue(ocl, bnd);
+  cl_bool          blocking = !(op & NOMP_ASYNC);
+  cl_event         wait = (cl_event)m->event, event = NULL;
+  cl_uint          nwait = (wait != NULL);
+  cl_event        *out   = (blocking && !ocl->profile) ? NULL : &event;
+  double           host  = nomp_profile_now();
+
+  struct opencl_mem_t *clm    = (struct opencl_mem_t *)m->bptr;
+  size_t               offset = NOMP_MEM_OFFSET(start - m->idx0, usize);
+  size_t               bytes  = NOMP_MEM_BYTES(start, end, usize);
+  char                *hptr = (char *)m->hptr + NOMP_MEM_OFFSET(start, usize);
+  if (clm->host && (op & (NOMP_TO | NOMP_FROM))) {
+    nomp_check(opencl_map(queue, clm->mem, op, offset, bytes, blocking, nwait,
+                          nwait ? &wait : NULL, &event));
+  } else if (op & NOMP_TO) {
+    check(clEnqueueWriteBuffer(queue, clm->mem, blocking, offset, bytes, hptr,
+                               nwait, nwait ? &wait : NULL, out),
           "clEnqueueWriteBuffer");
-  } else if (op == NOMP_FROM) {
-    check(clEnqueueReadBuffer(ocl->queue, *clm, CL_TRUE,
-                              NOMP_MEM_OFFSET(start - m->idx0, usize),
-                              NOMP_MEM_BYTES(start, end, usize),
-                              (char *)m->hptr + NOMP_MEM_OFFSET(start, usize),
-                              0, NULL, NULL),
+  } else if (op & NOMP_FROM) {
+    check(clEnqueueReadBuffer(queue, clm->mem, blocking, offset, bytes, hptr,
+                              nwait, nwait ? &wait : NULL, out),
           "clEnqueueReadBuffer");
-  } else if (op == NOMP_FREE) {
-    check(clReleaseMemObject(*clm), "clReleaseMemObject");
+  } else if (op & NOMP_FREE) {
+    nomp_check(opencl_set_event(m, NULL));
+    check(clReleaseMemObject(clm->mem), "clReleaseMemObject");
     nomp_free(&m->bptr);
+    return 0;
+  }
+
+  // A blocking copy leaves no pending work on the memory region (its event
+  // is complete if there is one).
+  if (op & (NOMP_TO | NOMP_FROM)) {
+    if (ocl->profile && event) {
+      unsigned entry = nomp_profile_entry(NOMP_PROFILE_COPY(op));
+      nomp_check(opencl_timings_add(ocl, event, entry,
+                                    bnd->queue * ocl->ndevices, host));
+    }
+    nomp_check(opencl_set_event(m, event));
+    if (!blocking) check(clFlush(queue), "clFlush");
   }
 
   return 0;
 }
 
-static int opencl_knl_build(nomp_backend_t *bnd, nomp_prog_t *prg,
-                            const char *source, const char *name) {
-  struct opencl_prog_t *ocl_prg = nomp_calloc(struct opencl_prog_t, 1);
-
+static int opencl_build_program(cl_program *program, nomp_backend_t *bnd,
+                                const char *options) {
   struct opencl_backend_t *ocl = (struct opencl_backend_t *)bnd->bptr;
-  cl_int                   err;
-  ocl_prg->prg = clCreateProgramWithSource(
-      ocl->ctx, 1, (const char **)(&source), NULL, &err);
-  check(err, "clCreateProgramWithSource");
 
-  err = clBuildProgram(ocl_prg->prg, 0, NULL, NULL, NULL, NULL);
+  cl_int err = clBuildProgram(*program, 0, NULL, options, NULL, NULL);
   if (err != CL_SUCCESS) {
-    ocl_prg->prg = NULL, ocl_prg->knl = NULL;
-
     size_t log_size;
-    clGetProgramBuildInfo(ocl_prg->prg, ocl->device_id, CL_PROGRAM_BUILD_LOG, 0,
+    clGetProgramBuildInfo(*program, ocl->device_id, CL_PROGRAM_BUILD_LOG, 0,
                           NULL, &log_size);
     char *log = nomp_calloc(char, log_size);
-    clGetProgramBuildInfo(ocl_prg->prg, ocl->device_id, CL_PROGRAM_BUILD_LOG,
+    clGetProgramBuildInfo(*program, ocl->device_id, CL_PROGRAM_BUILD_LOG,
                           log_size, log, NULL);
     int err = nomp_log(NOMP_OPENCL_FAILURE, NOMP_ERROR,
                        "clBuildProgram failed with error:\n %s.", log);
     nomp_free(&log);
+    clReleaseProgram(*program), *program = NULL;
     return err;
   }
 
+  return 0;
+}
+
+static cl_program opencl_load_binary(nomp_backend_t *bnd, uint64_t key,
+                                     const char *options) {
+  struct opencl_backend_t *ocl = (struct opencl_backend_t *)bnd->bptr;
+
+  unsigned char *binary;
+  size_t         size;
+  nomp_cache_read((void **)&binary, &size, key, "clbin");
+  if (!binary) return NULL;
+
+  cl_int     status, err;
+  cl_program program = clCreateProgramWithBinary(
+      ocl->ctx, 1, &ocl->device_id, &size, (const unsigned char **)&binary,
+      &status, &err);
+  nomp_free(&binary);
+
+  // Fall back to building from source if the binary is rejected, either by
+  // clCreateProgramWithBinary() itself or through the status of the device.
+  if (err == CL_SUCCESS) err = status;
+  if (err == CL_SUCCESS)
+    err = clBuildProgram(program, 0, NULL, options, NULL, NULL);
+  if (err != CL_SUCCESS) {
+    if (program) clReleaseProgram(program);
+    nomp_log(NOMP_SUCCESS, NOMP_WARNING,
+             "Cached OpenCL program binary was rejected with error %d.", err);
+    return NULL;
+  }
+
+  return program;
+}
+
+static void opencl_store_binary(cl_program program, uint64_t key) {
+  size_t size;
+  if (clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &size,
+                       NULL) != CL_SUCCESS ||
+      size == 0)
+    return;
+
+  unsigned char *binary = nomp_calloc(unsigned char, size);
+  if (clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(unsigned char *),
+                       &binary, NULL) == CL_SUCCESS)
+    nomp_cache_write(binary, size, key, "clbin");
+  nomp_free(&binary);
+}
+
+static int opencl_knl_build(nomp_backend_t *bnd, nomp_prog_t *prg,
+                            const char *source, const char *name) {
+  struct opencl_prog_t *ocl_prg = nomp_calloc(struct opencl_prog_t, 1);
+
+  // Program binaries are cached based on the source, the device (name, driver
+  // version, etc.) and the build options.
+  // Binaries are only cached for a single device.
+  struct opencl_backend_t *ocl     = (struct opencl_backend_t *)bnd->bptr;
+  const char              *options = "";
+  int                      cache   = (ocl->ndevices == 1);
+
+  uint64_t key = nomp_hash(ocl->device_hash, source, strlen(source) + 1);
+  key          = nomp_hash(key, options, strlen(options) + 1);
+
+  if (cache) ocl_prg->prg = opencl_load_binary(bnd, key, options);
+  if (!ocl_prg->prg) {
+    const char *sources[2] = {opencl_split_prelude, source};
+    cl_uint     nsources   = cache ? 1 : 2;
+    cl_int      err;
+    ocl_prg->prg = clCreateProgramWithSource(
+        ocl->ctx, nsources, sources + 2 - nsources, NULL, &err);
+    check(err, "clCreateProgramWithSource");
+    nomp_check(opencl_build_program(&ocl_prg->prg, bnd, options));
+    if (cache) opencl_store_binary(ocl_prg->prg, key);
+  }
+
+  cl_int err;
   ocl_prg->knl = clCreateKernel(ocl_prg->prg, name, &err);
   check(err, "clCreateKernel");
   prg->bptr = (void *)ocl_prg;
@@ -138,19 +405,194 @@ static int opencl_knl_build(nomp_backend_t *bnd, nomp_prog_t *prg,
   return 0;
 }
 
+// Shares of the work-groups of a split launch. Unless static weights are set,
+// the shares follow the throughput of each device measured with the events of
+// earlier launches of the kernel (and are equal until every device has been
+// measured). Events are only measured once they are complete, so this never
+// waits for the devices.
+static int opencl_weights(double *weights, const struct opencl_backend_t *ocl,
+                          struct opencl_prog_t *ocl_prg) {
+  int measured = 1;
+  for (unsigned d = 0; d < ocl->ndevices; d++) {
+    cl_event event  = ocl_prg->events[d];
+    cl_int   status = CL_QUEUED;
+    if (event) {
+      check(clGetEventInfo(event, CL_EVENT_COMMAND_EXECUTION_STATUS,
+                           sizeof(status), &status, NULL),
+            "clGetEventInfo");
+    }
+    if (event && status == CL_COMPLETE) {
+      cl_ulong start, end;
+      check(clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START,
+                                    sizeof(start), &start, NULL),
+            "clGetEventProfilingInfo");
+      check(clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END,
+                                    sizeof(end), &end, NULL),
+            "clGetEventProfilingInfo");
+      if (end > start) {
+        double rate      = ocl_prg->groups[d] / (double)(end - start);
+        ocl_prg->rate[d] = ocl_prg->rate[d] > 0 ? (ocl_prg->rate[d] + rate) / 2
+                                                : rate;
+      }
+    }
+    // Failed launches are dropped as well.
+    if (event && status <= CL_COMPLETE) {
+      check(clReleaseEvent(event), "clReleaseEvent");
+      ocl_prg->events[d] = NULL;
+    }
+    measured = measured && ocl_prg->rate[d] > 0;
+  }
+
+  for (unsigned d = 0; d < ocl->ndevices; d++) {
+    if (!ocl->balance)
+      weights[d] = ocl->weights[d];
+    else
+      weights[d] = measured ? ocl_prg->rate[d] : 1;
+  }
+
+  return 0;
+}
+
+// Split `total` work-groups between `n` devices in proportion to their
+// weights. Every device gets at least one work-group if there are enough of
+// them, so its throughput keeps being measured.
+static void opencl_split(size_t *groups, const double *weights, unsigned n,
+                         size_t total) {
+  double sum = 0;
+  for (unsigned d = 0; d < n; d++)
+    sum += weights[d];
+
+  size_t left = total;
+  for (unsigned d = 0; d < n; d++) {
+    groups[d] = (size_t)(total * (weights[d] / sum));
+    if (groups[d] == 0 && total >= n) groups[d] = 1;
+    if (groups[d] > left) groups[d] = left;
+    left -= groups[d];
+  }
+  for (unsigned d = 0; left > 0; d = (d + 1) % n)
+    groups[d]++, left--;
+}
+
+// Launch a kernel split between all the devices along the first axis. Every
+// device works on the same buffers (the devices share the memory), so
+// neighbouring work-groups on other devices see the same data and partial
+// results of reductions end up in the same scratch memory. The returned event
+// completes when all the devices are done.
+static int opencl_knl_split(cl_event *event, nomp_backend_t *bnd,
+                            const nomp_prog_t *prg, cl_uint nwait,
+                            const cl_event *wait) {
+  struct opencl_backend_t *ocl     = (struct opencl_backend_t *)bnd->bptr;
+  struct opencl_prog_t    *ocl_prg = (struct opencl_prog_t *)prg->bptr;
+
+  double weights[OPENCL_MAX_DEVICES];
+  size_t groups[OPENCL_MAX_DEVICES];
+  nomp_check(opencl_weights(weights, ocl, ocl_prg));
+  opencl_split(groups, weights, ocl->ndevices, prg->global[0]);
+
+  cl_event events[OPENCL_MAX_DEVICES];
+  cl_uint  nevents   = 0;
+  size_t   offset[3] = {0, 0, 0};
+  size_t   gws[3]    = {prg->gws[0], prg->gws[1], prg->gws[2]};
+  for (unsigned d = 0; d < ocl->ndevices; d++) {
+    if (groups[d] == 0) continue;
+    cl_command_queue queue = opencl_device_queue(ocl, bnd, d);
+    gws[0]                 = groups[d] * prg->local[0];
+    double host            = nomp_profile_now();
+    check(clEnqueueNDRangeKernel(queue, ocl_prg->knl, prg->ndim, offset, gws,
+                                 prg->local, nwait, nwait ? wait : NULL,
+                                 &events[nevents]),
+          "clEnqueueNDRangeKernel");
+    if (d > 0) check(clFlush(queue), "clFlush");
+    offset[0] += gws[0];
+
+    if (ocl->profile) {
+      nomp_check(opencl_timings_add(ocl, events[nevents], prg->profile_id,
+                                    bnd->queue * ocl->ndevices + d, host));
+    }
+    // Keep the event to measure the device unless an earlier one is pending.
+    if (ocl->balance && ocl_prg->events[d] == NULL) {
+      check(clRetainEvent(events[nevents]), "clRetainEvent");
+      ocl_prg->events[d] = events[nevents], ocl_prg->groups[d] = groups[d];
+    }
+    nevents++;
+  }
+
+  if (nevents == 1) {
+    *event = events[0];
+    return 0;
+  }
+
+  check(clEnqueueMarkerWithWaitList(opencl_queue(ocl, bnd), nevents, events,
+                                    event),
+        "clEnqueueMarkerWithWaitList");
+  for (unsigned i = 0; i < nevents; i++)
+    check(clReleaseEvent(events[i]), "clReleaseEvent");
+
+  return 0;
+}
+
 static int opencl_knl_run(nomp_backend_t *bnd, nomp_prog_t *prg) {
   struct opencl_prog_t *ocl_prg = (struct opencl_prog_t *)prg->bptr;
 
+  // Bind only the arguments which changed since the last launch of the
+  // kernel.
+  nomp_arg_t *args = prg->args;
   for (unsigned i = 0; i < prg->nargs; i++) {
-    check(clSetKernelArg(ocl_prg->knl, i, prg->args[i].size, prg->args[i].ptr),
+    uint64_t value  = 0;
+    int      cached = 1;
+    if (args[i].type == NOMP_PTR)
+      value = ((struct opencl_mem_t *)args[i].ptr)->id;
+    else if (args[i].size <= sizeof(value))
+      memcpy(&value, args[i].ptr, args[i].size);
+    else
+      cached = 0;
+
+    if (cached && ocl_prg->bound_size[i] == args[i].size &&
+        ocl_prg->bound[i] == value)
+      continue;
+
+    check(clSetKernelArg(ocl_prg->knl, i, args[i].size, args[i].ptr),
           "clSetKernelArg");
+    ocl_prg->bound[i] = value, ocl_prg->bound_size[i] = cached * args[i].size;
+  }
+
+  // Wait only for the pending work on the memory used by the kernel and
+  // record the kernel as the last work on all of it.
+  cl_event wait[NOMP_MAX_KERNEL_ARGS_SIZE], event;
+  cl_uint  nwait = 0;
+  for (unsigned i = 0; i < prg->nargs; i++) {
+    nomp_mem_t *m = prg->args[i].mem;
+    if (m && m->event) wait[nwait++] = (cl_event)m->event;
   }
 
   struct opencl_backend_t *ocl = (struct opencl_backend_t *)bnd->bptr;
-  check(clEnqueueNDRangeKernel(ocl->queue, ocl_prg->knl, prg->ndim, NULL,
-                               prg->gws, prg->local, 0, NULL, NULL),
-        "clEnqueueNDRangeKernel");
-  check(clFinish(ocl->queue), "clFinish");
+  if (ocl->ndevices > 1) {
+    nomp_check(opencl_knl_split(&event, bnd, prg, nwait, wait));
+  } else {
+    double host = nomp_profile_now();
+    check(clEnqueueNDRangeKernel(opencl_queue(ocl, bnd), ocl_prg->knl,
+                                 prg->ndim, NULL, prg->gws, prg->local, nwait,
+                                 nwait ? wait : NULL, &event),
+          "clEnqueueNDRangeKernel");
+    if (ocl->profile) {
+      nomp_check(opencl_timings_add(ocl, event, prg->profile_id,
+                                    bnd->queue * ocl->ndevices, host));
+    }
+  }
+
+  for (unsigned i = 0; i < prg->nargs; i++) {
+    nomp_mem_t *m = prg->args[i].mem;
+    if (m == NULL) continue;
+    check(clRetainEvent(event), "clRetainEvent");
+    nomp_check(opencl_set_event(m, event));
+  }
+  check(clReleaseEvent(event), "clReleaseEvent");
+
+  // Don't wait for the kernel to finish. Flush so the kernel is submitted to
+  // the device while the host keeps working. Blocking reads in
+  // opencl_update() wait for the kernel event, so NOMP_FROM and opencl_sync()
+  // see the results.
+  check(clFlush(opencl_queue(ocl, bnd)), "clFlush");
 
   return 0;
 }
@@ -159,6 +601,10 @@ static int opencl_knl_free(nomp_prog_t *prg) {
   struct opencl_prog_t *ocl_prg = (struct opencl_prog_t *)prg->bptr;
 
   if (ocl_prg) {
+    for (unsigned d = 0; d < OPENCL_MAX_DEVICES; d++) {
+      if (ocl_prg->events[d])
+        check(clReleaseEvent(ocl_prg->events[d]), "clReleaseEvent");
+    }
     check(clReleaseKernel(ocl_prg->knl), "clReleaseKernel");
     check(clReleaseProgram(ocl_prg->prg), "clReleaseProgram");
   }
@@ -167,9 +613,58 @@ static int opencl_knl_free(nomp_prog_t *prg) {
   return 0;
 }
 
+static int opencl_sync_queue(nomp_backend_t *bnd, unsigned queue) {
+  struct opencl_backend_t *ocl = (struct opencl_backend_t *)bnd->bptr;
+  for (unsigned d = 0; d < ocl->ndevices; d++)
+    check(clFinish(ocl->queues[queue * ocl->ndevices + d]), "clFinish");
+  return 0;
+}
+
+static int opencl_mem_wait(nomp_backend_t *NOMP_UNUSED(bnd), nomp_mem_t *m) {
+  cl_event event = (cl_event)m->event;
+  check(clWaitForEvents(1, &event), "clWaitForEvents");
+  return opencl_set_event(m, NULL);
+}
+
 static int opencl_sync(nomp_backend_t *bnd) {
+  for (unsigned i = 0; i < bnd->nqueues; i++)
+    nomp_check(opencl_sync_queue(bnd, i));
+
   struct opencl_backend_t *ocl = (struct opencl_backend_t *)bnd->bptr;
-  check(clFinish(ocl->queue), "clFinish");
+  return opencl_timings_collect(ocl, 1);
+}
+
+// Split launches are balanced with the execution time of the kernels on each
+// device, so profiling is enabled if there is more than one device. It is
+// also enabled to record the device time of kernels and copies for the
+// profiler.
+static int opencl_create_queue(cl_command_queue              *queue,
+                               const struct opencl_backend_t *ocl,
+                               cl_device_id                   device) {
+  cl_queue_properties props[3] = {CL_QUEUE_PROPERTIES,
+                                  CL_QUEUE_PROFILING_ENABLE, 0};
+
+  cl_int err;
+  *queue = clCreateCommandQueueWithProperties(
+      ocl->ctx, device, (ocl->ndevices > 1 || ocl->profile) ? props : NULL,
+      &err);
+  check(err, "clCreateCommandQueueWithProperties");
+
+  return 0;
+}
+
+static int opencl_create_queues(nomp_backend_t *bnd, unsigned n) {
+  struct opencl_backend_t *ocl = (struct opencl_backend_t *)bnd->bptr;
+
+  unsigned nd = ocl->ndevices;
+  ocl->queues = nomp_realloc(ocl->queues, cl_command_queue, n * nd);
+  for (unsigned i = bnd->nqueues; i < n; i++) {
+    for (unsigned d = 0; d < nd; d++) {
+      nomp_check(
+          opencl_create_queue(&ocl->queues[i * nd + d], ocl, ocl->devices[d]));
+    }
+  }
+
   return 0;
 }
 
@@ -177,15 +672,24 @@ static int opencl_finalize(nomp_backend_t *bnd) {
   struct opencl_backend_t *ocl = (struct opencl_backend_t *)bnd->bptr;
 
   if (ocl) {
-    check(clReleaseCommandQueue(ocl->queue), "clReleaseCommandQueue");
+    nomp_check(opencl_timings_collect(ocl, 1));
+    nomp_free(&ocl->timings);
+    for (unsigned i = 0; i < bnd->nqueues * ocl->ndevices; i++)
+      check(clReleaseCommandQueue(ocl->queues[i]), "clReleaseCommandQueue");
     check(clReleaseContext(ocl->ctx), "clReleaseContext");
+    for (unsigned d = 0; ocl->sub_devices && d < ocl->ndevices; d++)
+      check(clReleaseDevice(ocl->devices[d]), "clReleaseDevice");
+    nomp_free(&ocl->queues);
   }
   nomp_free(&bnd->bptr);
 
   return 0;
 }
 
-static int opencl_device_query(nomp_backend_t *bnd, cl_device_id id) {
+// Properties of the first device are used except for the maximum work-group
+// size which has to be supported by all the devices.
+static int opencl_device_query(nomp_backend_t *bnd, const cl_device_id *ids,
+                               unsigned n) {
 #define set_string(KEY, VAL)                                                   \
   {                                                                            \
     PyObject *obj = PyUnicode_FromString(VAL);                                 \
@@ -200,7 +704,8 @@ static int opencl_device_query(nomp_backend_t *bnd, cl_device_id id) {
     Py_XDECREF(obj);                                                           \
   }
 
-  char val[BUFSIZ];
+  cl_device_id id = ids[0];
+  char         val[BUFSIZ];
   check(clGetDeviceInfo(id, CL_DEVICE_NAME, sizeof(val), val, NULL),
         "clGetDeviceInfo");
   set_string("device::name", val);
@@ -210,6 +715,9 @@ static int opencl_device_query(nomp_backend_t *bnd, cl_device_id id) {
   check(clGetDeviceInfo(id, CL_DEVICE_VERSION, sizeof(val), val, NULL),
         "clGetDeviceInfo");
   set_string("device::driver", val);
+  check(clGetDeviceInfo(id, CL_DRIVER_VERSION, sizeof(val), val, NULL),
+        "clGetDeviceInfo");
+  set_string("device::driver_version", val);
 
   cl_device_type type;
   check(clGetDeviceInfo(id, CL_DEVICE_TYPE, sizeof(type), &type, NULL),
@@ -223,10 +731,15 @@ static int opencl_device_query(nomp_backend_t *bnd, cl_device_id id) {
   PyDict_SetItemString(bnd->py_context, "device::type", obj);
   Py_XDECREF(obj);
 
-  size_t max_threads_per_block;
-  check(clGetDeviceInfo(id, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(size_t),
-                        &max_threads_per_block, NULL),
-        "clGetDeviceInfo");
+  size_t max_threads_per_block = 0;
+  for (unsigned d = 0; d < n; d++) {
+    size_t max_threads;
+    check(clGetDeviceInfo(ids[d], CL_DEVICE_MAX_WORK_GROUP_SIZE,
+                          sizeof(size_t), &max_threads, NULL),
+          "clGetDeviceInfo");
+    if (d == 0 || max_threads < max_threads_per_block)
+      max_threads_per_block = max_threads;
+  }
   set_int("device::max_threads_per_block", max_threads_per_block);
 
 #undef set_string
@@ -235,6 +748,130 @@ static int opencl_device_query(nomp_backend_t *bnd, cl_device_id id) {
   return 0;
 }
 
+static int opencl_device_hash(uint64_t *hash, cl_device_id id) {
+  const cl_device_info info[] = {CL_DEVICE_NAME, CL_DEVICE_VENDOR,
+                                 CL_DEVICE_VERSION, CL_DRIVER_VERSION};
+
+  char val[BUFSIZ];
+  *hash = NOMP_HASH_SEED;
+  for (unsigned i = 0; i < sizeof(info) / sizeof(info[0]); i++) {
+    check(clGetDeviceInfo(id, info[i], sizeof(val), val, NULL),
+          "clGetDeviceInfo");
+    *hash = nomp_hash(*hash, val, strnlen(val, BUFSIZ) + 1);
+  }
+
+  return 0;
+}
+
+// Parse a comma separated list of at most `max` non-negative numbers from the
+// environment variable `name`. `n` is zero if the variable is not set.
+static int opencl_env_list(double *vals, unsigned *n, unsigned max,
+                           const char *name) {
+  *n              = 0;
+  const char *env = getenv(name);
+  if (env == NULL) return 0;
+
+  const char *str = env;
+  char       *end;
+  do {
+    if (*n == max) {
+      return nomp_log(NOMP_USER_INPUT_IS_INVALID, NOMP_ERROR,
+                      "%s can't have more than %u values.", name, max);
+    }
+    vals[*n] = strtod(str, &end);
+    if (end == str || vals[*n] < 0) break;
+    str = end + 1, (*n)++;
+  } while (*end == ',');
+
+  if (*end != '\0' || *n == 0) {
+    return nomp_log(NOMP_USER_INPUT_IS_INVALID, NOMP_ERROR,
+                    "%s is not a comma separated list of non-negative "
+                    "numbers: \"%s\".",
+                    name, env);
+  }
+
+  return 0;
+}
+
+static int opencl_host_memory(int *shared, cl_device_id id) {
+  cl_device_type type;
+  check(clGetDeviceInfo(id, CL_DEVICE_TYPE, sizeof(type), &type, NULL),
+        "clGetDeviceInfo");
+  cl_bool unified;
+  check(clGetDeviceInfo(id, CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof(unified),
+                        &unified, NULL),
+        "clGetDeviceInfo");
+  *shared = (type & CL_DEVICE_TYPE_CPU) || unified;
+  return 0;
+}
+
+// Devices run parts of a kernel on the same buffers at the same time, so
+// different devices have to share the host memory (like CPUs and integrated
+// GPUs). A device can be listed more than once to split kernels between
+// several queues of the device.
+static int opencl_check_devices(const struct opencl_backend_t *ocl) {
+  for (unsigned d = 1; d < ocl->ndevices; d++) {
+    if (ocl->devices[d] == ocl->devices[0]) continue;
+    int shared0, shared;
+    nomp_check(opencl_host_memory(&shared0, ocl->devices[0]));
+    nomp_check(opencl_host_memory(&shared, ocl->devices[d]));
+    if (!shared0 || !shared) {
+      return nomp_log(NOMP_USER_INPUT_IS_INVALID, NOMP_ERROR,
+                      "Kernels can only be split between OpenCL devices "
+                      "which share the host memory.");
+    }
+  }
+
+  return 0;
+}
+
+// Partition each device into NOMP_OPENCL_SUB_DEVICES sub-devices with the
+// same number of compute units (e.g., to split kernels between the cores of
+// a CPU). Sub-devices of a device share its memory.
+static int opencl_sub_devices(struct opencl_backend_t *ocl) {
+  const char *env = getenv("NOMP_OPENCL_SUB_DEVICES");
+  if (env == NULL) return 0;
+
+  int parts = nomp_str_toui(env, NOMP_MAX_BUFFER_SIZE);
+  if (parts <= 0 || parts * ocl->ndevices > OPENCL_MAX_DEVICES) {
+    return nomp_log(NOMP_USER_INPUT_IS_INVALID, NOMP_ERROR,
+                    "NOMP_OPENCL_SUB_DEVICES is invalid: \"%s\".", env);
+  }
+  if (parts == 1) return 0;
+
+  cl_device_id devices[OPENCL_MAX_DEVICES];
+  unsigned     n = 0;
+  for (unsigned d = 0; d < ocl->ndevices; d++) {
+    cl_uint units;
+    check(clGetDeviceInfo(ocl->devices[d], CL_DEVICE_MAX_COMPUTE_UNITS,
+                          sizeof(units), &units, NULL),
+          "clGetDeviceInfo");
+    if (units < (cl_uint)parts) {
+      return nomp_log(NOMP_USER_INPUT_IS_INVALID, NOMP_ERROR,
+                      "OpenCL device with %u compute units can't be "
+                      "partitioned into %d sub-devices.",
+                      units, parts);
+    }
+
+    cl_device_partition_property props[OPENCL_MAX_DEVICES + 3];
+    props[0] = CL_DEVICE_PARTITION_BY_COUNTS;
+    for (cl_uint i = 0; i < (cl_uint)parts; i++)
+      props[i + 1] = units / parts + (i < units % parts);
+    props[parts + 1] = CL_DEVICE_PARTITION_BY_COUNTS_LIST_END;
+    props[parts + 2] = 0;
+
+    cl_uint num;
+    check(clCreateSubDevices(ocl->devices[d], props, parts, &devices[n], &num),
+          "clCreateSubDevices");
+    n += num;
+  }
+
+  memcpy(ocl->devices, devices, n * sizeof(cl_device_id));
+  ocl->ndevices = n, ocl->sub_devices = 1;
+
+  return 0;
+}
+
 /**
  * @ingroup nomp_backend_init
  * @brief Initializes OpenCL backend with the specified platform and device.
@@ -243,6 +880,14 @@ static int opencl_device_query(nomp_backend_t *bnd, cl_device_id id) {
  * given platform id and device id. Returns a negative value if an error
  * occurred during the initialization, otherwise returns 0.
  *
+ * Kernels can be split between several devices of the platform along the
+ * first work-group axis. Devices are listed (instead of \p device_id) in
+ * `NOMP_OPENCL_DEVICES` environment variable (e.g., "0,1") and each of them
+ * can be partitioned into sub-devices with `NOMP_OPENCL_SUB_DEVICES`. The
+ * work-groups are shared based on the measured throughput of each device
+ * or on the static weights set in `NOMP_OPENCL_DEVICE_WEIGHTS` (e.g., "1,3").
+ * Different devices must share the host memory.
+ *
  * @param[in] bnd Target backend for code generation.
  * @param[in] platform_id Target platform id.
  * @param[in] device_id Target device id.
@@ -264,40 +909,88 @@ int opencl_init(nomp_backend_t *bnd, const int platform_id,
   cl_platform_id platform = cl_platforms[platform_id];
   nomp_free(&cl_platforms);
 
+  double   ids[OPENCL_MAX_DEVICES];
+  unsigned nids;
+  nomp_check(opencl_env_list(ids, &nids, OPENCL_MAX_DEVICES,
+                             "NOMP_OPENCL_DEVICES"));
+  if (nids == 0) ids[0] = device_id, nids = 1;
+
   cl_uint num_devices;
   check(clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, 0, NULL, &num_devices),
         "clGetDeviceIDs");
-  if (device_id < 0 || device_id >= (int)num_devices) {
-    return nomp_log(NOMP_USER_INPUT_IS_INVALID, NOMP_ERROR,
-                    ERR_STR_USER_DEVICE_IS_INVALID, device_id);
+  for (unsigned i = 0; i < nids; i++) {
+    if (ids[i] < 0 || ids[i] >= num_devices || ids[i] != (int)ids[i]) {
+      return nomp_log(NOMP_USER_INPUT_IS_INVALID, NOMP_ERROR,
+                      ERR_STR_USER_DEVICE_IS_INVALID, (int)ids[i]);
+    }
   }
 
   cl_device_id *cl_devices = nomp_calloc(cl_device_id, num_devices);
   check(clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, num_devices, cl_devices,
                        &num_devices),
         "clGetDeviceIDs");
-  cl_device_id device = cl_devices[device_id];
+  struct opencl_backend_t *ocl = nomp_calloc(struct opencl_backend_t, 1);
+  for (unsigned i = 0; i < nids; i++)
+    ocl->devices[i] = cl_devices[(int)ids[i]];
+  ocl->ndevices = nids;
   nomp_free(&cl_devices);
 
-  nomp_check(opencl_device_query(bnd, device));
+  nomp_check(opencl_check_devices(ocl));
+  nomp_check(opencl_sub_devices(ocl));
+  nomp_check(opencl_device_query(bnd, ocl->devices, ocl->ndevices));
 
-  struct opencl_backend_t *ocl = nomp_calloc(struct opencl_backend_t, 1);
-  ocl->device_id               = device;
+  cl_device_id device = ocl->device_id = ocl->devices[0];
+  nomp_check(opencl_device_hash(&ocl->device_hash, device));
   cl_int err;
-  ocl->ctx = clCreateContext(NULL, 1, &device, NULL, NULL, &err);
+  ocl->ctx =
+      clCreateContext(NULL, ocl->ndevices, ocl->devices, NULL, NULL, &err);
   check(err, "clCreateContext");
-  ocl->queue = clCreateCommandQueueWithProperties(ocl->ctx, device, 0, &err);
-  check(err, "clCreateCommandQueueWithProperties");
-
-  bnd->bptr      = (void *)ocl;
-  bnd->update    = opencl_update;
-  bnd->knl_build = opencl_knl_build;
-  bnd->knl_run   = opencl_knl_run;
-  bnd->knl_free  = opencl_knl_free;
-  bnd->sync      = opencl_sync;
-  bnd->finalize  = opencl_finalize;
+  // Buffers of CPU devices use the host memory directly. Set
+  // NOMP_OPENCL_ZERO_COPY to 0 or 1 to turn this off or to use it with other
+  // devices sharing the host memory (like integrated GPUs).
+  cl_device_type type;
+  check(clGetDeviceInfo(device, CL_DEVICE_TYPE, sizeof(type), &type, NULL),
+        "clGetDeviceInfo");
+  ocl->zero_copy     = (type & CL_DEVICE_TYPE_CPU) != 0;
+  const char *env_zc = getenv("NOMP_OPENCL_ZERO_COPY");
+  if (env_zc) ocl->zero_copy = nomp_str_toui(env_zc, NOMP_MAX_BUFFER_SIZE) > 0;
+  bnd->aliases_host = ocl->zero_copy;
+
+  // Work-groups are shared based on the measured throughput of the devices
+  // unless there are static weights.
+  unsigned nweights;
+  nomp_check(opencl_env_list(ocl->weights, &nweights, OPENCL_MAX_DEVICES,
+                             "NOMP_OPENCL_DEVICE_WEIGHTS"));
+  for (unsigned d = 0; d < nweights; d++) {
+    if (nweights != ocl->ndevices || ocl->weights[d] <= 0) {
+      return nomp_log(NOMP_USER_INPUT_IS_INVALID, NOMP_ERROR,
+                      "NOMP_OPENCL_DEVICE_WEIGHTS must have a positive "
+                      "weight for each of the %u devices.",
+                      ocl->ndevices);
+    }
+  }
+  ocl->balance = (nweights == 0);
+  ocl->profile = bnd->profile;
+
+  ocl->queues = nomp_calloc(cl_command_queue, ocl->ndevices);
+  for (unsigned d = 0; d < ocl->ndevices; d++)
+    nomp_check(opencl_create_queue(&ocl->queues[d], ocl, ocl->devices[d]));
+
+  bnd->bptr          = (void *)ocl;
+  bnd->update        = opencl_update;
+  bnd->knl_build     = opencl_knl_build;
+  bnd->knl_run       = opencl_knl_run;
+  bnd->knl_free      = opencl_knl_free;
+  bnd->sync          = opencl_sync;
+  bnd->create_queues = opencl_create_queues;
+  bnd->sync_queue    = opencl_sync_queue;
+  bnd->mem_wait      = opencl_mem_wait;
+  bnd->finalize      = opencl_finalize;
 
   return 0;
 }
 
+#undef opencl_device_queue
+#undef opencl_queue
+#undef OPENCL_MAX_DEVICES
 #undef check
@@ -8,6 +8,7 @@
 #define backendGetErrorName        TOKEN_PASTE(DRIVER, GetErrorName)
 #define backendMalloc              TOKEN_PASTE(DRIVER, Malloc)
 #define backendMemcpy              TOKEN_PASTE(DRIVER, Memcpy)
+#define backendMemcpyAsync         TOKEN_PASTE(DRIVER, MemcpyAsync)
 #define backendFree                TOKEN_PASTE(DRIVER, Free)
 #define backendMemcpyHostToDevice  TOKEN_PASTE(DRIVER, MemcpyHostToDevice)
 #define backendMemcpyDeviceToHost  TOKEN_PASTE(DRIVER, MemcpyDeviceToHost)
@@ -16,6 +17,34 @@
 #define backendSetDevice           TOKEN_PASTE(DRIVER, SetDevice)
 #define backendGetDeviceProperties TOKEN_PASTE(DRIVER, GetDeviceProperties)
 #define backendDriverGetVersion    TOKEN_PASTE(DRIVER, DriverGetVersion)
+#define backendStream_t            TOKEN_PASTE(DRIVER, Stream_t)
+#define backendStreamCreateWithFlags                                           \
+  TOKEN_PASTE(DRIVER, StreamCreateWithFlags)
+#define backendStreamNonBlocking   TOKEN_PASTE(DRIVER, StreamNonBlocking)
+#define backendStreamSynchronize   TOKEN_PASTE(DRIVER, StreamSynchronize)
+#define backendStreamDestroy       TOKEN_PASTE(DRIVER, StreamDestroy)
+#define backendStreamWaitEvent     TOKEN_PASTE(DRIVER, StreamWaitEvent)
+#define backendEvent_t             TOKEN_PASTE(DRIVER, Event_t)
+#define backendEventCreateWithFlags                                            \
+  TOKEN_PASTE(DRIVER, EventCreateWithFlags)
+#define backendEventDisableTiming  TOKEN_PASTE(DRIVER, EventDisableTiming)
+#define backendEventDefault        TOKEN_PASTE(DRIVER, EventDefault)
+#define backendEventRecord         TOKEN_PASTE(DRIVER, EventRecord)
+#define backendEventSynchronize    TOKEN_PASTE(DRIVER, EventSynchronize)
+#define backendEventQuery          TOKEN_PASTE(DRIVER, EventQuery)
+#define backendEventElapsedTime    TOKEN_PASTE(DRIVER, EventElapsedTime)
+#define backendEventDestroy        TOKEN_PASTE(DRIVER, EventDestroy)
+#define backendGraph_t             TOKEN_PASTE(DRIVER, Graph_t)
+#define backendGraphExec_t         TOKEN_PASTE(DRIVER, GraphExec_t)
+#define backendStreamBeginCapture  TOKEN_PASTE(DRIVER, StreamBeginCapture)
+#define backendStreamCaptureModeThreadLocal                                    \
+  TOKEN_PASTE(DRIVER, StreamCaptureModeThreadLocal)
+#define backendStreamEndCapture TOKEN_PASTE(DRIVER, StreamEndCapture)
+#define backendGraphInstantiateWithFlags                                       \
+  TOKEN_PASTE(DRIVER, GraphInstantiateWithFlags)
+#define backendGraphLaunch      TOKEN_PASTE(DRIVER, GraphLaunch)
+#define backendGraphExecDestroy TOKEN_PASTE(DRIVER, GraphExecDestroy)
+#define backendGraphDestroy     TOKEN_PASTE(DRIVER, GraphDestroy)
 
 #define backendrtcResult TOKEN_PASTE(RUNTIME_COMPILATION, Result)
 #define backendrtcGetErrorString                                               \
@@ -55,39 +84,162 @@
   check_error(call, backendrtcResult, RTC_SUCCESS, backendrtcGetErrorString,   \
               "runtime")
 
+// Events recorded before and after a kernel or a copy, the profiler entry its
+// device time is recorded in and the stream it ran on.
+#define backend_timing TOKEN_PASTE(DRIVER, _timing)
+struct backend_timing {
+  backendEvent_t start, end;
+  unsigned       entry, queue;
+};
+
 #define backend_t TOKEN_PASTE(DRIVER, _backend_t)
 struct backend_t {
   int                 device;
   backendDeviceProp_t prop;
+  // Stream 0 is the default (NULL) stream. Other streams don't synchronize
+  // with it.
+  backendStream_t *streams;
+  // Stream used only to capture graphs. Created the first time a graph is
+  // built.
+  backendStream_t capture;
+  // Kernels and copies which are not measured yet if the device time is
+  // recorded for the profiler.
+  struct backend_timing *timings;
+  unsigned               timings_n, timings_max;
+  // Event recorded (and waited for) at the host time `origin_time` when the
+  // first kernel or copy is timed. Device times are moved to the host clock
+  // relative to it.
+  backendEvent_t origin;
+  double         origin_time;
 };
 
+// Stream selected with nomp_set_queue().
+#define backend_stream(bnd)                                                    \
+  (((struct backend_t *)(bnd)->bptr)->streams[(bnd)->queue])
+
 #define backend_prog_t TOKEN_PASTE(DRIVER, _prog_t)
 struct backend_prog_t {
   backendModule   module;
   backendFunction kernel;
 };
 
-static int backend_update(nomp_backend_t *NOMP_UNUSED(bnd), nomp_mem_t *m,
+// Record the last work on the stream as the last work which used a memory
+// region. The event is created the first time and reused afterwards.
+static int backend_record(nomp_mem_t *m, backendStream_t stream) {
+  if (m->event == NULL) {
+    backendEvent_t event;
+    check_driver(
+        backendEventCreateWithFlags(&event, backendEventDisableTiming));
+    m->event = (void *)event;
+  }
+  check_driver(backendEventRecord((backendEvent_t)m->event, stream));
+  return 0;
+}
+
+// Record the device time of the completed kernels and copies (or of all of
+// them if \p wait is set) in the profiler. The others are kept.
+static int backend_timings_collect(struct backend_t *bptr, int wait) {
+  unsigned n = 0;
+  for (unsigned i = 0; i < bptr->timings_n; i++) {
+    struct backend_timing *t = &bptr->timings[i];
+    if (wait) {
+      check_driver(backendEventSynchronize(t->end));
+    } else if (backendEventQuery(t->end) != backendSuccess) {
+      bptr->timings[n++] = *t;
+      continue;
+    }
+
+    float start, end;
+    check_driver(backendEventElapsedTime(&start, bptr->origin, t->start));
+    check_driver(backendEventElapsedTime(&end, bptr->origin, t->end));
+    nomp_profile_device(t->entry, t->queue, bptr->origin_time + start,
+                        bptr->origin_time + end);
+    check_driver(backendEventDestroy(t->start));
+    check_driver(backendEventDestroy(t->end));
+  }
+  bptr->timings_n = n;
+
+  return 0;
+}
+
+// Start timing a kernel or a copy on the stream. Completed timings are
+// collected before growing the list.
+static int backend_timing_start(nomp_backend_t *bnd, backendStream_t stream,
+                                unsigned entry) {
+  struct backend_t *bptr = (struct backend_t *)bnd->bptr;
+  if (bptr->origin == NULL) {
+    check_driver(backendEventCreateWithFlags(&bptr->origin,
+                                             backendEventDefault));
+    check_driver(backendEventRecord(bptr->origin, stream));
+    check_driver(backendEventSynchronize(bptr->origin));
+    bptr->origin_time = nomp_profile_now();
+  }
+  if (bptr->timings_n == bptr->timings_max)
+    nomp_check(backend_timings_collect(bptr, 0));
+  if (bptr->timings_n == bptr->timings_max) {
+    bptr->timings_max += bptr->timings_max / 2 + 1;
+    bptr->timings =
+        nomp_realloc(bptr->timings, struct backend_timing, bptr->timings_max);
+  }
+
+  struct backend_timing *t = &bptr->timings[bptr->timings_n];
+  check_driver(backendEventCreateWithFlags(&t->start, backendEventDefault));
+  check_driver(backendEventCreateWithFlags(&t->end, backendEventDefault));
+  check_driver(backendEventRecord(t->start, stream));
+  t->entry = entry, t->queue = bnd->queue;
+
+  return 0;
+}
+
+static int backend_timing_end(nomp_backend_t *bnd, backendStream_t stream) {
+  struct backend_t      *bptr = (struct backend_t *)bnd->bptr;
+  struct backend_timing *t    = &bptr->timings[bptr->timings_n++];
+  check_driver(backendEventRecord(t->end, stream));
+  return 0;
+}
+
+static int backend_update(nomp_backend_t *bnd, nomp_mem_t *m,
                           const nomp_map_direction_t op, size_t start,
                           size_t end, size_t usize) {
   if (op & NOMP_ALLOC)
     check_driver(backendMalloc(&m->bptr, NOMP_MEM_BYTES(start, end, usize)));
 
+  // Copies are ordered with the other work on the selected stream and wait
+  // for the last work which used the memory region on other streams. They
+  // are blocking unless NOMP_ASYNC is given.
+  backendStream_t stream = backend_stream(bnd);
+  if (m->event && (op & (NOMP_TO | NOMP_FROM)))
+    check_driver(backendStreamWaitEvent(stream, (backendEvent_t)m->event, 0));
+  if (bnd->profile && (op & (NOMP_TO | NOMP_FROM))) {
+    nomp_check(backend_timing_start(
+        bnd, stream, nomp_profile_entry(NOMP_PROFILE_COPY(op))));
+  }
+
   if (op & NOMP_TO) {
-    check_driver(backendMemcpy(
+    check_driver(backendMemcpyAsync(
         (char *)(m->bptr) + NOMP_MEM_OFFSET(start - m->idx0, usize),
         (char *)(m->hptr) + NOMP_MEM_OFFSET(start, usize),
-        NOMP_MEM_BYTES(start, end, usize), backendMemcpyHostToDevice));
+        NOMP_MEM_BYTES(start, end, usize), backendMemcpyHostToDevice, stream));
   }
 
-  if (op == NOMP_FROM) {
-    check_driver(backendMemcpy(
+  if (op & NOMP_FROM) {
+    check_driver(backendMemcpyAsync(
         (char *)(m->hptr) + NOMP_MEM_OFFSET(start, usize),
         (char *)(m->bptr) + NOMP_MEM_OFFSET(start - m->idx0, usize),
-        NOMP_MEM_BYTES(start, end, usize), backendMemcpyDeviceToHost));
-  } else if (op == NOMP_FREE) {
+        NOMP_MEM_BYTES(start, end, usize), backendMemcpyDeviceToHost, stream));
+  } else if (op & NOMP_FREE) {
+    if (m->event) check_driver(backendEventDestroy((backendEvent_t)m->event));
     check_driver(backendFree(m->bptr));
-    m->bptr = NULL;
+    m->bptr = m->event = NULL;
+    return 0;
+  }
+
+  if (op & (NOMP_TO | NOMP_FROM)) {
+    if (bnd->profile) nomp_check(backend_timing_end(bnd, stream));
+    if (op & NOMP_ASYNC)
+      nomp_check(backend_record(m, stream));
+    else
+      check_driver(backendStreamSynchronize(stream));
   }
 
   return 0;
@@ -140,7 +292,7 @@ backend_rtc_error:
   return ret;
 }
 
-static int backend_knl_run(nomp_backend_t *NOMP_UNUSED(bnd), nomp_prog_t *prg) {
+static int backend_launch(nomp_prog_t *prg, backendStream_t stream) {
   nomp_arg_t *args = prg->args;
   void       *vargs[NOMP_MAX_KERNEL_ARGS_SIZE];
   for (unsigned i = 0; i < prg->nargs; i++) {
@@ -154,23 +306,128 @@ static int backend_knl_run(nomp_backend_t *NOMP_UNUSED(bnd), nomp_prog_t *prg) {
   struct backend_prog_t *bprg = (struct backend_prog_t *)prg->bptr;
   check_runtime(backendModuleLaunchKernel(bprg->kernel, global[0], global[1],
                                           global[2], local[0], local[1],
-                                          local[2], 0, NULL, vargs, NULL));
+                                          local[2], 0, stream, vargs, NULL));
+  return 0;
+}
+
+// Wait only for the pending work on the memory used by the kernel.
+static int backend_wait_args(nomp_prog_t *prg, backendStream_t stream) {
+  nomp_arg_t *args = prg->args;
+  for (unsigned i = 0; i < prg->nargs; i++) {
+    nomp_mem_t *m = args[i].mem;
+    if (m && m->event)
+      check_driver(backendStreamWaitEvent(stream, (backendEvent_t)m->event, 0));
+  }
+  return 0;
+}
+
+// Record the last work on the stream as the last work on all the memory used
+// by the kernel.
+static int backend_record_args(nomp_prog_t *prg, backendStream_t stream) {
+  nomp_arg_t *args = prg->args;
+  for (unsigned i = 0; i < prg->nargs; i++) {
+    if (args[i].mem) nomp_check(backend_record(args[i].mem, stream));
+  }
+  return 0;
+}
+
+static int backend_knl_run(nomp_backend_t *bnd, nomp_prog_t *prg) {
+  backendStream_t stream = backend_stream(bnd);
+  nomp_check(backend_wait_args(prg, stream));
+  if (bnd->profile)
+    nomp_check(backend_timing_start(bnd, stream, prg->profile_id));
+  nomp_check(backend_launch(prg, stream));
+  if (bnd->profile) nomp_check(backend_timing_end(bnd, stream));
+  nomp_check(backend_record_args(prg, stream));
+  return 0;
+}
+
+// Kernels are captured into a graph on a separate stream. The captured launch
+// parameters and arguments are fixed, so the graph is built again by the
+// caller when any of them changes.
+static int backend_graph_build(nomp_backend_t *bnd, void **graph,
+                               nomp_prog_t **prgs, unsigned n) {
+  struct backend_t *bptr = (struct backend_t *)bnd->bptr;
+  if (bptr->capture == NULL) {
+    check_driver(backendStreamCreateWithFlags(&bptr->capture,
+                                              backendStreamNonBlocking));
+  }
+
+  backendGraph_t g;
+  check_driver(backendStreamBeginCapture(bptr->capture,
+                                         backendStreamCaptureModeThreadLocal));
+  for (unsigned i = 0; i < n; i++)
+    nomp_check(backend_launch(prgs[i], bptr->capture));
+  check_driver(backendStreamEndCapture(bptr->capture, &g));
+
+  backendGraphExec_t exec;
+  check_driver(backendGraphInstantiateWithFlags(&exec, g, 0));
+  check_driver(backendGraphDestroy(g));
+  *graph = (void *)exec;
 
   return 0;
 }
 
+static int backend_graph_launch(nomp_backend_t *bnd, void *graph,
+                                nomp_prog_t **prgs, unsigned n) {
+  backendStream_t stream = backend_stream(bnd);
+  for (unsigned i = 0; i < n; i++)
+    nomp_check(backend_wait_args(prgs[i], stream));
+  check_driver(backendGraphLaunch((backendGraphExec_t)graph, stream));
+  for (unsigned i = 0; i < n; i++)
+    nomp_check(backend_record_args(prgs[i], stream));
+  return 0;
+}
+
+static int backend_graph_free(void *graph) {
+  check_driver(backendGraphExecDestroy((backendGraphExec_t)graph));
+  return 0;
+}
+
 static int backend_knl_free(nomp_prog_t *prg) {
   struct backend_prog_t *bprg = (struct backend_prog_t *)prg->bptr;
   if (bprg) check_runtime(backendModuleUnload(bprg->module));
+  nomp_free(&prg->bptr);
   return 0;
 }
 
-static int backend_sync(nomp_backend_t *NOMP_UNUSED(bnd)) {
+static int backend_sync(nomp_backend_t *bnd) {
   check_driver(backendDeviceSynchronize());
+  return backend_timings_collect((struct backend_t *)bnd->bptr, 1);
+}
+
+static int backend_mem_wait(nomp_backend_t *NOMP_UNUSED(bnd), nomp_mem_t *m) {
+  check_driver(backendEventSynchronize((backendEvent_t)m->event));
+  return 0;
+}
+
+static int backend_sync_queue(nomp_backend_t *bnd, unsigned queue) {
+  struct backend_t *bptr = (struct backend_t *)bnd->bptr;
+  check_driver(backendStreamSynchronize(bptr->streams[queue]));
+  return 0;
+}
+
+static int backend_create_queues(nomp_backend_t *bnd, unsigned n) {
+  struct backend_t *bptr = (struct backend_t *)bnd->bptr;
+  bptr->streams          = nomp_realloc(bptr->streams, backendStream_t, n);
+  for (unsigned i = bnd->nqueues; i < n; i++) {
+    check_driver(backendStreamCreateWithFlags(&bptr->streams[i],
+                                              backendStreamNonBlocking));
+  }
   return 0;
 }
 
 static int backend_finalize(nomp_backend_t *bnd) {
+  struct backend_t *bptr = (struct backend_t *)bnd->bptr;
+  if (bptr) {
+    nomp_check(backend_timings_collect(bptr, 1));
+    nomp_free(&bptr->timings);
+    if (bptr->origin) check_driver(backendEventDestroy(bptr->origin));
+    for (unsigned i = 1; i < bnd->nqueues; i++)
+      check_driver(backendStreamDestroy(bptr->streams[i]));
+    nomp_free(&bptr->streams);
+    if (bptr->capture) check_driver(backendStreamDestroy(bptr->capture));
+  }
   nomp_free(&bnd->bptr);
   return 0;
 }
@@ -234,22 +491,31 @@ int backend_init(nomp_backend_t *const backend, const int NOMP_UNUSED(platform),
 
   struct backend_t *bptr = nomp_calloc(struct backend_t, 1);
   bptr->device           = device;
+  bptr->streams          = nomp_calloc(backendStream_t, 1);
   check_driver(backendGetDeviceProperties(&bptr->prop, device));
 
-  backend->bptr      = (void *)bptr;
-  backend->update    = backend_update;
-  backend->knl_build = backend_knl_build;
-  backend->knl_run   = backend_knl_run;
-  backend->knl_free  = backend_knl_free;
-  backend->sync      = backend_sync;
-  backend->finalize  = backend_finalize;
+  backend->bptr          = (void *)bptr;
+  backend->update        = backend_update;
+  backend->knl_build     = backend_knl_build;
+  backend->knl_run       = backend_knl_run;
+  backend->knl_free      = backend_knl_free;
+  backend->sync          = backend_sync;
+  backend->create_queues = backend_create_queues;
+  backend->sync_queue    = backend_sync_queue;
+  backend->mem_wait      = backend_mem_wait;
+  backend->graph_build   = backend_graph_build;
+  backend->graph_launch  = backend_graph_launch;
+  backend->graph_free    = backend_graph_free;
+  backend->finalize      = backend_finalize;
 
   return 0;
 }
 
 #undef backend_init
+#undef backend_stream
 #undef backend_prog_t
 #undef backend_t
+#undef backend_timing
 
 #undef check_rtc
 #undef check_driver
@@ -271,6 +537,30 @@ int backend_init(nomp_backend_t *const backend, const int NOMP_UNUSED(platform),
 #undef backendrtcGetErrorString
 #undef backendrtcResult
 
+#undef backendGraphDestroy
+#undef backendGraphExecDestroy
+#undef backendGraphLaunch
+#undef backendGraphInstantiateWithFlags
+#undef backendStreamEndCapture
+#undef backendStreamCaptureModeThreadLocal
+#undef backendStreamBeginCapture
+#undef backendGraphExec_t
+#undef backendGraph_t
+#undef backendEventDestroy
+#undef backendEventElapsedTime
+#undef backendEventQuery
+#undef backendEventSynchronize
+#undef backendEventRecord
+#undef backendEventDefault
+#undef backendEventDisableTiming
+#undef backendEventCreateWithFlags
+#undef backendEvent_t
+#undef backendStreamWaitEvent
+#undef backendStreamDestroy
+#undef backendStreamSynchronize
+#undef backendStreamNonBlocking
+#undef backendStreamCreateWithFlags
+#undef backendStream_t
 #undef backendDriverGetVersion
 #undef backendGetDeviceProperties
 #undef backendSetDevice
@@ -279,6 +569,7 @@ int backend_init(nomp_backend_t *const backend, const int NOMP_UNUSED(platform),
 #undef backendMemcpyDeviceToHost
 #undef backendMemcpyHostToDevice
 #undef backendFree
+#undef backendMemcpyAsync
 #undef backendMemcpy
 #undef backendMalloc
 #undef backendGetErrorName
@@ -0,0 +1,61 @@
+#include "nomp-bench.h"
+
+#define BENCH_LAUNCHES 100
+#define BENCH_SIZE     256
+
+static const char *knl = "void foo(int *a, int N) {                      \n"
+                         "  for (int i = 0; i < N; i++)                  \n"
+                         "    a[i] += 1;                                 \n"
+                         "}                                              \n";
+
+// Time nomp_run() when N changes on every launch so the grid size has to be
+// evaluated again for each launch. The grid size is evaluated with SymEngine
+// (`grid:symengine`) if \p bytecode is "0" and with the bytecode generated at
+// JIT time (`grid:bytecode`) otherwise.
+static int bench_grid(int argc, const char **argv, const char *bytecode) {
+  setenv("NOMP_GRID_BYTECODE", bytecode, 1);
+  nomp_test_check(nomp_init(argc, argv));
+
+  int a[BENCH_SIZE] = {0}, n = BENCH_SIZE;
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_TO));
+
+  int         id         = -1;
+  const char *clauses[4] = {"transform", "nomp_bench", "tile", 0};
+  nomp_test_check(nomp_jit(&id, knl, clauses, 2, "a", sizeof(int), NOMP_PTR,
+                           "N", sizeof(int), NOMP_INT));
+  nomp_test_check(nomp_run(id, a, &n));
+  nomp_test_check(nomp_sync());
+
+  unsigned samples = nomp_bench_samples();
+  double   t[NOMP_BENCH_MAX_SAMPLES];
+  for (unsigned s = 0; s < samples; s++) {
+    double t0 = nomp_bench_time();
+    for (unsigned i = 0; i < BENCH_LAUNCHES; i++) {
+      n = BENCH_SIZE - i % 2;
+      nomp_test_check(nomp_run(id, a, &n));
+    }
+    t[s] = (nomp_bench_time() - t0) / BENCH_LAUNCHES;
+    nomp_test_check(nomp_sync());
+  }
+  nomp_bench_report(strcmp(bytecode, "0") ? "grid:bytecode" : "grid:symengine",
+                    BENCH_SIZE, t, samples, 0, NULL);
+
+  n = BENCH_SIZE;
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FREE));
+  nomp_test_check(nomp_finalize_excluding_interpreter());
+
+  return 0;
+}
+
+int main(int argc, const char *argv[]) {
+  nomp_test_check(nomp_bench_init("nomp-bench-grid"));
+
+  int err = 0;
+  err |= bench_grid(argc, argv, "0");
+  err |= bench_grid(argc, argv, "1");
+  unsetenv("NOMP_GRID_BYTECODE");
+
+  nomp_test_check(nomp_bench_finalize());
+
+  return err;
+}
@@ -0,0 +1,68 @@
+#include "nomp-bench.h"
+
+static const char *knl = "void foo(int *a, int N) {                      \n"
+                         "  for (int i = 0; i < N; i++)                  \n"
+                         "    a[i] += %u;                                \n"
+                         "}                                              \n";
+
+static int bench_jit_aux(const char *src) {
+  int         id         = -1;
+  const char *clauses[4] = {"transform", "nomp_bench", "tile", 0};
+  nomp_test_check(nomp_jit(&id, src, clauses, 2, "a", sizeof(int), NOMP_PTR,
+                           "N", sizeof(int), NOMP_INT));
+  return 0;
+}
+
+// Time nomp_jit(). `jit:cold` generates a new kernel every time (the source
+// differs by a constant) and runs the full pipeline: loopy, the transform
+// script and the backend compiler. `jit:warm` generates the same kernel
+// again, which is served from the kernel cache. The Python modules are
+// imported by the first kernel, before timing.
+static int bench_jit(void) {
+  char     src[NOMP_TEST_MAX_BUFFER_SIZE + 1];
+  unsigned samples = nomp_bench_samples(), k = 0;
+  double   t[NOMP_BENCH_MAX_SAMPLES];
+
+  snprintf(src, NOMP_TEST_MAX_BUFFER_SIZE, knl, k++);
+  nomp_test_check(bench_jit_aux(src));
+
+  for (unsigned s = 0; s < samples; s++) {
+    snprintf(src, NOMP_TEST_MAX_BUFFER_SIZE, knl, k++);
+    double t0 = nomp_bench_time();
+    nomp_test_check(bench_jit_aux(src));
+    t[s] = nomp_bench_time() - t0;
+  }
+  nomp_bench_report("jit:cold", 0, t, samples, 0, NULL);
+
+  unsigned hits0, hits1;
+  nomp_test_check(nomp_get_cache_stats(&hits0, NULL));
+  for (unsigned s = 0; s < samples; s++) {
+    double t0 = nomp_bench_time();
+    nomp_test_check(bench_jit_aux(src));
+    t[s] = nomp_bench_time() - t0;
+  }
+  nomp_test_check(nomp_get_cache_stats(&hits1, NULL));
+  nomp_test_assert(hits1 - hits0 == samples);
+  nomp_bench_report("jit:warm", 0, t, samples, 0, NULL);
+
+  return 0;
+}
+
+// The kernel cache is enabled with an empty directory so the first kernel
+// of each source is a miss.
+int main(int argc, const char *argv[]) {
+  char cache_dir[] = "/tmp/nomp-bench-jit-XXXXXX";
+  nomp_test_assert(mkdtemp(cache_dir));
+  setenv("NOMP_CACHE_DIR", cache_dir, 1);
+
+  nomp_test_check(nomp_init(argc, argv));
+  nomp_test_check(nomp_bench_init("nomp-bench-jit"));
+
+  int err = bench_jit();
+
+  nomp_test_check(nomp_bench_finalize());
+  nomp_test_check(nomp_finalize());
+  unsetenv("NOMP_CACHE_DIR");
+
+  return err;
+}
@@ -0,0 +1,171 @@
+#include "nomp-bench.h"
+
+#define BENCH_AXPY_SIZE (1 << 24)
+#define BENCH_MXM_SIZE  512
+#define BENCH_SEM_ORDER 8
+#define BENCH_SEM_SIZE  4096
+
+static const char *axpy =
+    "void axpy(double *y, double *x, double a, int N) {                  \n"
+    "  for (int i = 0; i < N; i++)                                       \n"
+    "    y[i] += a * x[i];                                               \n"
+    "}                                                                   \n";
+
+static const char *mxm =
+    "void mxm(double *a, double *b, double *c, int N) {                  \n"
+    "  for (int i = 0; i < N; i++) {                                     \n"
+    "    for (int j = 0; j < N; j++) {                                   \n"
+    "      double dot = 0;                                               \n"
+    "      for (int k = 0; k < N; k++)                                   \n"
+    "        dot += a[i * N + k] * b[k * N + j];                         \n"
+    "      c[i * N + j] = dot;                                           \n"
+    "    }                                                               \n"
+    "  }                                                                 \n"
+    "}                                                                   \n";
+
+// Local gradient of the spectral element Ax kernel (with 8 points in each
+// direction) scaled by the geometric factors. Elements are mapped to
+// work-groups by the annotations in tests/sem.py.
+static const char *sem =
+    "void sem(double *w, double *u, double *g, double *D, int E) {       \n"
+    "  for (int e = 0; e < E; e++) {                                     \n"
+    "    for (int k = 0; k < 8; k++) {                                   \n"
+    "      for (int j = 0; j < 8; j++) {                                 \n"
+    "        for (int i = 0; i < 8; i++) {                               \n"
+    "          double ur = 0;                                            \n"
+    "          double us = 0;                                            \n"
+    "          double ut = 0;                                            \n"
+    "          for (int l = 0; l < 8; l++) {                             \n"
+    "            ur += D[i * 8 + l] * u[e * 512 + k * 64 + j * 8 + l];   \n"
+    "            us += D[j * 8 + l] * u[e * 512 + k * 64 + l * 8 + i];   \n"
+    "            ut += D[k * 8 + l] * u[e * 512 + l * 64 + j * 8 + i];   \n"
+    "          }                                                         \n"
+    "          w[e * 512 + k * 64 + j * 8 + i] =                         \n"
+    "              g[3 * (e * 512 + k * 64 + j * 8 + i)] * ur +          \n"
+    "              g[3 * (e * 512 + k * 64 + j * 8 + i) + 1] * us +      \n"
+    "              g[3 * (e * 512 + k * 64 + j * 8 + i) + 2] * ut;       \n"
+    "        }                                                           \n"
+    "      }                                                             \n"
+    "    }                                                               \n"
+    "  }                                                                 \n"
+    "}                                                                   \n";
+
+// Time a kernel launched with nomp_run(__VA_ARGS__) followed by nomp_sync().
+#define bench_kernel(name, size, work, unit, ...)                              \
+  {                                                                            \
+    nomp_test_check(nomp_run(__VA_ARGS__));                                    \
+    nomp_test_check(nomp_sync());                                              \
+    unsigned samples_ = nomp_bench_samples();                                  \
+    double   t_[NOMP_BENCH_MAX_SAMPLES];                                       \
+    for (unsigned s_ = 0; s_ < samples_; s_++) {                               \
+      double t0_ = nomp_bench_time();                                          \
+      nomp_test_check(nomp_run(__VA_ARGS__));                                  \
+      nomp_test_check(nomp_sync());                                            \
+      t_[s_] = nomp_bench_time() - t0_;                                        \
+    }                                                                          \
+    nomp_bench_report(name, size, t_, samples_, work, unit);                   \
+  }
+
+// Streams 3 doubles per element.
+static int bench_axpy(void) {
+  int     n = BENCH_AXPY_SIZE;
+  double *x = nomp_calloc(double, n), *y = nomp_calloc(double, n);
+  double  a = 2;
+  nomp_test_check(nomp_update(x, 0, n, sizeof(double), NOMP_TO));
+  nomp_test_check(nomp_update(y, 0, n, sizeof(double), NOMP_TO));
+
+  int         id         = -1;
+  const char *clauses[4] = {"transform", "nomp_bench", "tile", 0};
+  nomp_test_check(nomp_jit(&id, axpy, clauses, 4, "y", sizeof(double),
+                           NOMP_PTR, "x", sizeof(double), NOMP_PTR, "a",
+                           sizeof(double), NOMP_FLOAT, "N", sizeof(int),
+                           NOMP_INT));
+
+  bench_kernel("kernel:axpy", n, 3.0 * n * sizeof(double), "GB/s", id, y, x,
+               &a, &n);
+
+  nomp_test_check(nomp_update(x, 0, n, sizeof(double), NOMP_FREE));
+  nomp_test_check(nomp_update(y, 0, n, sizeof(double), NOMP_FREE));
+  nomp_free(&x), nomp_free(&y);
+
+  return 0;
+}
+
+static int bench_mxm(void) {
+  int     n = BENCH_MXM_SIZE;
+  double *a = nomp_calloc(double, n * n), *b = nomp_calloc(double, n * n);
+  double *c = nomp_calloc(double, n * n);
+  nomp_test_check(nomp_update(a, 0, n * n, sizeof(double), NOMP_TO));
+  nomp_test_check(nomp_update(b, 0, n * n, sizeof(double), NOMP_TO));
+  nomp_test_check(nomp_update(c, 0, n * n, sizeof(double), NOMP_ALLOC));
+
+  int         id         = -1;
+  const char *clauses[4] = {"transform", "nomp_bench", "mxm", 0};
+  nomp_test_check(nomp_jit(&id, mxm, clauses, 4, "a", sizeof(double),
+                           NOMP_PTR, "b", sizeof(double), NOMP_PTR, "c",
+                           sizeof(double), NOMP_PTR, "N", sizeof(int),
+                           NOMP_INT));
+
+  bench_kernel("kernel:mxm", n, 2.0 * n * n * n, "GFLOP/s", id, a, b, c, &n);
+
+  nomp_test_check(nomp_update(a, 0, n * n, sizeof(double), NOMP_FREE));
+  nomp_test_check(nomp_update(b, 0, n * n, sizeof(double), NOMP_FREE));
+  nomp_test_check(nomp_update(c, 0, n * n, sizeof(double), NOMP_FREE));
+  nomp_free(&a), nomp_free(&b), nomp_free(&c);
+
+  return 0;
+}
+
+// Each point does 3 dot products of length 8 and the scaling by the
+// geometric factors.
+static int bench_sem(void) {
+  const unsigned p   = BENCH_SEM_ORDER;
+  int            e   = BENCH_SEM_SIZE;
+  size_t         dof = (size_t)e * p * p * p;
+  double        *w   = nomp_calloc(double, dof);
+  double        *u   = nomp_calloc(double, dof);
+  double        *g   = nomp_calloc(double, 3 * dof);
+
+  double D[BENCH_SEM_ORDER * BENCH_SEM_ORDER] = {0};
+  nomp_test_check(nomp_update(w, 0, dof, sizeof(double), NOMP_ALLOC));
+  nomp_test_check(nomp_update(u, 0, dof, sizeof(double), NOMP_TO));
+  nomp_test_check(nomp_update(g, 0, 3 * dof, sizeof(double), NOMP_TO));
+  nomp_test_check(nomp_update(D, 0, p * p, sizeof(double), NOMP_TO));
+
+  int         id         = -1;
+  const char *clauses[4] = {"annotate", "element_loop", "e", 0};
+  nomp_test_check(nomp_jit(&id, sem, clauses, 5, "w", sizeof(double),
+                           NOMP_PTR, "u", sizeof(double), NOMP_PTR, "g",
+                           sizeof(double), NOMP_PTR, "D", sizeof(double),
+                           NOMP_PTR, "E", sizeof(int), NOMP_INT));
+
+  bench_kernel("kernel:sem", e, (6.0 * p + 5) * dof, "GFLOP/s", id, w, u, g, D,
+               &e);
+
+  nomp_test_check(nomp_update(w, 0, dof, sizeof(double), NOMP_FREE));
+  nomp_test_check(nomp_update(u, 0, dof, sizeof(double), NOMP_FREE));
+  nomp_test_check(nomp_update(g, 0, 3 * dof, sizeof(double), NOMP_FREE));
+  nomp_test_check(nomp_update(D, 0, p * p, sizeof(double), NOMP_FREE));
+  nomp_free(&w), nomp_free(&u), nomp_free(&g);
+
+  return 0;
+}
+
+#undef bench_kernel
+
+// The SEM kernel needs the annotations script in tests/sem.py which is
+// passed with `--nomp-annotations-script sem` by `lnrun --bench`.
+int main(int argc, const char *argv[]) {
+  nomp_test_check(nomp_init(argc, argv));
+  nomp_test_check(nomp_bench_init("nomp-bench-kernels"));
+
+  int err = 0;
+  err |= bench_axpy();
+  err |= bench_mxm();
+  err |= bench_sem();
+
+  nomp_test_check(nomp_bench_finalize());
+  nomp_test_check(nomp_finalize());
+
+  return err;
+}
@@ -0,0 +1,93 @@
+#include "nomp-bench.h"
+
+#define BENCH_LAUNCHES 100
+
+static const char *empty = "void empty(int *a, int N) {                  \n"
+                           "  for (int i = 0; i < N; i++)                \n"
+                           "    a[i] = i;                                \n"
+                           "}                                            \n";
+
+// Time nomp_run() of a kernel which does (almost) no work. `run:enqueue` is
+// the time nomp_run() takes to return, averaged over a batch of launches,
+// `run:batch` is the time per launch of a batch followed by a single
+// nomp_sync() and `run:sync` is the time of a launch followed by nomp_sync(),
+// i.e., the round trip to the device. `run_v:enqueue` and `launch:enqueue`
+// are the same as `run:enqueue` with nomp_run_v() and with a binding created
+// by nomp_bind().
+static int bench_launch(void) {
+  int a[1] = {0}, n = 1;
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_TO));
+
+  int         id         = -1;
+  const char *clauses[4] = {"transform", "nomp_bench", "tile", 0};
+  nomp_test_check(nomp_jit(&id, empty, clauses, 2, "a", sizeof(int), NOMP_PTR,
+                           "N", sizeof(int), NOMP_INT));
+  nomp_test_check(nomp_run(id, a, &n));
+  nomp_test_check(nomp_sync());
+
+  unsigned samples = nomp_bench_samples();
+  double   t[NOMP_BENCH_MAX_SAMPLES];
+  for (unsigned s = 0; s < samples; s++) {
+    double t0 = nomp_bench_time();
+    for (unsigned i = 0; i < BENCH_LAUNCHES; i++)
+      nomp_test_check(nomp_run(id, a, &n));
+    t[s] = (nomp_bench_time() - t0) / BENCH_LAUNCHES;
+    nomp_test_check(nomp_sync());
+  }
+  nomp_bench_report("run:enqueue", 0, t, samples, 0, NULL);
+
+  for (unsigned s = 0; s < samples; s++) {
+    double t0 = nomp_bench_time();
+    for (unsigned i = 0; i < BENCH_LAUNCHES; i++)
+      nomp_test_check(nomp_run(id, a, &n));
+    nomp_test_check(nomp_sync());
+    t[s] = (nomp_bench_time() - t0) / BENCH_LAUNCHES;
+  }
+  nomp_bench_report("run:batch", 0, t, samples, 0, NULL);
+
+  for (unsigned s = 0; s < samples; s++) {
+    double t0 = nomp_bench_time();
+    nomp_test_check(nomp_run(id, a, &n));
+    nomp_test_check(nomp_sync());
+    t[s] = nomp_bench_time() - t0;
+  }
+  nomp_bench_report("run:sync", 0, t, samples, 0, NULL);
+
+  void *args[2] = {a, &n};
+  for (unsigned s = 0; s < samples; s++) {
+    double t0 = nomp_bench_time();
+    for (unsigned i = 0; i < BENCH_LAUNCHES; i++)
+      nomp_test_check(nomp_run_v(id, args));
+    t[s] = (nomp_bench_time() - t0) / BENCH_LAUNCHES;
+    nomp_test_check(nomp_sync());
+  }
+  nomp_bench_report("run_v:enqueue", 0, t, samples, 0, NULL);
+
+  int handle;
+  nomp_test_check(nomp_bind(&handle, id, args));
+  for (unsigned s = 0; s < samples; s++) {
+    double t0 = nomp_bench_time();
+    for (unsigned i = 0; i < BENCH_LAUNCHES; i++)
+      nomp_test_check(nomp_launch(handle));
+    t[s] = (nomp_bench_time() - t0) / BENCH_LAUNCHES;
+    nomp_test_check(nomp_sync());
+  }
+  nomp_bench_report("launch:enqueue", 0, t, samples, 0, NULL);
+  nomp_test_check(nomp_unbind(handle));
+
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FREE));
+
+  return 0;
+}
+
+int main(int argc, const char *argv[]) {
+  nomp_test_check(nomp_init(argc, argv));
+  nomp_test_check(nomp_bench_init("nomp-bench-launch"));
+
+  int err = bench_launch();
+
+  nomp_test_check(nomp_bench_finalize());
+  nomp_test_check(nomp_finalize());
+
+  return err;
+}
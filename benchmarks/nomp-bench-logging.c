@@ -0,0 +1,73 @@
+#include "nomp-bench.h"
+#include <unistd.h>
+
+#define BENCH_CALLS 100
+#define BENCH_SIZE  16
+
+static const char *knl = "void foo(int *a, int N) {                      \n"
+                         "  for (int i = 0; i < N; i++)                  \n"
+                         "    a[i] += 1;                                 \n"
+                         "}                                              \n";
+
+// Time nomp_run() (`logging:run`) and nomp_update() (`logging:update`) with
+// the verbose level \p verbose. With verbose level 0, info logs on the hot
+// path must not be formatted at all (or not even compiled in if libnomp was
+// configured with NOMP_LOG_LEVEL below 3). Logs printed with a higher verbose
+// level are sent to /dev/null.
+static int bench_logging(int argc, const char **argv, const char *verbose) {
+  setenv("NOMP_VERBOSE", verbose, 1);
+  nomp_test_check(nomp_init(argc, argv));
+
+  int a[BENCH_SIZE] = {0}, n = BENCH_SIZE;
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_TO));
+
+  int         id         = -1;
+  const char *clauses[4] = {"transform", "nomp_bench", "tile", 0};
+  nomp_test_check(nomp_jit(&id, knl, clauses, 2, "a", sizeof(int), NOMP_PTR,
+                           "N", sizeof(int), NOMP_INT));
+  nomp_test_check(nomp_sync());
+
+  int stderr_fd = dup(fileno(stderr));
+  nomp_test_assert(freopen("/dev/null", "w", stderr));
+
+  unsigned samples = nomp_bench_samples();
+  double   t_run[NOMP_BENCH_MAX_SAMPLES], t_update[NOMP_BENCH_MAX_SAMPLES];
+  for (unsigned s = 0; s < samples; s++) {
+    double t0 = nomp_bench_time();
+    for (unsigned i = 0; i < BENCH_CALLS; i++)
+      nomp_test_check(nomp_run(id, a, &n));
+    t_run[s] = (nomp_bench_time() - t0) / BENCH_CALLS;
+    nomp_test_check(nomp_sync());
+
+    t0 = nomp_bench_time();
+    for (unsigned i = 0; i < BENCH_CALLS; i++)
+      nomp_test_check(nomp_update(a, 0, 1, sizeof(int), NOMP_TO));
+    t_update[s] = (nomp_bench_time() - t0) / BENCH_CALLS;
+  }
+
+  fflush(stderr), dup2(stderr_fd, fileno(stderr)), close(stderr_fd);
+
+  char name[BUFSIZ];
+  snprintf(name, BUFSIZ, "logging:run:verbose=%s", verbose);
+  nomp_bench_report(name, 0, t_run, samples, 0, NULL);
+  snprintf(name, BUFSIZ, "logging:update:verbose=%s", verbose);
+  nomp_bench_report(name, 0, t_update, samples, 0, NULL);
+
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FREE));
+  nomp_test_check(nomp_finalize_excluding_interpreter());
+
+  return 0;
+}
+
+int main(int argc, const char *argv[]) {
+  nomp_test_check(nomp_bench_init("nomp-bench-logging"));
+
+  int err = 0;
+  err |= bench_logging(argc, argv, "0");
+  err |= bench_logging(argc, argv, "3");
+  unsetenv("NOMP_VERBOSE");
+
+  nomp_test_check(nomp_bench_finalize());
+
+  return err;
+}
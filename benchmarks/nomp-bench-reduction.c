@@ -0,0 +1,58 @@
+#include "nomp-bench.h"
+
+#define BENCH_MIN_SIZE (1UL << 12)
+#define BENCH_MAX_SIZE (1UL << 24)
+
+static const char *sum = "void sum(double *a, int N, double *s) {        \n"
+                         "  for (int i = 0; i < N; i++)                  \n"
+                         "    s[0] += a[i];                              \n"
+                         "}                                              \n";
+
+// Time a sum reduction of \p n doubles which are already on the device.
+// nomp_run() returns after the result is copied back to the host, so each
+// sample includes both stages of the reduction and the copy.
+static int bench_reduction(int id, double *a, int n) {
+  nomp_test_check(nomp_update(a, 0, n, sizeof(double), NOMP_TO));
+
+  double s = 0;
+  nomp_test_check(nomp_run(id, a, &n, &s));
+  nomp_test_assert(s == n);
+
+  unsigned samples = nomp_bench_samples();
+  double   t[NOMP_BENCH_MAX_SAMPLES];
+  for (unsigned i = 0; i < samples; i++) {
+    double t0 = nomp_bench_time();
+    nomp_test_check(nomp_run(id, a, &n, &s));
+    t[i] = nomp_bench_time() - t0;
+  }
+  nomp_bench_report("reduction:sum", n, t, samples, n * sizeof(double),
+                    "GB/s");
+
+  nomp_test_check(nomp_update(a, 0, n, sizeof(double), NOMP_FREE));
+
+  return 0;
+}
+
+int main(int argc, const char *argv[]) {
+  nomp_test_check(nomp_init(argc, argv));
+  nomp_test_check(nomp_bench_init("nomp-bench-reduction"));
+
+  int         id         = -1;
+  const char *clauses[4] = {"reduce", "s", "+", 0};
+  nomp_test_check(nomp_jit(&id, sum, clauses, 3, "a", sizeof(double),
+                           NOMP_PTR, "N", sizeof(int), NOMP_INT, "s",
+                           sizeof(double), NOMP_FLOAT));
+
+  int     err = 0;
+  double *a   = nomp_calloc(double, BENCH_MAX_SIZE);
+  for (size_t i = 0; i < BENCH_MAX_SIZE; i++)
+    a[i] = 1;
+  for (size_t n = BENCH_MIN_SIZE; n <= BENCH_MAX_SIZE && !err; n *= 4)
+    err = bench_reduction(id, a, n);
+  nomp_free(&a);
+
+  nomp_test_check(nomp_bench_finalize());
+  nomp_test_check(nomp_finalize());
+
+  return err;
+}
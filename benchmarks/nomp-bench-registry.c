@@ -0,0 +1,48 @@
+#include "nomp-bench.h"
+
+#define BENCH_MAX_BUFFERS 10000
+#define BENCH_UPDATES     100
+
+// Time the lookup done by nomp_update() for an already mapped buffer when
+// there are \p n buffers mapped to the device. `registry:first` and
+// `registry:last` update the first and the last mapped buffer. With the
+// hashed registry neither should depend on \p n.
+static int bench_registry(int *bufs, unsigned n) {
+  for (unsigned i = 0; i < n; i++)
+    nomp_test_check(nomp_update(&bufs[i], 0, 1, sizeof(int), NOMP_TO));
+
+  int        *ptrs[2]  = {&bufs[0], &bufs[n - 1]};
+  const char *names[2] = {"registry:first", "registry:last"};
+  unsigned    samples  = nomp_bench_samples();
+  double      t[NOMP_BENCH_MAX_SAMPLES];
+  for (unsigned j = 0; j < 2; j++) {
+    for (unsigned s = 0; s < samples; s++) {
+      double t0 = nomp_bench_time();
+      for (unsigned k = 0; k < BENCH_UPDATES; k++)
+        nomp_test_check(nomp_update(ptrs[j], 0, 1, sizeof(int), NOMP_TO));
+      t[s] = (nomp_bench_time() - t0) / BENCH_UPDATES;
+    }
+    nomp_bench_report(names[j], n, t, samples, 0, NULL);
+  }
+
+  for (unsigned i = 0; i < n; i++)
+    nomp_test_check(nomp_update(&bufs[i], 0, 1, sizeof(int), NOMP_FREE));
+
+  return 0;
+}
+
+int main(int argc, const char *argv[]) {
+  nomp_test_check(nomp_init(argc, argv));
+  nomp_test_check(nomp_bench_init("nomp-bench-registry"));
+
+  int  err  = 0;
+  int *bufs = nomp_calloc(int, BENCH_MAX_BUFFERS);
+  for (unsigned n = 10; n <= BENCH_MAX_BUFFERS && !err; n *= 10)
+    err = bench_registry(bufs, n);
+  nomp_free(&bufs);
+
+  nomp_test_check(nomp_bench_finalize());
+  nomp_test_check(nomp_finalize());
+
+  return err;
+}
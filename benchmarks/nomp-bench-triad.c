@@ -0,0 +1,84 @@
+#include "nomp-bench.h"
+
+#define BENCH_SIZE (1 << 22)
+
+static const char *knl =
+    "void triad(double *a, double *b, double *c, double s, int N) {  \n"
+    "  for (int i = 0; i < N; i++)                                   \n"
+    "    a[i] = b[i] + s * c[i];                                     \n"
+    "}                                                               \n";
+
+// STREAM triad through nomp_run(). `triad:kernel` is the kernel alone and
+// `triad:step` is a full step which copies the inputs to the device and the
+// result back. With zero-copy (\p zero_copy is "1"), OpenCL buffers of CPU
+// devices use the host memory and the copies don't move any data.
+static int bench_triad(int argc, const char **argv, const char *zero_copy) {
+  setenv("NOMP_OPENCL_ZERO_COPY", zero_copy, 1);
+  nomp_test_check(nomp_init(argc, argv));
+
+  int     n = BENCH_SIZE;
+  double *a = nomp_calloc(double, n), *b = nomp_calloc(double, n),
+         *c = nomp_calloc(double, n), s = 3;
+  for (int i = 0; i < n; i++)
+    b[i] = 1, c[i] = 2;
+
+  nomp_test_check(nomp_update(a, 0, n, sizeof(double), NOMP_ALLOC));
+  nomp_test_check(nomp_update(b, 0, n, sizeof(double), NOMP_TO));
+  nomp_test_check(nomp_update(c, 0, n, sizeof(double), NOMP_TO));
+
+  int         id         = -1;
+  const char *clauses[4] = {"transform", "nomp_bench", "tile", 0};
+  nomp_test_check(nomp_jit(&id, knl, clauses, 5, "a", sizeof(double), NOMP_PTR,
+                           "b", sizeof(double), NOMP_PTR, "c", sizeof(double),
+                           NOMP_PTR, "s", sizeof(double), NOMP_FLOAT, "N",
+                           sizeof(int), NOMP_INT));
+  nomp_test_check(nomp_run(id, a, b, c, &s, &n));
+  nomp_test_check(nomp_sync());
+
+  unsigned samples = nomp_bench_samples();
+  double   t[NOMP_BENCH_MAX_SAMPLES], bytes = 3.0 * n * sizeof(double);
+  char     name[BUFSIZ];
+  for (unsigned i = 0; i < samples; i++) {
+    double t0 = nomp_bench_time();
+    nomp_test_check(nomp_run(id, a, b, c, &s, &n));
+    nomp_test_check(nomp_sync());
+    t[i] = nomp_bench_time() - t0;
+  }
+  snprintf(name, BUFSIZ, "triad:kernel:zero-copy=%s", zero_copy);
+  nomp_bench_report(name, n, t, samples, bytes, "GB/s");
+
+  for (unsigned i = 0; i < samples; i++) {
+    double t0 = nomp_bench_time();
+    nomp_test_check(nomp_update(b, 0, n, sizeof(double), NOMP_TO));
+    nomp_test_check(nomp_update(c, 0, n, sizeof(double), NOMP_TO));
+    nomp_test_check(nomp_run(id, a, b, c, &s, &n));
+    nomp_test_check(nomp_update(a, 0, n, sizeof(double), NOMP_FROM));
+    t[i] = nomp_bench_time() - t0;
+  }
+  snprintf(name, BUFSIZ, "triad:step:zero-copy=%s", zero_copy);
+  nomp_bench_report(name, n, t, samples, bytes, "GB/s");
+
+  nomp_test_check(nomp_update(a, 0, n, sizeof(double), NOMP_FREE));
+  nomp_test_check(nomp_update(b, 0, n, sizeof(double), NOMP_FREE));
+  nomp_test_check(nomp_update(c, 0, n, sizeof(double), NOMP_FREE));
+  nomp_test_check(nomp_finalize_excluding_interpreter());
+
+  for (int i = 0; i < n; i++)
+    nomp_test_assert(a[i] == 7);
+  nomp_free(&a), nomp_free(&b), nomp_free(&c);
+
+  return 0;
+}
+
+int main(int argc, const char *argv[]) {
+  nomp_test_check(nomp_bench_init("nomp-bench-triad"));
+
+  int err = 0;
+  err |= bench_triad(argc, argv, "0");
+  err |= bench_triad(argc, argv, "1");
+  unsetenv("NOMP_OPENCL_ZERO_COPY");
+
+  nomp_test_check(nomp_bench_finalize());
+
+  return err;
+}
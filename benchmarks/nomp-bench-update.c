@@ -0,0 +1,49 @@
+#include "nomp-bench.h"
+
+#define BENCH_MIN_SIZE (1UL << 10)
+#define BENCH_MAX_SIZE (1UL << 26)
+
+// Time blocking host to device (`update:to`) and device to host
+// (`update:from`) copies of \p size bytes. The memory is allocated on the
+// device before timing so only the copies are measured.
+static int bench_update(char *buf, size_t size) {
+  nomp_test_check(nomp_update(buf, 0, size, 1, NOMP_ALLOC));
+
+  unsigned samples = nomp_bench_samples();
+  double   t[NOMP_BENCH_MAX_SAMPLES];
+  nomp_test_check(nomp_update(buf, 0, size, 1, NOMP_TO));
+  for (unsigned s = 0; s < samples; s++) {
+    double t0 = nomp_bench_time();
+    nomp_test_check(nomp_update(buf, 0, size, 1, NOMP_TO));
+    t[s] = nomp_bench_time() - t0;
+  }
+  nomp_bench_report("update:to", size, t, samples, size, "GB/s");
+
+  nomp_test_check(nomp_update(buf, 0, size, 1, NOMP_FROM));
+  for (unsigned s = 0; s < samples; s++) {
+    double t0 = nomp_bench_time();
+    nomp_test_check(nomp_update(buf, 0, size, 1, NOMP_FROM));
+    t[s] = nomp_bench_time() - t0;
+  }
+  nomp_bench_report("update:from", size, t, samples, size, "GB/s");
+
+  nomp_test_check(nomp_update(buf, 0, size, 1, NOMP_FREE));
+
+  return 0;
+}
+
+int main(int argc, const char *argv[]) {
+  nomp_test_check(nomp_init(argc, argv));
+  nomp_test_check(nomp_bench_init("nomp-bench-update"));
+
+  int   err = 0;
+  char *buf = nomp_calloc(char, BENCH_MAX_SIZE);
+  for (size_t size = BENCH_MIN_SIZE; size <= BENCH_MAX_SIZE && !err; size *= 4)
+    err = bench_update(buf, size);
+  nomp_free(&buf);
+
+  nomp_test_check(nomp_bench_finalize());
+  nomp_test_check(nomp_finalize());
+
+  return err;
+}
@@ -0,0 +1,92 @@
+#if !defined(_NOMP_BENCH_H_)
+#define _NOMP_BENCH_H_
+
+#include "nomp-test.h"
+#include <time.h>
+
+#define NOMP_BENCH_MAX_SAMPLES     1000
+#define NOMP_BENCH_DEFAULT_SAMPLES 20
+
+// Results of a benchmark are written as a single JSON object to the file set
+// with NOMP_BENCH_OUTPUT (or to stdout if it is not set):
+//
+//   {"benchmark": "nomp-bench-update", "results": [
+//     {"name": "update:to", "size": 1024, "samples": 20, "min": ...,
+//      "median": ..., "mean": ..., "stddev": ..., "max": ...,
+//      "throughput": ..., "throughput_unit": "GB/s"}, ...]}
+//
+// Times are in seconds. `lnrun --bench` collects the objects of all the
+// benchmarks in a single file so runs of different commits can be compared.
+static FILE    *bench_fp      = NULL;
+static unsigned bench_results = 0;
+static unsigned bench_samples = NOMP_BENCH_DEFAULT_SAMPLES;
+
+inline static double nomp_bench_time(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+// Number of timed samples of each measurement. Set with NOMP_BENCH_SAMPLES.
+inline static unsigned nomp_bench_samples(void) { return bench_samples; }
+
+inline static int nomp_bench_init(const char *name) {
+  const char *samples = getenv("NOMP_BENCH_SAMPLES");
+  if (samples) {
+    int n = atoi(samples);
+    nomp_test_assert(n > 0 && n <= NOMP_BENCH_MAX_SAMPLES);
+    bench_samples = n;
+  }
+
+  const char *output = getenv("NOMP_BENCH_OUTPUT");
+  bench_fp           = output ? fopen(output, "w") : stdout;
+  nomp_test_assert(bench_fp != NULL);
+  fprintf(bench_fp, "{\"benchmark\": \"%s\", \"results\": [", name);
+  bench_results = 0;
+
+  return 0;
+}
+
+inline static int nomp_bench_compare(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// Write the statistics of \p n timed samples of a measurement. \p work is the
+// amount of work done by a sample in the units of \p unit times 1e9 (bytes
+// for "GB/s" and floating point operations for "GFLOP/s"). The throughput is
+// computed from the median and omitted if \p unit is NULL.
+inline static void nomp_bench_report(const char *name, size_t size,
+                                     double *samples, unsigned n, double work,
+                                     const char *unit) {
+  qsort(samples, n, sizeof(double), nomp_bench_compare);
+  double median = (samples[(n - 1) / 2] + samples[n / 2]) / 2, mean = 0;
+  for (unsigned i = 0; i < n; i++)
+    mean += samples[i];
+  mean /= n;
+  double var = 0;
+  for (unsigned i = 0; i < n; i++)
+    var += (samples[i] - mean) * (samples[i] - mean);
+  double stddev = n > 1 ? sqrt(var / (n - 1)) : 0;
+
+  fprintf(bench_fp,
+          "%s\n  {\"name\": \"%s\", \"size\": %zu, \"samples\": %u, "
+          "\"min\": %.9e, \"median\": %.9e, \"mean\": %.9e, \"stddev\": %.9e, "
+          "\"max\": %.9e",
+          bench_results++ ? "," : "", name, size, n, samples[0], median, mean,
+          stddev, samples[n - 1]);
+  if (unit) {
+    fprintf(bench_fp, ", \"throughput\": %.6e, \"throughput_unit\": \"%s\"",
+            work * 1e-9 / median, unit);
+  }
+  fprintf(bench_fp, "}");
+}
+
+inline static int nomp_bench_finalize(void) {
+  fprintf(bench_fp, "\n]}\n");
+  if (bench_fp != stdout) fclose(bench_fp);
+  bench_fp = NULL;
+  return 0;
+}
+
+#endif // _NOMP_BENCH_H_
@@ -0,0 +1,39 @@
+"""Transform script for the libnomp benchmarks."""
+
+import math
+
+import loopy as lp
+
+LOOPY_LANG_VERSION = (2018, 2)
+
+
+def tile(knl, context):
+    """Tile a kernel with a single iname."""
+    (iname,) = knl.default_entrypoint.all_inames()
+    block_size = min(512, context["device::max_threads_per_block"])
+    i_inner, i_outer = f"{iname}_inner", f"{iname}_outer"
+    knl = lp.split_iname(
+        knl, iname, block_size, inner_iname=i_inner, outer_iname=i_outer
+    )
+    knl = lp.tag_inames(knl, {i_outer: "g.0", i_inner: "l.0"})
+    return knl
+
+
+def mxm(knl, context):
+    """Tile the two outer loops of a matrix multiplication."""
+    block_size = int(
+        math.sqrt(min(256, context["device::max_threads_per_block"]))
+    )
+    knl = lp.split_iname(knl, "i", block_size)
+    knl = lp.split_iname(knl, "j", block_size)
+    knl = lp.tag_inames(
+        knl,
+        {
+            "i_outer": "g.0",
+            "i_inner": "l.0",
+            "j_outer": "g.1",
+            "j_inner": "l.1",
+            "k": "for",
+        },
+    )
+    return knl
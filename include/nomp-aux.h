@@ -1,6 +1,7 @@
 #if !defined(_NOMP_AUX_H_)
 #define _NOMP_AUX_H_
 
+#include <stdint.h>
 #include <stdlib.h>
 
 #ifdef __cplusplus
@@ -23,6 +24,15 @@ char *nomp_copy_env(const char *name, size_t size);
 
 int nomp_path_len(size_t *len, const char *path);
 
+/**
+ * @ingroup nomp_other_utils
+ *
+ * @brief Initial value (offset basis) of the hash computed by nomp_hash().
+ */
+#define NOMP_HASH_SEED 0xcbf29ce484222325ULL
+
+uint64_t nomp_hash(uint64_t hash, const void *data, size_t len);
+
 #ifdef __cplusplus
 }
 #endif
@@ -6,6 +6,7 @@
 #define PY_SSIZE_T_CLEAN
 #include <Python.h>
 
+#include <pthread.h>
 #include <symengine/cwrapper.h>
 
 #include "nomp-defs.h"
@@ -58,6 +59,37 @@ typedef struct {
    * Name of the annotation script.
    */
   char annotations_script[NOMP_MAX_BUFFER_SIZE + 1];
+  /**
+   * Directory where generated kernels are cached. Caching is disabled if
+   * this is empty.
+   */
+  char cache_dir[PATH_MAX + 1];
+  /**
+   * File the trace of the run is written to. Tracing is disabled if this is
+   * empty.
+   */
+  char trace_file[PATH_MAX + 1];
+  /**
+   * File where the parameters of the kernels tuned with the `autotune`
+   * clause are stored. `tuning.db` in \ref cache_dir is used if this is
+   * empty.
+   */
+  char tuning_db[PATH_MAX + 1];
+  /**
+   * Evaluate kernel launch parameters with bytecode generated at JIT time
+   * instead of SymEngine.
+   */
+  int grid_bytecode;
+  /**
+   * High-water mark of the device memory pool in MiB. The pool is disabled
+   * if this is zero.
+   */
+  int pool_size;
+  /**
+   * Maximum number of worker processes used by nomp_jit_async(). Number of
+   * online processors is used if this is zero.
+   */
+  int jit_workers;
 } nomp_config_t;
 
 /**
@@ -83,6 +115,20 @@ typedef struct {
    * Pointer to the argument.
    */
   void *ptr;
+  /**
+   * Memory object of a ::NOMP_PTR argument (NULL for other arguments).
+   */
+  struct nomp_mem *mem;
+  /**
+   * Host pointer of a ::NOMP_PTR argument which was resolved to \ref mem by
+   * the last launch.
+   */
+  void *hptr;
+  /**
+   * Value of an integer argument used by the last evaluation of the kernel
+   * launch parameters.
+   */
+  long value;
 } nomp_arg_t;
 
 /**
@@ -98,15 +144,61 @@ typedef struct {
  */
 typedef enum {
   NOMP_SUM  = 0, /*!< Sum reduction. */
-  NOMP_PROD = 1  /*!< Multiplication reduction.*/
+  NOMP_PROD = 1, /*!< Multiplication reduction.*/
+  NOMP_MAX  = 2, /*!< Maximum reduction. */
+  NOMP_MIN  = 3, /*!< Minimum reduction. */
+  NOMP_LAND = 4, /*!< Logical and (&&) reduction. */
+  NOMP_LOR  = 5, /*!< Logical or (||) reduction. */
+  NOMP_BAND = 6, /*!< Bitwise and (&) reduction (integer types only). */
+  NOMP_BOR  = 7  /*!< Bitwise or (|) reduction (integer types only). */
 } nomp_reduction_op_t;
 
 /**
  * @ingroup nomp_internal_types
  *
- * @brief Structure to keep track of nomp program.
+ * @brief Opcodes of the bytecode used to evaluate kernel launch parameters.
+ */
+typedef enum {
+  NOMP_GRID_CONST = 0, /*!< Push a rational constant. */
+  NOMP_GRID_ARG   = 1, /*!< Push the value of a scalar kernel argument. */
+  NOMP_GRID_ADD   = 2, /*!< Replace the top n values with their sum. */
+  NOMP_GRID_MUL   = 3, /*!< Replace the top n values with their product. */
+  NOMP_GRID_POW   = 4, /*!< Raise the top value to an integer power. */
+  NOMP_GRID_FLOOR = 5, /*!< Replace the top value with its floor. */
+  NOMP_GRID_CEIL  = 6, /*!< Replace the top value with its ceiling. */
+  NOMP_GRID_MAX   = 7, /*!< Replace the top n values with their maximum. */
+  NOMP_GRID_MIN   = 8, /*!< Replace the top n values with their minimum. */
+  NOMP_GRID_STORE = 9  /*!< Pop the top value into a grid dimension. */
+} nomp_grid_op_t;
+
+/**
+ * @ingroup nomp_internal_types
+ *
+ * @brief A single instruction of the kernel launch parameter bytecode.
  */
 typedef struct {
+  /**
+   * Operation (one of ::nomp_grid_op_t).
+   */
+  nomp_grid_op_t op;
+  /**
+   * Operand of the instruction: numerator of the constant, argument index,
+   * number of values to combine, exponent or grid dimension depending on
+   * the operation.
+   */
+  long a;
+  /**
+   * Denominator of the constant (only used by NOMP_GRID_CONST).
+   */
+  long b;
+} nomp_grid_insn_t;
+
+/**
+ * @ingroup nomp_internal_types
+ *
+ * @brief Structure to keep track of nomp program.
+ */
+typedef struct nomp_prog {
   /**
    * Number of arguments of the kernel.
    */
@@ -124,9 +216,20 @@ typedef struct {
    */
   CVecBasic *sym_global, *sym_local;
   /**
-   * Flag used to determine if the grid size should be evaluated or not.
+   * Flag used to determine if the grid size should be evaluated or not. Set
+   * when the program is created and when an integer argument changes.
    */
   int eval_grid;
+  /**
+   * Kernel launch parameters lowered to bytecode over the kernel arguments.
+   * NULL if the expressions couldn't be lowered, in which case they are
+   * evaluated with SymEngine.
+   */
+  nomp_grid_insn_t *grid_code;
+  /**
+   * Number of instructions in \ref grid_code.
+   */
+  unsigned grid_code_n;
   /**
    * Map of variable names and their values used to evaluate
    * the kernel launch parameters.
@@ -161,10 +264,60 @@ typedef struct {
    * Pointer to the reduction variable.
    */
   void *reduction_ptr;
+  /**
+   * Program which performs the second stage of the reduction on the device.
+   * NULL if the second stage is done on the host. This is shared between
+   * programs and owned by the reduction utilities.
+   */
+  struct nomp_prog *reduction_prg;
   /**
    * Dictionary to hold jit argument names and values.
    */
   PyObject *py_dict;
+  /**
+   * Value of nomp_mem_generation() when the host pointers of the arguments
+   * were last resolved.
+   */
+  unsigned mem_generation;
+  /**
+   * Id of the program returned by nomp_jit().
+   */
+  int id;
+  /**
+   * C source and clauses the program was generated from. These are kept to
+   * create the loopy kernel again for kernel fusion. NULL for fused programs.
+   */
+  char *csrc, **clauses;
+  /**
+   * Loopy kernel with the clauses applied (before it is lowered to the
+   * backend). Created the first time the program is fused.
+   */
+  PyObject *py_knl;
+  /**
+   * Non-zero while the kernel is generated by a worker process started by
+   * nomp_jit_async(). The program is built when the worker is done.
+   */
+  int pending;
+  /**
+   * Error returned by the functions waiting for the kernel if the worker
+   * generating it failed. Zero otherwise.
+   */
+  int jit_err;
+  /**
+   * Parameters of the transform of a kernel with the `autotune` clause as a
+   * JSON string. NULL if the kernel isn't tuned or if it is not tuned yet.
+   */
+  char *tune_params;
+  /**
+   * Non-zero till the kernel is tuned by its first launch. The program is
+   * not built till then.
+   */
+  int tuning;
+  /**
+   * Id of the profiler entry which records the launches of the program (see
+   * nomp_profile_entry()). Zero if the program is not profiled.
+   */
+  unsigned profile_id;
 } nomp_prog_t;
 
 /**
@@ -172,7 +325,7 @@ typedef struct {
  *
  * @brief Structure to keep track of memory allocated by the backend.
  */
-typedef struct {
+typedef struct nomp_mem {
   /**
    * Start index of the memory region.
    */
@@ -197,8 +350,50 @@ typedef struct {
    * Size of the \ref bptr given by sizeof().
    */
   size_t bsize;
+  /**
+   * Backend event of the last transfer or kernel which used the memory
+   * region. Work which uses the memory region later waits on this event
+   * instead of the whole device. NULL if there is no pending work.
+   */
+  void *event;
 } nomp_mem_t;
 
+/**
+ * @ingroup nomp_internal_types
+ *
+ * @brief Registry of the memory regions mapped to the device. Each context
+ * has its own registry. A zero initialized registry is empty.
+ */
+typedef struct {
+  /**
+   * Hash table of the mapped memory regions keyed by the host pointer.
+   */
+  struct nomp_mem_slot *slots;
+  /**
+   * Number of used slots and size of the hash table.
+   */
+  unsigned slots_n, slots_max;
+  /**
+   * Incremented every time a memory region is registered or removed.
+   */
+  unsigned generation;
+} nomp_mem_registry_t;
+
+void nomp_mem_insert(nomp_mem_registry_t *r, nomp_mem_t *m);
+
+void nomp_mem_remove(nomp_mem_registry_t *r, const nomp_mem_t *m);
+
+nomp_mem_t *nomp_mem_find(const nomp_mem_registry_t *r, const void *p);
+
+nomp_mem_t *nomp_mem_find_range(const nomp_mem_registry_t *r, const void *p,
+                                size_t idx0, size_t idx1, size_t usize);
+
+nomp_mem_t *nomp_mem_pop(nomp_mem_registry_t *r);
+
+unsigned nomp_mem_generation(const nomp_mem_registry_t *r);
+
+void nomp_mem_finalize(nomp_mem_registry_t *r);
+
 /**
  * @ingroup nomp_internal_types
  *
@@ -227,15 +422,67 @@ struct nomp_backend {
    */
   int (*knl_free)(nomp_prog_t *);
   /**
-   * Function pointer to the backend synchronization function.
+   * Function pointer to the backend synchronization function which waits for
+   * all the queues.
    */
   int (*sync)(struct nomp_backend *);
+  /**
+   * Function pointer to the backend function which creates queues (streams)
+   * so that there are at least the given number of queues.
+   */
+  int (*create_queues)(struct nomp_backend *, unsigned);
+  /**
+   * Function pointer to the backend function which waits for a single queue.
+   */
+  int (*sync_queue)(struct nomp_backend *, unsigned);
+  /**
+   * Function pointer to the backend function which waits for the last event
+   * recorded on a memory region.
+   */
+  int (*mem_wait)(struct nomp_backend *, nomp_mem_t *);
+  /**
+   * Function pointer to the backend function which builds a native graph
+   * from a sequence of kernels with their current arguments and launch
+   * parameters. NULL if the backend doesn't support graphs.
+   */
+  int (*graph_build)(struct nomp_backend *, void **, nomp_prog_t **,
+                     unsigned);
+  /**
+   * Function pointer to the backend function which launches a native graph
+   * built from the given kernels.
+   */
+  int (*graph_launch)(struct nomp_backend *, void *, nomp_prog_t **, unsigned);
+  /**
+   * Function pointer to the backend function which frees a native graph.
+   */
+  int (*graph_free)(void *);
+  /**
+   * Non-zero if the backend memory aliases the host memory it was mapped
+   * from. Such memory can't be reused for another array, so it is not pooled.
+   */
+  int aliases_host;
+  /**
+   * Non-zero if the backend measures the time taken by kernels and copies on
+   * the device with device events and records it with
+   * nomp_profile_device(). Set before the backend is initialized if the
+   * profiler or the trace is on.
+   */
+  int profile;
   /**
    * Function pointer to the backend finalize function which releases allocated
    * resources.
    */
   int (*finalize)(struct nomp_backend *);
 
+  /**
+   * Number of queues (streams) created by the backend.
+   */
+  unsigned nqueues;
+  /**
+   * Queue used by the backend for memory transfers and kernel launches.
+   */
+  unsigned queue;
+
   /**
    * Scratch memory to be used as temporary memory for kernels (like reductions)
    */
@@ -252,6 +499,18 @@ struct nomp_backend {
    */
   PyObject *py_context;
 
+  /**
+   * Device memory pool of the backend. Owned by the pool utilities.
+   */
+  struct nomp_pool *pool;
+
+  /**
+   * Programs for the second stage of reductions on the device. Owned by the
+   * reduction utilities.
+   */
+  struct nomp_stage2_prog *stage2;
+  unsigned                 stage2_n, stage2_max;
+
   /**
    * Pointer to keep track of backend specific data. This is allocated and
    * released by the backend.
@@ -298,16 +557,38 @@ extern "C" {
  * @param[in] err Return value from nomp API.
  *
  */
+#if NOMP_LOG_LEVEL >= 3
 #define nomp_check(err)                                                        \
   {                                                                            \
     nomp_log(NOMP_SUCCESS, NOMP_INFO, "Calling %s ...", #err);                 \
     int err_ = (err);                                                          \
     if (err_ > 0) return err_;                                                 \
   }
+#else
+#define nomp_check(err)                                                        \
+  {                                                                            \
+    int err_ = (err);                                                          \
+    if (err_ > 0) return err_;                                                 \
+  }
+#endif
 
 #define NOMP_MEM_OFFSET(start, usize)     ((start) * (usize))
 #define NOMP_MEM_BYTES(start, end, usize) (((end) - (start)) * (usize))
 
+/**
+ * @ingroup nomp_internal_macros
+ *
+ * @def NOMP_PROFILE_COPY
+ *
+ * @brief Name of the profiler entry which records the copies done by
+ * nomp_update() in the direction \p op. The host time is recorded by
+ * nomp_update() and the device time by the backend.
+ *
+ * @param[in] op Direction of the copy (::NOMP_TO or ::NOMP_FROM).
+ */
+#define NOMP_PROFILE_COPY(op)                                                  \
+  (((op) & NOMP_TO) ? "nomp_update:to" : "nomp_update:from")
+
 /**
  * @defgroup nomp_backend_init Backend initialization functions
  *
@@ -322,6 +603,8 @@ int cuda_init(nomp_backend_t *backend, int platform, int device);
 
 int hip_init(nomp_backend_t *backend, int platform, int device);
 
+int cpu_init(nomp_backend_t *backend, int platform, int device);
+
 /**
  * @ingroup nomp_reduction_utils
  *
@@ -330,6 +613,120 @@ int hip_init(nomp_backend_t *backend, int platform, int device);
 int nomp_host_side_reduction(nomp_backend_t *bnd, nomp_prog_t *prg,
                              nomp_mem_t *m);
 
+int nomp_reduction_init(nomp_backend_t *bnd, nomp_prog_t *prg);
+
+int nomp_device_side_reduction(nomp_backend_t *bnd, nomp_prog_t *prg,
+                               nomp_mem_t *m, nomp_mem_t *out);
+
+int nomp_reduction_finalize(nomp_backend_t *bnd);
+
+/**
+ * @defgroup nomp_cache_utils Kernel cache utilities
+ *
+ * @brief Functions used to store and retrieve generated kernels on disk so
+ * nomp_jit() can skip the Python pipeline for kernels seen before.
+ */
+
+int nomp_cache_init(const nomp_config_t *cfg);
+
+int nomp_cache_key(uint64_t *key, const char *src, const char **clauses,
+                   PyObject *py_dict, PyObject *py_context);
+
+int nomp_cache_load(int *hit, char **name, char **src, nomp_prog_t *prg,
+                    uint64_t key);
+
+int nomp_cache_store(uint64_t key, const char *name, const char *src,
+                     nomp_prog_t *prg);
+
+int nomp_cache_write_knl(FILE *fp, const char *name, const char *src,
+                         nomp_prog_t *prg);
+
+int nomp_cache_read_knl(char **name, char **src, nomp_prog_t *prg, FILE *fp);
+
+int nomp_cache_read(void **data, size_t *size, uint64_t key, const char *ext);
+
+int nomp_cache_write(const void *data, size_t size, uint64_t key,
+                     const char *ext);
+
+int nomp_cache_path(char **path, uint64_t key, const char *ext);
+
+uint64_t nomp_cache_hash_kernel(const char *src, const char **clauses,
+                                PyObject *py_dict);
+
+uint64_t nomp_cache_hash_device(PyObject *py_context);
+
+void nomp_cache_finalize(void);
+
+/**
+ * @defgroup nomp_pool_utils Device memory pool utilities
+ *
+ * @brief Functions used to cache device memory released by nomp_update() so
+ * later allocations can reuse it without calling into the driver.
+ */
+
+int nomp_pool_init(nomp_backend_t *bnd, const nomp_config_t *cfg);
+
+int nomp_pool_alloc(nomp_backend_t *bnd, nomp_mem_t *m);
+
+int nomp_pool_free(nomp_backend_t *bnd, nomp_mem_t *m);
+
+int nomp_pool_trim(nomp_backend_t *bnd);
+
+void nomp_pool_stats(const nomp_backend_t *bnd, size_t *live, size_t *cached,
+                     unsigned *hits, unsigned *misses);
+
+int nomp_pool_finalize(nomp_backend_t *bnd);
+
+/**
+ * @defgroup nomp_trace_utils Trace utilities
+ *
+ * @brief Functions used to record a timeline of JIT stages, copies, kernel
+ * launches and syncs and write it as a Chrome trace-event file.
+ */
+
+/**
+ * @ingroup nomp_trace_utils
+ *
+ * @brief Category of a trace event.
+ */
+typedef enum {
+  NOMP_TRACE_JIT    = 0,
+  NOMP_TRACE_UPDATE = 1,
+  NOMP_TRACE_RUN    = 2,
+  NOMP_TRACE_SYNC   = 3,
+  NOMP_TRACE_DEVICE = 4
+} nomp_trace_cat_t;
+
+int nomp_trace_init(const nomp_config_t *cfg);
+
+void nomp_trace_span(nomp_trace_cat_t cat, const char *name, double start);
+
+void nomp_trace_update(unsigned entry, double start, size_t bytes,
+                       nomp_map_direction_t op);
+
+void nomp_trace_run(const nomp_prog_t *prg, double start);
+
+void nomp_trace_device(unsigned entry, unsigned queue, double start,
+                       double end);
+
+void nomp_trace_finalize(void);
+
+/**
+ * @defgroup nomp_autotune_utils Autotune utilities
+ *
+ * @brief Functions used to keep the parameters of the kernels tuned with the
+ * `autotune` clause in a persistent database keyed by the kernel and the
+ * device.
+ */
+
+int nomp_autotune_init(const nomp_config_t *cfg);
+
+const char *nomp_autotune_lookup(uint64_t kernel, uint64_t device);
+
+int nomp_autotune_store(uint64_t kernel, uint64_t device, const char *params);
+
+void nomp_autotune_finalize(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -34,6 +34,11 @@ int nomp_log_set_verbose(unsigned verbose);
 
 int nomp_log_(const char *desc, int errorno, nomp_log_type_t type, ...);
 
+// Used in place of nomp_log_() for logs which are compiled out. This is a
+// function call instead of a plain 0 so that nomp_log() can be used as a
+// statement without warnings.
+static inline int nomp_log_disabled_(void) { return 0; }
+
 #define NOMP_CASE_IMPL(_1, _2, _3, _4, _5, _6, _7, _8, N, ...) N
 #define NOMP_CASE(...)                                         NOMP_CASE_IMPL(__VA_ARGS__, 2, 2, 2, 2, 2, 2, 2, 1, 0)
 
@@ -54,17 +59,26 @@ int nomp_log_(const char *desc, int errorno, nomp_log_type_t type, ...);
  * @brief Log an error, warning or an info message. Use this instead of
  * using the nomp_log_() function directly.
  *
+ * Logs with a type above NOMP_LOG_LEVEL (set at configure time) are compiled
+ * out and return 0. Errors are always logged.
+ *
  * @param errorno Error number (One of \ref nomp_error_codes. used only when
  * type is an error).
  * @param type Log type one of ::nomp_log_type_t.
  * @param ... Log message as a C-string followed by arguments.
  */
 #define nomp_log(errorno, type, ...)                                           \
-  nomp_log_(NOMP_FIRST(__VA_ARGS__), errorno, type, __FILE__,                  \
-            __LINE__ NOMP_REST(__VA_ARGS__))
+  (((type) != NOMP_ERROR && (type) > NOMP_LOG_LEVEL)                           \
+       ? nomp_log_disabled_()                                                  \
+       : nomp_log_(NOMP_FIRST(__VA_ARGS__), errorno, type, __FILE__,           \
+                   __LINE__ NOMP_REST(__VA_ARGS__)))
 
 void nomp_log_finalize(void);
 
+void nomp_log_lock(void);
+
+void nomp_log_unlock(void);
+
 /**
  * @defgroup nomp_profiler_utils Profiling utilities
  *
@@ -73,6 +87,17 @@ void nomp_log_finalize(void);
 
 int nomp_profile_set_level(const int profile_level);
 
+double nomp_profile_now(void);
+
+unsigned nomp_profile_entry(const char *name);
+
+const char *nomp_profile_name(unsigned id);
+
+void nomp_profile_host(unsigned id, int toggle);
+
+void nomp_profile_device(unsigned id, unsigned queue, double start,
+                         double end);
+
 void nomp_profile(const char *name, int toggle, int sync);
 
 void nomp_profile_result(void);
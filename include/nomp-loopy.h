@@ -13,13 +13,18 @@ extern "C" {
  * @brief Python helper functions for calling loopy and other python functions.
  */
 
+void nomp_py_lock(void);
+
+void nomp_py_unlock(void);
+
 int nomp_py_init(const nomp_config_t *cfg);
 
 int nomp_py_append_to_sys_path(const char *path);
 
 int nomp_py_check_module(const char *module, const char *function);
 
-int nomp_py_c_to_loopy(PyObject **knl, const char *src);
+int nomp_py_c_to_loopy(PyObject **knl, const char *src,
+                       const PyObject *py_context);
 
 int nomp_py_realize_reduction(PyObject **knl, const char *var,
                               const PyObject *context);
@@ -27,6 +32,13 @@ int nomp_py_realize_reduction(PyObject **knl, const char *var,
 int nomp_py_transform(PyObject **knl, const char *file, const char *func,
                       const PyObject *context);
 
+int nomp_py_autotune_candidates(char ***candidates, unsigned *n,
+                                const char *file, const char *function,
+                                const PyObject *context);
+
+int nomp_py_autotune(PyObject **knl, const char *file, const char *function,
+                     const char *params, const PyObject *context);
+
 int nomp_py_get_knl_name_and_src(char **name, char **src, const PyObject *knl);
 
 int nomp_py_set_annotate_func(PyObject **func, const char *path);
@@ -38,12 +50,22 @@ int nomp_py_get_grid_size(nomp_prog_t *prg, PyObject *knl);
 
 int nomp_py_fix_parameters(PyObject **knl, const PyObject *py_dict);
 
+int nomp_py_lower_to_target(PyObject **knl, const PyObject *py_context);
+
+int nomp_py_fuse(PyObject **knl, PyObject *knls, PyObject *names);
+
 int nomp_py_finalize(int interpreter);
 
 int nomp_symengine_eval_grid_size(nomp_prog_t *prg);
 
 int nomp_symengine_update(CMapBasicBasic *map, const char *key, const long val);
 
+int nomp_symengine_vec_push(CVecBasic *vec, const char *str);
+
+int nomp_symengine_compile_grid_size(nomp_prog_t *prg);
+
+int nomp_grid_eval(nomp_prog_t *prg);
+
 #ifdef __cplusplus
 }
 #endif
@@ -35,8 +35,9 @@ typedef enum {
   NOMP_ALLOC = 1, /*!< Allocate memory on the device.*/
   NOMP_TO    = 2, /*!< Copy host data to device. Memory will be allocated if not
                    * allocated.*/
-  NOMP_FROM = 4,  /*!< Copy device data to host.*/
-  NOMP_FREE = 8   /*!< Free memory allocated on the device.*/
+  NOMP_FROM  = 4,  /*!< Copy device data to host.*/
+  NOMP_FREE  = 8,  /*!< Free memory allocated on the device.*/
+  NOMP_ASYNC = 16  /*!< Don't wait for ::NOMP_TO or ::NOMP_FROM to finish.*/
 } nomp_map_direction_t;
 
 /**
@@ -47,6 +48,12 @@ typedef enum {
   NOMP_JIT = 1 /*!< Argument value is fixed when the kernel is generated. */
 } nomp_arg_properties_t;
 
+/**
+ * @ingroup nomp_user_types
+ * @brief Opaque handle of a libnomp context. See nomp_context_create().
+ */
+typedef struct nomp_context nomp_context_t;
+
 /**
  * @defgroup nomp_error_codes Error codes returned to the user
  *
@@ -149,6 +156,12 @@ typedef enum {
  * @brief libnomp OpenCL operation failed.
  */
 #define NOMP_OPENCL_FAILURE -516
+/**
+ * @ingroup nomp_error_codes
+ *
+ * @brief libnomp CPU operation failed.
+ */
+#define NOMP_CPU_FAILURE -518
 
 /**
  * @defgroup nomp_user_api User API
@@ -158,19 +171,67 @@ typedef enum {
 
 int nomp_init(int argc, const char **argv);
 
+int nomp_context_create(nomp_context_t **context, int argc, const char **argv);
+
+int nomp_context_set(nomp_context_t *context);
+
+nomp_context_t *nomp_context_get(void);
+
+int nomp_context_destroy(nomp_context_t *context);
+
 int nomp_update(void *ptr, size_t start_index, size_t end_index,
                 size_t unit_size, nomp_map_direction_t op);
 
 int nomp_jit(int *id, const char *src, const char **clauses, int nargs, ...);
 
+int nomp_jit_async(int *id, const char *src, const char **clauses, int nargs,
+                   ...);
+
+int nomp_jit_wait(int id);
+
 int nomp_run(int id, ...);
 
+int nomp_run_v(int id, void **args);
+
+int nomp_bind(int *handle, int id, void **args);
+
+int nomp_launch(int handle);
+
+int nomp_unbind(int handle);
+
+int nomp_graph_begin(void);
+
+int nomp_graph_end(int *graph);
+
+int nomp_graph_launch(int graph);
+
+int nomp_graph_free(int graph);
+
+int nomp_fuse_begin(void);
+
+int nomp_fuse_end(void);
+
 int nomp_sync(void);
 
+int nomp_create_queues(unsigned n);
+
+int nomp_set_queue(unsigned queue);
+
+int nomp_sync_queue(unsigned queue);
+
+int nomp_wait(const void *ptr);
+
 char *nomp_get_err_str(unsigned id);
 
 int nomp_get_err_no(unsigned id);
 
+int nomp_get_cache_stats(unsigned *hits, unsigned *misses);
+
+int nomp_get_pool_stats(size_t *live, size_t *cached, unsigned *hits,
+                        unsigned *misses);
+
+int nomp_trim_pool(void);
+
 int nomp_finalize(void);
 
 int nomp_finalize_excluding_interpreter(void);
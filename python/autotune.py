@@ -0,0 +1,69 @@
+"""Search space of the transforms tuned with the `autotune` clause."""
+
+import importlib
+import itertools
+import json
+from typing import Callable, Dict, List
+
+import loopy as lp
+
+
+def search_space(**space):
+    """Declare the parameters of a transform function which are tuned.
+
+    Each keyword argument maps a parameter of the transform function to the
+    list of values to try, or to a function which takes the backend context
+    and returns that list (so the values can depend on the device). The
+    transform is called as `function(knl, context, **params)`:
+
+        @search_space(block_size=[32, 64, 128, 256], unroll=[1, 2, 4])
+        def tile(knl, context, block_size=128, unroll=1):
+            ...
+    """
+
+    def decorator(func: Callable) -> Callable:
+        func.search_space = space
+        return func
+
+    return decorator
+
+
+def _get_function(module: str, function: str) -> Callable:
+    func = getattr(importlib.import_module(module), function)
+    if not callable(func):
+        raise TypeError(f'"{module}.{function}" is not callable.')
+    return func
+
+
+def get_candidates(module: str, function: str, context: Dict) -> List[str]:
+    """Return the points of the search space as JSON strings."""
+    func = _get_function(module, function)
+    space = getattr(func, "search_space", None)
+    if space is None:
+        raise ValueError(
+            f'"{module}.{function}" has no search space. Declare it with '
+            "autotune.search_space()."
+        )
+
+    names = list(space)
+    values = [
+        list(space[name](context) if callable(space[name]) else space[name])
+        for name in names
+    ]
+    return [
+        json.dumps(dict(zip(names, point)), sort_keys=True)
+        for point in itertools.product(*values)
+    ]
+
+
+def apply(
+    knl: lp.translation_unit.TranslationUnit,
+    context: Dict,
+    module: str,
+    function: str,
+    params: str,
+) -> lp.translation_unit.TranslationUnit:
+    """Apply the transform with the parameters given as a JSON string. The
+    defaults of the transform are used if `params` is empty."""
+    kwargs = json.loads(params) if params else {}
+    return _get_function(module, function)(knl, context, **kwargs)
@@ -9,8 +9,10 @@ import numpy as np
 import pymbolic.primitives as prim
 from clang import cindex
 from loopy.isl_helpers import make_slab
-from loopy.kernel.data import AddressSpace
-from loopy.symbolic import aff_from_expr
+from loopy.kernel.data import AddressSpace, LocalInameTag
+from loopy.symbolic import WalkMapper, aff_from_expr
+from loopy.target.c import CASTBuilder
+from loopy.target.c.codegen.expression import ExpressionToCExpressionMapper
 from loopy.target.c.compyte.dtypes import (
     DTypeRegistry,
     fill_registry_with_c_types,
@@ -20,6 +22,7 @@ from pytools import UniqueNameGenerator
 LOOPY_LANG_VERSION = (2018, 2)
 LOOPY_INSN_PREFIX = "_nomp_insn"
 NOMP_VAR_PREFIX = "_nomp_var"
+NOMP_FUSE_PREFIX = "_nomp_fuse"
 
 _C_OPS_TO_PYMBOLIC_OPS = {
     "*": lambda x, y: prim.Product((x, y)),
@@ -61,10 +64,37 @@ _CLANG_TYPE_TO_C_TYPE = {
     "uchar": "unsigned char",
     "schar": "signed char",
 }
+
+
+class CPUExpressionToCExpressionMapper(ExpressionToCExpressionMapper):
+    """Maps work-group indices to `gid(axis)` which is defined by the cpu
+    backend for each work-group it runs."""
+
+    def map_group_hw_index(self, expr, type_context):
+        return prim.Variable("gid")(expr.axis)
+
+
+class CPUASTBuilder(CASTBuilder):
+    """C AST builder for the cpu backend."""
+
+    def get_expression_to_c_expression_mapper(self, codegen_state):
+        return CPUExpressionToCExpressionMapper(codegen_state)
+
+
+class CPUTarget(lp.CTarget):
+    """Plain C target for the cpu backend. Work-groups (`g.*` axes) are run
+    in parallel by the backend and work-items (`l.*` axes) are lowered to
+    loops by lower_to_target()."""
+
+    def get_device_ast_builder(self):
+        return CPUASTBuilder(self)
+
+
 _BACKEND_TO_TARGET = {
     "opencl": lp.OpenCLTarget(),
     "cuda": lp.CudaTarget(),
     "hip": lp.CudaTarget(),
+    "cpu": CPUTarget(),
 }
 _ARRAY_TYPES = [
     cindex.TypeKind.CONSTANTARRAY,
@@ -384,6 +414,26 @@ class ForLoopInfo:
         }
 
 
+def get_min_max(rhs: tuple) -> prim.Expression | None:
+    """Returns the maximum or minimum of two values if the conditional
+    expression `rhs` (condition, true value, false value) selects one of them
+    (e.g., `a > b ? a : b`). Otherwise, returns None."""
+    cond, if_true, if_false = rhs
+    if not isinstance(cond, prim.Comparison):
+        return None
+    if cond.operator not in [">", ">=", "<", "<="]:
+        return None
+
+    greater = cond.operator in [">", ">="]
+    if (cond.left, cond.right) == (if_true, if_false):
+        oprtr = prim.Max if greater else prim.Min
+    elif (cond.left, cond.right) == (if_false, if_true):
+        oprtr = prim.Min if greater else prim.Max
+    else:
+        return None
+    return oprtr((if_true, if_false))
+
+
 def set_tf_results(
     lhs, rhs, context: CToLoopyMapperContext
 ) -> tuple[CToLoopyMapperAccumulator]:
@@ -591,7 +641,9 @@ class CToLoopyMapper(IdentityMapper):
         rhs = CToLoopyExpressionMapper()(right)
 
         # Map assignment to an if-else if rhs is a conditional operator
-        # statement
+        # statement (unless it selects the minimum or maximum of two values).
+        if isinstance(rhs, tuple) and get_min_max(rhs) is not None:
+            rhs = get_min_max(rhs)
         if isinstance(rhs, tuple):
             return self.accumulate(
                 set_result_stmts(set_tf_results(lhs, rhs, context))
@@ -630,6 +682,10 @@ class CToLoopyMapper(IdentityMapper):
                     rhs[i] = lhs - rhs[i]
                 elif op_str == "*=":
                     rhs[i] = lhs * rhs[i]
+                elif op_str == "&=":
+                    rhs[i] = prim.BitwiseAnd((lhs, rhs[i]))
+                elif op_str == "|=":
+                    rhs[i] = prim.BitwiseOr((lhs, rhs[i]))
                 elif op_str != "=":
                     raise NotImplementedError(
                         f"Mapping not implemented for {op_str}"
@@ -647,6 +703,10 @@ class CToLoopyMapper(IdentityMapper):
             rhs = lhs - rhs
         elif op_str == "*=":
             rhs = lhs * rhs
+        elif op_str == "&=":
+            rhs = prim.BitwiseAnd((lhs, rhs))
+        elif op_str == "|=":
+            rhs = prim.BitwiseOr((lhs, rhs))
         elif op_str != "=":
             raise NotImplementedError(f"Mapping not implemented for {op_str}")
 
@@ -831,6 +891,109 @@ def get_knl_name(knl: lp.translation_unit.TranslationUnit) -> str:
     return knl.default_entrypoint.name
 
 
+def lower_to_target(
+    tunit: lp.translation_unit.TranslationUnit, context: dict
+) -> lp.translation_unit.TranslationUnit:
+    """Adapt the kernel to the execution model of the backend. The cpu
+    backend runs all the work-items of a work-group on the same thread, so
+    work-item (`l.*`) axes are turned into sequential loops."""
+    if context["backend::name"] != "cpu":
+        return tunit
+
+    knl = tunit.default_entrypoint
+    for iname in knl.inames:
+        if knl.iname_tags_of_type(iname, LocalInameTag):
+            tunit = lp.untag_inames(tunit, iname, LocalInameTag)
+    return tunit
+
+
 def fix_parameters(knl, params) -> lp.translation_unit.TranslationUnit:
     """Returns the kernel source for a given backend."""
     return lp.fix_parameters(knl, **params)
+
+
+class _AccessCollector(WalkMapper):
+    """Collect the index expressions used to access each array."""
+
+    def __init__(self):
+        super().__init__()
+        self.accesses = {}
+
+    def map_subscript(self, expr, *args, **kwargs):
+        self.accesses.setdefault(expr.aggregate.name, set()).add(expr.index)
+        super().map_subscript(expr, *args, **kwargs)
+
+
+def _fused_arg_index(arg: lp.KernelArgument) -> int:
+    return int(arg.name[len(NOMP_FUSE_PREFIX) :])
+
+
+def fuse(
+    tunits: list, names: list
+) -> lp.translation_unit.TranslationUnit | None:
+    """Fuse kernels launched one after the other into a single kernel.
+    `names` maps the arguments of each kernel to the arguments of the fused
+    kernel, so arguments which refer to the same array or scalar get the same
+    name. Returns None if the kernels can't be fused: the loop domains (and
+    their parallelization) must match and each array written by one of the
+    kernels and used by another must be accessed with the same index
+    everywhere."""
+    knls = []
+    for k, (tunit, arg_names) in enumerate(zip(tunits, names)):
+        for name, fused_name in arg_names.items():
+            tunit = lp.rename_argument(tunit, name, fused_name)
+        knls.append(lp.tag_instructions(tunit, f"{NOMP_FUSE_PREFIX}_knl{k}"))
+
+    knl0 = knls[0].default_entrypoint
+    inames = knl0.all_inames()
+    domain0 = knl0.get_inames_domain(inames)
+    for tunit in knls[1:]:
+        knl = tunit.default_entrypoint
+        if knl.all_inames() != inames:
+            return None
+        if any(knl.iname_tags(i) != knl0.iname_tags(i) for i in inames):
+            return None
+        domain, domain0 = isl.align_two(knl.get_inames_domain(inames), domain0)
+        if not domain.is_equal(domain0):
+            return None
+
+    # Fusing the loops is valid only if every shared array which is written
+    # is accessed by the same iteration in all the kernels.
+    accesses, users, written = {}, {}, set()
+    for k, tunit in enumerate(knls):
+        knl = tunit.default_entrypoint
+        collector = _AccessCollector()
+        for insn in knl.instructions:
+            if not isinstance(insn, lp.Assignment):
+                return None
+            collector(insn.assignee)
+            collector(insn.expression)
+            written |= insn.assignee_var_names()
+        for name, index in collector.accesses.items():
+            if name in knl.arg_dict:
+                accesses.setdefault(name, set()).update(index)
+                users.setdefault(name, set()).add(k)
+    for name in written & accesses.keys():
+        if len(users[name]) > 1 and len(accesses[name]) > 1:
+            return None
+
+    try:
+        fused = lp.fuse_kernels(knls)
+    except lp.LoopyError:
+        return None
+    if isinstance(fused, lp.LoopKernel):
+        fused = lp.make_program(fused)
+
+    # Each iteration runs the statements of the kernels in the order the
+    # kernels were launched.
+    for k in range(1, len(knls)):
+        fused = lp.add_dependency(
+            fused,
+            f"tag:{NOMP_FUSE_PREFIX}_knl{k}",
+            f"tag:{NOMP_FUSE_PREFIX}_knl{k - 1}",
+        )
+
+    # Arguments of the fused kernel are passed in the order of their index.
+    knl = fused.default_entrypoint
+    knl = knl.copy(args=sorted(knl.args, key=_fused_arg_index))
+    return fused.with_kernel(knl)
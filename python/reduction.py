@@ -3,6 +3,13 @@
 import loopy as lp
 import pymbolic.mapper
 import pymbolic.primitives as prim
+from loopy.library.reduction import (
+    MaxReductionOperation,
+    MinReductionOperation,
+    ProductReductionOperation,
+    ScalarReductionOperation,
+    SumReductionOperation,
+)
 from loopy.symbolic import Reduction
 from loopy.transform.data import reduction_arg_to_subst_rule
 from loopy_api import LOOPY_INSN_PREFIX, LOOPY_LANG_VERSION
@@ -27,6 +34,74 @@ class InameCollector(pymbolic.mapper.WalkMapper):
         raise NotImplementedError
 
 
+# pylint-disable-reason: Reduction operations must have the same API as the
+# reduction operations in loopy even though some of the arguments are unused.
+# pylint: disable=W0613
+class LogicalAndReductionOperation(ScalarReductionOperation):
+    """Reduction operation for the && operator."""
+
+    def neutral_element(self, dtype, callables_table, target):
+        return 1, callables_table
+
+    def __call__(self, dtype, operand1, operand2, callables_table, target):
+        return prim.LogicalAnd((operand1, operand2)), callables_table
+
+    def __str__(self):
+        return "land"
+
+
+class LogicalOrReductionOperation(ScalarReductionOperation):
+    """Reduction operation for the || operator."""
+
+    def neutral_element(self, dtype, callables_table, target):
+        return 0, callables_table
+
+    def __call__(self, dtype, operand1, operand2, callables_table, target):
+        return prim.LogicalOr((operand1, operand2)), callables_table
+
+    def __str__(self):
+        return "lor"
+
+
+class BitwiseAndReductionOperation(ScalarReductionOperation):
+    """Reduction operation for the & operator."""
+
+    def neutral_element(self, dtype, callables_table, target):
+        # All the bits set.
+        return prim.BitwiseNot(0), callables_table
+
+    def __call__(self, dtype, operand1, operand2, callables_table, target):
+        return prim.BitwiseAnd((operand1, operand2)), callables_table
+
+    def __str__(self):
+        return "band"
+
+
+class BitwiseOrReductionOperation(ScalarReductionOperation):
+    """Reduction operation for the | operator."""
+
+    def neutral_element(self, dtype, callables_table, target):
+        return 0, callables_table
+
+    def __call__(self, dtype, operand1, operand2, callables_table, target):
+        return prim.BitwiseOr((operand1, operand2)), callables_table
+
+    def __str__(self):
+        return "bor"
+
+
+_PYMBOLIC_TO_REDUCTION_OPS = {
+    prim.Sum: SumReductionOperation,
+    prim.Product: ProductReductionOperation,
+    prim.Max: MaxReductionOperation,
+    prim.Min: MinReductionOperation,
+    prim.LogicalAnd: LogicalAndReductionOperation,
+    prim.LogicalOr: LogicalOrReductionOperation,
+    prim.BitwiseAnd: BitwiseAndReductionOperation,
+    prim.BitwiseOr: BitwiseOrReductionOperation,
+}
+
+
 def realize_reduction(
     tunit: lp.translation_unit.TranslationUnit,
     var: str,
@@ -65,21 +140,27 @@ def realize_reduction(
             and isinstance(insn.assignee.aggregate, prim.Variable)
             and insn.assignee.aggregate.name == var
         ):
+            expr_type = type(insn.expression)
+            if expr_type not in _PYMBOLIC_TO_REDUCTION_OPS:
+                raise NotImplementedError(
+                    f"Reduction operation {expr_type.__name__} is not "
+                    "supported !"
+                )
+
+            # Reduction variable can be any of the operands, e.g.,
+            # `a[0] = a[i] > a[0] ? a[i] : a[0]`.
             (lhs, *rhs) = insn.expression.children
+            if insn.assignee in insn.expression.children:
+                rhs = list(insn.expression.children)
+                rhs.remove(insn.assignee)
+                lhs = insn.assignee
             if i_inner in InameCollector(*rhs).get_inames():
                 precompute = 1
-            if isinstance(insn.expression, prim.Sum):
-                rhs = Reduction(
-                    lp.library.reduction.SumReductionOperation(),
-                    i_inner,
-                    prim.Sum(tuple(rhs)),
-                )
-            elif isinstance(insn.expression, prim.Product):
-                rhs = Reduction(
-                    lp.library.reduction.ProductReductionOperation(),
-                    i_inner,
-                    prim.Product(tuple(rhs)),
-                )
+            rhs = Reduction(
+                _PYMBOLIC_TO_REDUCTION_OPS[expr_type](),
+                i_inner,
+                rhs[0] if len(rhs) == 1 else expr_type(tuple(rhs)),
+            )
 
             if isinstance(lhs, prim.Subscript):
                 agg = lhs.aggregate
@@ -0,0 +1,156 @@
+#include <inttypes.h>
+
+#include "nomp-impl.h"
+
+// Parameters of the fastest variant of each tuned kernel on each device. The
+// database is shared by all the contexts and is loaded from the tuning file
+// (if there is one) by the first context. Each line of the file is an entry:
+// the kernel hash, the device hash (both in hex) and the parameters as a JSON
+// string. New entries are appended to the file, so an entry overrides the
+// entries of the same kernel and device before it.
+struct autotune_entry {
+  uint64_t kernel, device;
+  char    *params;
+};
+
+static struct autotune_entry *autotune_entries = NULL;
+static unsigned               autotune_n = 0, autotune_max = 0;
+static char                   autotune_file[PATH_MAX + 1];
+static int                    autotune_ready = 0;
+
+static struct autotune_entry *autotune_find(uint64_t kernel, uint64_t device) {
+  for (unsigned i = 0; i < autotune_n; i++) {
+    struct autotune_entry *e = &autotune_entries[i];
+    if (e->kernel == kernel && e->device == device) return e;
+  }
+  return NULL;
+}
+
+static void autotune_set(uint64_t kernel, uint64_t device, const char *params,
+                         size_t len) {
+  struct autotune_entry *e = autotune_find(kernel, device);
+  if (e == NULL) {
+    if (autotune_n == autotune_max) {
+      autotune_max += autotune_max / 2 + 1;
+      autotune_entries = nomp_realloc(autotune_entries, struct autotune_entry,
+                                      autotune_max);
+    }
+    e         = &autotune_entries[autotune_n++];
+    e->kernel = kernel, e->device = device, e->params = NULL;
+  }
+  nomp_free(&e->params);
+  e->params = strndup(params, len);
+}
+
+/**
+ * @ingroup nomp_autotune_utils
+ *
+ * @brief Load the tuning database.
+ *
+ * @details Tuning file is set with `--nomp-tuning-db` command line argument
+ * or `NOMP_TUNING_DB` environment variable. If it is not set, `tuning.db` in
+ * the kernel cache directory is used. The database is kept in memory only if
+ * neither of them is set. The database is shared by all the contexts, so
+ * only the first context loads it. Lines of the file which can't be parsed
+ * are ignored.
+ *
+ * @param[in] cfg Nomp configuration struct of type ::nomp_config_t.
+ * @return int
+ */
+int nomp_autotune_init(const nomp_config_t *const cfg) {
+  if (autotune_ready) return 0;
+
+  strcpy(autotune_file, "");
+  if (strlen(cfg->tuning_db) > 0) {
+    strncpy(autotune_file, cfg->tuning_db, PATH_MAX);
+  } else if (strlen(cfg->cache_dir) > 0) {
+    snprintf(autotune_file, sizeof(autotune_file), "%s/tuning.db",
+             cfg->cache_dir);
+  }
+  autotune_file[PATH_MAX] = '\0';
+  autotune_ready          = 1;
+
+  FILE *fp = strlen(autotune_file) > 0 ? fopen(autotune_file, "r") : NULL;
+  if (fp == NULL) return 0;
+
+  char    *line = NULL;
+  size_t   size = 0;
+  ssize_t  len;
+  uint64_t kernel, device;
+  int      offset;
+  while ((len = getline(&line, &size, fp)) > 0) {
+    if (line[len - 1] == '\n') line[--len] = '\0';
+    if (sscanf(line, "%" SCNx64 " %" SCNx64 " %n", &kernel, &device,
+               &offset) == 2 &&
+        offset < len)
+      autotune_set(kernel, device, line + offset, len - offset);
+  }
+  nomp_free(&line);
+  fclose(fp);
+
+  return 0;
+}
+
+/**
+ * @ingroup nomp_autotune_utils
+ *
+ * @brief Find the tuned parameters of a kernel on a device.
+ *
+ * @param[in] kernel Hash of the kernel (see nomp_cache_hash_kernel()).
+ * @param[in] device Hash of the device (see nomp_cache_hash_device()).
+ * @return const char * Parameters as a JSON string or NULL if the kernel
+ * hasn't been tuned on the device.
+ */
+const char *nomp_autotune_lookup(uint64_t kernel, uint64_t device) {
+  const struct autotune_entry *e = autotune_find(kernel, device);
+  return e ? e->params : NULL;
+}
+
+/**
+ * @ingroup nomp_autotune_utils
+ *
+ * @brief Store the tuned parameters of a kernel on a device.
+ *
+ * @details The entry is appended to the tuning file right away so it isn't
+ * lost if the program doesn't finalize libnomp.
+ *
+ * @param[in] kernel Hash of the kernel (see nomp_cache_hash_kernel()).
+ * @param[in] device Hash of the device (see nomp_cache_hash_device()).
+ * @param[in] params Parameters as a JSON string.
+ * @return int
+ */
+int nomp_autotune_store(uint64_t kernel, uint64_t device, const char *params) {
+  autotune_set(kernel, device, params, strlen(params));
+  if (strlen(autotune_file) == 0) return 0;
+
+  FILE *fp = fopen(autotune_file, "a");
+  if (fp == NULL) {
+    return nomp_log(NOMP_USER_INPUT_IS_INVALID, NOMP_ERROR,
+                    "Unable to open tuning database: \"%s\". Error: %s.",
+                    autotune_file, strerror(errno));
+  }
+  int err = fprintf(fp, "%016" PRIx64 " %016" PRIx64 " %s\n", kernel, device,
+                    params) < 0;
+  err |= fclose(fp) != 0;
+  if (err) {
+    return nomp_log(NOMP_USER_INPUT_IS_INVALID, NOMP_ERROR,
+                    "Unable to write to tuning database: \"%s\".",
+                    autotune_file);
+  }
+
+  return 0;
+}
+
+/**
+ * @ingroup nomp_autotune_utils
+ *
+ * @brief Release the in-memory copy of the tuning database.
+ *
+ * @return void
+ */
+void nomp_autotune_finalize(void) {
+  for (unsigned i = 0; i < autotune_n; i++)
+    nomp_free(&autotune_entries[i].params);
+  nomp_free(&autotune_entries), autotune_n = autotune_max = 0;
+  strcpy(autotune_file, ""), autotune_ready = 0;
+}
@@ -1,6 +1,7 @@
 #include <ctype.h>
 #include <limits.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -144,3 +145,23 @@ int nomp_path_len(size_t *len, const char *path) {
 
   return 0;
 }
+
+/**
+ * @ingroup nomp_other_utils
+ *
+ * @brief Update a 64-bit FNV-1a hash with \p len bytes starting at \p data.
+ *
+ * Start a new hash by passing ::NOMP_HASH_SEED as \p hash and chain the
+ * returned value into subsequent calls to hash multiple pieces of data.
+ *
+ * @param[in] hash Current value of the hash.
+ * @param[in] data Pointer to the data to be hashed.
+ * @param[in] len Number of bytes to hash.
+ * @return uint64_t
+ */
+uint64_t nomp_hash(uint64_t hash, const void *data, size_t len) {
+  const unsigned char *bytes = (const unsigned char *)data;
+  for (size_t i = 0; i < len; i++)
+    hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+  return hash;
+}
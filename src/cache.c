@@ -0,0 +1,514 @@
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "nomp-aux.h"
+#include "nomp-impl.h"
+#include "nomp-loopy.h"
+
+// Entries written by a different version of libnomp are not read.
+static const char *CACHE_MAGIC = "nomp-kernel-cache-v2-" NOMP_VERSION;
+
+static char     cache_dir[PATH_MAX + 1];
+static char     scripts_dir[PATH_MAX + 1];
+static char     annotations_script[NOMP_MAX_BUFFER_SIZE + 1];
+static unsigned cache_hits   = 0;
+static unsigned cache_misses = 0;
+static uint64_t cache_seed   = NOMP_HASH_SEED;
+
+/**
+ * @ingroup nomp_cache_utils
+ *
+ * @brief Initialize the on-disk kernel cache.
+ *
+ * Cache is enabled only if a cache directory is set using `--nomp-cache-dir`
+ * command line argument or `NOMP_CACHE_DIR` environment variable. The
+ * directory is created if it doesn't exist. The version of libnomp and the
+ * hash of its Python frontend (computed when libnomp is built) are hashed
+ * here since every key includes them. They don't depend on the install
+ * directory, so kernels are found in the cache even if the Python frontend
+ * can't be imported.
+ *
+ * @param[in] cfg Nomp configuration struct of type ::nomp_config_t.
+ * @return int
+ */
+int nomp_cache_init(const nomp_config_t *const cfg) {
+  strncpy(cache_dir, cfg->cache_dir, PATH_MAX);
+  strncpy(scripts_dir, cfg->scripts_dir, PATH_MAX);
+  strncpy(annotations_script, cfg->annotations_script, NOMP_MAX_BUFFER_SIZE);
+  cache_dir[PATH_MAX] = scripts_dir[PATH_MAX] = '\0';
+  annotations_script[NOMP_MAX_BUFFER_SIZE] = '\0';
+  cache_hits = cache_misses = 0;
+
+  cache_seed = nomp_hash(NOMP_HASH_SEED, NOMP_VERSION, strlen(NOMP_VERSION));
+  cache_seed = nomp_hash(cache_seed, NOMP_FRONTEND_HASH,
+                         strlen(NOMP_FRONTEND_HASH));
+
+  if (strlen(cache_dir) == 0) return 0;
+
+  if (mkdir(cache_dir, 0755) && errno != EEXIST) {
+    return nomp_log(NOMP_USER_INPUT_IS_INVALID, NOMP_ERROR,
+                    "Unable to create cache directory: \"%s\". Error: %s.",
+                    cache_dir, strerror(errno));
+  }
+
+  return 0;
+}
+
+static char *cache_read_file(const char *path, size_t *len) {
+  FILE *fp = fopen(path, "rb");
+  if (!fp) return NULL;
+
+  long size = fseek(fp, 0, SEEK_END) ? -1 : ftell(fp);
+  if (size < 0 || fseek(fp, 0, SEEK_SET)) {
+    fclose(fp);
+    return NULL;
+  }
+
+  char *buf = nomp_calloc(char, size + 1);
+  *len      = fread(buf, sizeof(char), size, fp);
+  fclose(fp);
+
+  return buf;
+}
+
+// Hash the name and the contents of the Python module \p module in \p dir.
+// Returns the hash of the name only if the module is not found.
+static uint64_t cache_hash_file(uint64_t key, const char *dir,
+                                const char *module) {
+  key = nomp_hash(key, module, strlen(module) + 1);
+
+  char  *path = nomp_str_cat(4, PATH_MAX, dir, "/", module, ".py");
+  size_t len;
+  char  *contents = cache_read_file(path, &len);
+  nomp_free(&path);
+
+  if (contents) key = nomp_hash(key, contents, len);
+  nomp_free(&contents);
+
+  return key;
+}
+
+static uint64_t cache_hash_script(uint64_t key, const char *module) {
+  // Python modules are looked up from the scripts directory first and then
+  // from the current working directory.
+  char *path = nomp_str_cat(3, PATH_MAX, scripts_dir, "/", module);
+  char *file = nomp_str_cat(2, PATH_MAX, path, ".py");
+  nomp_free(&path);
+  const char *dir = access(file, R_OK) == 0 ? scripts_dir : ".";
+  nomp_free(&file);
+
+  return cache_hash_file(key, dir, module);
+}
+
+static uint64_t cache_hash_py_object(uint64_t key, PyObject *obj) {
+  PyObject *py_repr = PyObject_Repr(obj);
+  if (!py_repr) return key;
+
+  Py_ssize_t  len;
+  const char *str = PyUnicode_AsUTF8AndSize(py_repr, &len);
+  if (str) key = nomp_hash(key, str, len);
+  Py_DECREF(py_repr);
+
+  return key;
+}
+
+/**
+ * @ingroup nomp_cache_utils
+ *
+ * @brief Hash the inputs of a kernel which don't depend on the device.
+ *
+ * The hash covers the version of libnomp and the sources of its Python
+ * frontend, the C source, the clauses, the contents of the transform
+ * (or tuned transform) and annotation scripts referred to by the clauses and
+ * the values of the jit arguments. It is computed even if the cache is
+ * disabled.
+ *
+ * @param[in] src Kernel source in C.
+ * @param[in] clauses Clauses passed to nomp_jit().
+ * @param[in] py_dict Dictionary of jit argument names and values.
+ * @return uint64_t
+ */
+uint64_t nomp_cache_hash_kernel(const char *src, const char **clauses,
+                                PyObject *py_dict) {
+  uint64_t key = nomp_hash(cache_seed, src, strlen(src) + 1);
+  for (unsigned i = 0; clauses && clauses[i]; i++) {
+    key = nomp_hash(key, clauses[i], strlen(clauses[i]) + 1);
+    if ((strncmp(clauses[i], "transform", NOMP_MAX_BUFFER_SIZE) == 0 ||
+         strncmp(clauses[i], "autotune", NOMP_MAX_BUFFER_SIZE) == 0) &&
+        clauses[i + 1])
+      key = cache_hash_script(key, clauses[i + 1]);
+    if (strncmp(clauses[i], "annotate", NOMP_MAX_BUFFER_SIZE) == 0 &&
+        strlen(annotations_script) > 0)
+      key = cache_hash_script(key, annotations_script);
+  }
+
+  return cache_hash_py_object(key, py_dict);
+}
+
+/**
+ * @ingroup nomp_cache_utils
+ *
+ * @brief Hash the device information in the backend context.
+ *
+ * @param[in] py_context Backend context as a Python dictionary.
+ * @return uint64_t
+ */
+uint64_t nomp_cache_hash_device(PyObject *py_context) {
+  return cache_hash_py_object(NOMP_HASH_SEED, py_context);
+}
+
+/**
+ * @ingroup nomp_cache_utils
+ *
+ * @brief Compute the cache key of a kernel.
+ *
+ * The key is a hash of the C source, the clauses, the contents of the
+ * transform and annotation scripts referred to by the clauses, the values of
+ * the jit arguments and the device information in the backend context.
+ *
+ * @param[out] key Hash which identifies the kernel in the cache.
+ * @param[in] src Kernel source in C.
+ * @param[in] clauses Clauses passed to nomp_jit().
+ * @param[in] py_dict Dictionary of jit argument names and values.
+ * @param[in] py_context Backend context as a Python dictionary.
+ * @return int
+ */
+int nomp_cache_key(uint64_t *key, const char *src, const char **clauses,
+                   PyObject *py_dict, PyObject *py_context) {
+  *key = NOMP_HASH_SEED;
+  if (strlen(cache_dir) == 0) return 0;
+
+  *key = nomp_cache_hash_kernel(src, clauses, py_dict);
+  *key = cache_hash_py_object(*key, py_context);
+
+  return 0;
+}
+
+static char *cache_get_path(uint64_t key, const char *ext) {
+  char name[NOMP_MAX_BUFFER_SIZE];
+  snprintf(name, NOMP_MAX_BUFFER_SIZE, "/%016llx.%s", (unsigned long long)key,
+           ext);
+  return nomp_str_cat(2, PATH_MAX, cache_dir, name);
+}
+
+// Cache entries are written to a temporary file first and then renamed so
+// that concurrent processes never see a partially written entry.
+static FILE *cache_open_entry(char **tmp, char **path, uint64_t key,
+                              const char *ext) {
+  char pid[NOMP_MAX_BUFFER_SIZE];
+  snprintf(pid, NOMP_MAX_BUFFER_SIZE, ".%ld", (long)getpid());
+  *path = cache_get_path(key, ext);
+  *tmp  = nomp_str_cat(2, PATH_MAX, *path, pid);
+  return fopen(*tmp, "wb");
+}
+
+static int cache_close_entry(FILE *fp, char **tmp, char **path, int err) {
+  if (fp) {
+    err |= fclose(fp) != 0;
+    if (!err) err = rename(*tmp, *path) != 0;
+    if (err) unlink(*tmp);
+  }
+  nomp_free(tmp), nomp_free(path);
+  return err;
+}
+
+static int cache_write_str(FILE *fp, const char *str) {
+  size_t len = strlen(str);
+  if (fprintf(fp, "%zu\n", len) < 0) return 1;
+  if (fwrite(str, sizeof(char), len, fp) != len) return 1;
+  return fputc('\n', fp) == EOF;
+}
+
+static char *cache_read_str(FILE *fp) {
+  size_t len;
+  if (fscanf(fp, "%zu", &len) != 1 || fgetc(fp) != '\n') return NULL;
+
+  char *str = nomp_calloc(char, len + 1);
+  if (fread(str, sizeof(char), len, fp) != len || fgetc(fp) != '\n') {
+    nomp_free(&str);
+    return NULL;
+  }
+
+  return str;
+}
+
+static int cache_write_exprs(FILE *fp, CVecBasic *vec) {
+  size_t n = vecbasic_size(vec);
+  if (fprintf(fp, "%zu\n", n) < 0) return 1;
+
+  basic a;
+  basic_new_stack(a);
+  int err = 0;
+  for (unsigned i = 0; i < n && !err; i++) {
+    vecbasic_get(vec, i, a);
+    char *str = basic_str(a);
+    err       = cache_write_str(fp, str);
+    basic_str_free(str);
+  }
+  basic_free_stack(a);
+
+  return err;
+}
+
+static int cache_read_exprs(FILE *fp, CVecBasic *vec) {
+  size_t n;
+  if (fscanf(fp, "%zu", &n) != 1 || fgetc(fp) != '\n' || n > 3) return 1;
+
+  for (unsigned i = 0; i < n; i++) {
+    char *str = cache_read_str(fp);
+    if (!str) return 1;
+    int err = nomp_symengine_vec_push(vec, str);
+    nomp_free(&str);
+    if (err) return 1;
+  }
+
+  return 0;
+}
+
+/**
+ * @ingroup nomp_cache_utils
+ *
+ * @brief Write a generated kernel to a stream in the format of the cache
+ * entries.
+ *
+ * This is also used to send kernels generated by JIT worker processes to
+ * libnomp.
+ *
+ * @param[in] fp Stream to write to.
+ * @param[in] name Kernel name as a C-string.
+ * @param[in] src Backend kernel source as a C-string.
+ * @param[in] prg Nomp program object with grid size expressions.
+ * @return int Non-zero if the kernel couldn't be written.
+ */
+int nomp_cache_write_knl(FILE *fp, const char *name, const char *src,
+                         nomp_prog_t *prg) {
+  return cache_write_str(fp, CACHE_MAGIC) || cache_write_str(fp, name) ||
+         cache_write_str(fp, src) || cache_write_exprs(fp, prg->sym_global) ||
+         cache_write_exprs(fp, prg->sym_local);
+}
+
+/**
+ * @ingroup nomp_cache_utils
+ *
+ * @brief Read a kernel written by nomp_cache_write_knl() from a stream.
+ *
+ * Grid size expressions are stored in the program \p prg. If the kernel can't
+ * be read, anything partially read is discarded. User must free the memory
+ * allocated for \p name and \p src using nomp_free().
+ *
+ * @param[out] name Kernel name as a C-string.
+ * @param[out] src Backend kernel source as a C-string.
+ * @param[in,out] prg Nomp program object.
+ * @param[in] fp Stream to read from.
+ * @return int Non-zero if the kernel couldn't be read.
+ */
+int nomp_cache_read_knl(char **name, char **src, nomp_prog_t *prg, FILE *fp) {
+  *name = *src = NULL;
+
+  int   valid = 0;
+  char *magic = cache_read_str(fp);
+  if (magic && strcmp(magic, CACHE_MAGIC) == 0) {
+    *name = cache_read_str(fp), *src = cache_read_str(fp);
+    valid = *name && *src && !cache_read_exprs(fp, prg->sym_global) &&
+            !cache_read_exprs(fp, prg->sym_local);
+  }
+  nomp_free(&magic);
+
+  if (valid) {
+    prg->ndim = nomp_max(2, vecbasic_size(prg->sym_global),
+                         vecbasic_size(prg->sym_local));
+    return 0;
+  }
+
+  nomp_free(name), nomp_free(src);
+  vecbasic_free(prg->sym_global), prg->sym_global = vecbasic_new();
+  vecbasic_free(prg->sym_local), prg->sym_local   = vecbasic_new();
+
+  return 1;
+}
+
+/**
+ * @ingroup nomp_cache_utils
+ *
+ * @brief Load a kernel from the cache.
+ *
+ * On a cache hit, \p hit is set to 1 and kernel name, backend source and the
+ * grid size expressions are read from the cache. Grid size expressions are
+ * stored in the program \p prg. On a cache miss (or if the cache is disabled
+ * or the cache entry is not readable), \p hit is set to 0. User must free the
+ * memory allocated for \p name and \p src using nomp_free().
+ *
+ * @param[out] hit Set to 1 if the kernel was found in the cache.
+ * @param[out] name Kernel name as a C-string.
+ * @param[out] src Backend kernel source as a C-string.
+ * @param[in,out] prg Nomp program object.
+ * @param[in] key Cache key computed by nomp_cache_key().
+ * @return int
+ */
+int nomp_cache_load(int *hit, char **name, char **src, nomp_prog_t *prg,
+                    uint64_t key) {
+  *hit = 0, *name = *src = NULL;
+  if (strlen(cache_dir) == 0) return 0;
+
+  char *path = cache_get_path(key, "knl");
+  FILE *fp   = fopen(path, "rb");
+  nomp_free(&path);
+  if (!fp) {
+    cache_misses++;
+    return 0;
+  }
+
+  *hit = !nomp_cache_read_knl(name, src, prg, fp);
+  fclose(fp);
+
+  if (*hit) {
+    cache_hits++;
+    return 0;
+  }
+
+  cache_misses++;
+
+  return nomp_log(NOMP_SUCCESS, NOMP_WARNING,
+                  "Ignoring invalid kernel cache entry %016llx.",
+                  (unsigned long long)key);
+}
+
+/**
+ * @ingroup nomp_cache_utils
+ *
+ * @brief Store a kernel in the cache.
+ *
+ * Failing to write the cache entry is not an error, only a warning is issued.
+ *
+ * @param[in] key Cache key computed by nomp_cache_key().
+ * @param[in] name Kernel name as a C-string.
+ * @param[in] src Backend kernel source as a C-string.
+ * @param[in] prg Nomp program object with grid size expressions.
+ * @return int
+ */
+int nomp_cache_store(uint64_t key, const char *name, const char *src,
+                     nomp_prog_t *prg) {
+  if (strlen(cache_dir) == 0) return 0;
+
+  char *tmp, *path;
+  FILE *fp  = cache_open_entry(&tmp, &path, key, "knl");
+  int   err = !fp || nomp_cache_write_knl(fp, name, src, prg);
+  if (cache_close_entry(fp, &tmp, &path, err)) {
+    nomp_log(NOMP_SUCCESS, NOMP_WARNING,
+             "Unable to write kernel \"%s\" to the cache directory \"%s\".",
+             name, cache_dir);
+  }
+
+  return 0;
+}
+
+/**
+ * @ingroup nomp_cache_utils
+ *
+ * @brief Read a binary blob (like a compiled backend program) from the cache.
+ *
+ * \p data is set to NULL if the cache is disabled or if there is no entry
+ * for the given \p key and extension \p ext. Otherwise, \p data points to
+ * the contents of the entry and \p size is set to its size in bytes. User
+ * must free \p data using nomp_free().
+ *
+ * @param[out] data Contents of the cache entry.
+ * @param[out] size Size of the cache entry in bytes.
+ * @param[in] key Key of the cache entry.
+ * @param[in] ext Extension used to distinguish different kinds of entries.
+ * @return int
+ */
+int nomp_cache_read(void **data, size_t *size, uint64_t key, const char *ext) {
+  *data = NULL, *size = 0;
+  if (strlen(cache_dir) == 0) return 0;
+
+  char *path = cache_get_path(key, ext);
+  *data      = cache_read_file(path, size);
+  nomp_free(&path);
+
+  return 0;
+}
+
+/**
+ * @ingroup nomp_cache_utils
+ *
+ * @brief Write a binary blob (like a compiled backend program) to the cache.
+ *
+ * Does nothing if the cache is disabled. Failing to write the cache entry is
+ * not an error, only a warning is issued.
+ *
+ * @param[in] data Contents of the cache entry.
+ * @param[in] size Size of the cache entry in bytes.
+ * @param[in] key Key of the cache entry.
+ * @param[in] ext Extension used to distinguish different kinds of entries.
+ * @return int
+ */
+int nomp_cache_write(const void *data, size_t size, uint64_t key,
+                     const char *ext) {
+  if (strlen(cache_dir) == 0) return 0;
+
+  char *tmp, *path;
+  FILE *fp  = cache_open_entry(&tmp, &path, key, ext);
+  int   err = !fp || fwrite(data, 1, size, fp) != size;
+  if (cache_close_entry(fp, &tmp, &path, err)) {
+    nomp_log(NOMP_SUCCESS, NOMP_WARNING,
+             "Unable to write cache entry %016llx.%s to the cache directory "
+             "\"%s\".",
+             (unsigned long long)key, ext, cache_dir);
+  }
+
+  return 0;
+}
+
+/**
+ * @ingroup nomp_cache_utils
+ *
+ * @brief Get the path of a cache entry.
+ *
+ * Used by backends which have to pass a file to a system API (like dlopen())
+ * instead of reading the entry into memory. \p path is set to NULL if the
+ * cache is disabled. Otherwise, user must free \p path using nomp_free().
+ *
+ * @param[out] path Path of the cache entry.
+ * @param[in] key Key of the cache entry.
+ * @param[in] ext Extension used to distinguish different kinds of entries.
+ * @return int
+ */
+int nomp_cache_path(char **path, uint64_t key, const char *ext) {
+  *path = NULL;
+  if (strlen(cache_dir) == 0) return 0;
+  *path = cache_get_path(key, ext);
+  return 0;
+}
+
+/**
+ * @ingroup nomp_user_api
+ *
+ * @brief Query the number of kernel cache hits and misses.
+ *
+ * @details Returns the number of nomp_jit() calls which were served from the
+ * on-disk kernel cache (\p hits) and the number of calls which had to run the
+ * full code generation pipeline (\p misses) since nomp_init(). Both counts are
+ * zero if the cache is disabled. Either of the pointers can be NULL.
+ *
+ * @param[out] hits Number of cache hits.
+ * @param[out] misses Number of cache misses.
+ * @return int
+ */
+int nomp_get_cache_stats(unsigned *hits, unsigned *misses) {
+  if (hits) *hits = cache_hits;
+  if (misses) *misses = cache_misses;
+  return 0;
+}
+
+/**
+ * @ingroup nomp_cache_utils
+ *
+ * @brief Reset the state of the kernel cache.
+ *
+ * @return void
+ */
+void nomp_cache_finalize(void) {
+  strcpy(cache_dir, ""), strcpy(scripts_dir, "");
+  strcpy(annotations_script, ""), cache_seed = NOMP_HASH_SEED;
+}
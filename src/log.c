@@ -1,7 +1,9 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
+#include "nomp-aux.h"
 #include "nomp-impl.h"
 #include "nomp-log.h"
 
@@ -21,6 +23,9 @@ static unsigned    logs_n            = 0;
 static unsigned    logs_max          = 0;
 static const char *LOG_TYPE_STRING[] = {"Error", "Warning", "Info"};
 static unsigned    verbose           = 0;
+// Logs and timers are shared by all the contexts, so they can be recorded and
+// queried from multiple threads.
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /**
  * @ingroup nomp_log_utils
@@ -55,6 +60,10 @@ int nomp_log_set_verbose(const unsigned verbose_in) {
  * @return int
  */
 int nomp_log_(const char *description, int errorno, nomp_log_type_t type, ...) {
+  // Warnings and information are neither printed nor recorded if the verbose
+  // level is not high enough, so don't bother formatting them.
+  if (type != NOMP_ERROR && verbose < (unsigned)type) return 0;
+
   const char *type_str = LOG_TYPE_STRING[type - 1];
   size_t      len      = strlen(description) + strlen(type_str) + 10;
   char       *desc     = nomp_calloc(char, len);
@@ -68,24 +77,25 @@ int nomp_log_(const char *description, int errorno, nomp_log_type_t type, ...) {
   nomp_free(&desc);
 
   // Print the logs based on the verbose level.
-  if ((verbose >= NOMP_ERROR && type == NOMP_ERROR) ||
-      (verbose >= NOMP_WARNING && type == NOMP_WARNING) ||
-      (verbose >= NOMP_INFO && type == NOMP_INFO)) {
+  if (verbose >= (unsigned)type) {
     fprintf(stderr, "%s\n", buf);
     fflush(stderr);
   }
 
-  if (type == NOMP_ERROR) {
-    if (logs_max <= logs_n) {
-      logs_max += logs_max / 2 + 1;
-      logs = nomp_realloc(logs, struct log, logs_max);
-    }
+  if (type != NOMP_ERROR) return 0;
 
-    logs[logs_n].description = strndup(buf, BUFSIZ);
-    logs[logs_n].errorno = errorno, logs[logs_n].type = type, logs_n++;
+  pthread_mutex_lock(&log_lock);
+  if (logs_max <= logs_n) {
+    logs_max += logs_max / 2 + 1;
+    logs = nomp_realloc(logs, struct log, logs_max);
   }
 
-  return type == NOMP_ERROR ? logs_n : 0;
+  logs[logs_n].description = strndup(buf, BUFSIZ);
+  logs[logs_n].errorno = errorno, logs[logs_n].type = type;
+  int id               = ++logs_n;
+  pthread_mutex_unlock(&log_lock);
+
+  return id;
 }
 
 /**
@@ -100,9 +110,12 @@ int nomp_log_(const char *description, int errorno, nomp_log_type_t type, ...) {
  * @return char*
  */
 char *nomp_get_err_str(unsigned id) {
-  if (id == 0 || id > logs_n) return NULL;
+  char *str = NULL;
+  pthread_mutex_lock(&log_lock);
+  if (id > 0 && id <= logs_n) str = strndup(logs[id - 1].description, BUFSIZ);
+  pthread_mutex_unlock(&log_lock);
 
-  return strndup(logs[id - 1].description, BUFSIZ);
+  return str;
 }
 
 /**
@@ -117,8 +130,12 @@ char *nomp_get_err_str(unsigned id) {
  * @return int
  */
 int nomp_get_err_no(unsigned id) {
-  if (id == 0 || id > logs_n) return NOMP_USER_LOG_ID_IS_INVALID;
-  return logs[id - 1].errorno;
+  int errorno = NOMP_USER_LOG_ID_IS_INVALID;
+  pthread_mutex_lock(&log_lock);
+  if (id > 0 && id <= logs_n) errorno = logs[id - 1].errorno;
+  pthread_mutex_unlock(&log_lock);
+
+  return errorno;
 }
 
 /**
@@ -128,23 +145,55 @@ int nomp_get_err_no(unsigned id) {
  * @return void
  */
 void nomp_log_finalize(void) {
+  pthread_mutex_lock(&log_lock);
   for (unsigned i = 0; i < logs_n; i++)
     nomp_free(&logs[i].description);
   nomp_free(&logs), logs_n = logs_max = 0;
+  pthread_mutex_unlock(&log_lock);
 }
 
+/**
+ * @ingroup nomp_log_utils
+ * @brief Acquire the lock which guards the logs and the profiler.
+ *
+ * The lock is held while forking, so the child process doesn't start with
+ * the lock held by a thread which doesn't exist in it.
+ *
+ * @return void
+ */
+void nomp_log_lock(void) { pthread_mutex_lock(&log_lock); }
+
+/**
+ * @ingroup nomp_log_utils
+ * @brief Release the lock acquired with nomp_log_lock().
+ *
+ * @return void
+ */
+void nomp_log_unlock(void) { pthread_mutex_unlock(&log_lock); }
+
+// Timers are kept in the order they were created, which is the order they
+// are printed in. These are found with an open addressing hash table (with
+// linear probing) keyed by the hash of the entry name. Each slot holds the
+// index of a timer plus one, so zero marks an empty slot.
 struct time_log {
   char    *entry;
+  uint64_t hash;
   unsigned total_calls;
   double   total_time;
   double   last_call;
-  clock_t  last_tick;
+  double   last_tick;
+  int      running;
+  // Time measured on the device by the backend for kernels and copies.
+  unsigned device_calls;
+  double   device_time;
 };
 
-static struct time_log *time_logs     = NULL;
-static unsigned         time_logs_n   = 0;
-static unsigned         time_logs_max = 0;
-static int              profile_level = 0;
+static struct time_log *time_logs      = NULL;
+static unsigned         time_logs_n    = 0;
+static unsigned         time_logs_max  = 0;
+static unsigned        *time_slots     = NULL;
+static unsigned         time_slots_max = 0;
+static int              profile_level  = 0;
 
 /**
  * @ingroup nomp_profiler_utils
@@ -158,11 +207,157 @@ int nomp_profile_set_level(const int profile_level_in) {
   return 0;
 }
 
-static unsigned find_time_log(const char *entry) {
+/**
+ * @ingroup nomp_profiler_utils
+ * @brief Returns the monotonic wall clock time in milliseconds.
+ *
+ * @details Profiler and trace timestamps use this clock. Backends convert
+ * device timestamps to it.
+ *
+ * @return double
+ */
+double nomp_profile_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec * 1e-6;
+}
+
+static inline unsigned profile_find_slot(const char *entry, uint64_t hash) {
+  unsigned i = (unsigned)hash & (time_slots_max - 1);
+  for (; time_slots[i]; i = (i + 1) & (time_slots_max - 1)) {
+    const struct time_log *t = &time_logs[time_slots[i] - 1];
+    if (t->hash == hash && strncmp(t->entry, entry, NOMP_MAX_BUFFER_SIZE) == 0)
+      break;
+  }
+  return i;
+}
+
+static void profile_resize(unsigned size) {
+  nomp_free(&time_slots);
+  time_slots     = nomp_calloc(unsigned, size);
+  time_slots_max = size;
   for (unsigned i = 0; i < time_logs_n; i++) {
-    if (strncmp(time_logs[i].entry, entry, NOMP_MAX_BUFFER_SIZE) == 0) return i;
+    const struct time_log *t = &time_logs[i];
+    time_slots[profile_find_slot(t->entry, t->hash)] = i + 1;
+  }
+}
+
+// Returns the timer of an entry, creating it if needed. Must be called with
+// the lock held.
+static unsigned profile_entry(const char *entry) {
+  uint64_t hash = nomp_hash(NOMP_HASH_SEED, entry,
+                            strnlen(entry, NOMP_MAX_BUFFER_SIZE));
+  // Keep the load factor below 1/2.
+  if (2 * (time_logs_n + 1) > time_slots_max)
+    profile_resize(time_slots_max ? 2 * time_slots_max : 64);
+
+  unsigned s = profile_find_slot(entry, hash);
+  if (time_slots[s]) return time_slots[s] - 1;
+
+  if (time_logs_max <= time_logs_n) {
+    time_logs_max += time_logs_max / 2 + 1;
+    time_logs = nomp_realloc(time_logs, struct time_log, time_logs_max);
+  }
+  struct time_log *t = &time_logs[time_logs_n];
+  memset(t, 0, sizeof(struct time_log));
+  t->entry      = strndup(entry, NOMP_MAX_BUFFER_SIZE);
+  t->hash       = hash;
+  time_slots[s] = ++time_logs_n;
+
+  return time_logs_n - 1;
+}
+
+/**
+ * @ingroup nomp_profiler_utils
+ * @brief Get the id of the timer of an entry, creating the timer if it
+ * doesn't exist.
+ *
+ * @details Ids are used to record times with nomp_profile_host() and
+ * nomp_profile_device() without looking up the entry by name every time.
+ * Ids start from one, so zero can be used for anything which isn't profiled.
+ * Ids are valid until the profiler is finalized.
+ *
+ * @param[in] name Name of the entry.
+ * @return unsigned
+ */
+unsigned nomp_profile_entry(const char *name) {
+  pthread_mutex_lock(&log_lock);
+  unsigned id = profile_entry(name) + 1;
+  pthread_mutex_unlock(&log_lock);
+  return id;
+}
+
+/**
+ * @ingroup nomp_profiler_utils
+ * @brief Get the name of an entry.
+ *
+ * @param[in] id Id of the entry returned by nomp_profile_entry().
+ * @return const char *
+ */
+const char *nomp_profile_name(const unsigned id) {
+  pthread_mutex_lock(&log_lock);
+  const char *name = (id > 0 && id <= time_logs_n) ? time_logs[id - 1].entry
+                                                   : NULL;
+  pthread_mutex_unlock(&log_lock);
+  return name;
+}
+
+/**
+ * @ingroup nomp_profiler_utils
+ * @brief Start or stop the host timer of an entry.
+ *
+ * @details Time is measured with the monotonic wall clock, so the time spent
+ * waiting for the device is included.
+ *
+ * @param[in] id Id of the entry returned by nomp_profile_entry().
+ * @param[in] toggle Starts the timer if 1 and stops it if 0.
+ * @return void
+ */
+void nomp_profile_host(const unsigned id, const int toggle) {
+  if (profile_level == 0 || id == 0) return;
+
+  double now = nomp_profile_now();
+  pthread_mutex_lock(&log_lock);
+  if (id <= time_logs_n) {
+    struct time_log *t = &time_logs[id - 1];
+    if (toggle == 1) {
+      t->last_tick = now, t->running = 1;
+    } else if (t->running) {
+      // Ignore if the user toggles off the timer by accident.
+      t->last_call = now - t->last_tick;
+      t->total_time += t->last_call;
+      t->total_calls++, t->running = 0;
+    }
+  }
+  pthread_mutex_unlock(&log_lock);
+}
+
+/**
+ * @ingroup nomp_profiler_utils
+ * @brief Record the time taken by a kernel or a copy on the device.
+ *
+ * @details Called by the backends with the times measured using device
+ * events, which are reported separately from the host time of the entry.
+ * The work is also recorded in the trace (if tracing is on).
+ *
+ * @param[in] id Id of the entry returned by nomp_profile_entry().
+ * @param[in] queue Queue the work ran on.
+ * @param[in] start Start of the work converted to nomp_profile_now() time.
+ * @param[in] end End of the work converted to nomp_profile_now() time.
+ * @return void
+ */
+void nomp_profile_device(const unsigned id, const unsigned queue,
+                         const double start, const double end) {
+  if (id == 0) return;
+
+  pthread_mutex_lock(&log_lock);
+  if (id <= time_logs_n) {
+    time_logs[id - 1].device_time += end - start;
+    time_logs[id - 1].device_calls++;
   }
-  return time_logs_n;
+  pthread_mutex_unlock(&log_lock);
+
+  nomp_trace_device(id, queue, start, end);
 }
 
 /**
@@ -174,9 +369,9 @@ static unsigned find_time_log(const char *entry) {
  * toggle value. The function will start the timer if the toggle is 1. Else,
  * it will capture the execution time and records in a log.
  * @code{.c}
- * nomp_profile("Entry Name", 1, nomp.profile, 1);
+ * nomp_profile("Entry Name", 1, 0);
  * // Code to be measured
- * nomp_profile("Entry Name", 0, nomp.profile, 1);
+ * nomp_profile("Entry Name", 0, 1);
  * @endcode
  *
  * @param[in] name Name of the execution time that is being profiled.
@@ -189,44 +384,7 @@ void nomp_profile(const char *name, const int toggle, const int sync) {
   if (profile_level == 0) return;
 
   if (toggle == 0 && sync == 1) nomp_sync();
-  clock_t current_tick = clock();
-
-  unsigned id = find_time_log(name);
-  // If the timer is not found, create a new one.
-  if (id == time_logs_n) {
-    // Starts the timer if toggle is on.
-    if (toggle == 1) {
-      // Dynamically increase the memory if needed.
-      if (time_logs_max <= time_logs_n) {
-        time_logs_max += time_logs_max / 2 + 1;
-        time_logs = nomp_realloc(time_logs, struct time_log, time_logs_max);
-      }
-
-      // Creates a new time_log
-      time_logs[id].entry       = strndup(name, NOMP_MAX_BUFFER_SIZE);
-      time_logs[id].total_calls = 0;
-      time_logs[id].total_time  = 0;
-      time_logs[id].last_tick   = current_tick;
-      time_logs_n++;
-    }
-  } else if (toggle == 0) {
-    // Ignore if the user toggles off the timer by accident.
-    if (time_logs[id].last_tick == 0) return;
-
-    // Captures the execution time.
-    double elapsed =
-        (double)(current_tick - time_logs[id].last_tick) / CLOCKS_PER_SEC;
-    elapsed *= 1000.0;
-
-    // Updates the current timing information.
-    time_logs[id].last_call = elapsed;
-    time_logs[id].total_time += elapsed;
-    time_logs[id].last_tick = 0;
-    time_logs[id].total_calls++;
-  } else {
-    // Toggle is on. So, we start the timer on an exiting time log.
-    time_logs[id].last_tick = current_tick;
-  }
+  nomp_profile_host(nomp_profile_entry(name), toggle);
 }
 
 /**
@@ -234,21 +392,32 @@ void nomp_profile(const char *name, const int toggle, const int sync) {
  * @brief Prints all the execution times recorded by the program.
  * This function is executed only when the `--nomp-profile` is provided.
  *
+ * @details Host time of kernel launches is the launch overhead (unless the
+ * launch blocks) while the device time is the time the kernel ran for.
+ *
  * @return int
  */
 void nomp_profile_result(void) {
   if (profile_level == 0) return;
 
-  printf("| %-24s | %12s | %18s | %18s | %18s |\n", "Entry", "Total Calls",
-         "Total Time (ms)", "Last Call (ms)", "Average Time (ms)");
+  printf("| %-24s | %12s | %18s | %18s | %18s | %18s |\n", "Entry",
+         "Total Calls", "Total Time (ms)", "Last Call (ms)",
+         "Average Time (ms)", "Device Time (ms)");
   printf("|--------------------------|--------------|--------------------|-----"
-         "---------------|--------------------|\n");
+         "---------------|--------------------|--------------------|\n");
+  pthread_mutex_lock(&log_lock);
   for (unsigned i = 0; i < time_logs_n; i++) {
-    double avg_time = time_logs[i].total_time / time_logs[i].total_calls;
-    printf("| %-24s | %12d | %18.4lf | %18.4lf | %18.4lf |\n",
-           time_logs[i].entry, time_logs[i].total_calls,
-           time_logs[i].total_time, time_logs[i].last_call, avg_time);
+    const struct time_log *t        = &time_logs[i];
+    double                 avg_time = 0;
+    if (t->total_calls) avg_time = t->total_time / t->total_calls;
+    printf("| %-24s | %12d | %18.4lf | %18.4lf | %18.4lf | ", t->entry,
+           t->total_calls, t->total_time, t->last_call, avg_time);
+    if (t->device_calls)
+      printf("%18.4lf |\n", t->device_time);
+    else
+      printf("%18s |\n", "-");
   }
+  pthread_mutex_unlock(&log_lock);
 }
 
 /**
@@ -258,7 +427,10 @@ void nomp_profile_result(void) {
  * @return void
  */
 void nomp_profile_finalize(void) {
+  pthread_mutex_lock(&log_lock);
   for (unsigned i = 0; i < time_logs_n; i++)
     nomp_free(&time_logs[i].entry);
   nomp_free(&time_logs), time_logs_n = time_logs_max = 0;
+  nomp_free(&time_slots), time_slots_max = 0;
+  pthread_mutex_unlock(&log_lock);
 }
@@ -2,9 +2,44 @@
 #include "nomp-impl.h"
 #include "nomp-loopy.h"
 
-static char      backend[NOMP_MAX_BUFFER_SIZE + 1];
-static PyObject *py_backend_str               = NULL;
-static PyObject *py_pymbolic_to_symengine_str = NULL;
+// Python functions called while generating a kernel. Each of them is looked
+// up the first time it is called instead of importing the module on every
+// call, so nomp_init() and kernels served from the kernel cache don't import
+// loopy. These are released in nomp_py_finalize().
+enum py_func {
+  PY_C_TO_LOOPY,
+  PY_GET_KNL_NAME,
+  PY_GET_KNL_SRC,
+  PY_FIX_PARAMETERS,
+  PY_LOWER_TO_TARGET,
+  PY_FUSE,
+  PY_REALIZE_REDUCTION,
+  PY_AUTOTUNE_CANDIDATES,
+  PY_AUTOTUNE_APPLY,
+  PY_FUNCS_N
+};
+
+static const char *py_funcs_names[PY_FUNCS_N][2] = {
+    {"loopy_api", "c_to_loopy"},      {"loopy_api", "get_knl_name"},
+    {"loopy_api", "get_knl_src"},     {"loopy_api", "fix_parameters"},
+    {"loopy_api", "lower_to_target"}, {"loopy_api", "fuse"},
+    {"reduction", "realize_reduction"}, {"autotune", "get_candidates"},
+    {"autotune", "apply"}};
+
+static PyObject *py_funcs[PY_FUNCS_N] = {NULL};
+
+// The mapper doesn't keep any state between the calls, so a single instance
+// converts all the grid size expressions.
+static PyObject *py_pymbolic_to_symengine = NULL;
+
+// The interpreter is shared by all the contexts. Python calls are serialized
+// with `py_lock` (loopy and the kernel cache are not thread safe) and done
+// with the GIL held. The GIL is released by the thread which initialized the
+// interpreter so the other threads can take it.
+static pthread_mutex_t  py_lock = PTHREAD_MUTEX_INITIALIZER;
+static PyThreadState   *py_main = NULL;
+static pthread_t        py_main_thread;
+static PyGILState_STATE py_gil;
 
 #define check_error_(obj, err, ...)                                            \
   {                                                                            \
@@ -20,23 +55,92 @@ static PyObject *py_pymbolic_to_symengine_str = NULL;
 #define check_py_call(obj, ...)                                                \
   check_error_(obj, NOMP_PY_CALL_FAILURE, __VA_ARGS__)
 
+/**
+ * @ingroup nomp_py_utils
+ *
+ * @brief Take the lock of the nomp python interface.
+ *
+ * @details Must be held while calling any of the other nomp_py_*() functions
+ * or the Python C API. Initializes the interpreter if it is not initialized
+ * yet. The lock is not recursive.
+ *
+ * @return void
+ */
+void nomp_py_lock(void) {
+  pthread_mutex_lock(&py_lock);
+  if (!Py_IsInitialized()) {
+    // May be we need the isolated configuration listed here:
+    // https://docs.python.org/3/c-api/init_config.html#init-config
+    // But for now, we do the simplest thing possible.
+    Py_InitializeEx(0);
+    py_main        = PyEval_SaveThread();
+    py_main_thread = pthread_self();
+  }
+  py_gil = PyGILState_Ensure();
+}
+
+/**
+ * @ingroup nomp_py_utils
+ *
+ * @brief Release the lock taken with nomp_py_lock().
+ *
+ * @return void
+ */
+void nomp_py_unlock(void) {
+  PyGILState_Release(py_gil);
+  pthread_mutex_unlock(&py_lock);
+}
+
+static int py_import_func(PyObject **func, const char *module,
+                          const char *name) {
+  PyObject *py_module = PyImport_ImportModule(module);
+  check_py_call(py_module, "Importing Python module \"%s\" failed.", module);
+
+  PyObject *py_func = PyObject_GetAttrString(py_module, name);
+  check_py_call(py_func,
+                "Importing Python function \"%s\" from module \"%s\" failed.",
+                name, module);
+  check_py_call(PyCallable_Check(py_func),
+                "Python function \"%s\" from module \"%s\" is not callable.",
+                name, module);
+  Py_XDECREF(*func), *func = py_func;
+  Py_DECREF(py_module);
+
+  return 0;
+}
+
+static inline int py_load_func(enum py_func func) {
+  if (py_funcs[func]) return 0;
+  return py_import_func(&py_funcs[func], py_funcs_names[func][0],
+                        py_funcs_names[func][1]);
+}
+
+static int py_load_mapper(void) {
+  if (py_pymbolic_to_symengine) return 0;
+
+  PyObject *py_mapper = NULL;
+  nomp_check(py_import_func(&py_mapper, "pymbolic.interop.symengine",
+                            "PymbolicToSymEngineMapper"));
+  py_pymbolic_to_symengine = PyObject_CallNoArgs(py_mapper);
+  Py_DECREF(py_mapper);
+  check_py_call(py_pymbolic_to_symengine,
+                "Calling PymbolicToSymEngineMapper() failed.");
+
+  return 0;
+}
+
 /**
  * @ingroup nomp_py_utils
  *
  * @brief Initialize the nomp python interface.
  *
+ * @details Python functions used to generate kernels are imported when they
+ * are first called, so nomp_init() doesn't need loopy.
+ *
  * @param[in] cfg Nomp configuration struct of type ::nomp_config_t.
  * @return int
  */
 int nomp_py_init(const nomp_config_t *const cfg) {
-  strncpy(backend, cfg->backend, NOMP_MAX_BUFFER_SIZE);
-  backend[NOMP_MAX_BUFFER_SIZE] = '\0';
-
-  // May be we need the isolated configuration listed here:
-  // https://docs.python.org/3/c-api/init_config.html#init-config
-  // But for now, we do the simplest thing possible.
-  if (!Py_IsInitialized()) Py_InitializeEx(0);
-
   // Append current working directory to sys.path.
   nomp_check(nomp_py_append_to_sys_path("."));
 
@@ -48,13 +152,6 @@ int nomp_py_init(const nomp_config_t *const cfg) {
   // Append nomp script directory to sys.path.
   nomp_check(nomp_py_append_to_sys_path(cfg->scripts_dir));
 
-  py_backend_str = PyUnicode_FromString(backend);
-  check_py_str(py_backend_str, backend);
-
-  py_pymbolic_to_symengine_str =
-      PyUnicode_FromString("PymbolicToSymEngineMapper");
-  check_py_str(py_pymbolic_to_symengine_str, "PymbolicToSymEngineMapper");
-
   return 0;
 }
 
@@ -125,25 +222,26 @@ int nomp_py_check_module(const char *module, const char *function) {
  *
  * @param[out] kernel Loopy Kernel object.
  * @param[in] src C kernel source.
+ * @param[in] py_context Python dictionary with context information.
  * @return int
  */
-int nomp_py_c_to_loopy(PyObject **kernel, const char *src) {
-  PyObject *py_src_str = PyUnicode_FromString(src);
-  check_py_str(py_src_str, src);
+int nomp_py_c_to_loopy(PyObject **kernel, const char *src,
+                       const PyObject *py_context) {
+  nomp_check(py_load_func(PY_C_TO_LOOPY));
 
-  PyObject *py_loopy_api = PyImport_ImportModule("loopy_api");
-  check_py_call(py_loopy_api, "Importing loopy_api module failed.");
+  PyObject *py_backend_str =
+      PyDict_GetItemString((PyObject *)py_context, "backend::name");
+  check_py_call(py_backend_str, "Backend name is not set in the context.");
 
-  PyObject *py_c_to_loopy = PyObject_GetAttrString(py_loopy_api, "c_to_loopy");
-  check_py_call(py_c_to_loopy,
-                "Importing c_to_loopy function from loop_api module failed.");
+  PyObject *py_src_str = PyUnicode_FromString(src);
+  check_py_str(py_src_str, src);
 
-  *kernel = PyObject_CallFunctionObjArgs(py_c_to_loopy, py_src_str,
+  *kernel = PyObject_CallFunctionObjArgs(py_funcs[PY_C_TO_LOOPY], py_src_str,
                                          py_backend_str, NULL);
   check_error_(*kernel, NOMP_LOOPY_CONVERSION_FAILURE,
                "Converting C source to loopy kernel failed.");
 
-  Py_DECREF(py_loopy_api), Py_DECREF(py_c_to_loopy), Py_DECREF(py_src_str);
+  Py_DECREF(py_src_str);
 
   return 0;
 }
@@ -159,24 +257,18 @@ int nomp_py_c_to_loopy(PyObject **kernel, const char *src) {
  */
 int nomp_py_realize_reduction(PyObject **kernel, const char *const variable,
                               const PyObject *const py_context) {
-  PyObject *py_module = PyImport_ImportModule("reduction");
-  check_py_call(py_module, "Importing reduction module failed.");
-
-  PyObject *py_realize_reduction =
-      PyObject_GetAttrString(py_module, "realize_reduction");
-  check_py_call(py_realize_reduction, "Importing realize_reduction function "
-                                      "from reduction module failed.");
+  nomp_check(py_load_func(PY_REALIZE_REDUCTION));
 
   PyObject *py_variable_str = PyUnicode_FromString(variable);
   check_py_str(py_variable_str, variable);
 
-  PyObject *py_result = PyObject_CallFunctionObjArgs(
-      py_realize_reduction, *kernel, py_variable_str, py_context, NULL);
+  PyObject *py_result =
+      PyObject_CallFunctionObjArgs(py_funcs[PY_REALIZE_REDUCTION], *kernel,
+                                   py_variable_str, py_context, NULL);
   check_py_call(py_result, "Calling realize_reduction() function failed.");
 
   Py_DECREF(*kernel), *kernel = py_result;
-  Py_DECREF(py_variable_str), Py_DECREF(py_realize_reduction);
-  Py_DECREF(py_module);
+  Py_DECREF(py_variable_str);
 
   return 0;
 }
@@ -235,6 +327,94 @@ int nomp_py_transform(PyObject **kernel, const char *const file,
   return 0;
 }
 
+/**
+ * @ingroup nomp_py_utils
+ * @brief Get the points of the search space of a tuned transform.
+ *
+ * The search space is declared in the transform script with
+ * `autotune.search_space()`. Each point is returned as a JSON string which
+ * maps the parameters of the transform to their values. User must free each
+ * of the \p candidates and the array itself using nomp_free().
+ *
+ * @param[out] candidates Points of the search space.
+ * @param[out] n Number of points.
+ * @param[in] file Name of the transform script.
+ * @param[in] function Name of the transform function.
+ * @param[in] context Context (as a PyDict) with the device details.
+ * @return int
+ */
+int nomp_py_autotune_candidates(char ***candidates, unsigned *n,
+                                const char *file, const char *function,
+                                const PyObject *context) {
+  nomp_check(py_load_func(PY_AUTOTUNE_CANDIDATES));
+
+  *candidates = NULL, *n = 0;
+
+  PyObject *py_file = PyUnicode_FromString(file);
+  check_py_str(py_file, file);
+  PyObject *py_function = PyUnicode_FromString(function);
+  check_py_str(py_function, function);
+
+  PyObject *py_candidates =
+      PyObject_CallFunctionObjArgs(py_funcs[PY_AUTOTUNE_CANDIDATES], py_file,
+                                   py_function, context, NULL);
+  Py_DECREF(py_file), Py_DECREF(py_function);
+  check_py_call(py_candidates,
+                "Getting the search space of \"%s\" from module \"%s\" "
+                "failed.",
+                function, file);
+
+  Py_ssize_t len = PyList_Size(py_candidates);
+  *candidates    = nomp_calloc(char *, len > 0 ? len : 1);
+  for (Py_ssize_t i = 0; i < len; i++) {
+    Py_ssize_t  size;
+    const char *str =
+        PyUnicode_AsUTF8AndSize(PyList_GetItem(py_candidates, i), &size);
+    if (str) (*candidates)[(*n)++] = strndup(str, size);
+  }
+  Py_DECREF(py_candidates);
+
+  return 0;
+}
+
+/**
+ * @ingroup nomp_py_utils
+ * @brief Apply a tuned transform with the given parameters.
+ *
+ * @param[in,out] kernel Pointer to loopy kernel object.
+ * @param[in] file Name of the transform script.
+ * @param[in] function Name of the transform function.
+ * @param[in] params Parameters of the transform as a JSON string (one of the
+ * points returned by nomp_py_autotune_candidates()). Defaults of the
+ * transform are used if this is NULL.
+ * @param[in] context Context (as a PyDict) with the device details.
+ * @return int
+ */
+int nomp_py_autotune(PyObject **kernel, const char *file, const char *function,
+                     const char *params, const PyObject *context) {
+  nomp_check(py_load_func(PY_AUTOTUNE_APPLY));
+
+  PyObject *py_file = PyUnicode_FromString(file);
+  check_py_str(py_file, file);
+  PyObject *py_function = PyUnicode_FromString(function);
+  check_py_str(py_function, function);
+  PyObject *py_params = PyUnicode_FromString(params ? params : "");
+  check_py_str(py_params, params);
+
+  PyObject *py_tuned_kernel = PyObject_CallFunctionObjArgs(
+      py_funcs[PY_AUTOTUNE_APPLY], *kernel, context, py_file, py_function,
+      py_params, NULL);
+  Py_DECREF(py_file), Py_DECREF(py_function), Py_DECREF(py_params);
+  check_py_call(py_tuned_kernel,
+                "Calling Python function \"%s\" from module \"%s\" with "
+                "parameters %s failed.",
+                function, file, params ? params : "{}");
+
+  Py_DECREF(*kernel), *kernel = py_tuned_kernel;
+
+  return 0;
+}
+
 /**
  * @ingroup nomp_py_utils
  * @brief Get kernel name and generated source for the backend.
@@ -246,16 +426,11 @@ int nomp_py_transform(PyObject **kernel, const char *const file,
  */
 int nomp_py_get_knl_name_and_src(char **name, char **src,
                                  const PyObject *kernel) {
-  PyObject *py_loopy_api = PyImport_ImportModule("loopy_api");
-  check_py_call(py_loopy_api, "Importing module loopy_api failed.");
-
-  PyObject *py_get_knl_name =
-      PyObject_GetAttrString(py_loopy_api, "get_knl_name");
-  check_py_call(py_get_knl_name,
-                "Importing function loop_api.get_knl_name failed.");
+  nomp_check(py_load_func(PY_GET_KNL_NAME));
+  nomp_check(py_load_func(PY_GET_KNL_SRC));
 
   PyObject *py_name =
-      PyObject_CallFunctionObjArgs(py_get_knl_name, kernel, NULL);
+      PyObject_CallFunctionObjArgs(py_funcs[PY_GET_KNL_NAME], kernel, NULL);
   check_error_(py_name, NOMP_LOOPY_KNL_NAME_NOT_FOUND,
                "Unable to get loopy kernel name.");
 
@@ -263,13 +438,10 @@ int nomp_py_get_knl_name_and_src(char **name, char **src,
   const char *const name_ = PyUnicode_AsUTF8AndSize(py_name, &size);
   *name                   = strndup(name_, size);
 
-  Py_DECREF(py_name), Py_DECREF(py_get_knl_name);
+  Py_DECREF(py_name);
 
-  PyObject *py_kernel_src = PyObject_GetAttrString(py_loopy_api, "get_knl_src");
-  check_py_call(py_kernel_src,
-                "Importing function loop_api.get_knl_src failed.");
-
-  PyObject *py_src = PyObject_CallFunctionObjArgs(py_kernel_src, kernel, NULL);
+  PyObject *py_src =
+      PyObject_CallFunctionObjArgs(py_funcs[PY_GET_KNL_SRC], kernel, NULL);
 
   check_error_(py_src, NOMP_LOOPY_CODEGEN_FAILURE,
                "Backend code generation from loopy kernel \"%s\" failed.",
@@ -278,7 +450,7 @@ int nomp_py_get_knl_name_and_src(char **name, char **src,
   const char *const src_ = PyUnicode_AsUTF8AndSize(py_src, &size);
   *src                   = strndup(src_, size);
 
-  Py_DECREF(py_src), Py_DECREF(py_kernel_src);
+  Py_DECREF(py_src);
 
   return 0;
 }
@@ -346,34 +518,9 @@ int nomp_py_annotate(PyObject **kernel, PyObject *const function,
   return 0;
 }
 
-static int symengine_vec_push(CVecBasic *vec, const char *str) {
-  basic a;
-  basic_new_stack(a);
-
-  CWRAPPER_OUTPUT_TYPE err = basic_parse(a, str);
-  char                 msg[BUFSIZ];
-  snprintf(msg, BUFSIZ,
-           "Expression parsing with SymEngine failed with error %d.", err);
-  check_error_(!err, NOMP_LOOPY_GRIDSIZE_FAILURE, msg);
-
-  vecbasic_push_back(vec, a);
-  basic_free_stack(a);
-
-  return 0;
-}
-
 static int py_get_grid_size_aux(PyObject *exp, CVecBasic *vec) {
-  PyObject *py_pymbolic = PyImport_ImportModule("pymbolic.interop.symengine");
-  check_py_call(py_pymbolic,
-                "Importing module pymbolic.interop.symengine failed.");
-
-  PyObject *py_pymolic_to_symengine_mapper =
-      PyObject_CallMethodNoArgs(py_pymbolic, py_pymbolic_to_symengine_str);
-  check_py_call(py_pymolic_to_symengine_mapper,
-                "Calling PymbolicToSymEngineMapper() failed.");
-
   PyObject *py_symengine_expr =
-      PyObject_CallFunctionObjArgs(py_pymolic_to_symengine_mapper, exp, NULL);
+      PyObject_CallFunctionObjArgs(py_pymbolic_to_symengine, exp, NULL);
   check_py_call(py_symengine_expr,
                 "Converting pymbolic expression to SymEngine failed.");
 
@@ -382,13 +529,12 @@ static int py_get_grid_size_aux(PyObject *exp, CVecBasic *vec) {
                 "Converting SymEngine expression to string failed.");
 
   const char *str = PyUnicode_AsUTF8(py_expr_str);
-  if (symengine_vec_push(vec, str)) {
+  if (nomp_symengine_vec_push(vec, str)) {
     return nomp_log(NOMP_LOOPY_GRIDSIZE_FAILURE, NOMP_ERROR,
                     "Unable to evaluate grid sizes from loopy kernel.");
   }
 
   Py_DECREF(py_expr_str), Py_DECREF(py_symengine_expr);
-  Py_DECREF(py_pymolic_to_symengine_mapper), Py_DECREF(py_pymbolic);
 
   return 0;
 }
@@ -405,6 +551,7 @@ static int py_get_grid_size_aux(PyObject *exp, CVecBasic *vec) {
  */
 int nomp_py_get_grid_size(nomp_prog_t *prg, PyObject *kernel) {
   check_py_call(kernel, "Loopy kernel object is NULL.");
+  nomp_check(py_load_mapper());
 
   PyObject *py_callables = PyObject_GetAttrString(kernel, "callables_table");
   check_py_call(py_callables, "Loopy kernel's callables_table is NULL.");
@@ -457,23 +604,64 @@ int nomp_py_get_grid_size(nomp_prog_t *prg, PyObject *kernel) {
  * @return int
  */
 int nomp_py_fix_parameters(PyObject **kernel, const PyObject *py_dict) {
-  PyObject *py_loopy_api = PyImport_ImportModule("loopy_api");
-
-  PyObject *py_fix_parameters =
-      PyObject_GetAttrString(py_loopy_api, "fix_parameters");
-  check_py_call(py_fix_parameters,
-                "Importing loopy_api.fix_parameters() failed.");
-
-  check_py_call(PyCallable_Check(py_fix_parameters),
-                "loopy_api.fix_parameters() is not callable.");
+  nomp_check(py_load_func(PY_FIX_PARAMETERS));
 
-  PyObject *py_fixed_kernel =
-      PyObject_CallFunctionObjArgs(py_fix_parameters, *kernel, py_dict, NULL);
+  PyObject *py_fixed_kernel = PyObject_CallFunctionObjArgs(
+      py_funcs[PY_FIX_PARAMETERS], *kernel, py_dict, NULL);
   check_py_call(py_fixed_kernel, "Calling loopy.fix_parameters() failed.");
 
   Py_DECREF(*kernel), *kernel = py_fixed_kernel;
 
-  Py_DECREF(py_fix_parameters);
+  return 0;
+}
+
+/**
+ * @ingroup nomp_py_utils
+ * @brief Adapt the loopy kernel to the execution model of the backend.
+ *
+ * For example, the cpu backend runs all the work-items of a work-group
+ * sequentially, so work-item axes are turned into loops.
+ *
+ * @param[in,out] kernel Python kernel object.
+ * @param[in] py_context Python dictionary with context information.
+ * @return int
+ */
+int nomp_py_lower_to_target(PyObject **kernel, const PyObject *py_context) {
+  nomp_check(py_load_func(PY_LOWER_TO_TARGET));
+
+  PyObject *py_lowered_kernel = PyObject_CallFunctionObjArgs(
+      py_funcs[PY_LOWER_TO_TARGET], *kernel, py_context, NULL);
+  check_py_call(py_lowered_kernel,
+                "Calling loopy_api.lower_to_target() failed.");
+
+  Py_DECREF(*kernel), *kernel = py_lowered_kernel;
+
+  return 0;
+}
+
+/**
+ * @ingroup nomp_py_utils
+ * @brief Fuse loopy kernels launched one after the other into a single
+ * kernel.
+ *
+ * @param[out] kernel Fused loopy kernel or NULL if the kernels can't be fused.
+ * @param[in] kernels Python list of loopy kernels.
+ * @param[in] names Python list with a dictionary for each kernel which maps
+ * the names of its arguments to the names of the fused kernel arguments.
+ * @return int
+ */
+int nomp_py_fuse(PyObject **kernel, PyObject *kernels, PyObject *names) {
+  nomp_check(py_load_func(PY_FUSE));
+
+  PyObject *py_fused =
+      PyObject_CallFunctionObjArgs(py_funcs[PY_FUSE], kernels, names, NULL);
+  check_py_call(py_fused, "Calling loopy_api.fuse() failed.");
+
+  *kernel = NULL;
+  if (py_fused != Py_None)
+    *kernel = py_fused;
+  else
+    Py_DECREF(py_fused);
 
   return 0;
 }
@@ -483,18 +671,43 @@ int nomp_py_fix_parameters(PyObject **kernel, const PyObject *py_dict) {
  *
  * @brief Finalize the nomp python interface.
  *
+ * @details Called when the last context is destroyed. Takes the lock of the
+ * python interface, so it must not be held by the caller. The interpreter is
+ * only finalized by the thread which initialized it.
+ *
  * @param[in] interpreter If true, finalize the python interpreter.
  *
  * @return int
  */
 int nomp_py_finalize(int interpreter) {
-  Py_XDECREF(py_pymbolic_to_symengine_str), py_pymbolic_to_symengine_str = NULL;
-  Py_XDECREF(py_backend_str), py_backend_str                             = NULL;
+  nomp_py_lock();
+  for (unsigned i = 0; i < PY_FUNCS_N; i++)
+    Py_XDECREF(py_funcs[i]), py_funcs[i] = NULL;
+  Py_XDECREF(py_pymbolic_to_symengine), py_pymbolic_to_symengine = NULL;
+  if (!interpreter) {
+    nomp_py_unlock();
+    return 0;
+  }
 
   // We only finalize the Python interpreter if user explicitly asked for it.
   // This is because some modules like numpy can't be re-initialized in the
   // same process. See: https://github.com/pybind/pybind11/issues/3112
-  if (interpreter) Py_FinalizeEx();
+  // The interpreter is finalized with the thread state which initialized it,
+  // so it is left running if another thread destroys the last context.
+  if (py_main && !pthread_equal(py_main_thread, pthread_self())) {
+    nomp_py_unlock();
+    nomp_log(NOMP_SUCCESS, NOMP_WARNING,
+             "Python interpreter is not finalized since it was initialized "
+             "by another thread.");
+    return 0;
+  }
+  PyGILState_Release(py_gil);
+  if (py_main)
+    PyEval_RestoreThread(py_main), py_main = NULL;
+  else
+    PyGILState_Ensure();
+  Py_FinalizeEx();
+  pthread_mutex_unlock(&py_lock);
 
   return 0;
 }
@@ -0,0 +1,243 @@
+#include "nomp-impl.h"
+
+// Memory regions mapped to the device are stored in an open addressing hash
+// table (with linear probing) keyed by the host pointer. Each slot holds all
+// the regions mapped for a given host pointer sorted by their start offset
+// (in bytes) so that the sub-range containment query in nomp_update() is a
+// binary search instead of a scan over all the allocations.
+struct nomp_mem_slot {
+  const void  *hptr;
+  nomp_mem_t **mems;
+  // Running maximum of the end offsets of mems[0], ..., mems[i]. This is
+  // used to stop the containment search early.
+  size_t  *max_end;
+  unsigned n, max;
+};
+
+#define MEM_START(m) ((m)->idx0 * (m)->usize)
+#define MEM_END(m)   ((m)->idx1 * (m)->usize)
+
+static inline unsigned mem_hash(const void *p, unsigned size) {
+  // Fibonacci hashing: size of the table is always a power of 2.
+  uint64_t h = ((uint64_t)(uintptr_t)p) * 11400714819323198485ULL;
+  return (unsigned)(h >> 32) & (size - 1);
+}
+
+static inline unsigned mem_find_slot(const nomp_mem_registry_t *r,
+                                     const void *p) {
+  unsigned i = mem_hash(p, r->slots_max);
+  while (r->slots[i].hptr && r->slots[i].hptr != p)
+    i = (i + 1) & (r->slots_max - 1);
+  return i;
+}
+
+static void mem_resize(nomp_mem_registry_t *r, unsigned size) {
+  struct nomp_mem_slot *old = r->slots;
+  unsigned              n   = r->slots_max;
+
+  r->slots     = nomp_calloc(struct nomp_mem_slot, size);
+  r->slots_max = size;
+  for (unsigned i = 0; i < n; i++) {
+    if (old[i].hptr) r->slots[mem_find_slot(r, old[i].hptr)] = old[i];
+  }
+  nomp_free(&old);
+}
+
+static void mem_update_max_end(struct nomp_mem_slot *s, unsigned start) {
+  for (unsigned i = start; i < s->n; i++) {
+    size_t end = MEM_END(s->mems[i]);
+    if (i > 0 && s->max_end[i - 1] > end) end = s->max_end[i - 1];
+    s->max_end[i] = end;
+  }
+}
+
+// Returns the number of regions in the slot whose start offset is <= start.
+static unsigned mem_upper_bound(const struct nomp_mem_slot *s, size_t start) {
+  unsigned lo = 0, hi = s->n;
+  while (lo < hi) {
+    unsigned mid = lo + (hi - lo) / 2;
+    if (MEM_START(s->mems[mid]) <= start)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/**
+ * @ingroup nomp_mem_utils
+ *
+ * @brief Register a memory region which was mapped to the device.
+ *
+ * @param[in] r Memory registry of the context.
+ * @param[in] m Memory region to register.
+ * @return void
+ */
+void nomp_mem_insert(nomp_mem_registry_t *r, nomp_mem_t *m) {
+  r->generation++;
+  // Keep the load factor below 1/2.
+  if (2 * (r->slots_n + 1) > r->slots_max)
+    mem_resize(r, r->slots_max ? 2 * r->slots_max : 64);
+
+  struct nomp_mem_slot *s = &r->slots[mem_find_slot(r, m->hptr)];
+  if (!s->hptr) s->hptr = m->hptr, r->slots_n++;
+
+  if (s->n == s->max) {
+    s->max += s->max / 2 + 1;
+    s->mems    = nomp_realloc(s->mems, nomp_mem_t *, s->max);
+    s->max_end = nomp_realloc(s->max_end, size_t, s->max);
+  }
+
+  unsigned pos = mem_upper_bound(s, MEM_START(m));
+  memmove(s->mems + pos + 1, s->mems + pos, (s->n - pos) * sizeof(m));
+  s->mems[pos] = m, s->n++;
+  mem_update_max_end(s, pos);
+}
+
+/**
+ * @ingroup nomp_mem_utils
+ *
+ * @brief Remove a memory region from the registry. Does nothing if the memory
+ * region is not registered.
+ *
+ * @param[in] r Memory registry of the context.
+ * @param[in] m Memory region to remove.
+ * @return void
+ */
+void nomp_mem_remove(nomp_mem_registry_t *r, const nomp_mem_t *m) {
+  if (r->slots_n == 0) return;
+
+  unsigned              i = mem_find_slot(r, m->hptr);
+  struct nomp_mem_slot *s = &r->slots[i];
+  if (!s->hptr) return;
+
+  unsigned pos = 0;
+  while (pos < s->n && s->mems[pos] != m)
+    pos++;
+  if (pos == s->n) return;
+
+  memmove(s->mems + pos, s->mems + pos + 1, (s->n - pos - 1) * sizeof(m));
+  s->n--, r->generation++;
+  mem_update_max_end(s, pos);
+  if (s->n > 0) return;
+
+  // Slot is empty: release it and shift back the entries in the same probe
+  // sequence so the lookups don't need tombstones.
+  nomp_free(&s->mems), nomp_free(&s->max_end);
+  s->hptr = NULL, s->max = 0, r->slots_n--;
+
+  struct nomp_mem_slot *slots = r->slots;
+  unsigned              mask  = r->slots_max - 1;
+  for (unsigned j = (i + 1) & mask; slots[j].hptr; j = (j + 1) & mask) {
+    unsigned k = mem_hash(slots[j].hptr, r->slots_max);
+    // Move slot j to the hole at i if its home position k is not in (i, j].
+    if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j)) continue;
+    slots[i] = slots[j], i = j;
+    memset(&slots[j], 0, sizeof(struct nomp_mem_slot));
+  }
+}
+
+/**
+ * @ingroup nomp_mem_utils
+ *
+ * @brief Returns the nomp_mem object corresponding to host pointer \p p.
+ *
+ * Returns the nomp_mem object corresponding to host pointer \p p. If no buffer
+ * has been allocated for \p p on the device, returns NULL. If multiple regions
+ * of \p p are mapped, the one with the lowest start offset is returned.
+ *
+ * @param[in] r Memory registry of the context.
+ * @param[in] p Host pointer.
+ * @return nomp_mem_t *
+ */
+nomp_mem_t *nomp_mem_find(const nomp_mem_registry_t *r, const void *p) {
+  if (r->slots_n == 0 || p == NULL) return NULL;
+  struct nomp_mem_slot *s = &r->slots[mem_find_slot(r, p)];
+  return s->hptr ? s->mems[0] : NULL;
+}
+
+/**
+ * @ingroup nomp_mem_utils
+ *
+ * @brief Returns the nomp_mem object of host pointer \p p which contains the
+ * array slice [\p idx0, \p idx1).
+ *
+ * Returns NULL if there is no such memory region mapped to the device.
+ *
+ * @param[in] r Memory registry of the context.
+ * @param[in] p Host pointer.
+ * @param[in] idx0 Start index of the slice.
+ * @param[in] idx1 End index of the slice.
+ * @param[in] usize Size of a single element of the array.
+ * @return nomp_mem_t *
+ */
+nomp_mem_t *nomp_mem_find_range(const nomp_mem_registry_t *r, const void *p,
+                                size_t idx0, size_t idx1, size_t usize) {
+  if (r->slots_n == 0 || p == NULL) return NULL;
+
+  struct nomp_mem_slot *s = &r->slots[mem_find_slot(r, p)];
+  if (!s->hptr) return NULL;
+
+  // Only the regions starting at or before the slice can contain it. Walk
+  // them from right to left until none of the remaining regions can reach
+  // the end of the slice.
+  size_t   start = idx0 * usize, end = idx1 * usize;
+  unsigned i     = mem_upper_bound(s, start);
+  for (; i > 0 && s->max_end[i - 1] >= end; i--) {
+    if (MEM_END(s->mems[i - 1]) >= end) return s->mems[i - 1];
+  }
+
+  return NULL;
+}
+
+/**
+ * @ingroup nomp_mem_utils
+ *
+ * @brief Remove and return an arbitrary memory region from the registry.
+ * Returns NULL if the registry is empty. Used to release all the memory
+ * regions when a context is destroyed.
+ *
+ * @param[in] r Memory registry of the context.
+ * @return nomp_mem_t *
+ */
+nomp_mem_t *nomp_mem_pop(nomp_mem_registry_t *r) {
+  for (unsigned i = 0; i < r->slots_max && r->slots_n > 0; i++) {
+    if (!r->slots[i].hptr) continue;
+    nomp_mem_t *m = r->slots[i].mems[r->slots[i].n - 1];
+    nomp_mem_remove(r, m);
+    return m;
+  }
+  return NULL;
+}
+
+/**
+ * @ingroup nomp_mem_utils
+ *
+ * @brief Returns a counter which changes every time a memory region is
+ * registered or removed. Lookups done with the same value of the counter
+ * return the same result, so they can be cached.
+ *
+ * @param[in] r Memory registry of the context.
+ * @return unsigned
+ */
+unsigned nomp_mem_generation(const nomp_mem_registry_t *r) {
+  return r->generation;
+}
+
+/**
+ * @ingroup nomp_mem_utils
+ *
+ * @brief Free the memory used by the registry. All the memory regions must be
+ * removed before calling this function.
+ *
+ * @param[in] r Memory registry of the context.
+ * @return void
+ */
+void nomp_mem_finalize(nomp_mem_registry_t *r) {
+  for (unsigned i = 0; i < r->slots_max; i++)
+    nomp_free(&r->slots[i].mems), nomp_free(&r->slots[i].max_end);
+  nomp_free(&r->slots), r->slots_n = r->slots_max = 0;
+}
+
+#undef MEM_END
+#undef MEM_START
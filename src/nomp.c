@@ -1,9 +1,74 @@
+#include <errno.h>
+#include <float.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
 #include "nomp-aux.h"
 #include "nomp-impl.h"
 #include "nomp-loopy.h"
 
-static nomp_backend_t nomp;
-static int            initialized = 0;
+// A context has its own backend, mapped memory, kernels, etc. Contexts only
+// share the Python interpreter, the kernel cache and the logs, so different
+// threads can use different contexts at the same time.
+struct nomp_context {
+  nomp_backend_t      backend;
+  nomp_mem_registry_t mems;
+  int                 grid_bytecode;
+  nomp_prog_t       **progs;
+  unsigned            progs_n, progs_max;
+  // Kernels bound with nomp_bind().
+  struct nomp_binding **bindings;
+  unsigned              bindings_n, bindings_max;
+  // Graphs recorded with nomp_graph_end(). Graph being recorded between
+  // nomp_graph_begin() and nomp_graph_end() is `capture`. Kernel launches and
+  // memory transfers are added to it instead of being done.
+  struct nomp_graph **graphs, *capture;
+  unsigned            graphs_n, graphs_max;
+  // Set between nomp_fuse_begin() and nomp_fuse_end(). Kernel launches are
+  // queued and the queue is flushed before any work which depends on them.
+  int                      fusing;
+  struct nomp_fuse_launch *fuse_queue;
+  unsigned                 fuse_n, fuse_max;
+  struct nomp_fused       *fused;
+  unsigned                 fused_n, fused_max;
+  // Worker processes generating kernels for nomp_jit_async(), oldest first.
+  struct nomp_jit_job *jobs;
+  unsigned             jobs_n, jobs_max, jit_workers;
+};
+
+// Kernel generated by a worker process. The worker writes the kernel to the
+// pipe in the format of the kernel cache (or the error if it fails) and the
+// kernel is stored in the cache once it is built.
+struct nomp_jit_job {
+  pid_t    pid;
+  int      fd;
+  int      id;
+  uint64_t key;
+};
+
+// Current context of the calling thread.
+static __thread nomp_context_t *ctx = NULL;
+
+// Number of live contexts. State shared by the contexts is released when the
+// last one is destroyed.
+static unsigned        contexts_n    = 0;
+static pthread_mutex_t contexts_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int nomp_graph_record(const nomp_prog_t *prg, void **ptrs, void *ptr,
+                             size_t idx0, size_t idx1, size_t usize,
+                             nomp_map_direction_t op);
+
+static int nomp_fuse_queue(const nomp_prog_t *prg, void **ptrs);
+static int nomp_fuse_flush(void);
+
+static inline int nomp_check_context(void) {
+  if (ctx == NULL) {
+    return nomp_log(NOMP_INITIALIZE_FAILURE, NOMP_ERROR,
+                    "libnomp is not initialized in the calling thread.");
+  }
+  return 0;
+}
 
 static inline int nomp_check_env_vars(nomp_config_t *const cfg) {
   char *tmp = NULL;
@@ -28,6 +93,23 @@ static inline int nomp_check_env_vars(nomp_config_t *const cfg) {
   if ((tmp = getenv("NOMP_SCRIPTS_DIR")))
     strncpy(cfg->scripts_dir, tmp, PATH_MAX);
 
+  if ((tmp = getenv("NOMP_CACHE_DIR")))
+    strncpy(cfg->cache_dir, tmp, PATH_MAX);
+
+  if ((tmp = getenv("NOMP_TRACE"))) strncpy(cfg->trace_file, tmp, PATH_MAX);
+
+  if ((tmp = getenv("NOMP_TUNING_DB")))
+    strncpy(cfg->tuning_db, tmp, PATH_MAX);
+
+  if ((tmp = getenv("NOMP_GRID_BYTECODE")))
+    cfg->grid_bytecode = nomp_str_toui(tmp, NOMP_MAX_BUFFER_SIZE);
+
+  if ((tmp = getenv("NOMP_POOL_SIZE")))
+    cfg->pool_size = nomp_str_toui(tmp, NOMP_MAX_BUFFER_SIZE);
+
+  if ((tmp = getenv("NOMP_JIT_WORKERS")))
+    cfg->jit_workers = nomp_str_toui(tmp, NOMP_MAX_BUFFER_SIZE);
+
   return 0;
 }
 
@@ -79,6 +161,28 @@ static inline int nomp_check_cmd_line(nomp_config_t *const cfg, unsigned argc,
       valid = 1;
     }
 
+    if (!strncmp("--nomp-cache-dir", argv[i - 1], NOMP_MAX_BUFFER_SIZE))
+      strncpy(cfg->cache_dir, argv[i], PATH_MAX), valid = 1;
+
+    if (!strncmp("--nomp-trace", argv[i - 1], NOMP_MAX_BUFFER_SIZE))
+      strncpy(cfg->trace_file, argv[i], PATH_MAX), valid = 1;
+
+    if (!strncmp("--nomp-tuning-db", argv[i - 1], NOMP_MAX_BUFFER_SIZE))
+      strncpy(cfg->tuning_db, argv[i], PATH_MAX), valid = 1;
+
+    if (!strncmp("--nomp-grid-bytecode", argv[i - 1], NOMP_MAX_BUFFER_SIZE)) {
+      cfg->grid_bytecode = nomp_str_toui(argv[i], NOMP_MAX_BUFFER_SIZE);
+      valid              = 1;
+    }
+
+    if (!strncmp("--nomp-pool-size", argv[i - 1], NOMP_MAX_BUFFER_SIZE))
+      cfg->pool_size = nomp_str_toui(argv[i], NOMP_MAX_BUFFER_SIZE), valid = 1;
+
+    if (!strncmp("--nomp-jit-workers", argv[i - 1], NOMP_MAX_BUFFER_SIZE)) {
+      cfg->jit_workers = nomp_str_toui(argv[i], NOMP_MAX_BUFFER_SIZE);
+      valid            = 1;
+    }
+
     if (!valid) {
       nomp_log(NOMP_SUCCESS, NOMP_WARNING, "Unknown command line argument: %s.",
                argv[i - 1]);
@@ -98,10 +202,17 @@ static inline int nomp_set_configs(int argc, const char **argv,
   cfg->profile  = NOMP_DEFAULT_PROFILE;
   cfg->device   = NOMP_DEFAULT_DEVICE;
   cfg->platform = NOMP_DEFAULT_PLATFORM;
+  // Kernel launch parameters are evaluated with bytecode by default.
+  cfg->grid_bytecode = 1;
+  cfg->pool_size     = NOMP_DEFAULT_POOL_SIZE;
+  cfg->jit_workers   = 0;
   strcpy(cfg->backend, "");
   strcpy(cfg->install_dir, "");
   strcpy(cfg->scripts_dir, "");
   strcpy(cfg->annotations_script, "");
+  strcpy(cfg->cache_dir, "");
+  strcpy(cfg->trace_file, "");
+  strcpy(cfg->tuning_db, "");
 
   nomp_check(nomp_check_cmd_line(cfg, argc, argv));
   nomp_check_env_vars(cfg);
@@ -127,6 +238,11 @@ static inline int nomp_set_configs(int argc, const char **argv,
   check_if_valid(cfg->profile < 0, "--nomp-profile", "NOMP_PROFILE");
   check_if_valid(cfg->device < 0, "--nomp-device", "NOMP_DEVICE");
   check_if_valid(cfg->platform < 0, "--nomp-platform", "NOMP_PLATFORM");
+  check_if_valid(cfg->grid_bytecode < 0, "--nomp-grid-bytecode",
+                 "NOMP_GRID_BYTECODE");
+  check_if_valid(cfg->pool_size < 0, "--nomp-pool-size", "NOMP_POOL_SIZE");
+  check_if_valid(cfg->jit_workers < 0, "--nomp-jit-workers",
+                 "NOMP_JIT_WORKERS");
 
 #undef check_if_valid
 
@@ -153,6 +269,12 @@ static inline int nomp_deallocate_scratch_memory(nomp_backend_t *backend) {
 static inline int nomp_init_backend(nomp_backend_t *const      backend,
                                     const nomp_config_t *const cfg) {
   backend->py_context = PyDict_New();
+  // Every backend starts with a single (default) queue.
+  backend->nqueues = 1, backend->queue = 0;
+  backend->aliases_host = 0;
+  backend->graph_build  = NULL, backend->graph_launch = NULL;
+  backend->graph_free   = NULL;
+  backend->profile      = cfg->profile > 0 || strlen(cfg->trace_file) > 0;
 
   PyObject *py_str_backend = PyUnicode_FromString(cfg->backend);
   PyDict_SetItemString(backend->py_context, "backend::name", py_str_backend);
@@ -175,6 +297,12 @@ static inline int nomp_init_backend(nomp_backend_t *const      backend,
     nomp_check(hip_init(backend, cfg->platform, cfg->device));
     return 0;
   }
+#endif
+#if defined(CPU_ENABLED)
+  if (strncmp(cfg->backend, "cpu", NOMP_MAX_BUFFER_SIZE) == 0) {
+    nomp_check(cpu_init(backend, cfg->platform, cfg->device));
+    return 0;
+  }
 #endif
   return nomp_log(NOMP_USER_INPUT_IS_INVALID, NOMP_ERROR,
                   "Invalid backend: %s.", cfg->backend);
@@ -196,6 +324,8 @@ static inline int nomp_init_backend(nomp_backend_t *const      backend,
  * initialization, otherwise returns 0. Errors can be queried using
  * nomp_get_err_no() and nomp_get_err_str(). Calling this method multiple times
  * (without nomp_finalize in between) will return an error (but not segfault).
+ * The runtime is initialized as a context (see nomp_context_create()) which
+ * becomes the current context of the calling thread.
  *
  * <b>Accepted arguments:</b>
  * \arg `--nomp-install-dir <install-dir>` Specify `libnomp` install directory.
@@ -203,10 +333,30 @@ static inline int nomp_init_backend(nomp_backend_t *const      backend,
  * \arg `--nomp-platform <platform-index>` Specify platform id.
  * \arg `--nomp-device <device-index>` Specify device id.
  * \arg `--nomp-verbose <verbose-level>` Specify verbose level.
- * \arg `--nomp-profile <profile-level>` Specify profile level.
+ * \arg `--nomp-profile <profile-level>` Specify profile level. If non-zero,
+ * the time spent in each stage of nomp_jit() is printed when the last context
+ * is destroyed.
  * \arg `--nomp-scripts-dir <scripts-dir>` Specify the directory containing
  * \arg `--nomp-annotations-script <annotations-script>` Specify the name of
  * the annotations script.
+ * \arg `--nomp-cache-dir <cache-dir>` Specify the directory used to cache
+ * generated kernels across runs. Kernel caching is disabled if not set.
+ * \arg `--nomp-trace <file>` Write a timeline of the JIT stages, copies,
+ * kernel launches and syncs to \p file as a Chrome trace-event JSON file
+ * which can be opened with `chrome://tracing` or Perfetto. The file is
+ * written when the last context is destroyed.
+ * \arg `--nomp-tuning-db <file>` Specify the file where the parameters of the
+ * kernels tuned with the `autotune` clause of nomp_jit() are kept across
+ * runs. `tuning.db` in the cache directory is used if not set. Tuned
+ * parameters are only kept in memory if neither of them is set.
+ * \arg `--nomp-grid-bytecode <0|1>` Evaluate kernel launch parameters with
+ * bytecode generated at JIT time (1, default) or with SymEngine (0).
+ * \arg `--nomp-pool-size <MiB>` Specify the maximum size of the device memory
+ * cached for reuse after nomp_update() with ::NOMP_FREE. Setting it to 0
+ * disables the memory pool.
+ * \arg `--nomp-jit-workers <n>` Specify the maximum number of worker
+ * processes generating kernels for nomp_jit_async() at the same time. Number
+ * of online processors is used by default (or if it is 0).
  *
  * @param[in] argc The number of arguments to nomp_init().
  * @param[in] argv Arguments as strings, values followed by options.
@@ -221,77 +371,156 @@ static inline int nomp_init_backend(nomp_backend_t *const      backend,
  * @endcode
  */
 int nomp_init(int argc, const char **argv) {
-  // This will be overridden by the user specified verbose level later.
-  nomp_log_set_verbose(NOMP_DEFAULT_VERBOSE);
-
-  if (initialized) {
+  if (ctx) {
     return nomp_log(NOMP_INITIALIZE_FAILURE, NOMP_ERROR,
                     "libnomp is already initialized.");
   }
 
-  nomp_config_t cfg;
-  nomp_check(nomp_set_configs(argc, argv, &cfg));
+  nomp_context_t *context;
+  return nomp_context_create(&context, argc, argv);
+}
+
+static int nomp_context_init(nomp_context_t       *context,
+                             const nomp_config_t *const cfg) {
+  nomp_check(nomp_py_init(cfg));
 
-  nomp_check(nomp_py_init(&cfg));
+  // Setup the annotation script.
+  nomp_check(nomp_py_set_annotate_func(&context->backend.py_annotate,
+                                       cfg->annotations_script));
+
+  context->grid_bytecode = cfg->grid_bytecode;
+  context->jit_workers   = cfg->jit_workers;
+  if (context->jit_workers == 0) {
+    long n               = sysconf(_SC_NPROCESSORS_ONLN);
+    context->jit_workers = n > 0 ? n : 1;
+  }
 
-  // Set profile level.
-  nomp_check(nomp_profile_set_level(cfg.profile));
+  // Initialize the backend. It is finalized again if the rest of the
+  // context can't be initialized.
+  nomp_check(nomp_init_backend(&context->backend, cfg));
 
-  // Set verbose level.
-  nomp_check(nomp_log_set_verbose(cfg.verbose));
+  // Initialize the kernel cache and load the parameters of the kernels tuned
+  // in the previous runs.
+  int err = nomp_cache_init(cfg);
+  if (!err) err = nomp_autotune_init(cfg);
 
-  // Setup the annotation script.
-  nomp_check(
-      nomp_py_set_annotate_func(&nomp.py_annotate, cfg.annotations_script));
+  // Initialize the device memory pool and allocate scratch memory.
+  if (!err) err = nomp_pool_init(&context->backend, cfg);
+  if (!err) {
+    err = nomp_allocate_scratch_memory(&context->backend);
+    if (err) nomp_pool_finalize(&context->backend);
+  }
+
+  if (err) context->backend.finalize(&context->backend);
+
+  return err;
+}
+
+static int nomp_context_create_impl(nomp_context_t **context, int argc,
+                                    const char **argv) {
+  // Logging, profiling and tracing are shared by the contexts, so they are
+  // only set up by the first context.
+  int first = (contexts_n == 0);
+
+  // This will be overridden by the user specified verbose level later.
+  if (first) nomp_log_set_verbose(NOMP_DEFAULT_VERBOSE);
+
+  nomp_config_t cfg;
+  nomp_check(nomp_set_configs(argc, argv, &cfg));
+
+  if (first) {
+    // Set profile level and start tracing.
+    nomp_check(nomp_profile_set_level(cfg.profile));
+    nomp_check(nomp_trace_init(&cfg));
+
+    // Set verbose level.
+    nomp_check(nomp_log_set_verbose(cfg.verbose));
+  }
 
-  // Initialize the backend.
-  nomp_check(nomp_init_backend(&nomp, &cfg));
+  nomp_context_t *c = nomp_calloc(nomp_context_t, 1);
+  nomp_py_lock();
+  int err = nomp_context_init(c, &cfg);
+  if (err) {
+    Py_XDECREF(c->backend.py_annotate), Py_XDECREF(c->backend.py_context);
+  }
+  nomp_py_unlock();
 
-  // Allocate scratch memory.
-  nomp_check(nomp_allocate_scratch_memory(&nomp));
+  if (err) {
+    nomp_free(&c);
+    return err;
+  }
 
-  initialized = 1;
+  contexts_n++;
+  *context = ctx = c;
 
   return 0;
 }
 
-static nomp_mem_t **mems     = NULL;
-static unsigned     mems_n   = 0;
-static unsigned     mems_max = 0;
-
 /**
- * @ingroup nomp_mem_utils
+ * @ingroup nomp_user_api
+ *
+ * @brief Create a libnomp context and make it the current context of the
+ * calling thread.
  *
- * @brief Returns the nomp_mem object corresponding to host pointer \p p.
+ * @details A context has its own backend instance, mapped memory, kernels,
+ * bindings, graphs and queues. All the other libnomp functions act on the
+ * current context of the calling thread, which can be changed with
+ * nomp_context_set(). Kernel ids, binding handles, etc. are only valid in the
+ * context which created them. A context must not be used by more than one
+ * thread at a time, but different threads can use different contexts
+ * concurrently (nomp_jit() is serialized since it calls into Python). The
+ * Python interpreter, the kernel cache and the error logs are shared by all
+ * the contexts. Accepted arguments are the same as nomp_init(). The verbose
+ * level, the profile level and the trace file are shared as well, so they
+ * are set by the first context and ignored by the others.
  *
- * Returns the nomp_mem object corresponding to host ponter \p p. If no buffer
- * has been allocated for \p p on the device, returns NULL.
+ * <b>Example usage:</b>
+ * @code{.c}
+ * // In each thread:
+ * nomp_context_t *context;
+ * int err = nomp_context_create(&context, argc, argv);
+ * ...
+ * err = nomp_context_destroy(context);
+ * @endcode
  *
- * @param[in] p Host pointer
- * @return nomp_mem_t *
+ * @param[out] context The new context.
+ * @param[in] argc The number of arguments.
+ * @param[in] argv Arguments as strings, values followed by options.
+ * @return int
  */
-static inline nomp_mem_t *nomp_get_memory_if_mapped(void *p) {
-  // FIXME: This is O(N) in number of allocations.
-  // Needs to go. Must store a hashmap.
-  for (unsigned i = 0; i < mems_n; i++) {
-    if (mems[i] && mems[i]->hptr == p) return mems[i];
-  }
-  return NULL;
+int nomp_context_create(nomp_context_t **context, int argc, const char **argv) {
+  pthread_mutex_lock(&contexts_lock);
+  int err = nomp_context_create_impl(context, argc, argv);
+  pthread_mutex_unlock(&contexts_lock);
+
+  return err;
 }
 
-static inline unsigned nomp_get_index_if_mapped(void *p, size_t idx0,
-                                                size_t idx1, size_t usize) {
-  // FIXME: This is O(N) in number of allocations.
-  // Needs to go. Must store a hash map.
-  for (unsigned i = 0; i < mems_n; i++) {
-    if (mems[i] && mems[i]->hptr == p &&
-        (mems[i]->idx0 * mems[i]->usize <= idx0 * usize) &&
-        (mems[i]->idx1 * mems[i]->usize >= idx1 * usize))
-      return i;
-  }
-  return mems_n;
+/**
+ * @ingroup nomp_user_api
+ *
+ * @brief Set the current context of the calling thread.
+ *
+ * @details Passing NULL detaches the calling thread from its current context.
+ *
+ * @param[in] context Context created with nomp_context_create() or NULL.
+ * @return int
+ */
+int nomp_context_set(nomp_context_t *context) {
+  ctx = context;
+  return 0;
 }
 
+/**
+ * @ingroup nomp_user_api
+ *
+ * @brief Return the current context of the calling thread (NULL if there is
+ * none).
+ *
+ * @return nomp_context_t *
+ */
+nomp_context_t *nomp_context_get(void) { return ctx; }
+
 /**
  * @ingroup nomp_user_api
  *
@@ -302,7 +531,10 @@ static inline unsigned nomp_get_index_if_mapped(void *p, size_t idx0,
  * @details Operation \p op will be performed on the array slice [\p
  * start_index, \p end_index), i.e., on array elements start_index, ...
  * end_index - 1. This method returns a non-zero value if there is an error and
- * 0 otherwise.
+ * 0 otherwise. NOMP_FROM is blocking and waits for all the previously launched
+ * kernels to finish before copying the data back to the host. ::NOMP_TO and
+ * ::NOMP_FROM can be combined with ::NOMP_ASYNC to return without waiting for
+ * the copy, see nomp_wait().
  *
  * @param[in] ptr Pointer to host memory location (start of host memory array).
  * @param[in] idx0 Start index in the \p ptr to start copying.
@@ -334,46 +566,114 @@ static inline unsigned nomp_get_index_if_mapped(void *p, size_t idx0,
  */
 int nomp_update(void *ptr, size_t idx0, size_t idx1, size_t unit_size,
                 nomp_map_direction_t op) {
-  unsigned idx = nomp_get_index_if_mapped(ptr, idx0, idx1, unit_size);
-  if (idx == mems_n) {
+  nomp_check(nomp_check_context());
+
+  nomp_mem_t *m = nomp_mem_find_range(&ctx->mems, ptr, idx0, idx1, unit_size);
+  int         new = (m == NULL);
+  if (ctx->capture) {
+    // Memory can't be mapped or released while a graph is recorded.
+    if (new || (op & (NOMP_ALLOC | NOMP_FREE))) {
+      return nomp_log(NOMP_USER_MAP_OP_IS_INVALID, NOMP_ERROR,
+                      "Only NOMP_TO and NOMP_FROM on a pointer which is "
+                      "already on the device can be recorded in a graph.");
+    }
+    return nomp_graph_record(NULL, NULL, ptr, idx0, idx1, unit_size, op);
+  }
+  nomp_check(nomp_fuse_flush());
+  if (new) {
     // A new entry can't be created with NOMP_FREE or
     // NOMP_FROM.
-    if (op == NOMP_FROM || op == NOMP_FREE) {
+    if (!(op & (NOMP_ALLOC | NOMP_TO))) {
       return nomp_log(NOMP_USER_MAP_OP_IS_INVALID, NOMP_ERROR,
                       "NOMP_FREE or NOMP_FROM can only be called "
                       "on a pointer "
                       "which is already on the device.");
     }
     op |= NOMP_ALLOC;
-    if (mems_n == mems_max) {
-      mems_max += mems_max / 2 + 1;
-      mems = nomp_realloc(mems, nomp_mem_t *, mems_max);
-    }
-    nomp_mem_t *m = mems[mems_n] = nomp_calloc(nomp_mem_t, 1);
+    m       = nomp_calloc(nomp_mem_t, 1);
     m->idx0 = idx0, m->idx1 = idx1, m->usize = unit_size;
     m->hptr = ptr, m->bptr = NULL;
   }
 
-  nomp_check(nomp.update(&nomp, mems[idx], op, idx0, idx1, unit_size));
+  // Allocations and frees go through the memory pool.
+  if (op & NOMP_ALLOC) nomp_check(nomp_pool_alloc(&ctx->backend, m));
+  if (op & (NOMP_TO | NOMP_FROM)) {
+    unsigned entry = 0;
+    if (ctx->backend.profile)
+      entry = nomp_profile_entry(NOMP_PROFILE_COPY(op));
+    double start = nomp_profile_now();
+    nomp_profile_host(entry, 1);
+    nomp_check(ctx->backend.update(&ctx->backend, m, op & ~NOMP_ALLOC, idx0,
+                                   idx1, unit_size));
+    nomp_profile_host(entry, 0);
+    nomp_trace_update(entry, start, (idx1 - idx0) * unit_size, op);
+  } else if (op & NOMP_FREE) {
+    nomp_check(nomp_pool_free(&ctx->backend, m));
+  }
 
   // Device memory object was released.
-  if (mems[idx]->bptr == NULL) nomp_free(&mems[idx]);
+  if (m->bptr == NULL) {
+    if (!new) nomp_mem_remove(&ctx->mems, m);
+    nomp_free(&m);
+  }
   // Or new memory object got created.
-  else if (idx == mems_n)
-    mems_n++;
+  else if (new)
+    nomp_mem_insert(&ctx->mems, m);
 
   return 0;
 }
 
-static nomp_prog_t **progs     = NULL;
-static unsigned      progs_n   = 0;
-static unsigned      progs_max = 0;
+static inline int nomp_jit_reduce_clauses(nomp_prog_t       *program,
+                                          const char **const clauses) {
+  // Reduction clauses only update the program meta data, so they are
+  // processed here without calling into python. This way, the same
+  // information is available when the kernel is read from the cache.
+  for (unsigned i = 0; clauses[i] && clauses[i + 1] && clauses[i + 2];
+       i += 3) {
+    if (strncmp(clauses[i], "reduce", NOMP_MAX_BUFFER_SIZE)) continue;
+
+    static const char *ops[] = {"+", "*", "max", "min", "&&", "||", "&", "|"};
+    unsigned           op    = 0, nops = sizeof(ops) / sizeof(ops[0]);
+    while (op < nops && strncmp(clauses[i + 2], ops[op], NOMP_MAX_BUFFER_SIZE))
+      op++;
+    if (op == nops) {
+      return nomp_log(NOMP_USER_INPUT_IS_INVALID, NOMP_ERROR,
+                      "Invalid reduction operation: \"%s\".", clauses[i + 2]);
+    }
+    program->reduction_op = (nomp_reduction_op_t)op;
+
+    for (unsigned j = 0; j < program->nargs; j++) {
+      if (strncmp(program->args[j].name, clauses[i + 1],
+                  NOMP_MAX_BUFFER_SIZE) == 0) {
+        program->reduction_type  = program->args[j].type;
+        program->reduction_size  = program->args[j].size;
+        program->reduction_index = j;
+        program->args[j].type    = NOMP_PTR;
+        break;
+      }
+    }
+
+    if (program->reduction_type == NOMP_FLOAT &&
+        (program->reduction_op == NOMP_BAND ||
+         program->reduction_op == NOMP_BOR)) {
+      return nomp_log(NOMP_USER_INPUT_IS_INVALID, NOMP_ERROR,
+                      "Bitwise reduction \"%s\" is not supported for floating "
+                      "point variable \"%s\".",
+                      clauses[i + 2], clauses[i + 1]);
+    }
+  }
+
+  return 0;
+}
 
+// Tuned transforms (`autotune` clause) are applied with \p params, which is
+// NULL till the kernel is tuned.
 static inline int nomp_jit_act_on_clauses(PyObject                  **kernel,
-                                          nomp_prog_t                *program,
                                           const char **const          clauses,
+                                          const char                 *params,
                                           const nomp_backend_t *const backend) {
-  // Currently, we only support `transform` and `reduce` clauses.
+  // Currently, we only support `transform`, `autotune`, `reduce` and
+  // `annotate` clauses.
   unsigned i = 0;
   while (clauses[i]) {
     if (strncmp(clauses[i], "transform", NOMP_MAX_BUFFER_SIZE) == 0) {
@@ -385,21 +685,17 @@ static inline int nomp_jit_act_on_clauses(PyObject                  **kernel,
       continue;
     }
 
+    if (strncmp(clauses[i], "autotune", NOMP_MAX_BUFFER_SIZE) == 0) {
+      const char *file = clauses[i + 1], *function = clauses[i + 2];
+      nomp_check(nomp_py_check_module(file, function));
+      nomp_check(nomp_py_autotune(kernel, file, function, params,
+                                  backend->py_context));
+      i += 3;
+      continue;
+    }
+
+    // Reductions are handled in nomp_jit_reduce_clauses().
     if (strncmp(clauses[i], "reduce", NOMP_MAX_BUFFER_SIZE) == 0) {
-      for (unsigned j = 0; j < program->nargs; j++) {
-        if (strncmp(program->args[j].name, clauses[i + 1],
-                    NOMP_MAX_BUFFER_SIZE) == 0) {
-          program->reduction_type  = program->args[j].type;
-          program->reduction_size  = program->args[j].size;
-          program->reduction_index = j;
-          program->args[j].type    = NOMP_PTR;
-          break;
-        }
-      }
-      if (strncmp(clauses[i + 2], "+", 2) == 0)
-        program->reduction_op = NOMP_SUM;
-      if (strncmp(clauses[i + 2], "*", 2) == 0)
-        program->reduction_op = NOMP_PROD;
       i += 3;
       continue;
     }
@@ -443,11 +739,17 @@ static inline PyObject *nomp_get_py_object_from_type(nomp_arg_type_t type,
   return value;
 }
 
-static inline nomp_prog_t *nomp_jit_init_args(unsigned progs_n, unsigned nargs,
-                                              va_list args) {
+static inline nomp_prog_t *nomp_prog_new(unsigned nargs) {
+  if (ctx->progs_n == ctx->progs_max) {
+    ctx->progs_max += ctx->progs_max / 2 + 1;
+    ctx->progs = nomp_realloc(ctx->progs, nomp_prog_t *, ctx->progs_max);
+  }
+
   // Allocate memory for the program.
-  nomp_prog_t *prg = progs[progs_n] = nomp_calloc(nomp_prog_t, 1);
-  prg->args                         = nomp_calloc(nomp_arg_t, nargs);
+  nomp_prog_t *prg         = nomp_calloc(nomp_prog_t, 1);
+  prg->args                = nomp_calloc(nomp_arg_t, nargs);
+  prg->id                  = ctx->progs_n;
+  ctx->progs[ctx->progs_n] = prg;
   // Reduction index is set to -1 by default.
   prg->reduction_index = -1;
   // SymEngine map to store grid size expressions.
@@ -457,6 +759,25 @@ static inline nomp_prog_t *nomp_jit_init_args(unsigned progs_n, unsigned nargs,
   // Dictionary to hold jit kernel arguments.
   prg->py_dict = PyDict_New();
 
+  return prg;
+}
+
+// Release a program which failed before it was given an id.
+static void nomp_prog_discard(nomp_prog_t *prg) {
+  ctx->backend.knl_free(prg);
+  Py_XDECREF(prg->py_dict), Py_XDECREF(prg->py_knl);
+  vecbasic_free(prg->sym_global);
+  vecbasic_free(prg->sym_local);
+  mapbasicbasic_free(prg->map);
+  nomp_free(&prg->grid_code), nomp_free(&prg->tune_params);
+  nomp_free(&prg->args);
+  ctx->progs[ctx->progs_n] = NULL;
+  nomp_free(&prg);
+}
+
+static inline nomp_prog_t *nomp_jit_init_args(unsigned nargs, va_list args) {
+  nomp_prog_t *prg = nomp_prog_new(nargs);
+
   unsigned current_narg = 0;
   for (unsigned i = 0; i < nargs; i++) {
     const char  *name = va_arg(args, const char *);
@@ -486,6 +807,225 @@ static inline nomp_prog_t *nomp_jit_init_args(unsigned progs_n, unsigned nargs,
   return prg;
 }
 
+// Each stage of the JIT pipeline is timed separately by the profiler (see
+// `--nomp-profile`) and shown as a span in the trace (see `--nomp-trace`), so
+// the time spent in the Python glue can be compared with the time spent in
+// loopy and the backend compiler.
+#define nomp_jit_stage(NAME, CALL)                                             \
+  {                                                                            \
+    double start_ = nomp_profile_now();                                        \
+    nomp_profile("jit::" NAME, 1, 0);                                          \
+    nomp_check(CALL);                                                          \
+    nomp_profile("jit::" NAME, 0, 0);                                          \
+    nomp_trace_span(NOMP_TRACE_JIT, "jit::" NAME, start_);                     \
+  }
+
+// Create the loopy kernel from C source and act on the clauses. The kernel is
+// not lowered to the backend yet.
+static inline int nomp_jit_loopy(PyObject **knl, nomp_prog_t *prg,
+                                 const char *csrc, const char **clauses) {
+  // Create loopy kernel from C source.
+  nomp_jit_stage("c_to_loopy",
+                 nomp_py_c_to_loopy(knl, csrc, ctx->backend.py_context));
+
+  // Act on the clauses: transform, annotate, etc. and get the kernel
+  nomp_jit_stage("clauses",
+                 nomp_jit_act_on_clauses(knl, clauses, prg->tune_params,
+                                         &ctx->backend));
+
+  // Handle reductions if they exist.
+  if (prg->reduction_index >= 0) {
+    nomp_jit_stage("reduction", nomp_py_realize_reduction(
+                                    knl, prg->args[prg->reduction_index].name,
+                                    ctx->backend.py_context));
+  }
+
+  // Call fix_parameters on the loopy kernel.
+  if (PyDict_Size(prg->py_dict)) {
+    nomp_jit_stage("fix_parameters",
+                   nomp_py_fix_parameters(knl, prg->py_dict));
+  }
+
+  return 0;
+}
+
+// Lower the loopy kernel to the backend and get the source and the launch
+// parameters. The reference to the kernel is released.
+static inline int nomp_jit_lower(char **name, char **src, nomp_prog_t *prg,
+                                 PyObject *knl) {
+  // Adapt the kernel to the execution model of the backend.
+  nomp_jit_stage("lower_to_target",
+                 nomp_py_lower_to_target(&knl, ctx->backend.py_context));
+
+  // Get OpenCL, CUDA, etc. source and name from the loopy kernel.
+  nomp_jit_stage("codegen", nomp_py_get_knl_name_and_src(name, src, knl));
+
+  // Get grid size of the loopy kernel as pymbolic expressions. These grid
+  // sizes will be evaluated each time the kernel is run.
+  nomp_jit_stage("grid_size", nomp_py_get_grid_size(prg, knl));
+  Py_XDECREF(knl);
+
+  return 0;
+}
+
+static inline int nomp_jit_generate(char **name, char **src, nomp_prog_t *prg,
+                                    const char *csrc, const char **clauses) {
+  PyObject *knl = NULL;
+  nomp_check(nomp_jit_loopy(&knl, prg, csrc, clauses));
+  return nomp_jit_lower(name, src, prg, knl);
+}
+
+// Kernels are profiled as "<name>:<id>", so kernels with the same name are
+// reported separately.
+static inline void nomp_profile_prog(nomp_prog_t *prg, const char *name) {
+  if (!ctx->backend.profile) return;
+
+  char entry[NOMP_MAX_BUFFER_SIZE + 1];
+  snprintf(entry, sizeof(entry), "%s:%d", name, prg->id);
+  prg->profile_id = nomp_profile_entry(entry);
+}
+
+// Build the backend program from the generated kernel. Takes over \p name
+// and \p src.
+static int nomp_jit_build(nomp_prog_t *prg, char *name, char *src) {
+  nomp_profile_prog(prg, name);
+
+  // Lower the kernel launch parameters so they can be evaluated cheaply in
+  // nomp_run().
+  if (ctx->grid_bytecode) {
+    nomp_jit_stage("grid_bytecode", nomp_symengine_compile_grid_size(prg));
+  }
+
+  // Build the OpenCL, CUDA, etc. program.
+  nomp_jit_stage("build",
+                 ctx->backend.knl_build(&ctx->backend, prg, src, name));
+  nomp_free(&src), nomp_free(&name);
+
+  // Setup the second stage of the reduction if there is one.
+  nomp_check(nomp_reduction_init(&ctx->backend, prg));
+
+  return 0;
+}
+
+#undef nomp_jit_stage
+
+// Generate the kernel in a forked worker process and send it back through the
+// pipe. The worker starts with a copy of the interpreter (with the modules
+// already imported), so it only runs the Python pipeline and never touches
+// the backend.
+static void nomp_jit_worker(int fd, nomp_prog_t *prg, const char *csrc,
+                            const char **clauses) {
+  FILE *fp = fdopen(fd, "wb");
+  if (fp == NULL) _exit(1);
+
+  char *name, *src;
+  int   err = nomp_jit_generate(&name, &src, prg, csrc, clauses);
+  if (err) {
+    char *msg = nomp_get_err_str(err);
+    fprintf(fp, "%d\n%s", nomp_get_err_no(err), msg ? msg : "");
+    nomp_free(&msg);
+  } else {
+    err = nomp_cache_write_knl(fp, name, src, prg);
+  }
+  err |= fclose(fp) != 0;
+
+  _exit(err != 0);
+}
+
+static int nomp_jit_spawn(nomp_prog_t *prg, uint64_t key, const char *csrc,
+                          const char **clauses);
+
+static int nomp_jit_finish(unsigned job);
+
+// Generate the kernel (in a worker process if \p async is set) and build it.
+// Variants of a tuned kernel are cached separately.
+static int nomp_jit_prog(nomp_prog_t *prg, const char *csrc,
+                         const char **clauses, int async) {
+  // Look for the kernel in the cache before calling into python.
+  int      hit = 0;
+  uint64_t key;
+  char    *name, *src;
+  nomp_check(nomp_cache_key(&key, csrc, clauses, prg->py_dict,
+                            ctx->backend.py_context));
+  if (prg->tune_params)
+    key = nomp_hash(key, prg->tune_params, strlen(prg->tune_params) + 1);
+  nomp_check(nomp_cache_load(&hit, &name, &src, prg, key));
+  if (!hit && async) {
+    nomp_check(nomp_jit_spawn(prg, key, csrc, clauses));
+  } else {
+    if (!hit) {
+      nomp_check(nomp_jit_generate(&name, &src, prg, csrc, clauses));
+      nomp_check(nomp_cache_store(key, name, src, prg));
+    }
+    nomp_check(nomp_jit_build(prg, name, src));
+  }
+
+  return 0;
+}
+
+// Index of the `autotune` clause or -1 if the kernel is not tuned.
+static inline int nomp_jit_find_autotune(const char **const clauses) {
+  for (unsigned i = 0; clauses[i] && clauses[i + 1] && clauses[i + 2];
+       i += 3) {
+    if (strncmp(clauses[i], "autotune", NOMP_MAX_BUFFER_SIZE) == 0) return i;
+  }
+  return -1;
+}
+
+static int nomp_jit_setup(nomp_prog_t *prg, const char *csrc,
+                          const char **clauses, int async) {
+  // Record reduction meta data in the program.
+  nomp_check(nomp_jit_reduce_clauses(prg, clauses));
+
+  // A tuned kernel is generated with the parameters found by an earlier run
+  // on the same device. Otherwise, it is tuned and built by its first launch.
+  if (nomp_jit_find_autotune(clauses) >= 0) {
+    if (prg->reduction_index >= 0) {
+      return nomp_log(NOMP_USER_INPUT_IS_INVALID, NOMP_ERROR,
+                      "Kernels with a reduction can't be tuned with the "
+                      "\"autotune\" clause.");
+    }
+    const char *params = nomp_autotune_lookup(
+        nomp_cache_hash_kernel(csrc, clauses, prg->py_dict),
+        nomp_cache_hash_device(ctx->backend.py_context));
+    if (params)
+      prg->tune_params = strndup(params, strlen(params));
+    else
+      prg->tuning = 1;
+  }
+
+  if (!prg->tuning) nomp_check(nomp_jit_prog(prg, csrc, clauses, async));
+
+  return 0;
+}
+
+static int nomp_jit_impl(int *id, const char *csrc, const char **clauses,
+                         int nargs, va_list args, int async) {
+  // Initialize the nomp_prog_t with the kernel input arguments. The program
+  // is released if it can't be generated, so it doesn't take an id.
+  nomp_prog_t *prg = nomp_jit_init_args(nargs, args);
+  int          err = nomp_jit_setup(prg, csrc, clauses, async);
+  if (err) {
+    nomp_prog_discard(prg);
+    return err;
+  }
+
+  // Keep the source and the clauses so the kernel can be fused later.
+  unsigned nclauses = 0;
+  while (clauses[nclauses])
+    nclauses++;
+  prg->csrc    = strndup(csrc, strlen(csrc));
+  prg->clauses = nomp_calloc(char *, nclauses + 1);
+  for (unsigned i = 0; i < nclauses; i++)
+    prg->clauses[i] = strndup(clauses[i], NOMP_MAX_BUFFER_SIZE);
+
+  // Launch parameters are evaluated by the first nomp_run().
+  prg->eval_grid = 1;
+  *id            = ctx->progs_n++;
+
+  return 0;
+}
+
 /**
  * @ingroup nomp_user_api
  *
@@ -499,7 +1039,19 @@ static inline nomp_prog_t *nomp_jit_init_args(unsigned progs_n, unsigned nargs,
  * arguments to the kernel must be provided. Then for each argument, three
  * values has to be passed. First is the argument name as a string. Second is
  * is the `sizeof` argument and the third if argument type (one of \ref
- * nomp_user_types).
+ * nomp_user_types). The kernel belongs to the current context of the calling
+ * thread and \p id is only valid in that context.
+ *
+ * The `autotune` clause (`{"autotune", "file", "function"}`) is like
+ * `transform` except that the transform function has parameters which are
+ * tuned. The values to try are declared in the transform script with the
+ * `autotune.search_space()` decorator. The first launch of the kernel builds
+ * and times a variant for each point of the search space with the arguments
+ * of the launch (the device data of the arrays is restored afterwards) and
+ * keeps the fastest one. The fastest point is stored in the tuning database
+ * (see `--nomp-tuning-db` in nomp_init()) so the kernel is generated with it
+ * right away in later runs on the same device. Kernels with a reduction
+ * can't be tuned.
  *
  * <b>Example usage:</b>
  * @code{.c}
@@ -526,47 +1078,125 @@ static inline nomp_prog_t *nomp_jit_init_args(unsigned progs_n, unsigned nargs,
  */
 int nomp_jit(int *id, const char *csrc, const char **clauses, int nargs, ...) {
   if (*id >= 0) return 0;
+  nomp_check(nomp_check_context());
 
-  if (progs_n == progs_max) {
-    progs_max += progs_max / 2 + 1;
-    progs = nomp_realloc(progs, nomp_prog_t *, progs_max);
-  }
-
-  // Initialize the nomp_prog_t with the kernel input arguments.
+  // Python calls (and the kernel cache) are serialized between the threads.
   va_list args;
   va_start(args, nargs);
-  nomp_prog_t *prg = nomp_jit_init_args(progs_n, nargs, args);
+  nomp_py_lock();
+  int err = nomp_jit_impl(id, csrc, clauses, nargs, args, 0);
+  nomp_py_unlock();
   va_end(args);
 
-  // Create loopy kernel from C source.
-  PyObject *knl = NULL;
-  nomp_check(nomp_py_c_to_loopy(&knl, csrc));
+  return err;
+}
 
-  // Act on the clauses: transform, reduce, etc. and get the kernel
-  nomp_check(nomp_jit_act_on_clauses(&knl, prg, clauses, &nomp));
+static int nomp_jit_spawn(nomp_prog_t *prg, uint64_t key, const char *csrc,
+                          const char **clauses) {
+  // Wait for the oldest worker if all of them are busy. If that worker
+  // failed, the error belongs to its own kernel and is returned when the
+  // kernel is waited for.
+  if (ctx->jobs_n >= ctx->jit_workers) nomp_jit_finish(0);
+
+  int fds[2];
+  if (pipe(fds)) {
+    return nomp_log(NOMP_PY_CALL_FAILURE, NOMP_ERROR,
+                    "Unable to create a pipe for a JIT worker: %s.",
+                    strerror(errno));
+  }
 
-  // Handle reductions if they exist.
-  if (prg->reduction_index >= 0) {
-    nomp_check(nomp_py_realize_reduction(
-        &knl, prg->args[prg->reduction_index].name, nomp.py_context));
+  // The logs and the interpreter must be in a consistent state in the child.
+  nomp_log_lock();
+  PyOS_BeforeFork();
+  pid_t pid = fork();
+  if (pid == 0) {
+    PyOS_AfterFork_Child();
+    nomp_log_unlock();
+    close(fds[0]);
+    nomp_jit_worker(fds[1], prg, csrc, clauses);
+  }
+  PyOS_AfterFork_Parent();
+  nomp_log_unlock();
+
+  close(fds[1]);
+  if (pid < 0) {
+    close(fds[0]);
+    return nomp_log(NOMP_PY_CALL_FAILURE, NOMP_ERROR,
+                    "Unable to start a JIT worker: %s.", strerror(errno));
   }
 
-  // Call fix_parameters on the loopy kernel.
-  if (PyDict_Size(prg->py_dict)) nomp_py_fix_parameters(&knl, prg->py_dict);
+  if (ctx->jobs_n == ctx->jobs_max) {
+    ctx->jobs_max += ctx->jobs_max / 2 + 1;
+    ctx->jobs = nomp_realloc(ctx->jobs, struct nomp_jit_job, ctx->jobs_max);
+  }
+  struct nomp_jit_job *job = &ctx->jobs[ctx->jobs_n++];
+  job->pid                 = pid, job->fd = fds[0];
+  job->id                  = prg->id, job->key = key;
+  prg->pending             = 1;
 
-  // Get OpenCL, CUDA, etc. source and name from the loopy kernel and build
-  // the program.
-  char *name, *src;
-  nomp_check(nomp_py_get_knl_name_and_src(&name, &src, knl));
-  nomp_check(nomp.knl_build(&nomp, prg, src, name));
-  nomp_free(&src), nomp_free(&name);
+  return 0;
+}
 
-  // Get grid size of the loopy kernel as pymbolic expressions. These grid
-  // sizes will be evaluated each time the kernel is run.
-  nomp_check(nomp_py_get_grid_size(prg, knl));
-  Py_XDECREF(knl);
+// Read everything the worker writes until it closes the pipe.
+static char *nomp_jit_read(size_t *len, int fd) {
+  *len = 0;
+
+  char   *buf = NULL;
+  size_t  max = 0;
+  ssize_t n;
+  do {
+    if (*len + BUFSIZ > max) {
+      max += max + BUFSIZ;
+      buf = nomp_realloc(buf, char, max);
+    }
+    n = read(fd, buf + *len, max - *len - 1);
+    if (n > 0) *len += n;
+  } while (n > 0 || (n < 0 && errno == EINTR));
+  buf[*len] = '\0';
+  close(fd);
+
+  return buf;
+}
+
+// Wait for a worker and build its kernel. The job is removed even if the
+// kernel fails and the error is kept in the program (see jit_err).
+static int nomp_jit_finish(unsigned j) {
+  struct nomp_jit_job job = ctx->jobs[j];
+  ctx->jobs_n--;
+  memmove(&ctx->jobs[j], &ctx->jobs[j + 1],
+          (ctx->jobs_n - j) * sizeof(struct nomp_jit_job));
+
+  size_t len;
+  char  *buf    = nomp_jit_read(&len, job.fd);
+  int    status = -1;
+  while (waitpid(job.pid, &status, 0) < 0 && errno == EINTR)
+    ;
+
+  nomp_prog_t *prg = ctx->progs[job.id];
+
+  char *name = NULL, *src = NULL;
+  FILE *fp   = NULL;
+  int   ok   = WIFEXITED(status) && WEXITSTATUS(status) == 0 && len > 0;
+  if (ok) fp = fmemopen(buf, len, "rb");
+  ok = fp && !nomp_cache_read_knl(&name, &src, prg, fp);
+  if (fp) fclose(fp);
+
+  if (!ok) {
+    int   errorno = NOMP_PY_CALL_FAILURE;
+    char *msg     = strchr(buf, '\n');
+    if (msg && sscanf(buf, "%d", &errorno) == 1) msg++;
+    int err = nomp_log(errorno, NOMP_ERROR,
+                       "JIT worker failed to generate kernel %d: %s", job.id,
+                       msg ? msg : "worker exited unexpectedly.");
+    nomp_free(&buf);
+    return prg->jit_err = err;
+  }
+  nomp_free(&buf);
 
-  *id = progs_n++;
+  int err = nomp_cache_store(job.key, name, src, prg);
+  if (!err) err = nomp_jit_build(prg, name, src);
+  if (err) return prg->jit_err = err;
+  prg->pending = 0;
 
   return 0;
 }
@@ -574,88 +1204,1105 @@ int nomp_jit(int *id, const char *csrc, const char **clauses, int nargs, ...) {
 /**
  * @ingroup nomp_user_api
  *
- * @brief Runs the kernel generated by nomp_jit().
+ * @brief Generate and compile a kernel in the background.
  *
- * @details Runs the kernel with a given kernel id. Kernel id is followed by the
- * arguments (i.e., pointers and pointer to scalar variables).
+ * @details Same as nomp_jit() except that the kernel is generated by a
+ * worker process and \p id is returned right away. Kernels found in the
+ * kernel cache are built right away as well. nomp_run() (and other functions
+ * launching the kernel) wait for the kernel if it isn't ready yet. Workers
+ * run in parallel, so a large number of kernels can be generated at startup
+ * using all the processors (see `--nomp-jit-workers` in nomp_init()).
+ * Errors in generating the kernel are returned by the functions which wait
+ * for the kernel (or nomp_jit_wait()).
  *
  * <b>Example usage:</b>
  * @code{.c}
- * int N = 10;
- * double a[10], b[10];
- * for (unsigned i = 0; i < N; i++) {
- *   a[i] = i;
- *   b[i] = 10 -i
- * }
- *
- * static int id = -1;
- * const char *knl = "for (unsigned i = 0; i < N; i++) a[i] += b[i];"
- * const char *clauses[4] = {"transform", "file", "function", 0};
- * int err = nomp_jit(&id, knl, clauses, 3, "a", sizeof(a[0]), NOMP_PTR, "b",
- *   sizeof(b[0]), NOMP_PTR, "N", sizeof(int), NOMP_INT);
- * err = nomp_run(id, a, b, &N);
+ * static int ids[2] = {-1, -1};
+ * int err = nomp_jit_async(&ids[0], knl0, clauses, 2, "a", sizeof(double),
+ *   NOMP_PTR, "N", sizeof(int), NOMP_INT);
+ * err = nomp_jit_async(&ids[1], knl1, clauses, 2, "a", sizeof(double),
+ *   NOMP_PTR, "N", sizeof(int), NOMP_INT);
+ * ...
+ * err = nomp_run(ids[0], a, &N);
  * @endcode
  *
- * @param[in] id Id of the kernel to be run.
- * @param[in] ...  Arguments to the kernel.
- *
+ * @param[out] id Id of the generated kernel.
+ * @param[in] csrc Kernel source in C.
+ * @param[in] clauses Clauses to provide meta information about the kernel.
+ * @param[in] nargs Number of arguments to the kernel.
+ * @param[in] ... Three values for each argument: identifier, sizeof(argument)
+ * and argument type.
  * @return int
  */
-int nomp_run(int id, ...) {
-  if (id < 0) {
+int nomp_jit_async(int *id, const char *csrc, const char **clauses, int nargs,
+                   ...) {
+  if (*id >= 0) return 0;
+  nomp_check(nomp_check_context());
+
+  va_list args;
+  va_start(args, nargs);
+  nomp_py_lock();
+  int err = nomp_jit_impl(id, csrc, clauses, nargs, args, 1);
+  nomp_py_unlock();
+  va_end(args);
+
+  return err;
+}
+
+static inline int nomp_check_prog_id(int id) {
+  nomp_check(nomp_check_context());
+
+  if (id < 0 || id >= (int)ctx->progs_n) {
     return nomp_log(NOMP_USER_INPUT_IS_INVALID, NOMP_ERROR,
                     "Kernel id %d passed to nomp_run is not valid.", id);
   }
+  return 0;
+}
+
+// Wait for the worker generating a kernel started with nomp_jit_async(). The
+// kernel stays pending if the worker failed and the error of the worker is
+// returned every time the kernel is waited for.
+static int nomp_jit_wait_prog(const nomp_prog_t *prg) {
+  if (prg->jit_err) return prg->jit_err;
+
+  unsigned j = 0;
+  while (j < ctx->jobs_n && ctx->jobs[j].id != prg->id)
+    j++;
+  if (j == ctx->jobs_n) {
+    return nomp_log(NOMP_PY_CALL_FAILURE, NOMP_ERROR,
+                    "Kernel %d could not be generated.", prg->id);
+  }
+
+  nomp_py_lock();
+  int err = nomp_jit_finish(j);
+  nomp_py_unlock();
 
-  nomp_prog_t *prg = progs[id];
-  prg->eval_grid   = 0;
+  return err;
+}
+
+/**
+ * @ingroup nomp_user_api
+ *
+ * @brief Wait for a kernel generated with nomp_jit_async().
+ *
+ * @details Returns right away if the kernel is ready. Returns an error if
+ * the kernel couldn't be generated. Calling this is optional since launching
+ * the kernel waits for it as well.
+ *
+ * @param[in] id Id of the kernel returned by nomp_jit_async().
+ * @return int
+ */
+int nomp_jit_wait(int id) {
+  nomp_check(nomp_check_prog_id(id));
+
+  const nomp_prog_t *prg = ctx->progs[id];
+  if (prg->pending) return nomp_jit_wait_prog(prg);
+  return 0;
+}
 
+// Resolve the arguments of a kernel launch and evaluate the launch
+// parameters if needed. Host pointer of the reduction variable is resolved to
+// \p reduction_mem (which is NULL if the variable is not mapped).
+static int nomp_run_prepare(nomp_prog_t *prg, void **ptrs,
+                            nomp_mem_t **reduction_mem) {
   nomp_arg_t *args = prg->args;
   nomp_mem_t *m;
   long        val;
+  unsigned    gen = nomp_mem_generation(&ctx->mems);
 
-  va_list vargs;
-  va_start(vargs, id);
   for (unsigned i = 0; i < prg->nargs; i++) {
-    args[i].ptr = va_arg(vargs, void *);
+    args[i].ptr = ptrs[i];
     switch (args[i].type) {
     case NOMP_INT:
-      val = *((int *)args[i].ptr);
-      prg->eval_grid |= nomp_symengine_update(prg->map, args[i].name, val);
-      break;
     case NOMP_UINT:
-      val = *((unsigned *)args[i].ptr);
-      prg->eval_grid |= nomp_symengine_update(prg->map, args[i].name, val);
+      // Launch parameters depend only on the integer arguments, so they are
+      // evaluated again only if one of them changed.
+      if (args[i].type == NOMP_INT)
+        val = *((int *)args[i].ptr);
+      else
+        val = *((unsigned *)args[i].ptr);
+      if (val != args[i].value) args[i].value = val, prg->eval_grid = 1;
       break;
     case NOMP_PTR:
-      m = nomp_get_memory_if_mapped(args[i].ptr);
-      if (m == NULL) {
-        if (prg->reduction_index == (int)i) {
-          prg->reduction_ptr = args[i].ptr;
-          m                  = &nomp.scratch;
-        } else {
+      if (prg->reduction_index == (int)i) {
+        // Partial results of a reduction always go to the scratch memory. If
+        // the reduction variable is mapped, the final result is left on the
+        // device.
+        prg->reduction_ptr = args[i].ptr;
+        *reduction_mem     = nomp_mem_find(&ctx->mems, args[i].ptr);
+        m                  = &ctx->backend.scratch;
+      } else {
+        // Look up the host pointer only if it changed or if memory was mapped
+        // or freed since the last launch.
+        if (args[i].hptr != args[i].ptr || prg->mem_generation != gen) {
+          args[i].hptr = args[i].ptr;
+          args[i].mem  = nomp_mem_find(&ctx->mems, args[i].ptr);
+        }
+        if ((m = args[i].mem) == NULL) {
           return nomp_log(NOMP_USER_MAP_PTR_IS_INVALID, NOMP_ERROR,
                           ERR_STR_USER_MAP_PTR_IS_INVALID, args[i].ptr);
         }
       }
       args[i].size = m->bsize;
       args[i].ptr  = m->bptr;
+      args[i].mem  = m;
       break;
     case NOMP_FLOAT:
     default: break;
     }
   }
+  prg->mem_generation = gen;
+
+  if (prg->eval_grid && prg->grid_code) {
+    nomp_check(nomp_grid_eval(prg));
+  } else if (prg->eval_grid) {
+    // SymEngine map is shared by all the bindings of the program, so all the
+    // values are set before evaluating.
+    for (unsigned i = 0; i < prg->nargs; i++) {
+      if (args[i].type == NOMP_INT || args[i].type == NOMP_UINT)
+        nomp_symengine_update(prg->map, args[i].name, args[i].value);
+    }
+    nomp_check(nomp_symengine_eval_grid_size(prg));
+  }
+  prg->eval_grid = 0;
+
+  return 0;
+}
+
+// Number of timed launches of each variant of a tuned kernel. The fastest
+// launch is the time of the variant.
+#define NOMP_TUNE_RUNS 3
+
+// Variants of a tuned kernel are timed with the arguments of the first
+// launch, so the device data of the arrays is saved before tuning and
+// restored afterwards. The host data is left as it is.
+struct nomp_tune_mem {
+  nomp_mem_t *m;
+  char       *host, *dev;
+};
+
+static int nomp_tune_mem_save(struct nomp_tune_mem *t) {
+  nomp_mem_t *m     = t->m;
+  size_t      bytes = NOMP_MEM_BYTES(m->idx0, m->idx1, m->usize);
+  char       *hptr  = (char *)m->hptr + NOMP_MEM_OFFSET(m->idx0, m->usize);
+  t->host = nomp_calloc(char, bytes), t->dev = nomp_calloc(char, bytes);
+  memcpy(t->host, hptr, bytes);
+  nomp_check(ctx->backend.update(&ctx->backend, m, NOMP_FROM, m->idx0,
+                                 m->idx1, m->usize));
+  memcpy(t->dev, hptr, bytes), memcpy(hptr, t->host, bytes);
+  return 0;
+}
+
+static int nomp_tune_mem_restore(struct nomp_tune_mem *t, int n) {
+  nomp_backend_t *bnd = &ctx->backend;
+  for (int i = 0; i < n; i++) {
+    nomp_mem_t *m    = t[i].m;
+    char       *hptr = (char *)m->hptr + NOMP_MEM_OFFSET(m->idx0, m->usize);
+    memcpy(hptr, t[i].dev, NOMP_MEM_BYTES(m->idx0, m->idx1, m->usize));
+    nomp_check(bnd->update(bnd, m, NOMP_TO, m->idx0, m->idx1, m->usize));
+  }
+  // Copies may be asynchronous, so the host data is restored after the sync.
+  nomp_check(bnd->sync(bnd));
+  for (int i = 0; i < n; i++) {
+    nomp_mem_t *m    = t[i].m;
+    char       *hptr = (char *)m->hptr + NOMP_MEM_OFFSET(m->idx0, m->usize);
+    memcpy(hptr, t[i].host, NOMP_MEM_BYTES(m->idx0, m->idx1, m->usize));
+    nomp_free(&t[i].host), nomp_free(&t[i].dev);
+  }
+  return 0;
+}
+
+// Release the backend program and the launch parameters so the program can
+// be built again with other tuning parameters.
+static int nomp_tune_reset(nomp_prog_t *prg) {
+  nomp_check(ctx->backend.knl_free(prg));
+  vecbasic_free(prg->sym_global), vecbasic_free(prg->sym_local);
+  prg->sym_global = vecbasic_new(), prg->sym_local = vecbasic_new();
+  nomp_free(&prg->grid_code), prg->grid_code_n = 0;
+  prg->eval_grid = 1;
+  return 0;
+}
+
+// Time the variant of the program which is built. The first launch isn't
+// timed since it may include one time costs of the backend.
+static int nomp_tune_time(double *time, nomp_prog_t *prg, void **ptrs) {
+  nomp_backend_t *bnd           = &ctx->backend;
+  nomp_mem_t     *reduction_mem = NULL;
+  nomp_check(nomp_run_prepare(prg, ptrs, &reduction_mem));
+  nomp_check(bnd->knl_run(bnd, prg));
+  nomp_check(bnd->sync(bnd));
+
+  *time = DBL_MAX;
+  for (unsigned r = 0; r < NOMP_TUNE_RUNS; r++) {
+    double start = nomp_profile_now();
+    nomp_check(bnd->knl_run(bnd, prg));
+    nomp_check(bnd->sync(bnd));
+    double t = nomp_profile_now() - start;
+    if (t < *time) *time = t;
+  }
+
+  return 0;
+}
+
+// Build and time each point of the search space of the tuned transform and
+// build the program with the fastest one. Points which can't be built or run
+// are skipped. Parameters of the fastest point are stored in the tuning
+// database so the kernel isn't tuned again on the same device.
+static int nomp_tune_impl(nomp_prog_t *prg, void **ptrs) {
+  nomp_backend_t *bnd     = &ctx->backend;
+  const char    **clauses = (const char **)prg->clauses;
+  int             a       = nomp_jit_find_autotune(clauses);
+
+  char   **candidates;
+  unsigned n;
+  nomp_check(nomp_py_autotune_candidates(&candidates, &n, clauses[a + 1],
+                                         clauses[a + 2], bnd->py_context));
+
+  int    best = -1, built = -1;
+  double best_time = DBL_MAX, time;
+  for (unsigned c = 0; c < n; c++) {
+    nomp_check(nomp_tune_reset(prg));
+    prg->tune_params = candidates[c], built = -1;
+    int err = nomp_jit_prog(prg, prg->csrc, clauses, 0);
+    if (!err) err = nomp_tune_time(&time, prg, ptrs);
+    if (err) {
+      nomp_log(NOMP_SUCCESS, NOMP_WARNING,
+               "Autotune candidate %s of kernel %d failed and is skipped.",
+               candidates[c], prg->id);
+      continue;
+    }
+    nomp_log(NOMP_SUCCESS, NOMP_INFO,
+             "Autotune candidate %s of kernel %d took %g ms.", candidates[c],
+             prg->id, time);
+    if (time < best_time) best = c, best_time = time;
+    built = c;
+  }
+  prg->tune_params = NULL;
+
+  if (best >= 0) prg->tune_params = candidates[best], candidates[best] = NULL;
+  for (unsigned c = 0; c < n; c++)
+    nomp_free(&candidates[c]);
+  nomp_free(&candidates);
+  if (best < 0) {
+    nomp_check(nomp_tune_reset(prg));
+    return nomp_log(NOMP_USER_INPUT_IS_INVALID, NOMP_ERROR,
+                    "None of the %u autotune candidates of kernel %d could "
+                    "be built and run.",
+                    n, prg->id);
+  }
+
+  nomp_check(nomp_autotune_store(nomp_cache_hash_kernel(prg->csrc, clauses,
+                                                        prg->py_dict),
+                                 nomp_cache_hash_device(bnd->py_context),
+                                 prg->tune_params));
+
+  // Build the fastest variant again unless it is the last one built.
+  if (built != best) {
+    nomp_check(nomp_tune_reset(prg));
+    nomp_check(nomp_jit_prog(prg, prg->csrc, clauses, 0));
+  }
+  prg->tuning = 0;
+
+  return 0;
+}
+
+// Tune a kernel with the `autotune` clause using the arguments of its first
+// launch.
+static int nomp_tune_prog(nomp_prog_t *prg, void **ptrs) {
+  // Work queued before the launch must be done before the data is saved.
+  nomp_check(nomp_fuse_flush());
+  nomp_check(ctx->backend.sync(&ctx->backend));
+
+  struct nomp_tune_mem mems[NOMP_MAX_KERNEL_ARGS_SIZE];
+  int                  nmems = 0;
+  for (unsigned i = 0; i < prg->nargs; i++) {
+    if (prg->args[i].type != NOMP_PTR) continue;
+    nomp_mem_t *m = nomp_mem_find(&ctx->mems, ptrs[i]);
+    if (m == NULL) {
+      return nomp_log(NOMP_USER_MAP_PTR_IS_INVALID, NOMP_ERROR,
+                      ERR_STR_USER_MAP_PTR_IS_INVALID, ptrs[i]);
+    }
+    int j = 0;
+    while (j < nmems && mems[j].m != m)
+      j++;
+    if (j < nmems) continue;
+    mems[nmems].m = m;
+    nomp_check(nomp_tune_mem_save(&mems[nmems++]));
+  }
+
+  double start = nomp_profile_now();
+  nomp_profile("jit::autotune", 1, 0);
+  nomp_py_lock();
+  int err = nomp_tune_impl(prg, ptrs);
+  nomp_py_unlock();
+  nomp_profile("jit::autotune", 0, 0);
+  nomp_trace_span(NOMP_TRACE_JIT, "jit::autotune", start);
+
+  nomp_check(nomp_tune_mem_restore(mems, nmems));
+
+  return err;
+}
+
+#undef NOMP_TUNE_RUNS
+
+static int nomp_run_prog(nomp_prog_t *prg, void **ptrs) {
+  if (prg->pending) nomp_check(nomp_jit_wait_prog(prg));
+  if (prg->tuning) nomp_check(nomp_tune_prog(prg, ptrs));
+  if (ctx->capture) return nomp_graph_record(prg, ptrs, NULL, 0, 0, 0, 0);
+  if (ctx->fusing) return nomp_fuse_queue(prg, ptrs);
+
+  // Host time of the launch is recorded in the entry of the kernel next to
+  // the time the kernel takes on the device.
+  double start = nomp_profile_now();
+  nomp_profile_host(prg->profile_id, 1);
+  nomp_mem_t *reduction_mem = NULL;
+  nomp_check(nomp_run_prepare(prg, ptrs, &reduction_mem));
+
+  nomp_backend_t *bnd = &ctx->backend;
+  nomp_check(bnd->knl_run(bnd, prg));
+  if (prg->reduction_prg) {
+    nomp_check(
+        nomp_device_side_reduction(bnd, prg, &bnd->scratch, reduction_mem));
+  } else if (prg->reduction_index >= 0) {
+    nomp_check(nomp_host_side_reduction(bnd, prg, &bnd->scratch));
+    // Keep the device copy of a mapped reduction variable up to date.
+    if (reduction_mem) {
+      nomp_check(bnd->update(bnd, reduction_mem, NOMP_TO, reduction_mem->idx0,
+                             reduction_mem->idx1, reduction_mem->usize));
+    }
+  }
+  nomp_profile_host(prg->profile_id, 0);
+  nomp_trace_run(prg, start);
+
+  return 0;
+}
+
+/**
+ * @ingroup nomp_user_api
+ *
+ * @brief Runs the kernel generated by nomp_jit().
+ *
+ * @details Runs the kernel with a given kernel id. Kernel id is followed by the
+ * arguments (i.e., pointers and pointer to scalar variables). The kernel is
+ * launched asynchronously, i.e., nomp_run() may return before the kernel has
+ * finished executing. Use nomp_sync() or a nomp_update() with NOMP_FROM to
+ * wait for the results. Kernels with a reduction are the exception: they
+ * block until the reduction result is available on the host. If the reduction
+ * variable is mapped to the device with nomp_update(), the result is left on
+ * the device instead (without blocking) so it can be used by the following
+ * kernels or copied back later with NOMP_FROM.
+ *
+ * <b>Example usage:</b>
+ * @code{.c}
+ * int N = 10;
+ * double a[10], b[10];
+ * for (unsigned i = 0; i < N; i++) {
+ *   a[i] = i;
+ *   b[i] = 10 -i
+ * }
+ *
+ * static int id = -1;
+ * const char *knl = "for (unsigned i = 0; i < N; i++) a[i] += b[i];"
+ * const char *clauses[4] = {"transform", "file", "function", 0};
+ * int err = nomp_jit(&id, knl, clauses, 3, "a", sizeof(a[0]), NOMP_PTR, "b",
+ *   sizeof(b[0]), NOMP_PTR, "N", sizeof(int), NOMP_INT);
+ * err = nomp_run(id, a, b, &N);
+ * @endcode
+ *
+ * @param[in] id Id of the kernel to be run.
+ * @param[in] ...  Arguments to the kernel.
+ *
+ * @return int
+ */
+int nomp_run(int id, ...) {
+  nomp_check(nomp_check_prog_id(id));
+
+  void   *ptrs[NOMP_MAX_KERNEL_ARGS_SIZE];
+  va_list vargs;
+  va_start(vargs, id);
+  for (unsigned i = 0; i < ctx->progs[id]->nargs; i++)
+    ptrs[i] = va_arg(vargs, void *);
   va_end(vargs);
 
-  if (prg->eval_grid) nomp_check(nomp_symengine_eval_grid_size(prg));
+  return nomp_run_prog(ctx->progs[id], ptrs);
+}
+
+/**
+ * @ingroup nomp_user_api
+ *
+ * @brief Runs the kernel generated by nomp_jit() with the arguments passed as
+ * an array.
+ *
+ * @details Same as nomp_run() but the arguments (i.e., pointers and pointers
+ * to scalar variables) are passed in an array in the same order as in
+ * nomp_jit(). This is meant for language bindings and wrappers which can't
+ * build a variable argument list.
+ *
+ * <b>Example usage:</b>
+ * @code{.c}
+ * void *args[3] = {a, b, &N};
+ * int err = nomp_run_v(id, args);
+ * @endcode
+ *
+ * @param[in] id Id of the kernel to be run.
+ * @param[in] args Array of arguments to the kernel.
+ * @return int
+ */
+int nomp_run_v(int id, void **args) {
+  nomp_check(nomp_check_prog_id(id));
+  return nomp_run_prog(ctx->progs[id], args);
+}
+
+// Kernels bound to a fixed set of arguments with nomp_bind(). Each of them is
+// a shallow copy of the program with its own arguments, so the resolved
+// memory and the launch parameters of different bindings of the same kernel
+// don't evict each other.
+struct nomp_binding {
+  nomp_prog_t prg;
+  void      **ptrs;
+};
+
+static struct nomp_binding *nomp_binding_create(const nomp_prog_t *prg,
+                                                void             **ptrs) {
+  struct nomp_binding *b = nomp_calloc(struct nomp_binding, 1);
+  b->prg                 = *prg;
+  b->prg.args            = nomp_calloc(nomp_arg_t, prg->nargs);
+  memcpy(b->prg.args, prg->args, prg->nargs * sizeof(nomp_arg_t));
+  b->prg.eval_grid = 1;
+  b->ptrs          = nomp_calloc(void *, prg->nargs);
+  memcpy(b->ptrs, ptrs, prg->nargs * sizeof(void *));
+  return b;
+}
+
+static void nomp_binding_free(struct nomp_binding **b) {
+  nomp_free(&(*b)->prg.args), nomp_free(&(*b)->ptrs), nomp_free(b);
+}
+
+static inline int nomp_check_binding(int handle) {
+  nomp_check(nomp_check_context());
+
+  if (handle < 0 || handle >= (int)ctx->bindings_n || !ctx->bindings[handle]) {
+    return nomp_log(NOMP_USER_INPUT_IS_INVALID, NOMP_ERROR,
+                    "Binding handle %d is not valid.", handle);
+  }
+  return 0;
+}
+
+/**
+ * @ingroup nomp_user_api
+ *
+ * @brief Bind the kernel generated by nomp_jit() to a fixed set of arguments
+ * so it can be launched many times with nomp_launch().
+ *
+ * @details The pointers in \p args are stored in the binding, so the arrays
+ * and the scalar variables must stay valid till nomp_unbind(). The values of
+ * the scalar variables are read at every launch. Device memory of the arrays
+ * is resolved once and resolved again only if memory was mapped or freed in
+ * between. Kernel launch parameters are evaluated again only if the value of
+ * an integer argument changed.
+ *
+ * <b>Example usage:</b>
+ * @code{.c}
+ * int handle;
+ * void *args[3] = {a, b, &N};
+ * nomp_bind(&handle, id, args);
+ * for (int step = 0; step < nsteps; step++)
+ *   nomp_launch(handle);
+ * nomp_unbind(handle);
+ * @endcode
+ *
+ * @param[out] handle Handle of the binding.
+ * @param[in] id Id of the kernel.
+ * @param[in] args Array of arguments to the kernel.
+ * @return int
+ */
+int nomp_bind(int *handle, int id, void **args) {
+  // The binding has a copy of the program, so the program must be ready.
+  nomp_check(nomp_jit_wait(id));
+  if (ctx->progs[id]->tuning) nomp_check(nomp_tune_prog(ctx->progs[id], args));
+
+  if (ctx->bindings_n == ctx->bindings_max) {
+    ctx->bindings_max += ctx->bindings_max / 2 + 1;
+    ctx->bindings = nomp_realloc(ctx->bindings, struct nomp_binding *,
+                                 ctx->bindings_max);
+  }
+
+  ctx->bindings[ctx->bindings_n] = nomp_binding_create(ctx->progs[id], args);
+  *handle                       = ctx->bindings_n++;
+
+  return 0;
+}
+
+/**
+ * @ingroup nomp_user_api
+ *
+ * @brief Launch a kernel bound with nomp_bind().
+ *
+ * @details Behaves like nomp_run() with the arguments given to nomp_bind().
+ *
+ * @param[in] handle Handle returned by nomp_bind().
+ * @return int
+ */
+int nomp_launch(int handle) {
+  nomp_check(nomp_check_binding(handle));
+  struct nomp_binding *b = ctx->bindings[handle];
+  return nomp_run_prog(&b->prg, b->ptrs);
+}
+
+/**
+ * @ingroup nomp_user_api
+ *
+ * @brief Release a binding created with nomp_bind().
+ *
+ * @param[in] handle Handle returned by nomp_bind().
+ * @return int
+ */
+int nomp_unbind(int handle) {
+  nomp_check(nomp_check_binding(handle));
+  nomp_binding_free(&ctx->bindings[handle]);
+  return 0;
+}
+
+// A node of a graph is either a kernel launch bound to the arguments given
+// when it was recorded or a memory transfer of a mapped array. The mapped
+// array of a transfer is looked up again only if memory was mapped or freed
+// since the last replay.
+struct nomp_graph_node {
+  struct nomp_binding *knl;
+  void                *ptr;
+  size_t               idx0, idx1, usize;
+  nomp_map_direction_t op;
+  nomp_mem_t          *mem;
+  unsigned             mem_generation;
+};
+
+// Graphs with only kernels (and no reductions) are replayed with a native
+// graph if the backend supports them. The native graph captures the launch
+// parameters and the arguments, so it is built again whenever their values
+// (saved in `keys`) change.
+struct nomp_graph {
+  struct nomp_graph_node *nodes;
+  unsigned                n, max;
+  int                     native;
+  void                   *bgraph;
+  nomp_prog_t           **prgs;
+  uint64_t               *keys;
+};
+
+static int nomp_graph_record(const nomp_prog_t *prg, void **ptrs, void *ptr,
+                             size_t idx0, size_t idx1, size_t usize,
+                             nomp_map_direction_t op) {
+  struct nomp_graph *g = ctx->capture;
+  if (g->n == g->max) {
+    g->max += g->max / 2 + 1;
+    g->nodes = nomp_realloc(g->nodes, struct nomp_graph_node, g->max);
+  }
+
+  struct nomp_graph_node *node = &g->nodes[g->n++];
+  node->knl                    = prg ? nomp_binding_create(prg, ptrs) : NULL;
+  node->ptr = ptr, node->idx0 = idx0, node->idx1 = idx1, node->usize = usize;
+  node->op  = op, node->mem = NULL, node->mem_generation = 0;
+
+  return 0;
+}
+
+static int nomp_graph_free_impl(struct nomp_graph **g) {
+  struct nomp_graph *graph = *g;
+  if (graph->bgraph) nomp_check(ctx->backend.graph_free(graph->bgraph));
+  for (unsigned i = 0; i < graph->n; i++) {
+    if (graph->nodes[i].knl) nomp_binding_free(&graph->nodes[i].knl);
+  }
+  nomp_free(&graph->nodes), nomp_free(&graph->prgs), nomp_free(&graph->keys);
+  nomp_free(g);
+  return 0;
+}
+
+static inline int nomp_check_graph(int graph) {
+  nomp_check(nomp_check_context());
+
+  if (graph < 0 || graph >= (int)ctx->graphs_n || !ctx->graphs[graph]) {
+    return nomp_log(NOMP_USER_INPUT_IS_INVALID, NOMP_ERROR,
+                    "Graph handle %d is not valid.", graph);
+  }
+  return 0;
+}
+
+/**
+ * @ingroup nomp_user_api
+ *
+ * @brief Start recording a graph of kernel launches and memory transfers.
+ *
+ * @details Till nomp_graph_end() is called, nomp_run(), nomp_run_v(),
+ * nomp_launch() and nomp_update() with NOMP_TO or NOMP_FROM don't do any work
+ * and only record it in the graph. Memory can't be mapped or freed with
+ * nomp_update() while recording. The recorded graph is replayed with
+ * nomp_graph_launch().
+ *
+ * @return int
+ */
+int nomp_graph_begin(void) {
+  nomp_check(nomp_check_context());
+
+  if (ctx->capture) {
+    return nomp_log(NOMP_USER_INPUT_IS_INVALID, NOMP_ERROR,
+                    "A graph is already being recorded.");
+  }
+  ctx->capture = nomp_calloc(struct nomp_graph, 1);
+  return 0;
+}
 
-  nomp_check(nomp.knl_run(&nomp, prg));
-  if (prg->reduction_index >= 0)
-    nomp_check(nomp_host_side_reduction(&nomp, prg, &nomp.scratch));
+/**
+ * @ingroup nomp_user_api
+ *
+ * @brief Finish recording the graph started with nomp_graph_begin().
+ *
+ * @param[out] graph Handle of the recorded graph.
+ * @return int
+ */
+int nomp_graph_end(int *graph) {
+  nomp_check(nomp_check_context());
+
+  if (!ctx->capture) {
+    return nomp_log(NOMP_USER_INPUT_IS_INVALID, NOMP_ERROR,
+                    "nomp_graph_end called without nomp_graph_begin.");
+  }
+
+  struct nomp_graph *g = ctx->capture;
+  ctx->capture         = NULL;
+
+  g->native   = (ctx->backend.graph_build != NULL && g->n > 0);
+  size_t nkey = 0;
+  for (unsigned i = 0; i < g->n && g->native; i++) {
+    struct nomp_binding *knl = g->nodes[i].knl;
+    g->native = (knl && knl->prg.reduction_index < 0);
+    if (knl) nkey += knl->prg.nargs + 6;
+  }
+  if (g->native) {
+    g->prgs = nomp_calloc(nomp_prog_t *, g->n);
+    for (unsigned i = 0; i < g->n; i++)
+      g->prgs[i] = &g->nodes[i].knl->prg;
+    g->keys = nomp_calloc(uint64_t, nkey);
+  }
+
+  if (ctx->graphs_n == ctx->graphs_max) {
+    ctx->graphs_max += ctx->graphs_max / 2 + 1;
+    ctx->graphs =
+        nomp_realloc(ctx->graphs, struct nomp_graph *, ctx->graphs_max);
+  }
+  ctx->graphs[ctx->graphs_n] = g, *graph = ctx->graphs_n++;
+
+  return 0;
+}
+
+// Saves the value of the launch parameters and the arguments of a kernel in
+// `keys` and returns non-zero if any of them changed.
+static int nomp_graph_update_keys(uint64_t *keys, const nomp_prog_t *prg) {
+  uint64_t    key[NOMP_MAX_KERNEL_ARGS_SIZE + 6];
+  nomp_arg_t *args = prg->args;
+  for (unsigned i = 0; i < prg->nargs; i++) {
+    key[i] = 0;
+    if (args[i].type == NOMP_PTR) {
+      key[i] = (uint64_t)(uintptr_t)args[i].ptr;
+    } else {
+      size_t size = args[i].size;
+      memcpy(&key[i], args[i].ptr, size < sizeof(uint64_t) ? size : 8);
+    }
+  }
+  for (unsigned d = 0; d < 3; d++) {
+    key[prg->nargs + d]     = prg->global[d];
+    key[prg->nargs + 3 + d] = prg->local[d];
+  }
+
+  size_t bytes   = (prg->nargs + 6) * sizeof(uint64_t);
+  int    changed = memcmp(keys, key, bytes);
+  if (changed) memcpy(keys, key, bytes);
+  return changed;
+}
+
+static int nomp_graph_launch_native(struct nomp_graph *g) {
+  nomp_mem_t *reduction_mem;
+  uint64_t   *keys  = g->keys;
+  int         build = (g->bgraph == NULL);
+  for (unsigned i = 0; i < g->n; i++) {
+    struct nomp_binding *knl = g->nodes[i].knl;
+    nomp_check(nomp_run_prepare(&knl->prg, knl->ptrs, &reduction_mem));
+    build |= nomp_graph_update_keys(keys, &knl->prg);
+    keys += knl->prg.nargs + 6;
+  }
+
+  nomp_backend_t *bnd = &ctx->backend;
+  if (build) {
+    if (g->bgraph) nomp_check(bnd->graph_free(g->bgraph));
+    g->bgraph = NULL;
+    nomp_check(bnd->graph_build(bnd, &g->bgraph, g->prgs, g->n));
+  }
+
+  return bnd->graph_launch(bnd, g->bgraph, g->prgs, g->n);
+}
+
+// Kernels are launched with the backend pointers and the launch parameters
+// resolved by nomp_run_prepare(), which are only resolved again if an
+// argument changed. Kernels with a reduction need the host or device side
+// reduction after the launch, so they go through nomp_run_prog().
+static int nomp_graph_replay(struct nomp_graph *g) {
+  nomp_backend_t *bnd = &ctx->backend;
+  nomp_mem_t     *reduction_mem;
+  unsigned        gen = nomp_mem_generation(&ctx->mems);
+  for (unsigned i = 0; i < g->n; i++) {
+    struct nomp_graph_node *node = &g->nodes[i];
+    if (node->knl && node->knl->prg.reduction_index >= 0) {
+      nomp_check(nomp_run_prog(&node->knl->prg, node->knl->ptrs));
+    } else if (node->knl) {
+      nomp_check(nomp_run_prepare(&node->knl->prg, node->knl->ptrs,
+                                  &reduction_mem));
+      nomp_check(bnd->knl_run(bnd, &node->knl->prg));
+    } else {
+      if (node->mem == NULL || node->mem_generation != gen) {
+        node->mem = nomp_mem_find_range(&ctx->mems, node->ptr, node->idx0,
+                                        node->idx1, node->usize);
+        node->mem_generation = gen;
+      }
+      if (node->mem == NULL) {
+        return nomp_log(NOMP_USER_MAP_PTR_IS_INVALID, NOMP_ERROR,
+                        ERR_STR_USER_MAP_PTR_IS_INVALID, node->ptr);
+      }
+      nomp_check(bnd->update(bnd, node->mem, node->op, node->idx0, node->idx1,
+                             node->usize));
+    }
+  }
 
   return 0;
 }
 
+/**
+ * @ingroup nomp_user_api
+ *
+ * @brief Replay a graph recorded with nomp_graph_begin() and
+ * nomp_graph_end().
+ *
+ * @details The work is done in the order it was recorded, with the arguments
+ * given when it was recorded. Like nomp_bind(), the values of the scalar
+ * arguments are read at every replay, so they can be changed in between. On
+ * backends which support graphs (CUDA and HIP), a graph with only kernels
+ * (without reductions) is launched as a single native graph which is built
+ * again only if the arguments or the launch parameters changed. Other graphs
+ * are replayed by passing the recorded kernels straight to the backend, with
+ * the device pointers and launch parameters resolved by an earlier replay
+ * (they are resolved again only if an argument changed or memory was mapped
+ * or freed). Kernels with a reduction are launched like nomp_run().
+ *
+ * <b>Example usage:</b>
+ * @code{.c}
+ * int graph;
+ * nomp_graph_begin();
+ * nomp_run(id0, a, b, &N);
+ * nomp_run(id1, b, a, &N);
+ * nomp_graph_end(&graph);
+ * for (int step = 0; step < nsteps; step++)
+ *   nomp_graph_launch(graph);
+ * nomp_graph_free(graph);
+ * @endcode
+ *
+ * @param[in] graph Handle returned by nomp_graph_end().
+ * @return int
+ */
+int nomp_graph_launch(int graph) {
+  nomp_check(nomp_check_graph(graph));
+  if (ctx->capture) {
+    return nomp_log(NOMP_USER_INPUT_IS_INVALID, NOMP_ERROR,
+                    "A graph can't be launched while a graph is recorded.");
+  }
+  nomp_check(nomp_fuse_flush());
+
+  // Recorded work is done in order, so the kernels are run (and not queued)
+  // even if the graph is launched in a region started by nomp_fuse_begin().
+  struct nomp_graph *g      = ctx->graphs[graph];
+  int                active = ctx->fusing;
+  ctx->fusing               = 0;
+  int err = g->native ? nomp_graph_launch_native(g) : nomp_graph_replay(g);
+  ctx->fusing = active;
+
+  return err;
+}
+
+/**
+ * @ingroup nomp_user_api
+ *
+ * @brief Release a graph recorded with nomp_graph_end().
+ *
+ * @param[in] graph Handle returned by nomp_graph_end().
+ * @return int
+ */
+int nomp_graph_free(int graph) {
+  nomp_check(nomp_check_graph(graph));
+  return nomp_graph_free_impl(&ctx->graphs[graph]);
+}
+
+// Kernel launches queued between nomp_fuse_begin() and nomp_fuse_end(). Values
+// of the scalar arguments are saved when the launch is queued.
+struct nomp_fuse_launch {
+  int       id;
+  void    **ptrs;
+  uint64_t *vals;
+};
+
+// Fused programs keyed by the sequence of kernel ids and by which of their
+// arguments are the same. Id is -1 if the kernels couldn't be fused.
+struct nomp_fused {
+  uint64_t key;
+  int      id;
+};
+
+static int nomp_fuse_queue(const nomp_prog_t *prg, void **ptrs) {
+  if (ctx->fuse_n == ctx->fuse_max) {
+    ctx->fuse_max += ctx->fuse_max / 2 + 1;
+    ctx->fuse_queue = nomp_realloc(ctx->fuse_queue, struct nomp_fuse_launch,
+                                   ctx->fuse_max);
+  }
+
+  struct nomp_fuse_launch *l = &ctx->fuse_queue[ctx->fuse_n++];
+  l->id                      = prg->id;
+  l->ptrs                    = nomp_calloc(void *, prg->nargs);
+  l->vals                    = nomp_calloc(uint64_t, prg->nargs);
+  memcpy(l->ptrs, ptrs, prg->nargs * sizeof(void *));
+  for (unsigned i = 0; i < prg->nargs; i++) {
+    size_t size = prg->args[i].size;
+    if (prg->args[i].type != NOMP_PTR)
+      memcpy(&l->vals[i], ptrs[i], size < sizeof(uint64_t) ? size : 8);
+  }
+
+  return 0;
+}
+
+// Pointers to launch a queued kernel with the saved values of the scalars.
+static inline void nomp_fuse_ptrs(void **ptrs, struct nomp_fuse_launch *l) {
+  const nomp_prog_t *prg = ctx->progs[l->id];
+  for (unsigned i = 0; i < prg->nargs; i++)
+    ptrs[i] = prg->args[i].type == NOMP_PTR ? l->ptrs[i] : &l->vals[i];
+}
+
+static int nomp_fuse_build(int *id, unsigned s, unsigned e,
+                           const unsigned *map, unsigned nargs,
+                           const nomp_arg_t *fargs) {
+  PyObject *py_knls = PyList_New(e - s), *py_names = PyList_New(e - s);
+  char      name[NOMP_MAX_BUFFER_SIZE + 1];
+  for (unsigned k = s; k < e; k++) {
+    nomp_prog_t *prg = ctx->progs[ctx->fuse_queue[k].id];
+    if (!prg->py_knl) {
+      PyObject *py_knl = NULL;
+      int       err    = nomp_jit_loopy(&py_knl, prg, prg->csrc,
+                                        (const char **)prg->clauses);
+      if (err) {
+        Py_XDECREF(py_knl), Py_DECREF(py_knls), Py_DECREF(py_names);
+        return err;
+      }
+      prg->py_knl = py_knl;
+    }
+    Py_INCREF(prg->py_knl), PyList_SetItem(py_knls, k - s, prg->py_knl);
+
+    PyObject *py_dict = PyDict_New();
+    for (unsigned i = 0; i < prg->nargs; i++) {
+      snprintf(name, sizeof(name), "_nomp_fuse%u", *map++);
+      PyObject *py_name = PyUnicode_FromString(name);
+      PyDict_SetItemString(py_dict, prg->args[i].name, py_name);
+      Py_XDECREF(py_name);
+    }
+    PyList_SetItem(py_names, k - s, py_dict);
+  }
+
+  PyObject *knl = NULL;
+  int       err = nomp_py_fuse(&knl, py_knls, py_names);
+  Py_DECREF(py_knls), Py_DECREF(py_names);
+  nomp_check(err);
+  if (!knl) {
+    *id = -1;
+    return 0;
+  }
+
+  nomp_prog_t *prg = nomp_prog_new(nargs);
+  prg->nargs       = nargs;
+  for (unsigned i = 0; i < nargs; i++) {
+    prg->args[i] = fargs[i];
+    snprintf(prg->args[i].name, sizeof(prg->args[i].name), "_nomp_fuse%u", i);
+  }
+
+  char *kname = NULL, *src = NULL;
+  err         = nomp_jit_lower(&kname, &src, prg, knl);
+  if (!err && ctx->grid_bytecode) err = nomp_symengine_compile_grid_size(prg);
+  if (!err) err = ctx->backend.knl_build(&ctx->backend, prg, src, kname);
+  if (!err) nomp_profile_prog(prg, kname);
+  nomp_free(&src), nomp_free(&kname);
+  if (err) {
+    nomp_prog_discard(prg);
+    return err;
+  }
+
+  prg->eval_grid = 1;
+  *id            = ctx->progs_n++;
+
+  return 0;
+}
+
+// Run the queued launches in [s, e) as a single fused kernel if possible and
+// one after the other otherwise.
+static int nomp_fuse_run(unsigned s, unsigned e) {
+  // Arguments which refer to the same array, or to the same scalar with the
+  // same value, are the same argument of the fused kernel.
+  void      *ptrs[NOMP_MAX_KERNEL_ARGS_SIZE], *fptrs[NOMP_MAX_KERNEL_ARGS_SIZE];
+  uint64_t   fvals[NOMP_MAX_KERNEL_ARGS_SIZE];
+  nomp_arg_t fargs[NOMP_MAX_KERNEL_ARGS_SIZE];
+  unsigned   nargs = 0, nmap = 0, *map;
+  for (unsigned k = s; k < e; k++)
+    nmap += ctx->progs[ctx->fuse_queue[k].id]->nargs;
+  map = nomp_calloc(unsigned, nmap), nmap = 0;
+
+  uint64_t key  = NOMP_HASH_SEED;
+  int      id   = -1, full = 0;
+  for (unsigned k = s; k < e && !full; k++) {
+    struct nomp_fuse_launch *l   = &ctx->fuse_queue[k];
+    const nomp_prog_t       *prg = ctx->progs[l->id];
+    key                          = nomp_hash(key, &l->id, sizeof(l->id));
+    for (unsigned i = 0; i < prg->nargs && !full; i++) {
+      int      scalar = (prg->args[i].type != NOMP_PTR);
+      unsigned f      = 0;
+      while (f < nargs && (fptrs[f] != l->ptrs[i] ||
+                           (scalar && fvals[f] != l->vals[i])))
+        f++;
+      if (f == nargs && (full = (nargs == NOMP_MAX_KERNEL_ARGS_SIZE)))
+        break;
+      if (f == nargs) {
+        fptrs[f] = l->ptrs[i], fvals[f] = l->vals[i];
+        fargs[f] = prg->args[i], nargs++;
+        fargs[f].hptr = NULL, fargs[f].mem = NULL;
+      }
+      map[nmap++] = f;
+      key         = nomp_hash(key, &f, sizeof(f));
+    }
+  }
+
+  // Kernels with too many arguments in total are not fused.
+  unsigned j = 0;
+  while (!full && j < ctx->fused_n && ctx->fused[j].key != key)
+    j++;
+  if (!full && j == ctx->fused_n) {
+    nomp_py_lock();
+    int err = nomp_fuse_build(&id, s, e, map, nargs, fargs);
+    nomp_py_unlock();
+    if (err) {
+      nomp_free(&map);
+      return err;
+    }
+    if (ctx->fused_n == ctx->fused_max) {
+      ctx->fused_max += ctx->fused_max / 2 + 1;
+      ctx->fused = nomp_realloc(ctx->fused, struct nomp_fused, ctx->fused_max);
+    }
+    ctx->fused[ctx->fused_n].key = key, ctx->fused[ctx->fused_n++].id = id;
+  }
+  nomp_free(&map);
+
+  if (!full && (id = ctx->fused[j].id) >= 0) {
+    for (unsigned f = 0; f < nargs; f++)
+      ptrs[f] = fargs[f].type == NOMP_PTR ? fptrs[f] : &fvals[f];
+    return nomp_run_prog(ctx->progs[id], ptrs);
+  }
+
+  for (unsigned k = s; k < e; k++) {
+    nomp_fuse_ptrs(ptrs, &ctx->fuse_queue[k]);
+    nomp_check(nomp_run_prog(ctx->progs[ctx->fuse_queue[k].id], ptrs));
+  }
+
+  return 0;
+}
+
+static int nomp_fuse_flush(void) {
+  // Launches are run (and not queued again) while the queue is flushed. The
+  // queue is emptied first so a flush from one of the launches is a no-op,
+  // and it is dropped even if a launch fails so the error is reported once.
+  int      active = ctx->fusing;
+  unsigned n      = ctx->fuse_n;
+  ctx->fusing = 0, ctx->fuse_n = 0;
+
+  void    *ptrs[NOMP_MAX_KERNEL_ARGS_SIZE];
+  unsigned s   = 0;
+  int      err = 0;
+  while (s < n && !err) {
+    // Consecutive launches of kernels without reductions are fused.
+    unsigned e = s;
+    while (e < n && ctx->progs[ctx->fuse_queue[e].id]->reduction_index < 0)
+      e++;
+    if (e - s > 1) {
+      err = nomp_fuse_run(s, e);
+    } else {
+      e = s + 1;
+      nomp_fuse_ptrs(ptrs, &ctx->fuse_queue[s]);
+      err = nomp_run_prog(ctx->progs[ctx->fuse_queue[s].id], ptrs);
+    }
+    s = e;
+  }
+
+  for (unsigned i = 0; i < n; i++)
+    nomp_free(&ctx->fuse_queue[i].ptrs), nomp_free(&ctx->fuse_queue[i].vals);
+  ctx->fusing = active;
+
+  return err;
+}
+
+/**
+ * @ingroup nomp_user_api
+ *
+ * @brief Start a region in which consecutive kernel launches are fused.
+ *
+ * @details Till nomp_fuse_end() is called, nomp_run(), nomp_run_v() and
+ * nomp_launch() only queue the launch (with the current values of the scalar
+ * arguments). The queue is run by nomp_fuse_end() and before any other call
+ * which depends on the queued work (nomp_update(), nomp_sync(), etc.).
+ * Consecutive launches of kernels without reductions are fused into a single
+ * kernel if the loops of the kernels have the same domain and
+ * parallelization, and if each array which is written by one of the kernels
+ * and used by another is accessed with the same index everywhere. Otherwise,
+ * the kernels are launched one after the other. Fused kernels are generated
+ * once for each sequence of kernels and reused afterwards.
+ *
+ * <b>Example usage:</b>
+ * @code{.c}
+ * nomp_fuse_begin();
+ * nomp_run(axpy, y, x, &alpha, &N);
+ * nomp_run(scale, y, &beta, &N);
+ * nomp_fuse_end();
+ * @endcode
+ *
+ * @return int
+ */
+int nomp_fuse_begin(void) {
+  nomp_check(nomp_check_context());
+
+  if (ctx->fusing) {
+    return nomp_log(NOMP_USER_INPUT_IS_INVALID, NOMP_ERROR,
+                    "nomp_fuse_begin called twice.");
+  }
+  ctx->fusing = 1;
+  return 0;
+}
+
+/**
+ * @ingroup nomp_user_api
+ *
+ * @brief Run the launches queued since nomp_fuse_begin() and end the region.
+ *
+ * @return int
+ */
+int nomp_fuse_end(void) {
+  nomp_check(nomp_check_context());
+
+  if (!ctx->fusing) {
+    return nomp_log(NOMP_USER_INPUT_IS_INVALID, NOMP_ERROR,
+                    "nomp_fuse_end called without nomp_fuse_begin.");
+  }
+  nomp_check(nomp_fuse_flush());
+  ctx->fusing = 0;
+  return 0;
+}
+
 /**
  * @ingroup nomp_user_api
  *
@@ -666,51 +2313,327 @@ int nomp_run(int id, ...) {
  *
  * @return int
  */
-int nomp_sync(void) { return nomp.sync(&nomp); }
+int nomp_sync(void) {
+  nomp_check(nomp_check_context());
 
-static int nomp_finalize_impl(int interpreter) {
-  if (!initialized) return NOMP_FINALIZE_FAILURE;
+  double start = nomp_profile_now();
+  nomp_check(nomp_fuse_flush());
+  nomp_check(ctx->backend.sync(&ctx->backend));
+  nomp_trace_span(NOMP_TRACE_SYNC, "nomp_sync", start);
 
-  Py_XDECREF(nomp.py_annotate), nomp.py_annotate = NULL;
-  Py_XDECREF(nomp.py_context), nomp.py_context   = NULL;
+  return 0;
+}
 
-  // Free all the allocated memory.
-  for (unsigned i = 0; i < mems_n; i++) {
-    if (!mems[i]) continue;
-    nomp_check(nomp.update(&nomp, mems[i], NOMP_FREE, mems[i]->idx0,
-                           mems[i]->idx1, mems[i]->usize));
-    nomp_free(&mems[i]);
+/**
+ * @ingroup nomp_user_api
+ *
+ * @brief Create queues (streams) on the device.
+ *
+ * @details Makes sure there are at least \p n queues numbered from 0 to \p n
+ * - 1. Queue 0 is the default queue which is created by nomp_init(). Queues
+ * are released by nomp_finalize(). Use nomp_set_queue() to select the queue
+ * used by nomp_update() and nomp_run().
+ *
+ * @param[in] n Number of queues.
+ * @return int
+ */
+int nomp_create_queues(unsigned n) {
+  nomp_check(nomp_check_context());
+
+  if (n == 0) {
+    return nomp_log(NOMP_USER_INPUT_IS_INVALID, NOMP_ERROR,
+                    "Number of queues must be positive.");
   }
-  nomp_free(&mems), mems_n = mems_max = 0;
-  nomp_check(nomp_deallocate_scratch_memory(&nomp));
+  if (n <= ctx->backend.nqueues) return 0;
 
-  // Free all the allocated programs.
-  for (unsigned i = 0; i < progs_n; i++) {
-    if (!progs[i]) continue;
-    nomp_check(nomp.knl_free(progs[i]));
+  nomp_check(ctx->backend.create_queues(&ctx->backend, n));
+  ctx->backend.nqueues = n;
 
-    Py_XDECREF(progs[i]->py_dict);
+  return 0;
+}
 
-    vecbasic_free(progs[i]->sym_global);
-    vecbasic_free(progs[i]->sym_local);
-    mapbasicbasic_free(progs[i]->map);
+static inline int nomp_check_queue(unsigned queue) {
+  nomp_check(nomp_check_context());
 
-    nomp_free(&progs[i]->args);
-    nomp_free(&progs[i]);
+  if (queue >= ctx->backend.nqueues) {
+    return nomp_log(NOMP_USER_INPUT_IS_INVALID, NOMP_ERROR,
+                    "Invalid queue: %u. Number of queues: %u.", queue,
+                    ctx->backend.nqueues);
   }
-  nomp_free(&progs), progs_n = progs_max = 0;
-  nomp_check(nomp_py_finalize(interpreter));
+  return 0;
+}
 
-  // Free bookkeeping structures for the logger and profiler since these can be
-  // released irrespective of whether libnomp is initialized or not.
-  nomp_profile_finalize();
-  nomp_log_finalize();
+/**
+ * @ingroup nomp_user_api
+ *
+ * @brief Select the queue used by the following nomp_update() and
+ * nomp_run() calls.
+ *
+ * @details Work submitted to a queue runs in the order it was submitted.
+ * Work on different queues may run concurrently, so a kernel or a transfer
+ * which depends on work from another queue must be preceded by a call to
+ * nomp_sync_queue() (or nomp_sync()) on that queue. Kernels with reductions
+ * share the same scratch memory, so they shouldn't run concurrently on
+ * different queues.
+ *
+ * <b>Example usage:</b>
+ * @code{.c}
+ * nomp_create_queues(2);
+ * // Update boundary data on queue 1 while the interior kernel runs on
+ * // queue 0.
+ * nomp_set_queue(0);
+ * nomp_run(interior_id, u, &n);
+ * nomp_set_queue(1);
+ * nomp_update(halo, 0, m, sizeof(double), NOMP_TO);
+ * nomp_run(boundary_id, u, halo, &m);
+ * nomp_sync();
+ * @endcode
+ *
+ * @param[in] queue Queue id.
+ * @return int
+ */
+int nomp_set_queue(unsigned queue) {
+  nomp_check(nomp_check_queue(queue));
+  nomp_check(nomp_fuse_flush());
+  ctx->backend.queue = queue;
+  return 0;
+}
 
-  if ((initialized = nomp.finalize(&nomp))) return NOMP_FINALIZE_FAILURE;
+/**
+ * @ingroup nomp_user_api
+ *
+ * @brief Wait for all the work submitted to a single queue to finish.
+ *
+ * @param[in] queue Queue id.
+ * @return int
+ */
+int nomp_sync_queue(unsigned queue) {
+  nomp_check(nomp_check_queue(queue));
+  double start = nomp_profile_now();
+  nomp_check(nomp_fuse_flush());
+  nomp_check(ctx->backend.sync_queue(&ctx->backend, queue));
+  nomp_trace_span(NOMP_TRACE_SYNC, "nomp_sync_queue", start);
 
   return 0;
 }
 
+/**
+ * @ingroup nomp_user_api
+ *
+ * @brief Wait for the last transfer or kernel which used the memory mapped
+ * at \p ptr.
+ *
+ * @details nomp_update() with ::NOMP_ASYNC returns before the copy is done.
+ * Kernels launched by nomp_run() only wait for the pending work on the memory
+ * they use, so an asynchronous upload overlaps with kernels which don't use
+ * it. Call nomp_wait() before reading the host memory after an asynchronous
+ * ::NOMP_FROM or before writing to it after an asynchronous ::NOMP_TO. The
+ * host memory must stay valid till then.
+ *
+ * <b>Example usage:</b>
+ * @code{.c}
+ * nomp_update(a, 0, n, sizeof(double), NOMP_TO | NOMP_ASYNC);
+ * nomp_run(id, b, &n); // Doesn't wait for the upload of a.
+ * nomp_run(id, a, &n); // Waits for the upload of a.
+ * nomp_update(a, 0, n, sizeof(double), NOMP_FROM | NOMP_ASYNC);
+ * nomp_wait(a);
+ * @endcode
+ *
+ * @param[in] ptr Pointer to the mapped host memory.
+ * @return int
+ */
+int nomp_wait(const void *ptr) {
+  nomp_check(nomp_check_context());
+
+  nomp_mem_t *m = nomp_mem_find(&ctx->mems, ptr);
+  if (m == NULL) {
+    return nomp_log(NOMP_USER_MAP_PTR_IS_INVALID, NOMP_ERROR,
+                    ERR_STR_USER_MAP_PTR_IS_INVALID, ptr);
+  }
+  nomp_check(nomp_fuse_flush());
+  if (m->event == NULL) return 0;
+
+  return ctx->backend.mem_wait(&ctx->backend, m);
+}
+
+/**
+ * @ingroup nomp_user_api
+ *
+ * @brief Release the device memory cached in the memory pool.
+ *
+ * @details Memory freed with nomp_update() is kept in a pool (up to the size
+ * given by `--nomp-pool-size`) and reused by later allocations. Call this to
+ * return the cached memory to the device, for example before a phase which
+ * allocates device memory outside of libnomp. Memory regions which are still
+ * mapped are not affected. See nomp_get_pool_stats() for the pool usage.
+ *
+ * @return int
+ */
+int nomp_trim_pool(void) {
+  nomp_check(nomp_check_context());
+
+  return nomp_pool_trim(&ctx->backend);
+}
+
+/**
+ * @ingroup nomp_user_api
+ *
+ * @brief Query the statistics of the device memory pool of the current
+ * context.
+ *
+ * @details Sizes are in bytes and are rounded up to the size class of each
+ * allocation. \p live is the device memory used by arrays mapped with
+ * nomp_update() and \p cached is the device memory kept in the pool for
+ * later allocations. \p hits and \p misses count the allocations served
+ * from the pool and by the backend since nomp_init(). All of them are zero
+ * if the pool is disabled. Any of the pointers can be NULL.
+ *
+ * @param[out] live Bytes of device memory in use.
+ * @param[out] cached Bytes of device memory cached in the pool.
+ * @param[out] hits Number of allocations served from the pool.
+ * @param[out] misses Number of allocations done by the backend.
+ * @return int
+ */
+int nomp_get_pool_stats(size_t *live, size_t *cached, unsigned *hits,
+                        unsigned *misses) {
+  nomp_check(nomp_check_context());
+
+  nomp_pool_stats(&ctx->backend, live, cached, hits, misses);
+  return 0;
+}
+
+// Release the Python objects of the current context. This is done with the
+// lock of the Python interface, so it doesn't return early.
+static void nomp_context_py_free(void) {
+  nomp_py_lock();
+  Py_XDECREF(ctx->backend.py_annotate), ctx->backend.py_annotate = NULL;
+  Py_XDECREF(ctx->backend.py_context), ctx->backend.py_context   = NULL;
+  for (unsigned i = 0; i < ctx->progs_n; i++) {
+    if (!ctx->progs[i]) continue;
+    Py_XDECREF(ctx->progs[i]->py_dict), ctx->progs[i]->py_dict = NULL;
+    Py_XDECREF(ctx->progs[i]->py_knl), ctx->progs[i]->py_knl   = NULL;
+  }
+  nomp_py_unlock();
+}
+
+// Free everything owned by the current context.
+static int nomp_context_free(void) {
+  // Stop the JIT workers which are still running.
+  for (unsigned i = 0; i < ctx->jobs_n; i++) {
+    close(ctx->jobs[i].fd), kill(ctx->jobs[i].pid, SIGKILL);
+    waitpid(ctx->jobs[i].pid, NULL, 0);
+  }
+  nomp_free(&ctx->jobs), ctx->jobs_n = ctx->jobs_max = 0;
+
+  nomp_context_py_free();
+
+  // Free all the allocated memory.
+  nomp_mem_t *m;
+  while ((m = nomp_mem_pop(&ctx->mems))) {
+    nomp_check(nomp_pool_free(&ctx->backend, m));
+    nomp_free(&m);
+  }
+  nomp_mem_finalize(&ctx->mems);
+  nomp_check(nomp_pool_finalize(&ctx->backend));
+  nomp_check(nomp_deallocate_scratch_memory(&ctx->backend));
+
+  // Drop the queued launches and free all the graphs, bindings and programs.
+  for (unsigned i = 0; i < ctx->fuse_n; i++)
+    nomp_free(&ctx->fuse_queue[i].ptrs), nomp_free(&ctx->fuse_queue[i].vals);
+  nomp_free(&ctx->fuse_queue), ctx->fuse_n = ctx->fuse_max = 0;
+  nomp_free(&ctx->fused), ctx->fused_n = ctx->fused_max = 0, ctx->fusing = 0;
+  if (ctx->capture) nomp_check(nomp_graph_free_impl(&ctx->capture));
+  for (unsigned i = 0; i < ctx->graphs_n; i++) {
+    if (ctx->graphs[i]) nomp_check(nomp_graph_free_impl(&ctx->graphs[i]));
+  }
+  nomp_free(&ctx->graphs), ctx->graphs_n = ctx->graphs_max = 0;
+  for (unsigned i = 0; i < ctx->bindings_n; i++) {
+    if (ctx->bindings[i]) nomp_check(nomp_unbind(i));
+  }
+  nomp_free(&ctx->bindings), ctx->bindings_n = ctx->bindings_max = 0;
+  for (unsigned i = 0; i < ctx->progs_n; i++) {
+    nomp_prog_t *prg = ctx->progs[i];
+    if (!prg) continue;
+    nomp_check(ctx->backend.knl_free(prg));
+
+    for (unsigned j = 0; prg->clauses && prg->clauses[j]; j++)
+      nomp_free(&prg->clauses[j]);
+    nomp_free(&prg->clauses), nomp_free(&prg->csrc);
+    nomp_free(&prg->tune_params);
+
+    vecbasic_free(prg->sym_global);
+    vecbasic_free(prg->sym_local);
+    mapbasicbasic_free(prg->map);
+    nomp_free(&prg->grid_code);
+
+    nomp_free(&prg->args);
+    nomp_free(&ctx->progs[i]);
+  }
+  nomp_free(&ctx->progs), ctx->progs_n = ctx->progs_max = 0;
+  nomp_check(nomp_reduction_finalize(&ctx->backend));
+
+  if (ctx->backend.finalize(&ctx->backend)) return NOMP_FINALIZE_FAILURE;
+
+  return 0;
+}
+
+static int nomp_context_destroy_impl(nomp_context_t *context,
+                                     int             interpreter) {
+  // Everything is released through the current context, so the context is
+  // made current while it is destroyed.
+  nomp_context_t *current = ctx;
+  ctx                     = context;
+  int err                 = nomp_context_free();
+  ctx                     = (current == context && !err) ? NULL : current;
+  if (err) return err;
+  nomp_free(&context);
+
+  pthread_mutex_lock(&contexts_lock);
+  if (--contexts_n == 0) {
+    // Free the state shared by the contexts. Bookkeeping structures for the
+    // logger and profiler are freed since these can be released irrespective
+    // of whether libnomp is initialized or not.
+    nomp_cache_finalize();
+    nomp_autotune_finalize();
+    err = nomp_py_finalize(interpreter);
+    nomp_trace_finalize();
+    nomp_profile_result();
+    nomp_profile_finalize();
+    nomp_log_finalize();
+  }
+  pthread_mutex_unlock(&contexts_lock);
+
+  return err;
+}
+
+/**
+ * @ingroup nomp_user_api
+ *
+ * @brief Destroy a context created with nomp_context_create() (or
+ * nomp_init()).
+ *
+ * @details Frees all the resources of the context. If \p context is the
+ * current context of the calling thread, the thread is left without a
+ * context. The context must not be in use by another thread. Destroying the
+ * last context doesn't finalize the Python interpreter, use nomp_finalize()
+ * for that.
+ *
+ * @param[in] context Context to destroy.
+ * @return int
+ */
+int nomp_context_destroy(nomp_context_t *context) {
+  if (context == NULL) {
+    return nomp_log(NOMP_USER_INPUT_IS_INVALID, NOMP_ERROR,
+                    "Context passed to nomp_context_destroy is NULL.");
+  }
+  return nomp_context_destroy_impl(context, 0);
+}
+
+static int nomp_finalize_impl(int interpreter) {
+  if (!ctx) return NOMP_FINALIZE_FAILURE;
+  return nomp_context_destroy_impl(ctx, interpreter);
+}
+
 /**
  * @ingroup nomp_user_api
  *
@@ -719,7 +2642,9 @@ static int nomp_finalize_impl(int interpreter) {
  * @details Frees allocated runtime resources for libnomp. Returns a non-zero
  * value if an error occurs during the finalize process, otherwise returns 0.
  * Calling this method before nomp_init() will return an error. Calling this
- * method twice will also return an error.
+ * method twice will also return an error. This destroys the current context
+ * of the calling thread (see nomp_context_destroy()). The Python interpreter
+ * is finalized only if no other context is left.
  *
  * @return int
  */
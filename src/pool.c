@@ -0,0 +1,205 @@
+#include "nomp-impl.h"
+
+// Device memory released with NOMP_FREE is kept in size class bins instead of
+// being returned to the driver so that later allocations of a similar size
+// can reuse it. Size classes are spaced four per power of two starting at
+// POOL_MIN_BYTES, so a block is at most 25% larger than the request. The
+// total size of the cached blocks never exceeds the high-water mark set with
+// --nomp-pool-size.
+#define POOL_MIN_BYTES 256
+#define POOL_NBINS     256
+
+struct pool_block {
+  void  *bptr;
+  size_t bsize;
+  void  *event;
+};
+
+struct pool_bin {
+  struct pool_block *blocks;
+  unsigned           n, max;
+};
+
+struct nomp_pool {
+  struct pool_bin bins[POOL_NBINS];
+  size_t          pool_size, bytes_live, bytes_cached;
+  unsigned        pool_hits, pool_misses;
+};
+
+// Returns the size class of an allocation of `bytes` and sets `cbytes` to the
+// size of the blocks in that class.
+static inline unsigned pool_class(size_t *cbytes, size_t bytes) {
+  if (bytes <= POOL_MIN_BYTES) {
+    *cbytes = POOL_MIN_BYTES;
+    return 0;
+  }
+
+  unsigned p = 0;
+  while (((size_t)POOL_MIN_BYTES << (p + 1)) < bytes)
+    p++;
+  size_t base = (size_t)POOL_MIN_BYTES << p, step = base / 4;
+  size_t s    = (bytes - base + step - 1) / step;
+  *cbytes     = base + s * step;
+
+  return 4 * p + s;
+}
+
+static inline int pool_enabled(const nomp_backend_t *bnd) {
+  return bnd->pool && bnd->pool->pool_size > 0 && !bnd->aliases_host;
+}
+
+static int pool_release(nomp_backend_t *bnd, struct pool_block *b) {
+  nomp_mem_t m = {0};
+  m.bptr = b->bptr, m.bsize = b->bsize, m.event = b->event;
+  nomp_check(bnd->update(bnd, &m, NOMP_FREE, 0, 0, 1));
+  return 0;
+}
+
+/**
+ * @ingroup nomp_pool_utils
+ *
+ * @brief Initialize the device memory pool of a backend.
+ *
+ * @param[in] bnd Backend instance which owns the pool.
+ * @param[in] cfg Nomp configuration. The pool is disabled if the pool size
+ * is zero.
+ * @return int
+ */
+int nomp_pool_init(nomp_backend_t *bnd, const nomp_config_t *cfg) {
+  bnd->pool            = nomp_calloc(struct nomp_pool, 1);
+  bnd->pool->pool_size = (size_t)cfg->pool_size << 20;
+  return 0;
+}
+
+/**
+ * @ingroup nomp_pool_utils
+ *
+ * @brief Allocate device memory for \p m, reusing a cached block of the same
+ * size class if there is one.
+ *
+ * @details Pending work on a reused block (if any) is recorded in the event
+ * of \p m, so the first copy to the new memory region waits for it.
+ *
+ * @param[in] bnd Active backend instance.
+ * @param[in] m Memory region to allocate.
+ * @return int
+ */
+int nomp_pool_alloc(nomp_backend_t *bnd, nomp_mem_t *m) {
+  if (!pool_enabled(bnd))
+    return bnd->update(bnd, m, NOMP_ALLOC, m->idx0, m->idx1, m->usize);
+
+  struct nomp_pool *pool  = bnd->pool;
+  size_t           bytes = NOMP_MEM_BYTES(m->idx0, m->idx1, m->usize), cbytes;
+  struct pool_bin *bin   = &pool->bins[pool_class(&cbytes, bytes)];
+  if (bin->n > 0) {
+    struct pool_block *b = &bin->blocks[--bin->n];
+    m->bptr = b->bptr, m->bsize = b->bsize, m->event = b->event;
+    pool->bytes_cached -= cbytes, pool->pool_hits++;
+  } else {
+    nomp_check(bnd->update(bnd, m, NOMP_ALLOC, 0, cbytes, 1));
+    pool->pool_misses++;
+  }
+  pool->bytes_live += cbytes;
+
+  return 0;
+}
+
+/**
+ * @ingroup nomp_pool_utils
+ *
+ * @brief Release the device memory of \p m to the pool. The memory is
+ * returned to the backend if caching it would exceed the pool size.
+ *
+ * @param[in] bnd Active backend instance.
+ * @param[in] m Memory region to free.
+ * @return int
+ */
+int nomp_pool_free(nomp_backend_t *bnd, nomp_mem_t *m) {
+  if (!pool_enabled(bnd))
+    return bnd->update(bnd, m, NOMP_FREE, m->idx0, m->idx1, m->usize);
+
+  struct nomp_pool *pool  = bnd->pool;
+  size_t           bytes = NOMP_MEM_BYTES(m->idx0, m->idx1, m->usize), cbytes;
+  unsigned         c     = pool_class(&cbytes, bytes);
+  pool->bytes_live -= cbytes;
+  if (pool->bytes_cached + cbytes > pool->pool_size)
+    return bnd->update(bnd, m, NOMP_FREE, m->idx0, m->idx1, m->usize);
+
+  struct pool_bin *bin = &pool->bins[c];
+  if (bin->n == bin->max) {
+    bin->max += bin->max / 2 + 1;
+    bin->blocks = nomp_realloc(bin->blocks, struct pool_block, bin->max);
+  }
+  struct pool_block *b = &bin->blocks[bin->n++];
+  b->bptr = m->bptr, b->bsize = m->bsize, b->event = m->event;
+  m->bptr = m->event = NULL;
+  pool->bytes_cached += cbytes;
+
+  return 0;
+}
+
+/**
+ * @ingroup nomp_pool_utils
+ *
+ * @brief Return all the cached blocks to the backend.
+ *
+ * @param[in] bnd Active backend instance.
+ * @return int
+ */
+int nomp_pool_trim(nomp_backend_t *bnd) {
+  struct nomp_pool *pool = bnd->pool;
+  if (!pool) return 0;
+
+  for (unsigned i = 0; i < POOL_NBINS; i++) {
+    struct pool_bin *bin = &pool->bins[i];
+    for (; bin->n > 0; bin->n--)
+      nomp_check(pool_release(bnd, &bin->blocks[bin->n - 1]));
+  }
+  pool->bytes_cached = 0;
+
+  return 0;
+}
+
+/**
+ * @ingroup nomp_pool_utils
+ *
+ * @brief Query the statistics of the device memory pool of a backend. See
+ * nomp_get_pool_stats() for the meaning of the outputs.
+ *
+ * @param[in] bnd Backend instance which owns the pool.
+ * @param[out] live Bytes of device memory in use.
+ * @param[out] cached Bytes of device memory cached in the pool.
+ * @param[out] hits Number of allocations served from the pool.
+ * @param[out] misses Number of allocations done by the backend.
+ * @return void
+ */
+void nomp_pool_stats(const nomp_backend_t *bnd, size_t *live, size_t *cached,
+                     unsigned *hits, unsigned *misses) {
+  const struct nomp_pool *pool = bnd->pool;
+  if (live) *live = pool ? pool->bytes_live : 0;
+  if (cached) *cached = pool ? pool->bytes_cached : 0;
+  if (hits) *hits = pool ? pool->pool_hits : 0;
+  if (misses) *misses = pool ? pool->pool_misses : 0;
+}
+
+/**
+ * @ingroup nomp_pool_utils
+ *
+ * @brief Return the cached blocks to the backend and free the pool.
+ *
+ * @param[in] bnd Active backend instance.
+ * @return int
+ */
+int nomp_pool_finalize(nomp_backend_t *bnd) {
+  if (!bnd->pool) return 0;
+
+  nomp_check(nomp_pool_trim(bnd));
+  for (unsigned i = 0; i < POOL_NBINS; i++)
+    nomp_free(&bnd->pool->bins[i].blocks);
+  nomp_free(&bnd->pool);
+
+  return 0;
+}
+
+#undef POOL_NBINS
+#undef POOL_MIN_BYTES
@@ -1,25 +1,99 @@
+#include <float.h>
+#include <limits.h>
+
 #include "nomp-impl.h"
 
 #define NOMP_DO_SUM(a, b)  (a) += (b)
 #define NOMP_DO_PROD(a, b) (a) *= (b)
+#define NOMP_DO_MAX(a, b)  (a) = (b) > (a) ? (b) : (a)
+#define NOMP_DO_MIN(a, b)  (a) = (b) < (a) ? (b) : (a)
+#define NOMP_DO_LAND(a, b) (a) = (a) && (b)
+#define NOMP_DO_LOR(a, b)  (a) = (a) || (b)
+#define NOMP_DO_BAND(a, b) (a) &= (b)
+#define NOMP_DO_BOR(a, b)  (a) |= (b)
 
-#define NOMP_INIT_SUM(a)  (a) = 0
-#define NOMP_INIT_PROD(a) (a) = 1
+// Identity of each operation given the lowest and the highest value of the
+// type, so an empty reduction gives the identity.
+#define NOMP_IDENTITY_SUM(lo, hi)  0
+#define NOMP_IDENTITY_PROD(lo, hi) 1
+#define NOMP_IDENTITY_MAX(lo, hi)  (lo)
+#define NOMP_IDENTITY_MIN(lo, hi)  (hi)
+#define NOMP_IDENTITY_LAND(lo, hi) 1
+#define NOMP_IDENTITY_LOR(lo, hi)  0
+#define NOMP_IDENTITY_BAND(lo, hi) (~0)
+#define NOMP_IDENTITY_BOR(lo, hi)  0
 
-#define NOMP_REDUCTION(T, SUFFIX, OP)                                          \
-  static void reduce##SUFFIX##_##OP(T *out, T *in, unsigned n) {               \
-    NOMP_INIT_##OP(*out);                                                      \
-    for (; n; n--)                                                             \
-      NOMP_DO_##OP(*out, in[n - 1]);                                           \
+#define NOMP_REDUCTION(T, SUFFIX, LO, HI, OP)                                  \
+  static void reduce##SUFFIX##_##OP(void *out_, const void *in_, unsigned n) { \
+    T *out = (T *)out_;                                                        \
+    const T *in = (const T *)in_;                                              \
+    *out = NOMP_IDENTITY_##OP(LO, HI);                                         \
+    for (unsigned i = 0; i < n; i++)                                           \
+      NOMP_DO_##OP(*out, in[i]);                                               \
   }
 
+#define NOMP_FOR_EACH_INTEGER(macro, OP)                                       \
+  macro(int, _int, INT_MIN, INT_MAX, OP)                                       \
+      macro(long, _long, LONG_MIN, LONG_MAX, OP)                               \
+          macro(unsigned int, _uint, 0, UINT_MAX, OP)                          \
+              macro(unsigned long, _ulong, 0, ULONG_MAX, OP)
+
 #define NOMP_FOR_EACH_DOMAIN(macro, OP)                                        \
-  macro(int, _int, OP) macro(unsigned int, _uint, OP) macro(long, _long, OP)   \
-      macro(unsigned long, _ulong, OP) macro(float, _float, OP)                \
-          macro(double, _double, OP)
+  NOMP_FOR_EACH_INTEGER(macro, OP)                                             \
+  macro(float, _float, -FLT_MAX, FLT_MAX, OP)                                  \
+      macro(double, _double, -DBL_MAX, DBL_MAX, OP)
 
 NOMP_FOR_EACH_DOMAIN(NOMP_REDUCTION, SUM)
 NOMP_FOR_EACH_DOMAIN(NOMP_REDUCTION, PROD)
+NOMP_FOR_EACH_DOMAIN(NOMP_REDUCTION, MAX)
+NOMP_FOR_EACH_DOMAIN(NOMP_REDUCTION, MIN)
+NOMP_FOR_EACH_DOMAIN(NOMP_REDUCTION, LAND)
+NOMP_FOR_EACH_DOMAIN(NOMP_REDUCTION, LOR)
+NOMP_FOR_EACH_INTEGER(NOMP_REDUCTION, BAND)
+NOMP_FOR_EACH_INTEGER(NOMP_REDUCTION, BOR)
+
+#undef NOMP_FOR_EACH_DOMAIN
+#undef NOMP_FOR_EACH_INTEGER
+#undef NOMP_REDUCTION
+#undef NOMP_IDENTITY_BOR
+#undef NOMP_IDENTITY_BAND
+#undef NOMP_IDENTITY_LOR
+#undef NOMP_IDENTITY_LAND
+#undef NOMP_IDENTITY_MIN
+#undef NOMP_IDENTITY_MAX
+#undef NOMP_IDENTITY_PROD
+#undef NOMP_IDENTITY_SUM
+
+typedef void (*reduce_t)(void *out, const void *in, unsigned n);
+
+#define NOMP_REDUCERS(OP)                                                      \
+  {                                                                            \
+    reduce_int_##OP, reduce_long_##OP, reduce_uint_##OP, reduce_ulong_##OP,    \
+        reduce_float_##OP, reduce_double_##OP                                  \
+  }
+#define NOMP_INTEGER_REDUCERS(OP)                                              \
+  {                                                                            \
+    reduce_int_##OP, reduce_long_##OP, reduce_uint_##OP, reduce_ulong_##OP,    \
+        NULL, NULL                                                             \
+  }
+
+// Indexed by nomp_reduction_op_t and then by reducer_index().
+static const reduce_t reducers[][6] = {
+    NOMP_REDUCERS(SUM),  NOMP_REDUCERS(PROD),         NOMP_REDUCERS(MAX),
+    NOMP_REDUCERS(MIN),  NOMP_REDUCERS(LAND),         NOMP_REDUCERS(LOR),
+    NOMP_INTEGER_REDUCERS(BAND), NOMP_INTEGER_REDUCERS(BOR)};
+
+#undef NOMP_INTEGER_REDUCERS
+#undef NOMP_REDUCERS
+
+static int reducer_index(nomp_arg_type_t dom, size_t size) {
+  switch (dom) {
+  case NOMP_INT: return size == 4 ? 0 : 1;
+  case NOMP_UINT: return size == 4 ? 2 : 3;
+  case NOMP_FLOAT: return size == 4 ? 4 : 5;
+  default: return -1;
+  }
+}
 
 /**
  * @ingroup nomp_reduction_utils
@@ -32,62 +106,276 @@ NOMP_FOR_EACH_DOMAIN(NOMP_REDUCTION, PROD)
  */
 int nomp_host_side_reduction(nomp_backend_t *backend, nomp_prog_t *prg,
                              nomp_mem_t *m) {
-  int    dom  = prg->reduction_type;
-  int    op   = prg->reduction_op;
-  size_t size = prg->reduction_size;
-  void  *out  = prg->reduction_ptr;
+  size_t   size   = prg->reduction_size;
+  int      dom    = reducer_index(prg->reduction_type, size);
+  unsigned op     = prg->reduction_op;
+  unsigned nops   = sizeof(reducers) / sizeof(reducers[0]);
+  reduce_t reduce = (dom >= 0 && op < nops) ? reducers[op][dom] : NULL;
+  if (reduce == NULL) {
+    return nomp_log(NOMP_USER_INPUT_IS_INVALID, NOMP_ERROR,
+                    "Reduction operation %u is not supported for reduction "
+                    "variable type %d of size %zu.",
+                    op, prg->reduction_type, size);
+  }
 
   nomp_check(backend->sync(backend));
   nomp_check(backend->update(backend, m, NOMP_FROM, 0, prg->global[0], size));
+  reduce(prg->reduction_ptr, m->hptr, prg->global[0]);
 
-  // FIXME: Too much repetition.
-  if (op == NOMP_SUM) {
-    switch (dom) {
-    case NOMP_INT:
-      if (size == 4)
-        reduce_int_SUM((int *)out, (int *)m->hptr, prg->global[0]);
-      else
-        reduce_long_SUM((long *)out, (long *)m->hptr, prg->global[0]);
-      break;
-    case NOMP_UINT:
-      if (size == 4)
-        reduce_uint_SUM((unsigned int *)out, (unsigned int *)m->hptr,
-                        prg->global[0]);
-      else
-        reduce_ulong_SUM((unsigned long *)out, (unsigned long *)m->hptr,
-                         prg->global[0]);
-      break;
-    case NOMP_FLOAT:
-      if (size == 4)
-        reduce_float_SUM((float *)out, (float *)m->hptr, prg->global[0]);
-      else
-        reduce_double_SUM((double *)out, (double *)m->hptr, prg->global[0]);
-      break;
-    }
-  } else if (op == NOMP_PROD) {
-    switch (dom) {
-    case NOMP_INT:
-      if (size == 4)
-        reduce_int_PROD((int *)out, (int *)m->hptr, prg->global[0]);
-      else
-        reduce_long_PROD((long *)out, (long *)m->hptr, prg->global[0]);
-      break;
-    case NOMP_UINT:
-      if (size == 4)
-        reduce_uint_PROD((unsigned int *)out, (unsigned int *)m->hptr,
-                         prg->global[0]);
-      else
-        reduce_ulong_PROD((unsigned long *)out, (unsigned long *)m->hptr,
-                          prg->global[0]);
-      break;
-    case NOMP_FLOAT:
-      if (size == 4)
-        reduce_float_PROD((float *)out, (float *)m->hptr, prg->global[0]);
-      else
-        reduce_double_PROD((double *)out, (double *)m->hptr, prg->global[0]);
-      break;
+  return 0;
+}
+
+// The second stage of a reduction combines the partial results of the first
+// stage (one per work-group) on the device using a single work-group, so only
+// the final value has to be copied back to the host. Kernels are generated
+// once for each (type, operation) pair and shared between the programs of a
+// backend.
+#define STAGE2_MAX_LOCAL_SIZE 256
+
+struct nomp_stage2_prog {
+  nomp_arg_type_t     dom;
+  int                 size;
+  nomp_reduction_op_t op;
+  nomp_prog_t        *prg;
+};
+
+static const char *stage2_opencl_prelude =
+    "#define NOMP_KERNEL   __kernel\n"
+    "#define NOMP_GLOBAL   __global\n"
+    "#define NOMP_LOCAL    __local\n"
+    "#define NOMP_LOCAL_ID get_local_id(0)\n"
+    "#define NOMP_BARRIER  barrier(CLK_LOCAL_MEM_FENCE)\n";
+
+static const char *stage2_cuda_prelude =
+    "#define NOMP_KERNEL   extern \"C\" __global__\n"
+    "#define NOMP_GLOBAL\n"
+    "#define NOMP_LOCAL    __shared__\n"
+    "#define NOMP_LOCAL_ID threadIdx.x\n"
+    "#define NOMP_BARRIER  __syncthreads()\n";
+
+static const char *stage2_src =
+    "%s"
+    "#define NOMP_COMBINE(a, b) %s\n"
+    "NOMP_KERNEL void %s(NOMP_GLOBAL %s *in, int n, NOMP_GLOBAL %s *out) {\n"
+    "  NOMP_LOCAL %s s[%u];\n"
+    "  int t = NOMP_LOCAL_ID;\n"
+    "  %s r = %s;\n"
+    "  for (int i = t; i < n; i += %u)\n"
+    "    r = NOMP_COMBINE(r, in[i]);\n"
+    "  s[t] = r;\n"
+    "  NOMP_BARRIER;\n"
+    "  for (int k = %u; k > 0; k /= 2) {\n"
+    "    if (t < k) s[t] = NOMP_COMBINE(s[t], s[t + k]);\n"
+    "    NOMP_BARRIER;\n"
+    "  }\n"
+    "  if (t == 0) out[0] = s[0];\n"
+    "}\n";
+
+static const char *stage2_type(nomp_arg_type_t dom, int size) {
+  switch (dom) {
+  case NOMP_INT: return size == 4 ? "int" : "long";
+  case NOMP_UINT: return size == 4 ? "unsigned int" : "unsigned long";
+  case NOMP_FLOAT: return size == 4 ? "float" : "double";
+  default: return NULL;
+  }
+}
+
+// Lowest and highest value of the type as literals for the device compiler.
+static void stage2_limits(const char **lo, const char **hi,
+                          nomp_arg_type_t dom, int size) {
+  switch (dom) {
+  case NOMP_INT:
+    *lo = size == 4 ? "(-2147483647 - 1)" : "(-9223372036854775807L - 1)";
+    *hi = size == 4 ? "2147483647" : "9223372036854775807L";
+    break;
+  case NOMP_UINT:
+    *lo = "0";
+    *hi = size == 4 ? "4294967295u" : "18446744073709551615ul";
+    break;
+  default:
+    *lo = size == 4 ? "-3.40282347e+38f" : "-1.7976931348623157e+308";
+    *hi = size == 4 ? "3.40282347e+38f" : "1.7976931348623157e+308";
+    break;
+  }
+}
+
+static int stage2_build(nomp_prog_t **out, nomp_backend_t *backend,
+                        nomp_arg_type_t dom, int size, nomp_reduction_op_t op) {
+  const char *type = stage2_type(dom, size);
+  if (type == NULL) {
+    return nomp_log(NOMP_USER_INPUT_IS_INVALID, NOMP_ERROR,
+                    "Invalid reduction variable type: %d.", dom);
+  }
+
+  // Only OpenCL, CUDA and HIP backends can run the second stage on the device.
+  PyObject *py_name =
+      PyDict_GetItemString(backend->py_context, "backend::name");
+  const char *backend_name = py_name ? PyUnicode_AsUTF8(py_name) : "";
+  const char *prelude      = NULL;
+  if (strncmp(backend_name, "opencl", NOMP_MAX_BUFFER_SIZE) == 0)
+    prelude = stage2_opencl_prelude;
+  if (strncmp(backend_name, "cuda", NOMP_MAX_BUFFER_SIZE) == 0 ||
+      strncmp(backend_name, "hip", NOMP_MAX_BUFFER_SIZE) == 0)
+    prelude = stage2_cuda_prelude;
+  if (prelude == NULL) return 0;
+
+  // Local size is the largest power of 2 supported by the device.
+  unsigned  max_local = STAGE2_MAX_LOCAL_SIZE, local = 1;
+  PyObject *py_max    = PyDict_GetItemString(backend->py_context,
+                                             "device::max_threads_per_block");
+  if (py_max && PyLong_AsLong(py_max) > 0 &&
+      PyLong_AsUnsignedLong(py_max) < max_local)
+    max_local = PyLong_AsUnsignedLong(py_max);
+  while (2 * local <= max_local)
+    local *= 2;
+
+  char prelude_buf[BUFSIZ];
+  if (dom == NOMP_FLOAT && size == 8 && prelude == stage2_opencl_prelude) {
+    snprintf(prelude_buf, BUFSIZ, "%s%s",
+             "#pragma OPENCL EXTENSION cl_khr_fp64 : enable\n", prelude);
+    prelude = prelude_buf;
+  }
+
+  // Each thread starts from the identity of the operation (the same as on
+  // the host), so an empty reduction gives the identity.
+  const char *identities[] = {"0", "1", NULL, NULL, "1", "0", "(~0)", "0"};
+  stage2_limits(&identities[NOMP_MAX], &identities[NOMP_MIN], dom, size);
+  static const char *combines[] = {"((a) + (b))",
+                                  "((a) * (b))",
+                                  "((a) > (b) ? (a) : (b))",
+                                  "((a) < (b) ? (a) : (b))",
+                                  "((a) && (b))",
+                                  "((a) || (b))",
+                                  "((a) & (b))",
+                                  "((a) | (b))"};
+  const char *identity = identities[op], *combine = combines[op];
+
+  char name[NOMP_MAX_BUFFER_SIZE + 1];
+  snprintf(name, NOMP_MAX_BUFFER_SIZE, "nomp_reduction_%s%d_%d",
+           dom == NOMP_FLOAT ? "f" : (dom == NOMP_INT ? "i" : "u"), size, op);
+
+  size_t len = strlen(stage2_src) + strlen(prelude) + 5 * strlen(type) +
+               strlen(combine) + strlen(name) + 128;
+  char *src = nomp_calloc(char, len);
+  snprintf(src, len, stage2_src, prelude, combine, name, type, type, type,
+           local, type, identity, local, local / 2);
+
+  nomp_prog_t *prg = *out = nomp_calloc(nomp_prog_t, 1);
+  prg->args               = nomp_calloc(nomp_arg_t, 3);
+  prg->nargs = 3, prg->ndim = 1, prg->reduction_index = -1;
+  prg->args[0].type = prg->args[2].type = NOMP_PTR;
+  prg->args[1].type = NOMP_INT, prg->args[1].size = sizeof(int);
+  for (unsigned i = 0; i < 3; i++)
+    prg->global[i] = prg->local[i] = prg->gws[i] = 1;
+  prg->local[0] = prg->gws[0] = local;
+
+  int err = backend->knl_build(backend, prg, src, name);
+  if (backend->profile) prg->profile_id = nomp_profile_entry(name);
+  nomp_free(&src);
+
+  return err;
+}
+
+/**
+ * @ingroup nomp_reduction_utils
+ * @brief Setup the second stage of the reduction of a program.
+ *
+ * Builds (or reuses) the device kernel which combines the partial results of
+ * the reduction in \p prg. If the backend can't run the second stage on the
+ * device, the partial results are combined on the host by
+ * nomp_host_side_reduction().
+ *
+ * @param[in] backend Active backend instance.
+ * @param[in,out] prg Program with a reduction.
+ * @return int
+ */
+int nomp_reduction_init(nomp_backend_t *backend, nomp_prog_t *prg) {
+  if (prg->reduction_index < 0) return 0;
+
+  nomp_arg_type_t     dom  = prg->reduction_type;
+  int                 size = prg->reduction_size;
+  nomp_reduction_op_t op   = prg->reduction_op;
+  struct nomp_stage2_prog *stage2 = backend->stage2;
+  for (unsigned i = 0; i < backend->stage2_n; i++) {
+    if (stage2[i].dom == dom && stage2[i].size == size && stage2[i].op == op) {
+      prg->reduction_prg = stage2[i].prg;
+      return 0;
     }
   }
 
+  nomp_prog_t *stage2_prg = NULL;
+  nomp_check(stage2_build(&stage2_prg, backend, dom, size, op));
+  if (stage2_prg == NULL) return 0;
+
+  if (backend->stage2_n == backend->stage2_max) {
+    backend->stage2_max += backend->stage2_max / 2 + 1;
+    backend->stage2 = nomp_realloc(backend->stage2, struct nomp_stage2_prog,
+                                   backend->stage2_max);
+  }
+  stage2 = &backend->stage2[backend->stage2_n++];
+  stage2->dom = dom, stage2->size = size, stage2->op = op;
+  stage2->prg = stage2_prg;
+
+  prg->reduction_prg = stage2_prg;
+
   return 0;
 }
+
+/**
+ * @ingroup nomp_reduction_utils
+ * @brief Perform the second stage of the reduction on the device.
+ *
+ * Combines the partial results of the reduction stored in \p m on the device.
+ * If \p out is not NULL, the result is written to the device memory \p out
+ * and left there (i.e., no synchronization or data transfer is done) so it
+ * can be used by the following kernels. Otherwise, the result is copied to
+ * the host variable of the reduction.
+ *
+ * @param[in] backend Active backend instance.
+ * @param[in] prg Active program instance.
+ * @param[in] m Memory used to store device side partial reductions.
+ * @param[in] out Device memory of the reduction variable or NULL.
+ * @return int
+ */
+int nomp_device_side_reduction(nomp_backend_t *backend, nomp_prog_t *prg,
+                               nomp_mem_t *m, nomp_mem_t *out) {
+  nomp_prog_t *stage2_prg = prg->reduction_prg;
+  int          n          = prg->global[0];
+
+  nomp_mem_t *res          = out ? out : m;
+  stage2_prg->args[0].ptr  = m->bptr;
+  stage2_prg->args[0].size = m->bsize;
+  stage2_prg->args[1].ptr  = &n;
+  stage2_prg->args[2].ptr  = res->bptr;
+  stage2_prg->args[2].size = res->bsize;
+  stage2_prg->args[0].mem = m, stage2_prg->args[2].mem = res;
+  nomp_check(backend->knl_run(backend, stage2_prg));
+  if (out) return 0;
+
+  // The read is blocking, so there is no need to synchronize first.
+  size_t size = prg->reduction_size;
+  nomp_check(backend->update(backend, m, NOMP_FROM, 0, 1, size));
+  memcpy(prg->reduction_ptr, m->hptr, size);
+
+  return 0;
+}
+
+/**
+ * @ingroup nomp_reduction_utils
+ * @brief Free the kernels used for the second stage of reductions.
+ *
+ * @param[in] backend Active backend instance.
+ * @return int
+ */
+int nomp_reduction_finalize(nomp_backend_t *backend) {
+  struct nomp_stage2_prog *stage2 = backend->stage2;
+  for (unsigned i = 0; i < backend->stage2_n; i++) {
+    nomp_check(backend->knl_free(stage2[i].prg));
+    nomp_free(&stage2[i].prg->args), nomp_free(&stage2[i].prg);
+  }
+  nomp_free(&backend->stage2), backend->stage2_n = backend->stage2_max = 0;
+
+  return 0;
+}
+
+#undef STAGE2_MAX_LOCAL_SIZE
@@ -23,6 +23,31 @@ int nomp_symengine_update(CMapBasicBasic *map, const char *key,
   return eval_grid;
 }
 
+/**
+ * @ingroup nomp_py_utils
+ * @brief Parse an expression and append it to a SymEngine vector.
+ *
+ * @param[in,out] vec SymEngine vector to append the expression to.
+ * @param[in] str Expression as a C-string.
+ * @return int
+ */
+int nomp_symengine_vec_push(CVecBasic *vec, const char *str) {
+  basic a;
+  basic_new_stack(a);
+
+  CWRAPPER_OUTPUT_TYPE err = basic_parse(a, str);
+  if (err) {
+    return nomp_log(NOMP_LOOPY_GRIDSIZE_FAILURE, NOMP_ERROR,
+                    "Expression parsing with SymEngine failed with error %d.",
+                    err);
+  }
+
+  vecbasic_push_back(vec, a);
+  basic_free_stack(a);
+
+  return 0;
+}
+
 static int symengine_evaluate(size_t *out, unsigned i, CVecBasic *vec,
                               CMapBasicBasic *map) {
   basic a;
@@ -66,3 +91,272 @@ int nomp_symengine_eval_grid_size(nomp_prog_t *prg) {
 
   return 0;
 }
+
+// Maximum depth of the stack used to evaluate the kernel launch parameter
+// bytecode. Expressions which need a deeper stack are evaluated with
+// SymEngine.
+#define GRID_MAX_STACK 32
+
+struct grid_compiler {
+  const nomp_prog_t *prg;
+  nomp_grid_insn_t  *code;
+  unsigned           n, max;
+  int                depth;
+};
+
+static int grid_emit(struct grid_compiler *c, nomp_grid_op_t op, long a,
+                     long b, int delta) {
+  if (c->n == c->max) {
+    c->max += c->max / 2 + 8;
+    c->code = nomp_realloc(c->code, nomp_grid_insn_t, c->max);
+  }
+  c->code[c->n].op = op, c->code[c->n].a = a, c->code[c->n].b = b;
+  c->n++, c->depth += delta;
+  return c->depth > GRID_MAX_STACK;
+}
+
+static int grid_lower_symbol(struct grid_compiler *c, const basic_struct *a) {
+  const nomp_prog_t *prg  = c->prg;
+  char              *name = basic_str(a);
+  unsigned           i    = 0;
+  for (; i < prg->nargs; i++) {
+    if ((prg->args[i].type == NOMP_INT || prg->args[i].type == NOMP_UINT) &&
+        !strncmp(name, prg->args[i].name, NOMP_MAX_BUFFER_SIZE))
+      break;
+  }
+  basic_str_free(name);
+
+  if (i == prg->nargs) return 1;
+  return grid_emit(c, NOMP_GRID_ARG, i, 0, 1);
+}
+
+static int grid_lower(struct grid_compiler *c, const basic_struct *a);
+
+static int grid_lower_function(struct grid_compiler *c, const basic_struct *a,
+                               TypeID type) {
+  CVecBasic *args = vecbasic_new();
+  basic_get_args(a, args);
+  unsigned n = vecbasic_size(args);
+
+  int err = (n == 0);
+  for (unsigned i = 0; i < n && !err; i++) {
+    basic b;
+    basic_new_stack(b);
+    vecbasic_get(args, i, b);
+    err = grid_lower(c, b);
+    basic_free_stack(b);
+  }
+  vecbasic_free(args);
+  if (err) return err;
+
+  switch (type) {
+  case SYMENGINE_ADD: return grid_emit(c, NOMP_GRID_ADD, n, 0, 1 - (int)n);
+  case SYMENGINE_MUL: return grid_emit(c, NOMP_GRID_MUL, n, 0, 1 - (int)n);
+  case SYMENGINE_MAX: return grid_emit(c, NOMP_GRID_MAX, n, 0, 1 - (int)n);
+  case SYMENGINE_MIN: return grid_emit(c, NOMP_GRID_MIN, n, 0, 1 - (int)n);
+  case SYMENGINE_FLOOR:
+    return n != 1 || grid_emit(c, NOMP_GRID_FLOOR, 0, 0, 0);
+  case SYMENGINE_CEILING:
+    return n != 1 || grid_emit(c, NOMP_GRID_CEIL, 0, 0, 0);
+  case SYMENGINE_POW: {
+    // Only integer exponents are supported. Fold the exponent (which was
+    // just emitted as a constant) into the instruction.
+    nomp_grid_insn_t *e = &c->code[c->n - 1];
+    if (n != 2 || e->op != NOMP_GRID_CONST || e->b != 1) return 1;
+    long exponent = e->a;
+    c->n--, c->depth--;
+    return grid_emit(c, NOMP_GRID_POW, exponent, 0, 0);
+  }
+  default: return 1;
+  }
+}
+
+static int grid_lower(struct grid_compiler *c, const basic_struct *a) {
+  TypeID type = basic_get_type(a);
+  switch (type) {
+  case SYMENGINE_INTEGER:
+    return grid_emit(c, NOMP_GRID_CONST, integer_get_si(a), 1, 1);
+  case SYMENGINE_RATIONAL: {
+    basic num, den;
+    basic_new_stack(num), basic_new_stack(den);
+    rational_get_num(num, a), rational_get_den(den, a);
+    int err = grid_emit(c, NOMP_GRID_CONST, integer_get_si(num),
+                        integer_get_si(den), 1);
+    basic_free_stack(num), basic_free_stack(den);
+    return err;
+  }
+  case SYMENGINE_SYMBOL: return grid_lower_symbol(c, a);
+  case SYMENGINE_ADD:
+  case SYMENGINE_MUL:
+  case SYMENGINE_POW:
+  case SYMENGINE_FLOOR:
+  case SYMENGINE_CEILING:
+  case SYMENGINE_MAX:
+  case SYMENGINE_MIN: return grid_lower_function(c, a, type);
+  default: return 1;
+  }
+}
+
+/**
+ * @ingroup nomp_py_utils
+ * @brief Lower the kernel launch parameters of a program to bytecode.
+ *
+ * The SymEngine expressions of the kernel launch parameters are lowered to a
+ * flat bytecode over the scalar kernel arguments which is evaluated by
+ * nomp_grid_eval() without any memory allocation. If an expression contains
+ * an operation which is not supported, \p prg is left unchanged and the
+ * launch parameters are evaluated with SymEngine.
+ *
+ * @param[in,out] prg Nomp program.
+ * @return int
+ */
+int nomp_symengine_compile_grid_size(nomp_prog_t *prg) {
+  struct grid_compiler c    = {prg, NULL, 0, 0, 0};
+  CVecBasic           *v[2] = {prg->sym_global, prg->sym_local};
+
+  int err = 0;
+  for (unsigned i = 0; i < 2 && !err; i++) {
+    for (unsigned j = 0; j < vecbasic_size(v[i]) && !err; j++) {
+      basic a;
+      basic_new_stack(a);
+      vecbasic_get(v[i], j, a);
+      err = grid_lower(&c, a) ||
+            grid_emit(&c, NOMP_GRID_STORE, 3 * i + j, 0, -1);
+      basic_free_stack(a);
+    }
+  }
+
+  if (err) {
+    nomp_free(&c.code);
+    nomp_log(NOMP_SUCCESS, NOMP_INFO,
+             "Kernel launch parameters will be evaluated with SymEngine.");
+    return 0;
+  }
+
+  nomp_free(&prg->grid_code);
+  prg->grid_code = c.code, prg->grid_code_n = c.n;
+
+  return 0;
+}
+
+struct grid_value {
+  long num, den;
+};
+
+static inline void grid_normalize(struct grid_value *v) {
+  long a = v->num < 0 ? -v->num : v->num, b = v->den;
+  while (b) {
+    long t = a % b;
+    a = b, b = t;
+  }
+  if (a > 1) v->num /= a, v->den /= a;
+}
+
+static inline long grid_floor_div(long a, long b) {
+  long q = a / b;
+  return (a % b != 0 && a < 0) ? q - 1 : q;
+}
+
+static inline int grid_less(const struct grid_value *x,
+                            const struct grid_value *y) {
+  return x->num * y->den < y->num * x->den;
+}
+
+/**
+ * @ingroup nomp_py_utils
+ * @brief Evaluate global and local grid sizes using the bytecode generated by
+ * nomp_symengine_compile_grid_size().
+ *
+ * The values of the scalar arguments are read directly from the kernel
+ * arguments of \p prg.
+ *
+ * @param[in] prg Nomp program.
+ * @return int
+ */
+int nomp_grid_eval(nomp_prog_t *prg) {
+  struct grid_value s[GRID_MAX_STACK + 1], *v;
+  size_t            out[6] = {1, 1, 1, 1, 1, 1};
+  unsigned          sp     = 0;
+
+  for (unsigned i = 0; i < prg->grid_code_n; i++) {
+    const nomp_grid_insn_t *in = &prg->grid_code[i];
+    const nomp_arg_t       *arg;
+    unsigned                n = in->a, b = sp - n;
+    switch (in->op) {
+    case NOMP_GRID_CONST: s[sp].num = in->a, s[sp++].den = in->b; break;
+    case NOMP_GRID_ARG:
+      arg = &prg->args[in->a];
+      if (arg->type == NOMP_INT)
+        s[sp].num = *((int *)arg->ptr);
+      else
+        s[sp].num = *((unsigned *)arg->ptr);
+      s[sp++].den = 1;
+      break;
+    case NOMP_GRID_ADD:
+      for (unsigned j = b + 1; j < sp; j++) {
+        s[b].num = s[b].num * s[j].den + s[j].num * s[b].den;
+        s[b].den *= s[j].den;
+        grid_normalize(&s[b]);
+      }
+      sp = b + 1;
+      break;
+    case NOMP_GRID_MUL:
+      for (unsigned j = b + 1; j < sp; j++) {
+        s[b].num *= s[j].num, s[b].den *= s[j].den;
+        grid_normalize(&s[b]);
+      }
+      sp = b + 1;
+      break;
+    case NOMP_GRID_MAX:
+    case NOMP_GRID_MIN:
+      for (unsigned j = b + 1; j < sp; j++) {
+        if (grid_less(&s[b], &s[j]) == (in->op == NOMP_GRID_MAX))
+          s[b] = s[j];
+      }
+      sp = b + 1;
+      break;
+    case NOMP_GRID_POW: {
+      v                   = &s[sp - 1];
+      struct grid_value x = *v;
+      long              e = in->a;
+      if (e < 0) {
+        if (x.num == 0) goto invalid;
+        x.num = v->num < 0 ? -v->den : v->den;
+        x.den = v->num < 0 ? -v->num : v->num;
+        e     = -e;
+      }
+      v->num = v->den = 1;
+      for (; e > 0; e--)
+        v->num *= x.num, v->den *= x.den;
+      break;
+    }
+    case NOMP_GRID_FLOOR:
+      v      = &s[sp - 1];
+      v->num = grid_floor_div(v->num, v->den), v->den = 1;
+      break;
+    case NOMP_GRID_CEIL:
+      v      = &s[sp - 1];
+      v->num = -grid_floor_div(-v->num, v->den), v->den = 1;
+      break;
+    case NOMP_GRID_STORE:
+      v = &s[--sp];
+      if (v->den != 1) goto invalid;
+      out[in->a] = v->num;
+      break;
+    default: goto invalid;
+    }
+  }
+
+  for (unsigned i = 0; i < 3; i++) {
+    prg->global[i] = out[i], prg->local[i] = out[3 + i];
+    prg->gws[i]    = prg->global[i] * prg->local[i];
+  }
+
+  return 0;
+
+invalid:
+  return nomp_log(NOMP_LOOPY_GRIDSIZE_FAILURE, NOMP_ERROR,
+                  "Kernel launch parameters did not evaluate to integers.");
+}
+
+#undef GRID_MAX_STACK
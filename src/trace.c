@@ -0,0 +1,247 @@
+#include "nomp-impl.h"
+
+// Trace events are written to a ring buffer which is shared by all the
+// contexts. Writers claim a slot with an atomic increment of the head and
+// publish the event by storing its sequence number last, so recording an
+// event never takes a lock. The oldest events are overwritten once the
+// buffer is full, so a long run keeps the last TRACE_CAPACITY events. The
+// buffer is written out as a Chrome trace-event JSON file (which Perfetto
+// can open as well) when the last context is destroyed.
+#define TRACE_CAPACITY (1U << 16)
+
+struct trace_event {
+  // Index of the event plus one once the event is complete.
+  uint64_t seq;
+  // Profiler entry which names the event (see nomp_profile_entry()).
+  unsigned entry;
+  // Host events are on track zero and device events on the track of their
+  // queue plus one.
+  unsigned track;
+  double   start, end;
+  // Category of the event and its arguments: bytes and direction of copies
+  // and grid sizes of kernels.
+  nomp_trace_cat_t     cat;
+  nomp_map_direction_t op;
+  size_t               bytes;
+  unsigned             ndim;
+  size_t               global[3], local[3];
+};
+
+static struct trace_event *trace_events = NULL;
+static uint64_t            trace_head   = 0;
+static FILE               *trace_fp     = NULL;
+static double              trace_origin = 0;
+
+static const char *TRACE_CAT_STRING[] = {"jit", "update", "run", "sync",
+                                         "device"};
+
+/**
+ * @ingroup nomp_trace_utils
+ *
+ * @brief Start tracing if a trace file is set.
+ *
+ * @details Trace file is set with `--nomp-trace` command line argument or
+ * `NOMP_TRACE` environment variable. The file is created here so that an
+ * invalid path is reported by nomp_init(). Tracing is shared by all the
+ * contexts, so only the first context which sets a trace file starts it.
+ *
+ * @param[in] cfg Nomp configuration struct of type ::nomp_config_t.
+ * @return int
+ */
+int nomp_trace_init(const nomp_config_t *const cfg) {
+  if (trace_fp || strlen(cfg->trace_file) == 0) return 0;
+
+  trace_fp = fopen(cfg->trace_file, "w");
+  if (trace_fp == NULL) {
+    return nomp_log(NOMP_USER_INPUT_IS_INVALID, NOMP_ERROR,
+                    "Unable to open trace file: \"%s\". Error: %s.",
+                    cfg->trace_file, strerror(errno));
+  }
+
+  trace_events = nomp_calloc(struct trace_event, TRACE_CAPACITY);
+  trace_head   = 0;
+  trace_origin = nomp_profile_now();
+
+  return 0;
+}
+
+static inline struct trace_event *trace_claim(uint64_t *seq) {
+  *seq = __atomic_fetch_add(&trace_head, 1, __ATOMIC_RELAXED);
+  struct trace_event *e = &trace_events[*seq & (TRACE_CAPACITY - 1)];
+  __atomic_store_n(&e->seq, 0, __ATOMIC_RELAXED);
+  return e;
+}
+
+static inline void trace_publish(struct trace_event *e, uint64_t seq) {
+  __atomic_store_n(&e->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+static inline struct trace_event *
+trace_host_event(uint64_t *seq, nomp_trace_cat_t cat, unsigned entry,
+                 double start) {
+  double              end = nomp_profile_now();
+  struct trace_event *e   = trace_claim(seq);
+  e->entry = entry, e->track = 0, e->start = start, e->end = end;
+  e->cat = cat, e->bytes = 0, e->ndim = 0;
+  return e;
+}
+
+/**
+ * @ingroup nomp_trace_utils
+ *
+ * @brief Record a span on the host which started at \p start and ends now.
+ *
+ * @param[in] cat Category of the span.
+ * @param[in] name Name of the span.
+ * @param[in] start Start of the span returned by nomp_profile_now().
+ * @return void
+ */
+void nomp_trace_span(nomp_trace_cat_t cat, const char *name, double start) {
+  if (trace_events == NULL) return;
+
+  uint64_t seq;
+  trace_publish(trace_host_event(&seq, cat, nomp_profile_entry(name), start),
+                seq);
+}
+
+/**
+ * @ingroup nomp_trace_utils
+ *
+ * @brief Record a copy done by nomp_update() on the host.
+ *
+ * @param[in] entry Profiler entry of the copy.
+ * @param[in] start Start of the copy returned by nomp_profile_now().
+ * @param[in] bytes Number of bytes copied.
+ * @param[in] op Direction of the copy.
+ * @return void
+ */
+void nomp_trace_update(unsigned entry, double start, size_t bytes,
+                       nomp_map_direction_t op) {
+  if (trace_events == NULL) return;
+
+  uint64_t            seq;
+  struct trace_event *e = trace_host_event(&seq, NOMP_TRACE_UPDATE, entry,
+                                           start);
+  e->bytes = bytes, e->op = op;
+  trace_publish(e, seq);
+}
+
+/**
+ * @ingroup nomp_trace_utils
+ *
+ * @brief Record the launch of a kernel on the host.
+ *
+ * @details The span covers the time taken by nomp_run() to enqueue the
+ * kernel. The time the kernel runs on the device is recorded by the backend
+ * with nomp_trace_device().
+ *
+ * @param[in] prg Program which was launched.
+ * @param[in] start Start of the launch returned by nomp_profile_now().
+ * @return void
+ */
+void nomp_trace_run(const nomp_prog_t *prg, double start) {
+  if (trace_events == NULL) return;
+
+  uint64_t            seq;
+  struct trace_event *e =
+      trace_host_event(&seq, NOMP_TRACE_RUN, prg->profile_id, start);
+  e->ndim = prg->ndim;
+  for (unsigned i = 0; i < 3; i++)
+    e->global[i] = prg->global[i], e->local[i] = prg->local[i];
+  trace_publish(e, seq);
+}
+
+/**
+ * @ingroup nomp_trace_utils
+ *
+ * @brief Record a kernel or a copy on the device.
+ *
+ * @param[in] entry Profiler entry of the kernel or the copy.
+ * @param[in] queue Queue the work ran on. Each queue has its own track.
+ * @param[in] start Start of the work in the host clock (see
+ * nomp_profile_now()).
+ * @param[in] end End of the work in the host clock.
+ * @return void
+ */
+void nomp_trace_device(unsigned entry, unsigned queue, double start,
+                       double end) {
+  if (trace_events == NULL) return;
+
+  uint64_t            seq;
+  struct trace_event *e = trace_claim(&seq);
+  e->entry = entry, e->track = queue + 1, e->start = start, e->end = end;
+  e->cat = NOMP_TRACE_DEVICE, e->bytes = 0, e->ndim = 0;
+  trace_publish(e, seq);
+}
+
+static void trace_write_args(const struct trace_event *e) {
+  if (e->cat == NOMP_TRACE_UPDATE) {
+    fprintf(trace_fp, ",\"args\":{\"bytes\":%zu,\"direction\":\"%s\"}",
+            e->bytes, (e->op & NOMP_TO) ? "to" : "from");
+  }
+  if (e->cat == NOMP_TRACE_RUN) {
+    fprintf(trace_fp, ",\"args\":{\"global\":[%zu", e->global[0]);
+    for (unsigned i = 1; i < e->ndim; i++)
+      fprintf(trace_fp, ",%zu", e->global[i]);
+    fprintf(trace_fp, "],\"local\":[%zu", e->local[0]);
+    for (unsigned i = 1; i < e->ndim; i++)
+      fprintf(trace_fp, ",%zu", e->local[i]);
+    fprintf(trace_fp, "]}");
+  }
+}
+
+/**
+ * @ingroup nomp_trace_utils
+ *
+ * @brief Write the recorded events to the trace file and stop tracing.
+ *
+ * @details Called when the last context is destroyed, before the profiler
+ * entries which name the events are freed. Events are written as complete
+ * ("X") events with microsecond timestamps relative to the start of tracing.
+ *
+ * @return void
+ */
+void nomp_trace_finalize(void) {
+  if (trace_events == NULL) return;
+
+  fprintf(trace_fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  fprintf(trace_fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,"
+                    "\"args\":{\"name\":\"libnomp\"}}");
+
+  uint64_t head   = __atomic_load_n(&trace_head, __ATOMIC_ACQUIRE);
+  uint64_t first  = head > TRACE_CAPACITY ? head - TRACE_CAPACITY : 0;
+  unsigned tracks = 0;
+  for (uint64_t i = first; i < head; i++) {
+    const struct trace_event *e = &trace_events[i & (TRACE_CAPACITY - 1)];
+    // Skip the events which were not published or were overwritten.
+    if (__atomic_load_n(&e->seq, __ATOMIC_ACQUIRE) != i + 1) continue;
+
+    const char *name = nomp_profile_name(e->entry);
+    fprintf(trace_fp,
+            ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":0,"
+            "\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f",
+            name ? name : "unknown", TRACE_CAT_STRING[e->cat], e->track,
+            (e->start - trace_origin) * 1e3, (e->end - e->start) * 1e3);
+    trace_write_args(e);
+    fprintf(trace_fp, "}");
+    if (e->track + 1 > tracks) tracks = e->track + 1;
+  }
+
+  // Name the tracks: host first and then one for each queue.
+  for (unsigned t = 0; t < tracks; t++) {
+    fprintf(trace_fp,
+            ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,"
+            "\"args\":{\"name\":\"",
+            t);
+    if (t == 0)
+      fprintf(trace_fp, "host\"}}");
+    else
+      fprintf(trace_fp, "queue %u\"}}", t - 1);
+  }
+  fprintf(trace_fp, "\n]}\n");
+
+  fclose(trace_fp), trace_fp = NULL;
+  nomp_free(&trace_events);
+}
+
+#undef TRACE_CAPACITY
@@ -0,0 +1,78 @@
+#include "nomp-test.h"
+
+#define TEST_SIZE 10
+
+static const char *knl = "void foo(int *a, int N) {                      \n"
+                         "  for (int i = 0; i < N; i++)                  \n"
+                         "    a[i] += i;                                 \n"
+                         "}                                              \n";
+
+static int test_invalid_queues(void) {
+  int err = nomp_create_queues(0);
+  nomp_test_assert(nomp_get_err_no(err) == NOMP_USER_INPUT_IS_INVALID);
+
+  nomp_test_check(nomp_create_queues(2));
+  err = nomp_set_queue(2);
+  nomp_test_assert(nomp_get_err_no(err) == NOMP_USER_INPUT_IS_INVALID);
+  err = nomp_sync_queue(5);
+  nomp_test_assert(nomp_get_err_no(err) == NOMP_USER_INPUT_IS_INVALID);
+
+  // Creating fewer queues than what already exists is a no-op.
+  nomp_test_check(nomp_create_queues(1));
+  nomp_test_check(nomp_set_queue(1));
+  nomp_test_check(nomp_set_queue(0));
+
+  return 0;
+}
+
+// Run the same kernel on two independent arrays, each array on its own
+// queue.
+static int test_multiple_queues(void) {
+  int a[TEST_SIZE], b[TEST_SIZE], n = TEST_SIZE;
+  for (int i = 0; i < n; i++)
+    a[i] = 0, b[i] = n - i;
+
+  nomp_test_check(nomp_create_queues(2));
+
+  int         id         = -1;
+  const char *clauses[4] = {"transform", "nomp_api_100", "tile", 0};
+  nomp_test_check(nomp_jit(&id, knl, clauses, 2, "a", sizeof(int), NOMP_PTR,
+                           "N", sizeof(int), NOMP_INT));
+
+  nomp_test_check(nomp_set_queue(0));
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_TO));
+  nomp_test_check(nomp_run(id, a, &n));
+
+  nomp_test_check(nomp_set_queue(1));
+  nomp_test_check(nomp_update(b, 0, n, sizeof(int), NOMP_TO));
+  nomp_test_check(nomp_run(id, b, &n));
+  nomp_test_check(nomp_run(id, b, &n));
+
+  nomp_test_check(nomp_sync_queue(1));
+  nomp_test_check(nomp_update(b, 0, n, sizeof(int), NOMP_FROM));
+  nomp_test_check(nomp_update(b, 0, n, sizeof(int), NOMP_FREE));
+
+  nomp_test_check(nomp_sync());
+  nomp_test_check(nomp_set_queue(0));
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FROM));
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FREE));
+
+  for (int i = 0; i < n; i++) {
+    nomp_test_assert(a[i] == i);
+    nomp_test_assert(b[i] == n + i);
+  }
+
+  return 0;
+}
+
+int main(int argc, const char *argv[]) {
+  nomp_test_check(nomp_init(argc, argv));
+
+  int err = 0;
+  err |= SUBTEST(test_invalid_queues);
+  err |= SUBTEST(test_multiple_queues);
+
+  nomp_test_check(nomp_finalize());
+
+  return err;
+}
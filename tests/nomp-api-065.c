@@ -0,0 +1,87 @@
+#include "nomp-test.h"
+
+#define TEST_SIZE 1024
+
+static const char *knl = "void foo(int *a, int N) {                      \n"
+                         "  for (int i = 0; i < N; i++)                  \n"
+                         "    a[i] += i;                                 \n"
+                         "}                                              \n";
+
+static int test_invalid_async_update(void) {
+  int a[TEST_SIZE];
+  int err = nomp_update(a, 0, TEST_SIZE, sizeof(int), NOMP_FROM | NOMP_ASYNC);
+  nomp_test_assert(nomp_get_err_no(err) == NOMP_USER_MAP_OP_IS_INVALID);
+
+  err = nomp_wait(a);
+  nomp_test_assert(nomp_get_err_no(err) == NOMP_USER_MAP_PTR_IS_INVALID);
+
+  return 0;
+}
+
+// Kernel on `b` doesn't depend on the asynchronous upload of `a`, the one on
+// `a` does.
+static int test_async_update(int id) {
+  int a[TEST_SIZE], b[TEST_SIZE], n = TEST_SIZE;
+  for (int i = 0; i < n; i++)
+    a[i] = n - i, b[i] = 0;
+
+  nomp_test_check(nomp_update(b, 0, n, sizeof(int), NOMP_TO));
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_TO | NOMP_ASYNC));
+  nomp_test_check(nomp_run(id, b, &n));
+  nomp_test_check(nomp_run(id, a, &n));
+
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FROM | NOMP_ASYNC));
+  nomp_test_check(nomp_update(b, 0, n, sizeof(int), NOMP_FROM | NOMP_ASYNC));
+  nomp_test_check(nomp_wait(a));
+  nomp_test_check(nomp_wait(b));
+
+  for (int i = 0; i < n; i++) {
+    nomp_test_assert(a[i] == n);
+    nomp_test_assert(b[i] == i);
+  }
+
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FREE));
+  nomp_test_check(nomp_update(b, 0, n, sizeof(int), NOMP_FREE));
+
+  return 0;
+}
+
+// Kernel on queue 0 waits for the upload of `a` on queue 1 without a call to
+// nomp_sync_queue().
+static int test_async_update_across_queues(int id) {
+  int a[TEST_SIZE], n = TEST_SIZE;
+  for (int i = 0; i < n; i++)
+    a[i] = 1;
+
+  nomp_test_check(nomp_create_queues(2));
+  nomp_test_check(nomp_set_queue(1));
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_TO | NOMP_ASYNC));
+  nomp_test_check(nomp_set_queue(0));
+  nomp_test_check(nomp_run(id, a, &n));
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FROM));
+
+  for (int i = 0; i < n; i++)
+    nomp_test_assert(a[i] == i + 1);
+
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FREE));
+
+  return 0;
+}
+
+int main(int argc, const char *argv[]) {
+  nomp_test_check(nomp_init(argc, argv));
+
+  int         id         = -1;
+  const char *clauses[4] = {"transform", "nomp_api_100", "tile", 0};
+  nomp_test_check(nomp_jit(&id, knl, clauses, 2, "a", sizeof(int), NOMP_PTR,
+                           "N", sizeof(int), NOMP_INT));
+
+  int err = 0;
+  err |= SUBTEST(test_invalid_async_update);
+  err |= SUBTEST(test_async_update, id);
+  err |= SUBTEST(test_async_update_across_queues, id);
+
+  nomp_test_check(nomp_finalize());
+
+  return err;
+}
@@ -0,0 +1,88 @@
+#include "nomp-test.h"
+
+#define TEST_SIZE 1000
+
+static const char *knl = "void foo(int *a, int N) {                      \n"
+                         "  for (int i = 0; i < N; i++)                  \n"
+                         "    a[i] += i;                                 \n"
+                         "}                                              \n";
+
+// Map and free arrays of the same size repeatedly. Only the first allocation
+// should reach the backend, and reused memory must not leak old values.
+static int test_pool_reuse(int argc, const char **argv) {
+  nomp_test_check(nomp_init(argc, argv));
+  int pooled = !nomp_test_shares_host_memory();
+
+  unsigned hits0, misses0;
+  nomp_test_check(nomp_get_pool_stats(NULL, NULL, &hits0, &misses0));
+
+  int         id         = -1;
+  const char *clauses[4] = {"transform", "nomp_api_100", "tile", 0};
+  nomp_test_check(nomp_jit(&id, knl, clauses, 2, "a", sizeof(int), NOMP_PTR,
+                           "N", sizeof(int), NOMP_INT));
+
+  int a[TEST_SIZE], n = TEST_SIZE;
+  for (unsigned step = 0; step < 4; step++) {
+    for (int i = 0; i < n; i++)
+      a[i] = step;
+    nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_TO));
+    nomp_test_check(nomp_run(id, a, &n));
+    nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FROM));
+
+    size_t live;
+    nomp_test_check(nomp_get_pool_stats(&live, NULL, NULL, NULL));
+    nomp_test_assert(!pooled || live >= n * sizeof(int));
+    nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FREE));
+
+    for (int i = 0; i < n; i++)
+      nomp_test_assert(a[i] == (int)step + i);
+  }
+
+  size_t   live, cached;
+  unsigned hits, misses;
+  nomp_test_check(nomp_get_pool_stats(&live, &cached, &hits, &misses));
+  nomp_test_assert(live == 0);
+  if (pooled) {
+    nomp_test_assert(hits - hits0 == 3 && misses - misses0 == 1);
+    nomp_test_assert(cached >= n * sizeof(int));
+  } else {
+    nomp_test_assert(hits == 0 && misses == 0 && cached == 0);
+  }
+
+  nomp_test_check(nomp_trim_pool());
+  nomp_test_check(nomp_get_pool_stats(&live, &cached, NULL, NULL));
+  nomp_test_assert(live == 0 && cached == 0);
+
+  nomp_test_check(nomp_finalize_excluding_interpreter());
+
+  return 0;
+}
+
+static int test_pool_disabled(int argc, const char **argv) {
+  setenv("NOMP_POOL_SIZE", "0", 1);
+  nomp_test_check(nomp_init(argc, argv));
+
+  int a[TEST_SIZE], n = TEST_SIZE;
+  for (unsigned step = 0; step < 2; step++) {
+    nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_TO));
+    nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FREE));
+  }
+
+  size_t   live, cached;
+  unsigned hits, misses;
+  nomp_test_check(nomp_get_pool_stats(&live, &cached, &hits, &misses));
+  nomp_test_assert(live == 0 && cached == 0 && hits == 0 && misses == 0);
+
+  nomp_test_check(nomp_finalize());
+  unsetenv("NOMP_POOL_SIZE");
+
+  return 0;
+}
+
+int main(int argc, const char *argv[]) {
+  int err = 0;
+  err |= SUBTEST(test_pool_reuse, argc, argv);
+  err |= SUBTEST(test_pool_disabled, argc, argv);
+
+  return err;
+}
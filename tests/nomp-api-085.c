@@ -0,0 +1,73 @@
+#include "nomp-test.h"
+
+#define TEST_SIZE 64
+
+static const char *knl = "void foo(int *a, int N) {                      \n"
+                         "  for (int i = 0; i < N; i++)                  \n"
+                         "    a[i] += 1;                                 \n"
+                         "}                                              \n";
+
+static int check_array(const int *a, int n, int full, int partial) {
+  for (int i = 0; i < n - 1; i++)
+    nomp_test_assert(a[i] == full);
+  nomp_test_assert(a[n - 1] == partial);
+  return 0;
+}
+
+// Launches of the same kernel which change some of the arguments and keep
+// the others must see the latest value of every argument, even if the memory
+// of an argument was freed and mapped again in between.
+static int test_rebind_arguments(int id) {
+  int a[TEST_SIZE] = {0}, b[TEST_SIZE] = {0}, c[TEST_SIZE] = {0};
+  int n = TEST_SIZE, m = TEST_SIZE - 1;
+
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_TO));
+  nomp_test_check(nomp_update(b, 0, n, sizeof(int), NOMP_TO));
+
+  nomp_test_check(nomp_run(id, a, &n));
+  nomp_test_check(nomp_run(id, a, &n));
+  nomp_test_check(nomp_run(id, b, &n));
+  nomp_test_check(nomp_run(id, a, &m));
+  nomp_test_check(nomp_run(id, b, &n));
+
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FROM));
+  nomp_test_check(nomp_update(b, 0, n, sizeof(int), NOMP_FROM));
+  nomp_test_check(check_array(a, n, 3, 2));
+  nomp_test_check(check_array(b, n, 2, 2));
+
+  // Free `a` and map `c`, which may reuse the device memory of `a`.
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FREE));
+  nomp_test_check(nomp_update(c, 0, n, sizeof(int), NOMP_TO));
+  nomp_test_check(nomp_run(id, c, &n));
+  nomp_test_check(nomp_run(id, b, &m));
+
+  nomp_test_check(nomp_update(c, 0, n, sizeof(int), NOMP_FROM));
+  nomp_test_check(nomp_update(b, 0, n, sizeof(int), NOMP_FROM));
+  nomp_test_check(check_array(c, n, 1, 1));
+  nomp_test_check(check_array(b, n, 3, 2));
+
+  // `a` is not mapped anymore.
+  int err = nomp_run(id, a, &n);
+  nomp_test_assert(nomp_get_err_no(err) == NOMP_USER_MAP_PTR_IS_INVALID);
+
+  nomp_test_check(nomp_update(b, 0, n, sizeof(int), NOMP_FREE));
+  nomp_test_check(nomp_update(c, 0, n, sizeof(int), NOMP_FREE));
+
+  return 0;
+}
+
+int main(int argc, const char *argv[]) {
+  nomp_test_check(nomp_init(argc, argv));
+
+  int         id         = -1;
+  const char *clauses[4] = {"transform", "nomp_api_100", "tile", 0};
+  nomp_test_check(nomp_jit(&id, knl, clauses, 2, "a", sizeof(int), NOMP_PTR,
+                           "N", sizeof(int), NOMP_INT));
+
+  int err = 0;
+  err |= SUBTEST(test_rebind_arguments, id);
+
+  nomp_test_check(nomp_finalize());
+
+  return err;
+}
@@ -0,0 +1,102 @@
+#include "nomp-test.h"
+
+#define TEST_SIZE 32
+
+static const char *knl = "void foo(int *a, int *b, int N) {              \n"
+                         "  for (int i = 0; i < N; i++)                  \n"
+                         "    a[i] += b[i];                              \n"
+                         "}                                              \n";
+
+static int test_run_v(int id) {
+  int a[TEST_SIZE], b[TEST_SIZE], n = TEST_SIZE;
+  for (int i = 0; i < n; i++)
+    a[i] = i, b[i] = n - i;
+
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_TO));
+  nomp_test_check(nomp_update(b, 0, n, sizeof(int), NOMP_TO));
+
+  void *args[3] = {a, b, &n};
+  nomp_test_check(nomp_run_v(id, args));
+  nomp_test_check(nomp_run(id, a, b, &n));
+
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FROM));
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FREE));
+  nomp_test_check(nomp_update(b, 0, n, sizeof(int), NOMP_FREE));
+
+  for (int i = 0; i < n; i++)
+    nomp_test_assert(a[i] == 2 * n - i);
+
+  int err = nomp_run_v(id + 1, args);
+  nomp_test_assert(nomp_get_err_no(err) == NOMP_USER_INPUT_IS_INVALID);
+
+  return 0;
+}
+
+// Two bindings of the same kernel launched alternately. Scalars are read at
+// every launch and arrays mapped again after nomp_bind() are picked up.
+static int test_bind(int id) {
+  int a[TEST_SIZE] = {0}, c[TEST_SIZE] = {0}, b[TEST_SIZE];
+  int n = TEST_SIZE, m = TEST_SIZE / 2;
+  for (int i = 0; i < TEST_SIZE; i++)
+    b[i] = 1;
+
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_TO));
+  nomp_test_check(nomp_update(b, 0, n, sizeof(int), NOMP_TO));
+  nomp_test_check(nomp_update(c, 0, n, sizeof(int), NOMP_TO));
+
+  int   ha, hc;
+  void *args_a[3] = {a, b, &n}, *args_c[3] = {c, b, &m};
+  nomp_test_check(nomp_bind(&ha, id, args_a));
+  nomp_test_check(nomp_bind(&hc, id, args_c));
+  for (unsigned step = 0; step < 3; step++) {
+    nomp_test_check(nomp_launch(ha));
+    nomp_test_check(nomp_launch(hc));
+  }
+  m = TEST_SIZE;
+  nomp_test_check(nomp_launch(hc));
+
+  // Map `b` again with new values.
+  nomp_test_check(nomp_update(b, 0, n, sizeof(int), NOMP_FREE));
+  for (int i = 0; i < TEST_SIZE; i++)
+    b[i] = 2;
+  nomp_test_check(nomp_update(b, 0, n, sizeof(int), NOMP_TO));
+  nomp_test_check(nomp_launch(ha));
+
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FROM));
+  nomp_test_check(nomp_update(c, 0, n, sizeof(int), NOMP_FROM));
+  for (int i = 0; i < TEST_SIZE; i++) {
+    nomp_test_assert(a[i] == 5);
+    nomp_test_assert(c[i] == (i < TEST_SIZE / 2 ? 4 : 1));
+  }
+
+  nomp_test_check(nomp_unbind(ha));
+  nomp_test_check(nomp_unbind(hc));
+  int err = nomp_launch(ha);
+  nomp_test_assert(nomp_get_err_no(err) == NOMP_USER_INPUT_IS_INVALID);
+  err = nomp_unbind(-1);
+  nomp_test_assert(nomp_get_err_no(err) == NOMP_USER_INPUT_IS_INVALID);
+
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FREE));
+  nomp_test_check(nomp_update(b, 0, n, sizeof(int), NOMP_FREE));
+  nomp_test_check(nomp_update(c, 0, n, sizeof(int), NOMP_FREE));
+
+  return 0;
+}
+
+int main(int argc, const char *argv[]) {
+  nomp_test_check(nomp_init(argc, argv));
+
+  int         id         = -1;
+  const char *clauses[4] = {"transform", "nomp_api_100", "tile", 0};
+  nomp_test_check(nomp_jit(&id, knl, clauses, 3, "a", sizeof(int), NOMP_PTR,
+                           "b", sizeof(int), NOMP_PTR, "N", sizeof(int),
+                           NOMP_INT));
+
+  int err = 0;
+  err |= SUBTEST(test_run_v, id);
+  err |= SUBTEST(test_bind, id);
+
+  nomp_test_check(nomp_finalize());
+
+  return err;
+}
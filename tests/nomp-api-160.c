@@ -0,0 +1,128 @@
+#include "nomp-test.h"
+
+#define TEST_SIZE 32
+
+static const char *knl = "void foo(int *a, int *b, int N) {              \n"
+                         "  for (int i = 0; i < N; i++)                  \n"
+                         "    a[i] += b[i];                              \n"
+                         "}                                              \n";
+
+// Graph with only kernels. Scalars are read at every replay.
+static int test_graph_kernels(int id) {
+  int a[TEST_SIZE] = {0}, b[TEST_SIZE], n = TEST_SIZE;
+  for (int i = 0; i < TEST_SIZE; i++)
+    b[i] = 1;
+
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_TO));
+  nomp_test_check(nomp_update(b, 0, n, sizeof(int), NOMP_TO));
+
+  int graph;
+  nomp_test_check(nomp_graph_begin());
+  nomp_test_check(nomp_run(id, a, b, &n));
+  void *args[3] = {a, b, &n};
+  nomp_test_check(nomp_run_v(id, args));
+  nomp_test_check(nomp_graph_end(&graph));
+
+  // Nothing is run while recording.
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FROM));
+  for (int i = 0; i < TEST_SIZE; i++)
+    nomp_test_assert(a[i] == 0);
+
+  for (unsigned step = 0; step < 2; step++)
+    nomp_test_check(nomp_graph_launch(graph));
+  n = TEST_SIZE / 2;
+  nomp_test_check(nomp_graph_launch(graph));
+
+  n = TEST_SIZE;
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FROM));
+  for (int i = 0; i < TEST_SIZE; i++)
+    nomp_test_assert(a[i] == (i < TEST_SIZE / 2 ? 6 : 4));
+
+  nomp_test_check(nomp_graph_free(graph));
+  int err = nomp_graph_launch(graph);
+  nomp_test_assert(nomp_get_err_no(err) == NOMP_USER_INPUT_IS_INVALID);
+
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FREE));
+  nomp_test_check(nomp_update(b, 0, n, sizeof(int), NOMP_FREE));
+
+  return 0;
+}
+
+// Graph with memory transfers between the kernels.
+static int test_graph_updates(int id) {
+  int a[TEST_SIZE] = {0}, b[TEST_SIZE] = {0}, n = TEST_SIZE;
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_TO));
+  nomp_test_check(nomp_update(b, 0, n, sizeof(int), NOMP_TO));
+
+  int graph;
+  nomp_test_check(nomp_graph_begin());
+  nomp_test_check(nomp_update(b, 0, n, sizeof(int), NOMP_TO));
+  nomp_test_check(nomp_run(id, a, b, &n));
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FROM));
+  nomp_test_check(nomp_graph_end(&graph));
+
+  for (int step = 1; step <= 3; step++) {
+    for (int i = 0; i < TEST_SIZE; i++)
+      b[i] = step * i;
+    nomp_test_check(nomp_graph_launch(graph));
+    for (int i = 0; i < TEST_SIZE; i++)
+      nomp_test_assert(a[i] == step * (step + 1) / 2 * i);
+  }
+
+  // The arrays of the graph must be mapped when it is launched.
+  nomp_test_check(nomp_update(b, 0, n, sizeof(int), NOMP_FREE));
+  int err = nomp_graph_launch(graph);
+  nomp_test_assert(nomp_get_err_no(err) == NOMP_USER_MAP_PTR_IS_INVALID);
+
+  nomp_test_check(nomp_graph_free(graph));
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FREE));
+
+  return 0;
+}
+
+static int test_graph_errors(void) {
+  int a[TEST_SIZE] = {0}, n = TEST_SIZE, graph;
+
+  int err = nomp_graph_end(&graph);
+  nomp_test_assert(nomp_get_err_no(err) == NOMP_USER_INPUT_IS_INVALID);
+
+  nomp_test_check(nomp_graph_begin());
+  err = nomp_graph_begin();
+  nomp_test_assert(nomp_get_err_no(err) == NOMP_USER_INPUT_IS_INVALID);
+
+  // Memory can't be mapped while recording.
+  err = nomp_update(a, 0, n, sizeof(int), NOMP_TO);
+  nomp_test_assert(nomp_get_err_no(err) == NOMP_USER_MAP_OP_IS_INVALID);
+  nomp_test_check(nomp_graph_end(&graph));
+
+  nomp_test_check(nomp_graph_begin());
+  err = nomp_graph_launch(graph);
+  nomp_test_assert(nomp_get_err_no(err) == NOMP_USER_INPUT_IS_INVALID);
+  nomp_test_check(nomp_graph_end(&graph));
+
+  // Empty graphs are fine.
+  nomp_test_check(nomp_graph_launch(graph));
+  err = nomp_graph_free(-1);
+  nomp_test_assert(nomp_get_err_no(err) == NOMP_USER_INPUT_IS_INVALID);
+
+  return 0;
+}
+
+int main(int argc, const char *argv[]) {
+  nomp_test_check(nomp_init(argc, argv));
+
+  int         id         = -1;
+  const char *clauses[4] = {"transform", "nomp_api_100", "tile", 0};
+  nomp_test_check(nomp_jit(&id, knl, clauses, 3, "a", sizeof(int), NOMP_PTR,
+                           "b", sizeof(int), NOMP_PTR, "N", sizeof(int),
+                           NOMP_INT));
+
+  int err = 0;
+  err |= SUBTEST(test_graph_kernels, id);
+  err |= SUBTEST(test_graph_updates, id);
+  err |= SUBTEST(test_graph_errors);
+
+  nomp_test_check(nomp_finalize());
+
+  return err;
+}
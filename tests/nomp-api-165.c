@@ -0,0 +1,129 @@
+#include "nomp-test.h"
+
+#define TEST_SIZE 32
+
+static const char *add = "void add(int *a, int *b, int N) {              \n"
+                         "  for (int i = 0; i < N; i++)                  \n"
+                         "    a[i] += b[i];                              \n"
+                         "}                                              \n";
+
+static const char *scale = "void scale(int *a, int N) {                  \n"
+                           "  for (int i = 0; i < N; i++)                \n"
+                           "    a[i] *= 2;                               \n"
+                           "}                                            \n";
+
+// Chain of elementwise kernels over the same domain. The second time, the
+// fused kernel generated the first time is reused.
+static int test_fuse_chain(int add_id, int scale_id) {
+  int a[TEST_SIZE], b[TEST_SIZE], n = TEST_SIZE;
+  for (int i = 0; i < n; i++)
+    a[i] = i, b[i] = 1;
+
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_TO));
+  nomp_test_check(nomp_update(b, 0, n, sizeof(int), NOMP_TO));
+
+  for (unsigned step = 0; step < 2; step++) {
+    nomp_test_check(nomp_fuse_begin());
+    nomp_test_check(nomp_run(add_id, a, b, &n));
+    nomp_test_check(nomp_run(scale_id, a, &n));
+    nomp_test_check(nomp_run(add_id, a, b, &n));
+    nomp_test_check(nomp_fuse_end());
+  }
+
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FROM));
+  for (int i = 0; i < n; i++)
+    nomp_test_assert(a[i] == 2 * (2 * (i + 1) + 1 + 1) + 1);
+
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FREE));
+  nomp_test_check(nomp_update(b, 0, n, sizeof(int), NOMP_FREE));
+
+  return 0;
+}
+
+// Scalars are read when the launch is queued and nomp_update() runs the
+// queued launches first.
+static int test_fuse_queue(int scale_id) {
+  int a[TEST_SIZE], n = TEST_SIZE;
+  for (int i = 0; i < n; i++)
+    a[i] = 1;
+
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_TO));
+  nomp_test_check(nomp_fuse_begin());
+  nomp_test_check(nomp_run(scale_id, a, &n));
+  n = TEST_SIZE / 2;
+  nomp_test_check(nomp_run(scale_id, a, &n));
+  n = TEST_SIZE;
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FROM));
+  for (int i = 0; i < n; i++)
+    nomp_test_assert(a[i] == (i < TEST_SIZE / 2 ? 4 : 2));
+
+  nomp_test_check(nomp_run(scale_id, a, &n));
+  nomp_test_check(nomp_fuse_end());
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FROM));
+  for (int i = 0; i < n; i++)
+    nomp_test_assert(a[i] == (i < TEST_SIZE / 2 ? 8 : 4));
+
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FREE));
+
+  return 0;
+}
+
+// Work in a graph is done in the order it was recorded even if the graph is
+// launched in a fused region.
+static int test_fuse_graph(int scale_id) {
+  int a[TEST_SIZE], n = TEST_SIZE;
+  for (int i = 0; i < n; i++)
+    a[i] = 1;
+
+  int graph;
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_TO));
+  nomp_test_check(nomp_graph_begin());
+  nomp_test_check(nomp_run(scale_id, a, &n));
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FROM));
+  nomp_test_check(nomp_graph_end(&graph));
+
+  nomp_test_check(nomp_fuse_begin());
+  nomp_test_check(nomp_graph_launch(graph));
+  for (int i = 0; i < n; i++)
+    nomp_test_assert(a[i] == 2);
+  nomp_test_check(nomp_fuse_end());
+
+  nomp_test_check(nomp_graph_free(graph));
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FREE));
+
+  return 0;
+}
+
+static int test_fuse_errors(void) {
+  int err = nomp_fuse_end();
+  nomp_test_assert(nomp_get_err_no(err) == NOMP_USER_INPUT_IS_INVALID);
+
+  nomp_test_check(nomp_fuse_begin());
+  err = nomp_fuse_begin();
+  nomp_test_assert(nomp_get_err_no(err) == NOMP_USER_INPUT_IS_INVALID);
+  nomp_test_check(nomp_fuse_end());
+
+  return 0;
+}
+
+int main(int argc, const char *argv[]) {
+  nomp_test_check(nomp_init(argc, argv));
+
+  int         add_id = -1, scale_id = -1;
+  const char *clauses[4] = {"transform", "nomp_api_100", "tile", 0};
+  nomp_test_check(nomp_jit(&add_id, add, clauses, 3, "a", sizeof(int),
+                           NOMP_PTR, "b", sizeof(int), NOMP_PTR, "N",
+                           sizeof(int), NOMP_INT));
+  nomp_test_check(nomp_jit(&scale_id, scale, clauses, 2, "a", sizeof(int),
+                           NOMP_PTR, "N", sizeof(int), NOMP_INT));
+
+  int err = 0;
+  err |= SUBTEST(test_fuse_chain, add_id, scale_id);
+  err |= SUBTEST(test_fuse_queue, scale_id);
+  err |= SUBTEST(test_fuse_graph, scale_id);
+  err |= SUBTEST(test_fuse_errors);
+
+  nomp_test_check(nomp_finalize());
+
+  return err;
+}
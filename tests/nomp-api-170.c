@@ -0,0 +1,101 @@
+#include "nomp-test.h"
+#include <pthread.h>
+
+#define TEST_THREADS  4
+#define TEST_SIZE     64
+#define TEST_LAUNCHES 100
+
+static const char *knl = "void foo(int *a, int N) {                      \n"
+                         "  for (int i = 0; i < N; i++)                  \n"
+                         "    a[i] += 1;                                 \n"
+                         "}                                              \n";
+
+struct test_thread {
+  int          argc;
+  const char **argv;
+  int          err;
+};
+
+static int run_context(int argc, const char **argv) {
+  nomp_context_t *context = NULL;
+  nomp_test_check(nomp_context_create(&context, argc, argv));
+  nomp_test_assert(nomp_context_get() == context);
+
+  int a[TEST_SIZE], n = TEST_SIZE;
+  for (int i = 0; i < n; i++)
+    a[i] = i;
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_TO));
+
+  int         id         = -1;
+  const char *clauses[4] = {"transform", "nomp_api_100", "tile", 0};
+  nomp_test_check(nomp_jit(&id, knl, clauses, 2, "a", sizeof(int), NOMP_PTR,
+                           "N", sizeof(int), NOMP_INT));
+  for (unsigned i = 0; i < TEST_LAUNCHES; i++)
+    nomp_test_check(nomp_run(id, a, &n));
+
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FROM));
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FREE));
+  for (int i = 0; i < n; i++)
+    nomp_test_assert(a[i] == i + TEST_LAUNCHES);
+
+  nomp_test_check(nomp_context_destroy(context));
+  nomp_test_assert(nomp_context_get() == NULL);
+
+  return 0;
+}
+
+static void *run_thread(void *arg) {
+  struct test_thread *t = (struct test_thread *)arg;
+  t->err                = run_context(t->argc, t->argv);
+  return NULL;
+}
+
+// Each thread creates its own context and uses it concurrently with the
+// other threads.
+static int test_threads(int argc, const char **argv) {
+  pthread_t          threads[TEST_THREADS];
+  struct test_thread args[TEST_THREADS];
+  for (unsigned i = 0; i < TEST_THREADS; i++) {
+    args[i].argc = argc, args[i].argv = argv, args[i].err = 0;
+    nomp_test_assert(
+        pthread_create(&threads[i], NULL, run_thread, &args[i]) == 0);
+  }
+
+  int err = 0;
+  for (unsigned i = 0; i < TEST_THREADS; i++) {
+    nomp_test_assert(pthread_join(threads[i], NULL) == 0);
+    err |= args[i].err;
+  }
+
+  return err;
+}
+
+// A thread without a context can't call libnomp and a thread can't be
+// initialized twice.
+static int test_context_errors(int argc, const char **argv) {
+  int err = nomp_sync();
+  nomp_test_assert(nomp_get_err_no(err) == NOMP_INITIALIZE_FAILURE);
+
+  nomp_test_check(nomp_init(argc, argv));
+  err = nomp_init(argc, argv);
+  nomp_test_assert(nomp_get_err_no(err) == NOMP_INITIALIZE_FAILURE);
+
+  nomp_context_t *context = nomp_context_get();
+  nomp_test_check(nomp_context_set(NULL));
+  err = nomp_sync();
+  nomp_test_assert(nomp_get_err_no(err) == NOMP_INITIALIZE_FAILURE);
+  nomp_test_check(nomp_context_set(context));
+  nomp_test_check(nomp_sync());
+
+  return 0;
+}
+
+int main(int argc, const char *argv[]) {
+  int err = 0;
+  err |= SUBTEST(test_threads, argc, argv);
+  err |= SUBTEST(test_context_errors, argc, argv);
+
+  nomp_test_check(nomp_finalize());
+
+  return err;
+}
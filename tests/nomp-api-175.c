@@ -0,0 +1,138 @@
+#include "nomp-test.h"
+
+#define TEST_SIZE     4096
+#define TEST_LAUNCHES 10
+
+static const char *add = "void add(int *a, int *b, int N) {              \n"
+                         "  for (int i = 0; i < N; i++)                  \n"
+                         "    a[i] += b[i];                              \n"
+                         "}                                              \n";
+
+static const char *stencil =
+    "void stencil(int *a, int *b, int N) {                               \n"
+    "  for (int i = 1; i < N - 1; i++)                                   \n"
+    "    b[i] = a[i - 1] + a[i + 1];                                     \n"
+    "}                                                                   \n";
+
+static const char *sum = "void sum(int *a, int N, int *s) {              \n"
+                         "  for (int i = 0; i < N; i++)                  \n"
+                         "    s[0] += a[i];                              \n"
+                         "}                                              \n";
+
+// Elementwise kernel launched many times, so the work-groups are shared
+// based on the throughput measured for each device.
+static int test_split_add(void) {
+  int a[TEST_SIZE], b[TEST_SIZE], n = TEST_SIZE;
+  for (int i = 0; i < n; i++)
+    a[i] = i, b[i] = 1;
+
+  int         id         = -1;
+  const char *clauses[4] = {"transform", "nomp_api_100", "tile", 0};
+  nomp_test_check(nomp_jit(&id, add, clauses, 3, "a", sizeof(int), NOMP_PTR,
+                           "b", sizeof(int), NOMP_PTR, "N", sizeof(int),
+                           NOMP_INT));
+
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_TO));
+  nomp_test_check(nomp_update(b, 0, n, sizeof(int), NOMP_TO));
+  for (unsigned i = 0; i < TEST_LAUNCHES; i++) {
+    nomp_test_check(nomp_run(id, a, b, &n));
+    if (i % 2) nomp_test_check(nomp_sync());
+  }
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FROM));
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FREE));
+  nomp_test_check(nomp_update(b, 0, n, sizeof(int), NOMP_FREE));
+
+  for (int i = 0; i < n; i++)
+    nomp_test_assert(a[i] == i + TEST_LAUNCHES);
+
+  return 0;
+}
+
+// Work-groups next to the boundary between two devices read the elements
+// owned by the other device.
+static int test_split_stencil(void) {
+  int a[TEST_SIZE], b[TEST_SIZE] = {0}, n = TEST_SIZE;
+  for (int i = 0; i < n; i++)
+    a[i] = i;
+
+  int         id         = -1;
+  const char *clauses[4] = {"transform", "nomp_api_100", "tile", 0};
+  nomp_test_check(nomp_jit(&id, stencil, clauses, 3, "a", sizeof(int),
+                           NOMP_PTR, "b", sizeof(int), NOMP_PTR, "N",
+                           sizeof(int), NOMP_INT));
+
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_TO));
+  nomp_test_check(nomp_update(b, 0, n, sizeof(int), NOMP_TO));
+  nomp_test_check(nomp_run(id, a, b, &n));
+  nomp_test_check(nomp_update(b, 0, n, sizeof(int), NOMP_FROM));
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FREE));
+  nomp_test_check(nomp_update(b, 0, n, sizeof(int), NOMP_FREE));
+
+  nomp_test_assert(b[0] == 0 && b[n - 1] == 0);
+  for (int i = 1; i < n - 1; i++)
+    nomp_test_assert(b[i] == 2 * i);
+
+  return 0;
+}
+
+// Partial results computed by all the devices are combined.
+static int test_split_sum(void) {
+  int a[TEST_SIZE], n = TEST_SIZE, s = 0;
+  for (int i = 0; i < n; i++)
+    a[i] = 1;
+
+  int         id         = -1;
+  const char *clauses[4] = {"reduce", "s", "+", 0};
+  nomp_test_check(nomp_jit(&id, sum, clauses, 3, "a", sizeof(int), NOMP_PTR,
+                           "N", sizeof(int), NOMP_INT, "s", sizeof(int),
+                           NOMP_INT));
+
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_TO));
+  for (unsigned i = 0; i < TEST_LAUNCHES; i++) {
+    nomp_test_check(nomp_run(id, a, &n, &s));
+    nomp_test_assert(s == n);
+  }
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FREE));
+
+  return 0;
+}
+
+static int test_split(int argc, const char **argv, const char *weights) {
+  if (weights)
+    setenv("NOMP_OPENCL_DEVICE_WEIGHTS", weights, 1);
+  else
+    unsetenv("NOMP_OPENCL_DEVICE_WEIGHTS");
+
+  nomp_test_check(nomp_init(argc, argv));
+  int err = 0;
+  err |= SUBTEST(test_split_add);
+  err |= SUBTEST(test_split_stencil);
+  err |= SUBTEST(test_split_sum);
+  nomp_test_check(nomp_finalize_excluding_interpreter());
+
+  return err;
+}
+
+// Kernels are split between two queues of the same device, which is what the
+// OpenCL backend does with different devices sharing the host memory. Other
+// backends ignore these variables and run the same tests on a single device.
+int main(int argc, const char *argv[]) {
+  const char *device = getenv("NOMP_DEVICE");
+  for (int i = 0; i + 1 < argc; i++) {
+    if (strncmp(argv[i], "--nomp-device", NOMP_TEST_MAX_BUFFER_SIZE) == 0)
+      device = argv[i + 1];
+  }
+
+  char devices[NOMP_TEST_MAX_BUFFER_SIZE + 1];
+  snprintf(devices, NOMP_TEST_MAX_BUFFER_SIZE, "%s,%s", device ? device : "0",
+           device ? device : "0");
+  setenv("NOMP_OPENCL_DEVICES", devices, 1);
+
+  int err = 0;
+  err |= test_split(argc, argv, NULL);
+  err |= test_split(argc, argv, "1,3");
+  unsetenv("NOMP_OPENCL_DEVICES");
+  unsetenv("NOMP_OPENCL_DEVICE_WEIGHTS");
+
+  return err;
+}
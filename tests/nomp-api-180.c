@@ -0,0 +1,121 @@
+#include "nomp-test.h"
+
+#define TEST_SIZE    64
+#define TEST_KERNELS 8
+
+static const char *knl = "void foo(int *a, int N) {                      \n"
+                         "  for (int i = 0; i < N; i++)                  \n"
+                         "    a[i] += %d;                                \n"
+                         "}                                              \n";
+
+static const char *invalid_knl = "void foo(int *a, int N) {              \n"
+                                 "  for (int i = 0; i < N; i++)          \n"
+                                 "    a[i] = i                           \n"
+                                 "}                                      \n";
+
+// Several kernels are generated in the background at the same time and each
+// of them is waited for by the first launch.
+static int test_jit_async(void) {
+  static int  ids[TEST_KERNELS] = {-1, -1, -1, -1, -1, -1, -1, -1};
+  const char *clauses[4]        = {"transform", "nomp_api_100", "tile", 0};
+  char        src[NOMP_TEST_MAX_BUFFER_SIZE + 1];
+  for (unsigned k = 0; k < TEST_KERNELS; k++) {
+    snprintf(src, NOMP_TEST_MAX_BUFFER_SIZE, knl, k + 1);
+    nomp_test_check(nomp_jit_async(&ids[k], src, clauses, 2, "a", sizeof(int),
+                                   NOMP_PTR, "N", sizeof(int), NOMP_INT));
+    nomp_test_assert(ids[k] >= 0);
+  }
+
+  // Calling nomp_jit_async() again with a valid id is a no-op.
+  int id = ids[0];
+  nomp_test_check(nomp_jit_async(&ids[0], src, clauses, 2, "a", sizeof(int),
+                                 NOMP_PTR, "N", sizeof(int), NOMP_INT));
+  nomp_test_assert(ids[0] == id);
+
+  int a[TEST_SIZE], n = TEST_SIZE;
+  for (int i = 0; i < n; i++)
+    a[i] = i;
+
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_TO));
+  nomp_test_check(nomp_jit_wait(ids[TEST_KERNELS - 1]));
+  for (unsigned k = 0; k < TEST_KERNELS; k++)
+    nomp_test_check(nomp_run(ids[k], a, &n));
+  nomp_test_check(nomp_jit_wait(ids[0]));
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FROM));
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FREE));
+
+  int total = TEST_KERNELS * (TEST_KERNELS + 1) / 2;
+  for (int i = 0; i < n; i++)
+    nomp_test_assert(a[i] == i + total);
+
+  return 0;
+}
+
+// Errors in the worker are returned by nomp_jit_wait() and by launching the
+// kernel afterwards.
+static int test_jit_async_error(void) {
+  static int  id         = -1;
+  const char *clauses[4] = {"transform", "nomp_api_100", "tile", 0};
+  nomp_test_check(nomp_jit_async(&id, invalid_knl, clauses, 2, "a",
+                                 sizeof(int), NOMP_PTR, "N", sizeof(int),
+                                 NOMP_INT));
+
+  int err = nomp_jit_wait(id);
+  nomp_test_assert(nomp_get_err_no(err) == NOMP_LOOPY_CONVERSION_FAILURE);
+
+  int a[TEST_SIZE], n = TEST_SIZE;
+  err = nomp_run(id, a, &n);
+  nomp_test_assert(nomp_get_err_no(err) == NOMP_LOOPY_CONVERSION_FAILURE);
+
+  return 0;
+}
+
+// With a single worker, the second kernel waits for the worker of the first
+// one. The first kernel fails but the second one is still generated and the
+// error is returned by the launch of the first kernel.
+static int test_jit_async_full(void) {
+  static int  ids[2]     = {-1, -1};
+  const char *clauses[4] = {"transform", "nomp_api_100", "tile", 0};
+  nomp_test_check(nomp_jit_async(&ids[0], invalid_knl, clauses, 2, "a",
+                                 sizeof(int), NOMP_PTR, "N", sizeof(int),
+                                 NOMP_INT));
+
+  char src[NOMP_TEST_MAX_BUFFER_SIZE + 1];
+  snprintf(src, NOMP_TEST_MAX_BUFFER_SIZE, knl, TEST_KERNELS + 1);
+  nomp_test_check(nomp_jit_async(&ids[1], src, clauses, 2, "a", sizeof(int),
+                                 NOMP_PTR, "N", sizeof(int), NOMP_INT));
+  nomp_test_assert(ids[1] >= 0);
+
+  int a[TEST_SIZE], n = TEST_SIZE;
+  for (int i = 0; i < n; i++)
+    a[i] = i;
+
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_TO));
+  int err = nomp_run(ids[0], a, &n);
+  nomp_test_assert(nomp_get_err_no(err) == NOMP_LOOPY_CONVERSION_FAILURE);
+  nomp_test_check(nomp_run(ids[1], a, &n));
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FROM));
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FREE));
+
+  for (int i = 0; i < n; i++)
+    nomp_test_assert(a[i] == i + TEST_KERNELS + 1);
+
+  return 0;
+}
+
+int main(int argc, const char *argv[]) {
+  nomp_test_check(nomp_init(argc, argv));
+
+  int err = 0;
+  err |= SUBTEST(test_jit_async);
+  err |= SUBTEST(test_jit_async_error);
+  nomp_test_check(nomp_finalize_excluding_interpreter());
+
+  setenv("NOMP_JIT_WORKERS", "1", 1);
+  nomp_test_check(nomp_init(argc, argv));
+  err |= SUBTEST(test_jit_async_full);
+  nomp_test_check(nomp_finalize());
+  unsetenv("NOMP_JIT_WORKERS");
+
+  return err;
+}
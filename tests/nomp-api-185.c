@@ -0,0 +1,80 @@
+#include "nomp-test.h"
+
+#define TEST_SIZE     256
+#define TEST_LAUNCHES 10
+
+static const char *add = "void add(int *a, int *b, int N) {              \n"
+                         "  for (int i = 0; i < N; i++)                  \n"
+                         "    a[i] += b[i];                              \n"
+                         "}                                              \n";
+
+static const char *sum = "void sum(int *a, int N, int *s) {              \n"
+                         "  for (int i = 0; i < N; i++)                  \n"
+                         "    s[0] += a[i];                              \n"
+                         "}                                              \n";
+
+// Kernels and copies (blocking and asynchronous) are timed on the device
+// while they run.
+static int test_profile_add(void) {
+  int a[TEST_SIZE], b[TEST_SIZE], n = TEST_SIZE;
+  for (int i = 0; i < n; i++)
+    a[i] = i, b[i] = 1;
+
+  int         id         = -1;
+  const char *clauses[4] = {"transform", "nomp_api_100", "tile", 0};
+  nomp_test_check(nomp_jit(&id, add, clauses, 3, "a", sizeof(int), NOMP_PTR,
+                           "b", sizeof(int), NOMP_PTR, "N", sizeof(int),
+                           NOMP_INT));
+
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_TO));
+  nomp_test_check(nomp_update(b, 0, n, sizeof(int), NOMP_TO | NOMP_ASYNC));
+  for (unsigned i = 0; i < TEST_LAUNCHES; i++)
+    nomp_test_check(nomp_run(id, a, b, &n));
+  nomp_test_check(nomp_sync());
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FROM));
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FREE));
+  nomp_test_check(nomp_update(b, 0, n, sizeof(int), NOMP_FREE));
+
+  for (int i = 0; i < n; i++)
+    nomp_test_assert(a[i] == i + TEST_LAUNCHES);
+
+  return 0;
+}
+
+// Both stages of a reduction are timed.
+static int test_profile_sum(void) {
+  int a[TEST_SIZE], n = TEST_SIZE, s = 0;
+  for (int i = 0; i < n; i++)
+    a[i] = 1;
+
+  int         id         = -1;
+  const char *clauses[4] = {"reduce", "s", "+", 0};
+  nomp_test_check(nomp_jit(&id, sum, clauses, 3, "a", sizeof(int), NOMP_PTR,
+                           "N", sizeof(int), NOMP_INT, "s", sizeof(int),
+                           NOMP_INT));
+
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_TO));
+  for (unsigned i = 0; i < TEST_LAUNCHES; i++) {
+    nomp_test_check(nomp_run(id, a, &n, &s));
+    nomp_test_assert(s == n);
+  }
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FREE));
+
+  return 0;
+}
+
+// Timings are collected at nomp_sync() and when the context is destroyed,
+// after which the profile is printed.
+int main(int argc, const char *argv[]) {
+  setenv("NOMP_PROFILE", "1", 1);
+  nomp_test_check(nomp_init(argc, argv));
+
+  int err = 0;
+  err |= SUBTEST(test_profile_add);
+  err |= SUBTEST(test_profile_sum);
+
+  nomp_test_check(nomp_finalize());
+  unsetenv("NOMP_PROFILE");
+
+  return err;
+}
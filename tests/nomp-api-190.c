@@ -0,0 +1,73 @@
+#include "nomp-test.h"
+
+#define TEST_SIZE     256
+#define TEST_LAUNCHES 4
+
+static const char *add = "void add(int *a, int *b, int N) {              \n"
+                         "  for (int i = 0; i < N; i++)                  \n"
+                         "    a[i] += b[i];                              \n"
+                         "}                                              \n";
+
+// Copies, launches and syncs are recorded next to the JIT stages.
+static int test_trace_add(void) {
+  int a[TEST_SIZE], b[TEST_SIZE], n = TEST_SIZE;
+  for (int i = 0; i < n; i++)
+    a[i] = i, b[i] = 1;
+
+  int         id         = -1;
+  const char *clauses[4] = {"transform", "nomp_api_100", "tile", 0};
+  nomp_test_check(nomp_jit(&id, add, clauses, 3, "a", sizeof(int), NOMP_PTR,
+                           "b", sizeof(int), NOMP_PTR, "N", sizeof(int),
+                           NOMP_INT));
+
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_TO));
+  nomp_test_check(nomp_update(b, 0, n, sizeof(int), NOMP_TO | NOMP_ASYNC));
+  for (unsigned i = 0; i < TEST_LAUNCHES; i++)
+    nomp_test_check(nomp_run(id, a, b, &n));
+  nomp_test_check(nomp_sync());
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FROM));
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FREE));
+  nomp_test_check(nomp_update(b, 0, n, sizeof(int), NOMP_FREE));
+
+  for (int i = 0; i < n; i++)
+    nomp_test_assert(a[i] == i + TEST_LAUNCHES);
+
+  return 0;
+}
+
+// The trace is written when the last context is destroyed.
+static int test_trace_file(const char *file) {
+  FILE *fp = fopen(file, "r");
+  nomp_test_assert(fp != NULL);
+
+  static char trace[1 << 20];
+  size_t      n = fread(trace, 1, sizeof(trace) - 1, fp);
+  fclose(fp);
+  trace[n] = '\0';
+
+  nomp_test_assert(strstr(trace, "\"traceEvents\"") != NULL);
+  nomp_test_assert(strstr(trace, "\"jit::c_to_loopy\"") != NULL);
+  nomp_test_assert(strstr(trace, "\"nomp_update:to\"") != NULL);
+  nomp_test_assert(strstr(trace, "\"nomp_sync\"") != NULL);
+  nomp_test_assert(strstr(trace, "\"direction\":\"from\"") != NULL);
+  nomp_test_assert(strstr(trace, "\"global\":[") != NULL);
+
+  return 0;
+}
+
+int main(int argc, const char *argv[]) {
+  const char *file = "nomp-api-190.json";
+  setenv("NOMP_TRACE", file, 1);
+  nomp_test_check(nomp_init(argc, argv));
+
+  int err = 0;
+  err |= SUBTEST(test_trace_add);
+
+  nomp_test_check(nomp_finalize());
+  unsetenv("NOMP_TRACE");
+
+  err |= SUBTEST(test_trace_file, file);
+  remove(file);
+
+  return err;
+}
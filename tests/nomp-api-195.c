@@ -0,0 +1,96 @@
+#include "nomp-test.h"
+
+#define TEST_SIZE     1000
+#define TEST_LAUNCHES 4
+
+static const char *add = "void add(int *a, int *b, int N) {              \n"
+                         "  for (int i = 0; i < N; i++)                  \n"
+                         "    a[i] += b[i];                              \n"
+                         "}                                              \n";
+
+static const char *sum = "void sum(int *a, int N, int *s) {              \n"
+                         "  for (int i = 0; i < N; i++)                  \n"
+                         "    s[0] += a[i];                              \n"
+                         "}                                              \n";
+
+// The first launch tunes the kernel, which runs the variants with the same
+// arguments, so the device data must be the same as without tuning.
+static int test_autotune_add(void) {
+  int a[TEST_SIZE], b[TEST_SIZE], n = TEST_SIZE;
+  for (int i = 0; i < n; i++)
+    a[i] = i, b[i] = 1;
+
+  int         id         = -1;
+  const char *clauses[4] = {"autotune", "nomp_api_195", "tile", 0};
+  nomp_test_check(nomp_jit(&id, add, clauses, 3, "a", sizeof(int), NOMP_PTR,
+                           "b", sizeof(int), NOMP_PTR, "N", sizeof(int),
+                           NOMP_INT));
+
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_TO));
+  nomp_test_check(nomp_update(b, 0, n, sizeof(int), NOMP_TO));
+  for (unsigned i = 0; i < TEST_LAUNCHES; i++)
+    nomp_test_check(nomp_run(id, a, b, &n));
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FROM));
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FREE));
+  nomp_test_check(nomp_update(b, 0, n, sizeof(int), NOMP_FREE));
+
+  for (int i = 0; i < n; i++)
+    nomp_test_assert(a[i] == i + TEST_LAUNCHES);
+
+  return 0;
+}
+
+static int test_autotune_reduction(void) {
+  int         id         = -1;
+  const char *clauses[7] = {"reduce",       "s",    "+", "autotune",
+                            "nomp_api_195", "tile", 0};
+
+  int err = nomp_jit(&id, sum, clauses, 3, "a", sizeof(int), NOMP_PTR, "N",
+                     sizeof(int), NOMP_INT, "s", sizeof(int), NOMP_INT);
+  nomp_test_assert(nomp_get_err_no(err) == NOMP_USER_INPUT_IS_INVALID);
+
+  char *desc = nomp_get_err_str(err);
+  int   eq   = logcmp(desc, "\\[Error\\] .*src\\/.*.c:[0-9]* Kernels with a "
+                            "reduction can't be tuned with the \"autotune\" "
+                            "clause.");
+  nomp_free(&desc);
+  nomp_test_assert(eq);
+
+  return 0;
+}
+
+// Each line of the tuning database is an entry.
+static int test_autotune_db(const char *file, unsigned entries) {
+  FILE *fp = fopen(file, "r");
+  nomp_test_assert(fp != NULL);
+
+  unsigned lines = 0;
+  int      c;
+  while ((c = fgetc(fp)) != EOF)
+    lines += (c == '\n');
+  fclose(fp);
+  nomp_test_assert(lines == entries);
+
+  return 0;
+}
+
+// The kernel is tuned in the first run and the tuned parameters are read
+// from the tuning database in the second run, so there is a single entry.
+int main(int argc, const char *argv[]) {
+  const char *file = "nomp-api-195.db";
+  remove(file);
+  setenv("NOMP_TUNING_DB", file, 1);
+
+  int err = 0;
+  for (unsigned run = 0; run < 2; run++) {
+    nomp_test_check(nomp_init(argc, argv));
+    err |= SUBTEST(test_autotune_add);
+    err |= SUBTEST(test_autotune_reduction);
+    nomp_test_check(nomp_finalize_excluding_interpreter());
+    err |= SUBTEST(test_autotune_db, file, 1);
+  }
+  unsetenv("NOMP_TUNING_DB");
+  remove(file);
+
+  return err;
+}
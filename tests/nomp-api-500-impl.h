@@ -18,7 +18,9 @@ static int nomp_api_500_sum_aux(const char *fmt, const char **clauses,
 static int nomp_api_500_sum_const(unsigned N) {
   nomp_test_assert(N <= TEST_MAX_SIZE);
 
-  TEST_TYPE   a[TEST_MAX_SIZE] = {0};
+  // Seed the reduction variable with a value other than the identity, so an
+  // empty sum only passes if the reduction starts from zero.
+  TEST_TYPE   a[TEST_MAX_SIZE] = {5};
   const char *knl_fmt =
       "void foo(%s *a, int N) {                                        \n"
       "  for (int i = 0; i < N; i++) {                                 \n"
@@ -26,7 +28,7 @@ static int nomp_api_500_sum_const(unsigned N) {
       "  }                                                             \n"
       "}                                                               \n";
   const char *clauses[4] = {"reduce", "a", "+", NULL};
-  nomp_api_500_sum_aux(knl_fmt, clauses, a, N);
+  nomp_test_check(nomp_api_500_sum_aux(knl_fmt, clauses, a, N));
 
 #if defined(TEST_TOL)
   nomp_test_assert(fabs(a[0] - N) < TEST_TOL);
@@ -111,6 +113,43 @@ static int nomp_api_500_sum_array(unsigned N) {
 }
 #undef nomp_api_500_sum_array
 
+#define nomp_api_500_sum_array_device                                          \
+  TOKEN_PASTE(nomp_api_500_sum_array_device, TEST_SUFFIX)
+static int nomp_api_500_sum_array_device(unsigned N) {
+  nomp_test_assert(N <= TEST_MAX_SIZE && N > 0);
+
+  TEST_TYPE a[TEST_MAX_SIZE];
+  for (unsigned i = 0; i < N; i++)
+    a[i] = i;
+
+  // Result of the reduction should stay on the device when the reduction
+  // variable is mapped (host sees it right away if the memory is shared).
+  TEST_TYPE sum = 1;
+  nomp_test_check(nomp_update(&sum, 0, 1, sizeof(TEST_TYPE), NOMP_TO));
+
+  const char *knl_fmt =
+      "void foo(%s *a, int N, %s *sum) {                               \n"
+      "  for (int i = 0; i < N; i++) {                                 \n"
+      "    sum[0] += a[i];                                             \n"
+      "  }                                                             \n"
+      "}                                                               \n";
+  const char *clauses[4] = {"reduce", "sum", "+", NULL};
+  nomp_api_500_sum_array_aux(knl_fmt, clauses, a, N, &sum);
+  if (!nomp_test_shares_host_memory()) nomp_test_assert(sum == 1);
+
+  nomp_test_check(nomp_update(&sum, 0, 1, sizeof(TEST_TYPE), NOMP_FROM));
+  nomp_test_check(nomp_update(&sum, 0, 1, sizeof(TEST_TYPE), NOMP_FREE));
+
+#if defined(TEST_TOL)
+  nomp_test_assert(fabs(sum - (N - 1) * N / 2) < TEST_TOL);
+#else
+  nomp_test_assert(sum == (TEST_TYPE)((N - 1) * N / 2));
+#endif
+
+  return 0;
+}
+#undef nomp_api_500_sum_array_device
+
 #define nomp_api_500_condition TOKEN_PASTE(nomp_api_500_condition, TEST_SUFFIX)
 static int nomp_api_500_condition(unsigned N) {
   nomp_test_assert(N <= TEST_MAX_SIZE);
@@ -142,8 +181,197 @@ static int nomp_api_500_condition(unsigned N) {
   return 0;
 }
 #undef nomp_api_500_condition
+
+#define nomp_api_500_max TOKEN_PASTE(nomp_api_500_max, TEST_SUFFIX)
+static int nomp_api_500_max(unsigned N) {
+  nomp_test_assert(N <= TEST_MAX_SIZE && N > 0);
+
+  TEST_TYPE a[TEST_MAX_SIZE];
+  for (unsigned i = 0; i < N; i++)
+    a[i] = (7 * i) % N;
+
+  const char *knl_fmt =
+      "void foo(%s *a, int N, %s *m) {                                 \n"
+      "  for (int i = 0; i < N; i++) {                                 \n"
+      "    m[0] = a[i] > m[0] ? a[i] : m[0];                           \n"
+      "  }                                                             \n"
+      "}                                                               \n";
+  const char *clauses[4] = {"reduce", "m", "max", NULL};
+  TEST_TYPE   m;
+  nomp_api_500_sum_array_aux(knl_fmt, clauses, a, N, &m);
+
+#if defined(TEST_TOL)
+  nomp_test_assert(fabs(m - (N - 1)) < TEST_TOL);
+#else
+  nomp_test_assert(m == (TEST_TYPE)(N - 1));
+#endif
+
+  return 0;
+}
+#undef nomp_api_500_max
+
+#define nomp_api_500_min TOKEN_PASTE(nomp_api_500_min, TEST_SUFFIX)
+static int nomp_api_500_min(unsigned N) {
+  nomp_test_assert(N <= TEST_MAX_SIZE && N > 0);
+
+  TEST_TYPE a[TEST_MAX_SIZE];
+  for (unsigned i = 0; i < N; i++)
+    a[i] = (7 * i) % N + 3;
+
+  const char *knl_fmt =
+      "void foo(%s *a, int N, %s *m) {                                 \n"
+      "  for (int i = 0; i < N; i++) {                                 \n"
+      "    m[0] = a[i] < m[0] ? a[i] : m[0];                           \n"
+      "  }                                                             \n"
+      "}                                                               \n";
+  const char *clauses[4] = {"reduce", "m", "min", NULL};
+  TEST_TYPE   m;
+  nomp_api_500_sum_array_aux(knl_fmt, clauses, a, N, &m);
+
+#if defined(TEST_TOL)
+  nomp_test_assert(fabs(m - 3) < TEST_TOL);
+#else
+  nomp_test_assert(m == (TEST_TYPE)3);
+#endif
+
+  return 0;
+}
+#undef nomp_api_500_min
+
+#define nomp_api_500_logical TOKEN_PASTE(nomp_api_500_logical, TEST_SUFFIX)
+static int nomp_api_500_logical(unsigned N) {
+  nomp_test_assert(N <= TEST_MAX_SIZE && N > 1);
+
+  // All the elements except the last one are positive.
+  TEST_TYPE a[TEST_MAX_SIZE];
+  for (unsigned i = 0; i < N; i++)
+    a[i] = N - 1 - i;
+
+  const char *and_fmt =
+      "void foo(%s *a, int N, %s *r) {                                 \n"
+      "  for (int i = 0; i < N; i++) {                                 \n"
+      "    r[0] = r[0] && a[i] > 0;                                    \n"
+      "  }                                                             \n"
+      "}                                                               \n";
+  const char *and_clauses[4] = {"reduce", "r", "&&", NULL};
+  TEST_TYPE   r_and;
+  nomp_api_500_sum_array_aux(and_fmt, and_clauses, a, N, &r_and);
+  nomp_test_assert(r_and == 0);
+
+  const char *or_fmt =
+      "void foo(%s *a, int N, %s *r) {                                 \n"
+      "  for (int i = 0; i < N; i++) {                                 \n"
+      "    r[0] = r[0] || a[i] == 0;                                   \n"
+      "  }                                                             \n"
+      "}                                                               \n";
+  const char *or_clauses[4] = {"reduce", "r", "||", NULL};
+  TEST_TYPE   r_or;
+  nomp_api_500_sum_array_aux(or_fmt, or_clauses, a, N, &r_or);
+  nomp_test_assert(r_or == 1);
+
+  return 0;
+}
+#undef nomp_api_500_logical
+
+#if !defined(TEST_TOL)
+#define nomp_api_500_bitwise TOKEN_PASTE(nomp_api_500_bitwise, TEST_SUFFIX)
+static int nomp_api_500_bitwise(unsigned N) {
+  nomp_test_assert(N <= TEST_MAX_SIZE && N >= 8);
+
+  // Lower 8 bits are set in every element and each element sets one of the
+  // next 8 bits.
+  TEST_TYPE a[TEST_MAX_SIZE];
+  for (unsigned i = 0; i < N; i++)
+    a[i] = 0xFF | (1 << (8 + i % 8));
+
+  const char *and_fmt =
+      "void foo(%s *a, int N, %s *r) {                                 \n"
+      "  for (int i = 0; i < N; i++) {                                 \n"
+      "    r[0] &= a[i];                                               \n"
+      "  }                                                             \n"
+      "}                                                               \n";
+  const char *and_clauses[4] = {"reduce", "r", "&", NULL};
+  TEST_TYPE   r_and;
+  nomp_api_500_sum_array_aux(and_fmt, and_clauses, a, N, &r_and);
+  nomp_test_assert(r_and == 0xFF);
+
+  const char *or_fmt =
+      "void foo(%s *a, int N, %s *r) {                                 \n"
+      "  for (int i = 0; i < N; i++) {                                 \n"
+      "    r[0] |= a[i];                                               \n"
+      "  }                                                             \n"
+      "}                                                               \n";
+  const char *or_clauses[4] = {"reduce", "r", "|", NULL};
+  TEST_TYPE   r_or;
+  nomp_api_500_sum_array_aux(or_fmt, or_clauses, a, N, &r_or);
+  nomp_test_assert(r_or == 0xFFFF);
+
+  return 0;
+}
+#undef nomp_api_500_bitwise
+#endif
+
 #undef nomp_api_500_sum_array_aux
 
+#define nomp_api_500_empty_aux TOKEN_PASTE(nomp_api_500_empty_aux, TEST_SUFFIX)
+static int nomp_api_500_empty_aux(const char *expr, const char *op,
+                                  TEST_TYPE seed, TEST_TYPE identity) {
+  TEST_TYPE a[TEST_MAX_SIZE] = {0};
+  nomp_test_check(nomp_update(a, 0, TEST_MAX_SIZE, sizeof(TEST_TYPE), NOMP_TO));
+
+  const char *knl_fmt =
+      "void foo(%s *a, int N, %s *r) {                                 \n"
+      "  for (int i = 0; i < N; i++) {                                 \n"
+      "    %s;                                                         \n"
+      "  }                                                             \n"
+      "}                                                               \n";
+  const char *clauses[4] = {"reduce", "r", op, NULL};
+
+  int   id  = -1;
+  char *knl =
+      generate_knl(knl_fmt, 3, TOSTRING(TEST_TYPE), TOSTRING(TEST_TYPE), expr);
+  nomp_test_check(nomp_jit(&id, knl, clauses, 3, "a", sizeof(TEST_TYPE),
+                           NOMP_PTR, "N", sizeof(int), NOMP_INT, "r",
+                           sizeof(TEST_TYPE), TEST_NOMP_TYPE));
+  nomp_free(&knl);
+
+  TEST_TYPE r = seed;
+  int       n = 0;
+  nomp_test_check(nomp_run(id, a, &n, &r));
+  nomp_test_check(nomp_sync());
+  nomp_test_check(
+      nomp_update(a, 0, TEST_MAX_SIZE, sizeof(TEST_TYPE), NOMP_FREE));
+
+  nomp_test_assert(r == identity);
+
+  return 0;
+}
+
+#define nomp_api_500_empty TOKEN_PASTE(nomp_api_500_empty, TEST_SUFFIX)
+static int nomp_api_500_empty(TEST_TYPE seed) {
+  // Reduction over an empty range gives the identity of the operation,
+  // whatever the value of the reduction variable was.
+  nomp_test_check(nomp_api_500_empty_aux("r[0] += a[i]", "+", seed, 0));
+  nomp_test_check(nomp_api_500_empty_aux("r[0] *= a[i]", "*", seed, 1));
+  nomp_test_check(nomp_api_500_empty_aux("r[0] = a[i] > r[0] ? a[i] : r[0]",
+                                         "max", seed, TEST_LOWEST));
+  nomp_test_check(nomp_api_500_empty_aux("r[0] = a[i] < r[0] ? a[i] : r[0]",
+                                         "min", seed, TEST_HIGHEST));
+  nomp_test_check(
+      nomp_api_500_empty_aux("r[0] = r[0] && a[i] > 0", "&&", seed, 1));
+  nomp_test_check(
+      nomp_api_500_empty_aux("r[0] = r[0] || a[i] == 0", "||", seed, 0));
+#if !defined(TEST_TOL)
+  nomp_test_check(
+      nomp_api_500_empty_aux("r[0] &= a[i]", "&", seed, (TEST_TYPE)~0));
+  nomp_test_check(nomp_api_500_empty_aux("r[0] |= a[i]", "|", seed, 0));
+#endif
+
+  return 0;
+}
+#undef nomp_api_500_empty
+#undef nomp_api_500_empty_aux
+
 #define nomp_api_500_dot_aux TOKEN_PASTE(nomp_api_500_dot_aux, TEST_SUFFIX)
 static int nomp_api_500_dot_aux(const char *fmt, const char **clauses,
                                 TEST_TYPE *a, TEST_TYPE *b, int n,
@@ -6,12 +6,15 @@
 
 static int test_sum(void) {
   int err = 0;
+  TEST_BUILTIN_TYPES(500_sum_const, 0);
   TEST_BUILTIN_TYPES(500_sum_const, 10);
   TEST_BUILTIN_TYPES(500_sum_const, 50);
   TEST_BUILTIN_TYPES(500_sum_var, 10);
   TEST_BUILTIN_TYPES(500_sum_var, 50);
   TEST_BUILTIN_TYPES(500_sum_array, 10);
   TEST_BUILTIN_TYPES(500_sum_array, 50);
+  TEST_BUILTIN_TYPES(500_sum_array_device, 10);
+  TEST_BUILTIN_TYPES(500_sum_array_device, 50);
   return err;
 }
 
@@ -21,6 +24,38 @@ static int test_sum_condition(void) {
   return err;
 }
 
+static int test_max_min(void) {
+  int err = 0;
+  TEST_BUILTIN_TYPES(500_max, 10);
+  TEST_BUILTIN_TYPES(500_max, 50);
+  TEST_BUILTIN_TYPES(500_min, 10);
+  TEST_BUILTIN_TYPES(500_min, 50);
+  return err;
+}
+
+static int test_logical(void) {
+  int err = 0;
+  TEST_BUILTIN_TYPES(500_logical, 10);
+  TEST_BUILTIN_TYPES(500_logical, 50);
+  return err;
+}
+
+// Bitwise reductions are only defined for integer types.
+static int test_bitwise(void) {
+  int err = 0;
+  err |= nomp_api_500_bitwise_int(50);
+  err |= nomp_api_500_bitwise_long(50);
+  err |= nomp_api_500_bitwise_unsigned(50);
+  err |= nomp_api_500_bitwise_unsigned_long(50);
+  return err;
+}
+
+static int test_empty(void) {
+  int err = 0;
+  TEST_BUILTIN_TYPES(500_empty, 5);
+  return err;
+}
+
 static int test_dot(void) {
   int err = 0;
   TEST_BUILTIN_TYPES(500_dot, 10);
@@ -40,6 +75,10 @@ int main(int argc, const char *argv[]) {
 
   int err = 0;
   err |= SUBTEST(test_sum);
+  err |= SUBTEST(test_max_min);
+  err |= SUBTEST(test_logical);
+  err |= SUBTEST(test_bitwise);
+  err |= SUBTEST(test_empty);
   err |= SUBTEST(test_dot);
   err |= SUBTEST(test_multiple_reductions);
   // FIXME: Fix the errors of the following kernels
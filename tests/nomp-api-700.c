@@ -0,0 +1,96 @@
+#include "nomp-test.h"
+#include <limits.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define TEST_MAX_SIZE 100
+
+static const char *knl =
+    "void foo(int *a, int *b, int N) {                      \n"
+    "  for (int i = 0; i < N; i++)                          \n"
+    "    a[i] = a[i] + 2 * b[i];                            \n"
+    "}                                                      \n";
+
+static int run_kernel(int n, unsigned *hits, unsigned *misses) {
+  int a[TEST_MAX_SIZE], b[TEST_MAX_SIZE];
+  for (int i = 0; i < n; i++)
+    a[i] = n - i, b[i] = i;
+
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_TO));
+  nomp_test_check(nomp_update(b, 0, n, sizeof(int), NOMP_TO));
+
+  int         id         = -1;
+  const char *clauses[4] = {"transform", "nomp_api_100", "tile", 0};
+  nomp_test_check(nomp_jit(&id, knl, clauses, 3, "a", sizeof(int), NOMP_PTR,
+                           "b", sizeof(int), NOMP_PTR, "N", sizeof(int),
+                           NOMP_INT));
+  nomp_test_check(nomp_get_cache_stats(hits, misses));
+
+  nomp_test_check(nomp_run(id, a, b, &n));
+  nomp_test_check(nomp_sync());
+
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FROM));
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FREE));
+  nomp_test_check(nomp_update(b, 0, n, sizeof(int), NOMP_FREE));
+
+  for (int i = 0; i < n; i++)
+    nomp_test_assert(a[i] == n + i);
+
+  return 0;
+}
+
+// First run populates the cache. This is done in a separate process so the
+// python modules imported while generating the kernel are not visible to the
+// second run.
+static int test_first_run(int argc, const char **argv) {
+  pid_t pid = fork();
+  if (pid == 0) {
+    unsigned hits, misses;
+    int      err = nomp_init(argc, argv);
+    if (!err) err = run_kernel(TEST_MAX_SIZE, &hits, &misses);
+    if (!err) err = !(hits == 0 && misses == 1);
+    if (!err) err = nomp_finalize();
+    _exit(err != 0);
+  }
+
+  int status;
+  nomp_test_assert(pid > 0 && waitpid(pid, &status, 0) == pid);
+  nomp_test_assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+  return 0;
+}
+
+// Second run must be served from the cache without calling into loopy. The
+// install directory is pointed to a location without loopy_api so that any
+// attempt to import it makes nomp_jit() fail.
+static int test_second_run(int argc, const char **argv) {
+  char *install_dir = nomp_copy_env("NOMP_INSTALL_DIR", PATH_MAX);
+  setenv("NOMP_INSTALL_DIR", "/nonexistent", 1);
+
+  unsigned hits = 0, misses = 0;
+  nomp_test_check(nomp_init(argc, argv));
+  int err = run_kernel(TEST_MAX_SIZE, &hits, &misses);
+  nomp_test_check(nomp_finalize());
+
+  if (install_dir)
+    setenv("NOMP_INSTALL_DIR", install_dir, 1);
+  else
+    unsetenv("NOMP_INSTALL_DIR");
+  nomp_free(&install_dir);
+
+  nomp_test_assert(!err && hits == 1 && misses == 0);
+
+  return 0;
+}
+
+int main(int argc, const char *argv[]) {
+  char cache_dir[] = "/tmp/nomp-api-700-XXXXXX";
+  nomp_test_assert(mkdtemp(cache_dir));
+  setenv("NOMP_CACHE_DIR", cache_dir, 1);
+
+  int err = 0;
+  err |= SUBTEST(test_first_run, argc, argv);
+  err |= SUBTEST(test_second_run, argc, argv);
+
+  return err;
+}
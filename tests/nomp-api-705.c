@@ -0,0 +1,137 @@
+#include "nomp-test.h"
+#include <dirent.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define TEST_MAX_SIZE 100
+
+static const char *knl =
+    "void foo(int *a, int *b, int N) {                      \n"
+    "  for (int i = 0; i < N; i++)                          \n"
+    "    a[i] = a[i] + 2 * b[i];                            \n"
+    "}                                                      \n";
+
+static char cache_dir[] = "/tmp/nomp-api-705-XXXXXX";
+
+static int run_kernel(int n) {
+  int a[TEST_MAX_SIZE], b[TEST_MAX_SIZE];
+  for (int i = 0; i < n; i++)
+    a[i] = n - i, b[i] = i;
+
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_TO));
+  nomp_test_check(nomp_update(b, 0, n, sizeof(int), NOMP_TO));
+
+  int         id         = -1;
+  const char *clauses[4] = {"transform", "nomp_api_100", "tile", 0};
+  nomp_test_check(nomp_jit(&id, knl, clauses, 3, "a", sizeof(int), NOMP_PTR,
+                           "b", sizeof(int), NOMP_PTR, "N", sizeof(int),
+                           NOMP_INT));
+
+  nomp_test_check(nomp_run(id, a, b, &n));
+  nomp_test_check(nomp_sync());
+
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FROM));
+  nomp_test_check(nomp_update(a, 0, n, sizeof(int), NOMP_FREE));
+  nomp_test_check(nomp_update(b, 0, n, sizeof(int), NOMP_FREE));
+
+  for (int i = 0; i < n; i++)
+    nomp_test_assert(a[i] == n + i);
+
+  return 0;
+}
+
+// Every build is done in a separate process, so the program is built by the
+// backend again instead of being reused from an earlier nomp_init().
+static int run_in_child(int argc, const char **argv) {
+  pid_t pid = fork();
+  if (pid == 0) {
+    int err = nomp_init(argc, argv);
+    if (!err) err = run_kernel(TEST_MAX_SIZE);
+    if (!err) err = nomp_finalize();
+    _exit(err != 0);
+  }
+
+  int status;
+  nomp_test_assert(pid > 0 && waitpid(pid, &status, 0) == pid);
+  nomp_test_assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+  return 0;
+}
+
+// Find the program binary in the cache directory. Returns 1 if there is none,
+// i.e., the backend doesn't cache program binaries.
+static int find_binary(char *path) {
+  DIR *dir = opendir(cache_dir);
+  nomp_test_assert(dir);
+
+  int            missing = 1;
+  struct dirent *entry;
+  while (missing && (entry = readdir(dir))) {
+    const char *ext = strrchr(entry->d_name, '.');
+    if (ext && strcmp(ext, ".clbin") == 0) {
+      snprintf(path, PATH_MAX, "%s/%s", cache_dir, entry->d_name);
+      missing = 0;
+    }
+  }
+  closedir(dir);
+
+  return missing;
+}
+
+// First build compiles the program from source and stores the binary.
+static int test_first_build(int argc, const char **argv) {
+  return run_in_child(argc, argv);
+}
+
+// Second build must load the binary. Binaries are only written after a build
+// from source and cache entries are replaced by renaming a new file, so the
+// entry is left untouched when the binary is loaded.
+static int test_binary_load(int argc, const char **argv) {
+  char path[PATH_MAX];
+  if (find_binary(path)) return 0;
+
+  struct stat before, after;
+  nomp_test_assert(stat(path, &before) == 0);
+  nomp_test_check(run_in_child(argc, argv));
+  nomp_test_assert(stat(path, &after) == 0);
+
+  nomp_test_assert(before.st_ino == after.st_ino);
+
+  return 0;
+}
+
+// A corrupted binary must be rejected and the program built from source,
+// which replaces the corrupted cache entry with a new binary.
+static int test_corrupted_binary(int argc, const char **argv) {
+  char path[PATH_MAX];
+  if (find_binary(path)) return 0;
+
+  const char garbage[] = "not an OpenCL program binary";
+  FILE      *fp        = fopen(path, "wb");
+  nomp_test_assert(fp);
+  nomp_test_assert(fwrite(garbage, 1, sizeof(garbage), fp) == sizeof(garbage));
+  nomp_test_assert(fclose(fp) == 0);
+
+  struct stat before, after;
+  nomp_test_assert(stat(path, &before) == 0);
+  nomp_test_check(run_in_child(argc, argv));
+  nomp_test_assert(stat(path, &after) == 0);
+
+  nomp_test_assert(before.st_ino != after.st_ino);
+
+  return 0;
+}
+
+int main(int argc, const char *argv[]) {
+  nomp_test_assert(mkdtemp(cache_dir));
+  setenv("NOMP_CACHE_DIR", cache_dir, 1);
+
+  int err = 0;
+  err |= SUBTEST(test_first_build, argc, argv);
+  err |= SUBTEST(test_binary_load, argc, argv);
+  err |= SUBTEST(test_corrupted_binary, argc, argv);
+
+  return err;
+}
@@ -1,13 +1,21 @@
 #define TEST_NOMP_TYPE NOMP_INT
 #define TEST_TYPE      int
 #define TEST_SUFFIX    _int
+#define TEST_LOWEST    INT_MIN
+#define TEST_HIGHEST   INT_MAX
 #include TEST_IMPL_H
+#undef TEST_HIGHEST
+#undef TEST_LOWEST
 #undef TEST_SUFFIX
 #undef TEST_TYPE
 
-#define TEST_TYPE   long
-#define TEST_SUFFIX _long
+#define TEST_TYPE    long
+#define TEST_SUFFIX  _long
+#define TEST_LOWEST  LONG_MIN
+#define TEST_HIGHEST LONG_MAX
 #include TEST_IMPL_H
+#undef TEST_HIGHEST
+#undef TEST_LOWEST
 #undef TEST_SUFFIX
 #undef TEST_TYPE
 #undef TEST_NOMP_TYPE
@@ -15,13 +23,21 @@
 #define TEST_NOMP_TYPE NOMP_UINT
 #define TEST_TYPE      unsigned
 #define TEST_SUFFIX    _unsigned
+#define TEST_LOWEST    0
+#define TEST_HIGHEST   UINT_MAX
 #include TEST_IMPL_H
+#undef TEST_HIGHEST
+#undef TEST_LOWEST
 #undef TEST_SUFFIX
 #undef TEST_TYPE
 
-#define TEST_TYPE   unsigned long
-#define TEST_SUFFIX _unsigned_long
+#define TEST_TYPE    unsigned long
+#define TEST_SUFFIX  _unsigned_long
+#define TEST_LOWEST  0
+#define TEST_HIGHEST ULONG_MAX
 #include TEST_IMPL_H
+#undef TEST_HIGHEST
+#undef TEST_LOWEST
 #undef TEST_SUFFIX
 #undef TEST_TYPE
 #undef TEST_NOMP_TYPE
@@ -32,15 +48,23 @@
 #define TEST_TOL       1e-12
 #define TEST_TYPE      double
 #define TEST_SUFFIX    _double
+#define TEST_LOWEST    (-DBL_MAX)
+#define TEST_HIGHEST   DBL_MAX
 #include TEST_IMPL_H
+#undef TEST_HIGHEST
+#undef TEST_LOWEST
 #undef TEST_SUFFIX
 #undef TEST_TYPE
 #undef TEST_TOL
 
-#define TEST_TOL    1e-8
-#define TEST_TYPE   float
-#define TEST_SUFFIX _float
+#define TEST_TOL     1e-8
+#define TEST_TYPE    float
+#define TEST_SUFFIX  _float
+#define TEST_LOWEST  (-FLT_MAX)
+#define TEST_HIGHEST FLT_MAX
 #include TEST_IMPL_H
+#undef TEST_HIGHEST
+#undef TEST_LOWEST
 #undef TEST_SUFFIX
 #undef TEST_TYPE
 #undef TEST_TOL
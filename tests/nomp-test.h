@@ -4,6 +4,8 @@
 #define NOMP_TEST_MAX_BUFFER_SIZE 4096
 
 #include <assert.h>
+#include <float.h>
+#include <limits.h>
 #include <math.h>
 #include <regex.h>
 #include <stdarg.h>
@@ -88,6 +90,17 @@ inline static char *generate_knl(const char *fmt, unsigned nargs, ...) {
   return knl;
 }
 
+// Returns 1 if the device memory of the active backend is the host memory
+// itself (like in the cpu backend), i.e., nomp_update() doesn't copy data.
+inline static int nomp_test_shares_host_memory(void) {
+  int probe = 0;
+  nomp_update(&probe, 0, 1, sizeof(int), NOMP_TO);
+  probe = 1;
+  nomp_update(&probe, 0, 1, sizeof(int), NOMP_FROM);
+  nomp_update(&probe, 0, 1, sizeof(int), NOMP_FREE);
+  return probe == 1;
+}
+
 inline static int logcmp(const char *log, const char *pattern) {
   regex_t regex;
   int     result = regcomp(&regex, pattern, 0);
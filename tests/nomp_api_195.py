@@ -0,0 +1,31 @@
+"""Transform script with a tuned transform for nomp-api-195."""
+
+import loopy as lp
+from autotune import search_space
+
+LOOPY_LANG_VERSION = (2018, 2)
+
+
+def _block_sizes(context):
+    """Block sizes supported by the device."""
+    max_threads = context["device::max_threads_per_block"]
+    return [size for size in (32, 64, 128, 256) if size <= max_threads]
+
+
+@search_space(block_size=_block_sizes, unroll=[1, 2])
+def tile(knl, context, block_size=128, unroll=1):
+    """Tile a kernel with a single iname and unroll a part of each block."""
+    (iname,) = knl.default_entrypoint.all_inames()
+    block_size = min(block_size, context["device::max_threads_per_block"])
+    tile_size = block_size * unroll
+    i_inner, i_outer = f"{iname}_inner", f"{iname}_outer"
+    knl = lp.split_iname(
+        knl, iname, tile_size, inner_iname=i_inner, outer_iname=i_outer
+    )
+    knl = lp.tag_inames(knl, {i_outer: "g.0"})
+    i_unroll, i_local = f"{iname}_unroll", f"{iname}_local"
+    knl = lp.split_iname(
+        knl, i_inner, block_size, inner_iname=i_local, outer_iname=i_unroll
+    )
+    knl = lp.tag_inames(knl, {i_local: "l.0", i_unroll: "unr"})
+    return knl